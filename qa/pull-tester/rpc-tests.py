@@ -117,6 +117,7 @@ BASE_SCRIPTS= [
     'addressindex.py',
     'spentindex.py',
     'timestampindex.py',
+    'indexbuilder.py',
     'decodescript.py',
     'blockchain.py',
     'disablewallet.py',
@@ -9,7 +9,7 @@
 #
 #   getaddresstxids
 #   getaddressbalance
-#   getaddressdeltas
+#   getaddressdeltas (including paging)
 #   getaddressutxos
 #   getaddressmempool
 
@@ -345,6 +345,39 @@ class AddressIndexTest(BitcoinTestFramework):
         block_hash = self.nodes[1].getblockhash(111)
         assert_equal(deltas_info['end']['hash'], block_hash)
 
+        # Paging through the deltas and txids returns the same results
+        # in block order, one or more transactions at a time
+        for limit in (1, 2, 100):
+            paged = []
+            cursor = None
+            while True:
+                params = {'addresses': [addr1], 'limit': limit}
+                if cursor is not None:
+                    params['cursor'] = cursor
+                page = self.nodes[1].getaddressdeltas(params)
+                paged += page['deltas']
+                if 'nextCursor' not in page:
+                    break
+                cursor = page['nextCursor']
+            assert_equal(paged, deltas)
+
+            paged = []
+            cursor = None
+            while True:
+                params = {'addresses': [addr1, addr_p2sh, addr_p2pkh], 'limit': limit}
+                if cursor is not None:
+                    params['cursor'] = cursor
+                page = self.nodes[1].getaddresstxids(params)
+                assert(len(page['txids']) <= limit)
+                paged += page['txids']
+                if 'nextCursor' not in page:
+                    break
+                cursor = page['nextCursor']
+            assert_equal(paged, multitxids)
+
+        page = self.nodes[1].getaddressdeltas({'addresses': [addr1], 'start': 107, 'end': 111, 'limit': 1})
+        assert_equal(page['deltas'], deltas[1:2])
+
         # Test getaddressutxos by comparing results with deltas
         utxos = self.nodes[3].getaddressutxos(addr1)
 
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+# Copyright (c) 2025 The Juno Cash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or https://www.opensource.org/licenses/mit-license.php .
+#
+# Test that the insightexplorer indexes can be enabled on an existing node
+# without -reindex, and that the background index builder follows reorgs.
+
+import time
+
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_start_raises_init_error,
+    connect_nodes,
+    start_node,
+    start_nodes,
+    stop_node,
+    sync_blocks,
+)
+
+
+class IndexBuilderTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+        self.cache_behavior = 'clean'
+
+    def setup_network(self):
+        self.base_args = [
+            '-debug',
+            '-txindex',
+            '-experimentalfeatures',
+            '-allowdeprecated=getnewaddress',
+        ]
+        # node0 has the indexes from the start; node1 gets them later.
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, [
+            self.base_args + ['-insightexplorer'],
+            self.base_args,
+        ])
+        connect_nodes(self.nodes[0], 1)
+        self.is_network_split = False
+        self.sync_all()
+
+    def wait_for_indexes(self, node, timeout=60):
+        deadline = time.time() + timeout
+        while True:
+            try:
+                return node.getblockhashes(0x7fffffff, 0)
+            except JSONRPCException as e:
+                # RPC_IN_WARMUP while the indexes are being built
+                assert_equal(e.error['code'], -28)
+                assert time.time() < deadline, "timed out waiting for the indexes"
+                time.sleep(0.5)
+
+    def check_same_indexes(self, addresses, txids):
+        for node in self.nodes:
+            self.wait_for_indexes(node)
+        for address in addresses:
+            query = {'addresses': [address]}
+            assert_equal(
+                self.nodes[0].getaddressbalance(query),
+                self.nodes[1].getaddressbalance(query))
+            assert_equal(
+                self.nodes[0].getaddresstxids(query),
+                self.nodes[1].getaddresstxids(query))
+            assert_equal(
+                self.nodes[0].getaddressutxos(query),
+                self.nodes[1].getaddressutxos(query))
+            assert_equal(
+                self.nodes[0].getaddressdeltas(query),
+                self.nodes[1].getaddressdeltas(query))
+        for txid in txids:
+            spent = {'txid': txid, 'index': 0}
+            assert_equal(
+                self.nodes[0].getspentinfo(spent),
+                self.nodes[1].getspentinfo(spent))
+        assert_equal(
+            self.nodes[0].getblockhashes(0x7fffffff, 0, {'noOrphans': True, 'logicalTimes': True}),
+            self.nodes[1].getblockhashes(0x7fffffff, 0, {'noOrphans': True, 'logicalTimes': True}))
+
+    def run_test(self):
+        self.nodes[0].generate(105)
+        self.sync_all()
+
+        # Spend some coinbase outputs to transparent addresses.
+        addresses = [self.nodes[1].getnewaddress() for _ in range(3)]
+        sent = [self.nodes[0].sendtoaddress(address, 1 + i) for i, address in enumerate(addresses)]
+        self.nodes[0].generate(1)
+        self.sync_all()
+        # The coinbase transactions whose outputs were spent
+        txids = set()
+        for txid in sent:
+            tx = self.nodes[0].getrawtransaction(txid, 1)
+            txids.update(vin['txid'] for vin in tx['vin'])
+
+        # The indexes are disabled on node1.
+        try:
+            self.nodes[1].getaddressbalance(addresses[0])
+            raise AssertionError("getaddressbalance should be disabled")
+        except JSONRPCException as e:
+            assert "getaddressbalance is disabled" in e.error['message']
+
+        # Enable them without -reindex; they are built in the background.
+        stop_node(self.nodes[1], 1)
+        self.nodes[1] = start_node(1, self.options.tmpdir,
+            self.base_args + ['-insightexplorer', '-indexbatchsize=7', '-indexthrottle=10'])
+        connect_nodes(self.nodes[0], 1)
+        self.check_same_indexes(addresses, txids)
+
+        # New blocks are added by following the tip.
+        self.nodes[0].sendtoaddress(addresses[0], 4)
+        self.nodes[0].generate(2)
+        self.sync_all()
+        self.check_same_indexes(addresses, txids)
+
+        # A reorg rolls back the entries of the disconnected blocks.
+        blockhash = self.nodes[1].getbestblockhash()
+        self.nodes[1].invalidateblock(blockhash)
+        self.nodes[0].invalidateblock(blockhash)
+        self.nodes[0].generate(3)
+        sync_blocks(self.nodes)
+        self.check_same_indexes(addresses, txids)
+
+        # Turning the indexes off again still requires a rebuild.
+        stop_node(self.nodes[1], 1)
+        assert_start_raises_init_error(1, self.options.tmpdir, self.base_args,
+            "You need to rebuild the database using -reindex to turn off -insightexplorer")
+        self.nodes[1] = start_node(1, self.options.tmpdir, self.base_args + ['-insightexplorer'])
+        connect_nodes(self.nodes[0], 1)
+        sync_blocks(self.nodes)
+        self.check_same_indexes(addresses, txids)
+
+
+if __name__ == '__main__':
+    IndexBuilderTest().main()
@@ -14,12 +14,15 @@
 
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.authproxy import JSONRPCException
-from test_framework.util import start_node, \
+from test_framework.util import assert_equal, start_node, \
     connect_nodes, stop_node, sync_blocks
 
 import os.path
 import time
 
+NODE_NETWORK = 1 << 0
+NODE_NETWORK_LIMITED = 1 << 10
+
 def calc_usage(blockdir):
     return sum(os.path.getsize(blockdir+f) for f in os.listdir(blockdir) if os.path.isfile(blockdir+f)) / (1024. * 1024.)
 
@@ -28,7 +31,7 @@ class PruneTest(BitcoinTestFramework):
     def __init__(self):
         super().__init__()
         self.cache_behavior = 'clean'
-        self.num_nodes = 3
+        self.num_nodes = 4
 
         self.utxo = []
         self.address = ["",""]
@@ -85,6 +88,14 @@ class PruneTest(BitcoinTestFramework):
 
         sync_blocks(self.nodes[0:3])
 
+    def test_services(self):
+        # The pruned node only offers to serve recent blocks (BIP 159).
+        services = int(self.nodes[2].getnetworkinfo()["localservices"], 16)
+        assert_equal(services & NODE_NETWORK, 0)
+        assert_equal(services & NODE_NETWORK_LIMITED, NODE_NETWORK_LIMITED)
+        services = int(self.nodes[0].getnetworkinfo()["localservices"], 16)
+        assert_equal(services & NODE_NETWORK, NODE_NETWORK)
+
     def test_height_min(self):
         if not os.path.isfile(self.prunedir+"blk00000.dat"):
             raise AssertionError("blk00000.dat is missing, pruning too early")
@@ -237,6 +248,32 @@ class PruneTest(BitcoinTestFramework):
         # Verify we can now have the data for a block previously pruned
         assert(self.nodes[2].getblock(self.forkhash)["height"] == self.forkheight)
 
+    def test_prunekeepblocks(self):
+        # Keep more blocks than pruning needs, so that the undo data of the
+        # old ones is deleted while the blocks themselves stay.
+        self.nodes.append(start_node(3, self.options.tmpdir, ["-debug","-maxreceivebuffer=20000","-prune=550","-prunekeepblocks=1200"], timewait=900))
+        keepdir = self.options.tmpdir+"/node3/regtest/blocks/"
+        connect_nodes(self.nodes[3], 0)
+        sync_blocks([self.nodes[0], self.nodes[3]])
+
+        waitstart = time.time()
+        while os.path.isfile(keepdir+"rev00000.dat"):
+            time.sleep(0.1)
+            if time.time() - waitstart > 10:
+                raise AssertionError("rev00000.dat not pruned when it should be")
+        if not os.path.isfile(keepdir+"blk00000.dat"):
+            raise AssertionError("blk00000.dat pruned within -prunekeepblocks")
+        print("Success")
+
+        # The old blocks are still served.
+        self.nodes[3].getblock(self.nodes[3].getblockhash(1))
+
+        # Checking blocks whose undo data was deleted stops at level 3.
+        stop_node(self.nodes[3], 3)
+        self.nodes[3] = start_node(3, self.options.tmpdir, ["-debug","-prune=550","-prunekeepblocks=1200","-checklevel=3","-checkblocks=1000"], timewait=900)
+        self.nodes[3].getblock(self.nodes[3].getblockhash(1))
+        print("Success")
+
     def mine_full_block(self, node, address):
         # Want to create a full block
         # We'll generate a 66k transaction below, and 14 of them is close to the 1MB block limit
@@ -265,6 +302,9 @@ class PruneTest(BitcoinTestFramework):
 
     def run_test(self):
         print("Warning! This test requires 4GB of disk space and takes over 30 mins (up to 2 hours)")
+        print("Check that the pruned node advertises NODE_NETWORK_LIMITED")
+        self.test_services()
+
         print("Mining a big blockchain of 995 blocks")
         self.create_big_chain()
         # Chain diagram key:
@@ -358,6 +398,9 @@ class PruneTest(BitcoinTestFramework):
         #
         # N1 doesn't change because 1033 on main chain (*) is invalid
 
+        print("Test that -prunekeepblocks deletes undo data before blocks")
+        self.test_prunekeepblocks()
+
         print("Done")
 
 if __name__ == '__main__':
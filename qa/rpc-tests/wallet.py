@@ -55,6 +55,11 @@ class WalletTest (BitcoinTestFramework):
         assert_equal(Decimal(self.nodes[1].getbalance("*")), Decimal('10'))
         assert_equal(Decimal(self.nodes[2].getbalance("*")), Decimal('0'))
 
+        # The wallet summary used by getwalletinfo agrees with getbalance.
+        walletinfo = self.nodes[0].getwalletinfo()
+        assert_equal(Decimal(walletinfo['balance']), Decimal('40'))
+        assert_equal(Decimal(walletinfo['immature_balance']), Decimal('0'))
+
         # Send 21 ZEC from 0 to 2 using sendtoaddress call.
         # Second transaction will be child of first, and will require a fee
         self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), Decimal('11'))
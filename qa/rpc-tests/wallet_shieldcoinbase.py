@@ -7,7 +7,8 @@ from test_framework.test_framework import BitcoinTestFramework
 from test_framework.authproxy import JSONRPCException
 from test_framework.util import assert_equal, initialize_chain_clean, \
     start_node, connect_nodes_bi, sync_blocks, sync_mempools, \
-    wait_and_assert_operationid_status, get_coinbase_address, \
+    wait_and_assert_operationid_status, wait_and_assert_operationid_status_result, \
+    get_coinbase_address, \
     NU5_BRANCH_ID, nuparams
 from test_framework.zip317 import conventional_fee, ZIP_317_FEE
 
@@ -118,7 +119,7 @@ class WalletShieldCoinbaseTest (BitcoinTestFramework):
 
         # Shield coinbase utxos from any node 2 taddr
         fee2 = conventional_fee(5)
-        result = self.nodes[2].z_shieldcoinbase("*", myzaddr, fee2, None, None, 'AllowLinkingAccountAddresses')
+        result = self.nodes[2].z_shieldcoinbase("*", myzaddr, fee2)
         wait_and_assert_operationid_status(self.nodes[2], result['opid'])
         self.sync_all()
         self.nodes[1].generate(1)
@@ -188,5 +189,24 @@ class WalletShieldCoinbaseTest (BitcoinTestFramework):
         self.nodes[1].generate(1)
         self.sync_all()
 
+        # Shielding will fail because maxtransactions parameter must be at least 1
+        try:
+            self.nodes[0].z_shieldcoinbase(mytaddr, myzaddr, ZIP_317_FEE, 5, None, 0)
+        except JSONRPCException as e:
+            errorString = e.error['message']
+        assert_equal("Maximum number of transactions must be at least 1" in errorString, True)
+
+        # Bulk shielding plans several transactions and reports every txid
+        result = self.nodes[0].z_shieldcoinbase(mytaddr, myzaddr, ZIP_317_FEE, 5, None, 3)
+        assert_equal(result["shieldingTransactions"], 3)
+        assert_equal(Decimal(result["shieldingUTXOs"]), Decimal('15'))
+        assert_equal(Decimal(result["remainingUTXOs"]), Decimal('2'))
+        opresult = wait_and_assert_operationid_status_result(self.nodes[0], result['opid'])
+        assert_equal(len(opresult['result']['txids']), 3)
+        sync_blocks(self.nodes[:2])
+        sync_mempools(self.nodes[:2])
+        self.nodes[1].generate(1)
+        self.sync_all()
+
 # Note, no "if __name__ == '__main__" and call the test here; it's called from
 # pool-specific derived classes in wallet_shieldcoinbase_*.py
@@ -8,6 +8,10 @@
 #include "serialize.h"
 #include "streams.h"
 
+#include <limits>
+
+CNetAddrHasher::CNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
 int CAddrInfo::GetTriedBucket(const uint256& nKey) const
 {
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetKey()).GetHash().GetCheapHash();
@@ -71,29 +75,69 @@ double CAddrInfo::GetChance(int64_t nNow) const
     return fChance;
 }
 
+CAddrMan::Snapshot CAddrMan::GetSnapshot() const
+{
+    LOCK(cs);
+    Snapshot snapshot;
+    snapshot.nKey = nKey;
+    snapshot.nIdCount = nIdCount;
+    snapshot.nNew = nNew;
+    snapshot.nTried = nTried;
+    snapshot.vEntryChunks.assign(vEntryChunks.begin(), vEntryChunks.end());
+    snapshot.vNew.assign(&vvNew[0][0], &vvNew[0][0] + ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE);
+    return snapshot;
+}
+
+bool CAddrMan::Exists(int nId) const
+{
+    return nId >= 0 && nId < nIdCount && Info(nId).nRandomPos != -1;
+}
+
+CAddrInfo& CAddrMan::MutableInfo(int nId)
+{
+    std::shared_ptr<EntryChunk>& chunk = vEntryChunks[nId >> ADDRMAN_CHUNK_SIZE_LOG2];
+    // Snapshots are only taken under cs, so a chunk that is not shared now
+    // cannot become shared while we modify it.
+    if (chunk.use_count() > 1)
+        chunk = std::make_shared<EntryChunk>(*chunk);
+    return (*chunk)[nId & (ADDRMAN_CHUNK_SIZE - 1)];
+}
+
+int CAddrMan::Insert(const CAddrInfo& infoIn)
+{
+    int nId;
+    if (!vFreeIds.empty()) {
+        nId = vFreeIds.back();
+        vFreeIds.pop_back();
+    } else {
+        nId = nIdCount++;
+        if ((size_t)(nId >> ADDRMAN_CHUNK_SIZE_LOG2) == vEntryChunks.size())
+            vEntryChunks.push_back(std::make_shared<EntryChunk>());
+    }
+    CAddrInfo& info = MutableInfo(nId);
+    info = infoIn;
+    mapAddr[info] = nId;
+    info.nRandomPos = vRandom.size();
+    vRandom.push_back(nId);
+    return nId;
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
+    boost::unordered_map<CNetAddr, int, CNetAddrHasher>::iterator it = mapAddr.find(addr);
     if (it == mapAddr.end())
         return NULL;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end())
-        return &(*it2).second;
-    return NULL;
+    return &MutableInfo((*it).second);
 }
 
 CAddrInfo* CAddrMan::Create(const CAddress& addr, const CNetAddr& addrSource, int* pnId)
 {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
-    mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
-    vRandom.push_back(nId);
+    int nId = Insert(CAddrInfo(addr, addrSource));
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &MutableInfo(nId);
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -106,11 +150,11 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     int nId1 = vRandom[nRndPos1];
     int nId2 = vRandom[nRndPos2];
 
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
+    assert(Exists(nId1));
+    assert(Exists(nId2));
 
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
+    MutableInfo(nId1).nRandomPos = nRndPos2;
+    MutableInfo(nId2).nRandomPos = nRndPos1;
 
     vRandom[nRndPos1] = nId2;
     vRandom[nRndPos2] = nId1;
@@ -118,15 +162,16 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
 
 void CAddrMan::Delete(int nId)
 {
-    assert(mapInfo.count(nId) != 0);
-    CAddrInfo& info = mapInfo[nId];
+    assert(Exists(nId));
+    CAddrInfo& info = MutableInfo(nId);
     assert(!info.fInTried);
     assert(info.nRefCount == 0);
 
     SwapRandom(info.nRandomPos, vRandom.size() - 1);
     vRandom.pop_back();
     mapAddr.erase(info);
-    mapInfo.erase(nId);
+    info = CAddrInfo();
+    vFreeIds.push_back(nId);
     nNew--;
 }
 
@@ -135,7 +180,7 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
     // if there is an entry in the specified bucket, delete it.
     if (vvNew[nUBucket][nUBucketPos] != -1) {
         int nIdDelete = vvNew[nUBucket][nUBucketPos];
-        CAddrInfo& infoDelete = mapInfo[nIdDelete];
+        CAddrInfo& infoDelete = MutableInfo(nIdDelete);
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
         vvNew[nUBucket][nUBucketPos] = -1;
@@ -167,8 +212,8 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
     if (vvTried[nKBucket][nKBucketPos] != -1) {
         // find an item to evict
         int nIdEvict = vvTried[nKBucket][nKBucketPos];
-        assert(mapInfo.count(nIdEvict) == 1);
-        CAddrInfo& infoOld = mapInfo[nIdEvict];
+        assert(Exists(nIdEvict));
+        CAddrInfo& infoOld = MutableInfo(nIdEvict);
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
@@ -291,7 +336,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
     if (vvNew[nUBucket][nUBucketPos] != nId) {
         bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
         if (!fInsert) {
-            CAddrInfo& infoExisting = mapInfo[vvNew[nUBucket][nUBucketPos]];
+            const CAddrInfo& infoExisting = Info(vvNew[nUBucket][nUBucketPos]);
             if (infoExisting.IsTerrible() || (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
                 // Overwrite the existing new table entry.
                 fInsert = true;
@@ -360,8 +405,8 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
                     MilliSleep(kRetrySleepInterval);
             }
             int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            assert(Exists(nId));
+            const CAddrInfo& info = Info(nId);
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -382,8 +427,8 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
                     MilliSleep(kRetrySleepInterval);
             }
             int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            assert(Exists(nId));
+            const CAddrInfo& info = Info(nId);
             if (RandomInt(1 << 30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -402,9 +447,10 @@ int CAddrMan::Check_()
     if (vRandom.size() != nTried + nNew)
         return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-        int n = (*it).first;
-        CAddrInfo& info = (*it).second;
+    for (int n = 0; n < nIdCount; n++) {
+        if (!Exists(n))
+            continue;
+        const CAddrInfo& info = Info(n);
         if (info.fInTried) {
             if (!info.nLastSuccess)
                 return -1;
@@ -438,9 +484,9 @@ int CAddrMan::Check_()
              if (vvTried[n][i] != -1) {
                  if (!setTried.count(vvTried[n][i]))
                      return -11;
-                 if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey) != n)
+                 if (Info(vvTried[n][i]).GetTriedBucket(nKey) != n)
                      return -17;
-                 if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) != i)
+                 if (Info(vvTried[n][i]).GetBucketPosition(nKey, false, n) != i)
                      return -18;
                  setTried.erase(vvTried[n][i]);
              }
@@ -452,7 +498,7 @@ int CAddrMan::Check_()
             if (vvNew[n][i] != -1) {
                 if (!mapNew.count(vvNew[n][i]))
                     return -12;
-                if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) != i)
+                if (Info(vvNew[n][i]).GetBucketPosition(nKey, true, n) != i)
                     return -19;
                 if (--mapNew[vvNew[n][i]] == 0)
                     mapNew.erase(vvNew[n][i]);
@@ -484,9 +530,9 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
 
         int nRndPos = RandomInt(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        assert(Exists(vRandom[n]));
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = Info(vRandom[n]);
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -12,11 +12,15 @@
 #include "timedata.h"
 #include "util/system.h"
 
+#include <array>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <vector>
 
+#include <boost/unordered_map.hpp>
+
 /**
  * Extended statistics about a CAddress
  */
@@ -166,10 +170,29 @@ public:
 //! the maximum number of nodes to return in a getaddr call
 #define ADDRMAN_GETADDR_MAX 2500
 
+//! how many entries are stored together, and copied together when a snapshot shares them
+#define ADDRMAN_CHUNK_SIZE_LOG2 8
+
 //! Convenience
 #define ADDRMAN_TRIED_BUCKET_COUNT (1 << ADDRMAN_TRIED_BUCKET_COUNT_LOG2)
 #define ADDRMAN_NEW_BUCKET_COUNT (1 << ADDRMAN_NEW_BUCKET_COUNT_LOG2)
 #define ADDRMAN_BUCKET_SIZE (1 << ADDRMAN_BUCKET_SIZE_LOG2)
+#define ADDRMAN_CHUNK_SIZE (1 << ADDRMAN_CHUNK_SIZE_LOG2)
+
+/** Salted hash of a network address, so that peers cannot choose addresses that collide. */
+class CNetAddrHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    CNetAddrHasher();
+
+    size_t operator()(const CNetAddr& addr) const
+    {
+        return addr.GetSipHash(k0, k1);
+    }
+};
 
 /** 
  * Stochastical (IP) address manager 
@@ -180,14 +203,20 @@ private:
     //! critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
-    //! last used nId
+    //! number of nIds allocated, whether in use or free
     int nIdCount;
 
-    //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    typedef std::array<CAddrInfo, ADDRMAN_CHUNK_SIZE> EntryChunk;
+
+    //! table with information about all nIds, in chunks of ADDRMAN_CHUNK_SIZE consecutive nIds.
+    //! A chunk may be shared with a snapshot, and is then copied before it is modified.
+    std::vector<std::shared_ptr<EntryChunk>> vEntryChunks;
+
+    //! nIds of deleted entries, which are reused before new nIds are allocated
+    std::vector<int> vFreeIds;
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    boost::unordered_map<CNetAddr, int, CNetAddrHasher> mapAddr;
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -211,6 +240,94 @@ protected:
     //! Source of random numbers for randomization in inner loops
     FastRandomContext insecure_rand;
 
+    /**
+     * The serialized state of the tables at one point in time. Taking it
+     * only copies the bucket table and shares the entry chunks, so that it
+     * can be encoded without holding the lock.
+     */
+    struct Snapshot
+    {
+        uint256 nKey;
+        int nIdCount;
+        int nNew;
+        int nTried;
+        std::vector<std::shared_ptr<const EntryChunk>> vEntryChunks;
+        //! vvNew, one bucket after another
+        std::vector<int> vNew;
+
+        const CAddrInfo& Info(int nId) const
+        {
+            return (*vEntryChunks[nId >> ADDRMAN_CHUNK_SIZE_LOG2])[nId & (ADDRMAN_CHUNK_SIZE - 1)];
+        }
+    };
+
+    Snapshot GetSnapshot() const;
+
+    //! Encode a snapshot in the serialized format described below.
+    template<typename Stream>
+    void SerializeSnapshot(Stream &s, const Snapshot& snapshot) const
+    {
+        unsigned char nVersion = 1;
+        s << nVersion;
+        s << ((unsigned char)32);
+        s << snapshot.nKey;
+        s << snapshot.nNew;
+        s << snapshot.nTried;
+
+        int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
+        s << nUBuckets;
+        std::vector<int> vUnkIds(snapshot.nIdCount, -1);
+        int nIds = 0;
+        for (int nId = 0; nId < snapshot.nIdCount; nId++) {
+            const CAddrInfo &info = snapshot.Info(nId);
+            if (info.nRefCount) {
+                assert(nIds != snapshot.nNew); // this means nNew was wrong, oh ow
+                vUnkIds[nId] = nIds;
+                s << info;
+                nIds++;
+            }
+        }
+        nIds = 0;
+        for (int nId = 0; nId < snapshot.nIdCount; nId++) {
+            const CAddrInfo &info = snapshot.Info(nId);
+            if (info.fInTried) {
+                assert(nIds != snapshot.nTried); // this means nTried was wrong, oh ow
+                s << info;
+                nIds++;
+            }
+        }
+        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
+            const int* pBucket = &snapshot.vNew[bucket * ADDRMAN_BUCKET_SIZE];
+            int nSize = 0;
+            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+                if (pBucket[i] != -1)
+                    nSize++;
+            }
+            s << nSize;
+            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+                if (pBucket[i] != -1) {
+                    int nIndex = vUnkIds[pBucket[i]];
+                    s << nIndex;
+                }
+            }
+        }
+    }
+
+    //! Whether an entry with the given nId exists.
+    bool Exists(int nId) const;
+
+    //! The entry with the given nId, which must exist.
+    const CAddrInfo& Info(int nId) const
+    {
+        return (*vEntryChunks[nId >> ADDRMAN_CHUNK_SIZE_LOG2])[nId & (ADDRMAN_CHUNK_SIZE - 1)];
+    }
+
+    //! The entry with the given nId, copying its chunk first if a snapshot shares it.
+    CAddrInfo& MutableInfo(int nId);
+
+    //! Store an entry under a free nId, and index it in vRandom and mapAddr.
+    int Insert(const CAddrInfo& info);
+
     //! Find an entry.
     CAddrInfo* Find(const CNetAddr& addr, int *pnId = NULL);
 
@@ -289,51 +406,8 @@ public:
     template<typename Stream>
     void Serialize(Stream &s) const
     {
-        LOCK(cs);
-
-        unsigned char nVersion = 1;
-        s << nVersion;
-        s << ((unsigned char)32);
-        s << nKey;
-        s << nNew;
-        s << nTried;
-
-        int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
-        s << nUBuckets;
-        std::map<int, int> mapUnkIds;
-        int nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            mapUnkIds[(*it).first] = nIds;
-            const CAddrInfo &info = (*it).second;
-            if (info.nRefCount) {
-                assert(nIds != nNew); // this means nNew was wrong, oh ow
-                s << info;
-                nIds++;
-            }
-        }
-        nIds = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            const CAddrInfo &info = (*it).second;
-            if (info.fInTried) {
-                assert(nIds != nTried); // this means nTried was wrong, oh ow
-                s << info;
-                nIds++;
-            }
-        }
-        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
-            int nSize = 0;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-                if (vvNew[bucket][i] != -1)
-                    nSize++;
-            }
-            s << nSize;
-            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
-                if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
-                    s << nIndex;
-                }
-            }
-        }
+        // The lock is only held while the snapshot is taken.
+        SerializeSnapshot(s, GetSnapshot());
     }
 
     template<typename Stream>
@@ -367,11 +441,11 @@ public:
 
         // Deserialize entries from the new table.
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
-            s >> info;
-            mapAddr[info] = n;
-            info.nRandomPos = vRandom.size();
-            vRandom.push_back(n);
+            CAddrInfo infoIn;
+            s >> infoIn;
+            int nId = Insert(infoIn);
+            assert(nId == n);
+            CAddrInfo &info = MutableInfo(nId);
             if (nVersion != 1 || nUBuckets != ADDRMAN_NEW_BUCKET_COUNT) {
                 // In case the new table data cannot be used (nVersion unknown, or bucket count wrong),
                 // immediately try to give them a reference based on their primary source address.
@@ -383,7 +457,6 @@ public:
                 }
             }
         }
-        nIdCount = nNew;
 
         // Deserialize entries from the tried table.
         int nLost = 0;
@@ -393,13 +466,8 @@ public:
             int nKBucket = info.GetTriedBucket(nKey);
             int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
             if (vvTried[nKBucket][nKBucketPos] == -1) {
-                info.nRandomPos = vRandom.size();
                 info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
+                vvTried[nKBucket][nKBucketPos] = Insert(info);
             } else {
                 nLost++;
             }
@@ -414,7 +482,7 @@ public:
                 int nIndex = 0;
                 s >> nIndex;
                 if (nIndex >= 0 && nIndex < nNew) {
-                    CAddrInfo &info = mapInfo[nIndex];
+                    CAddrInfo &info = MutableInfo(nIndex);
                     int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                     if (nVersion == 1 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
                         info.nRefCount++;
@@ -426,13 +494,10 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
-                Delete(itCopy->first);
+        for (int nId = 0; nId < nIdCount; nId++) {
+            if (Exists(nId) && Info(nId).fInTried == false && Info(nId).nRefCount == 0) {
+                Delete(nId);
                 nLostUnk++;
-            } else {
-                it++;
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -446,6 +511,9 @@ public:
     {
         LOCK(cs);
         std::vector<int>().swap(vRandom);
+        std::vector<std::shared_ptr<EntryChunk>>().swap(vEntryChunks);
+        std::vector<int>().swap(vFreeIds);
+        mapAddr.clear();
         nKey = GetRandHash();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
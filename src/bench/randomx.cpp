@@ -0,0 +1,72 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "bench.h"
+#include "crypto/randomx/aes_hash.hpp"
+#include "crypto/randomx/dataset.hpp"
+#include "crypto/randomx/randomx.h"
+
+#include <vector>
+
+/* Number of dataset items initialized per iteration (64 KiB of dataset) */
+static const uint32_t DATASET_ITEMS = 1024;
+
+static randomx_cache* GetCache(randomx_flags flags)
+{
+    randomx_cache* cache = randomx_alloc_cache(flags);
+    const char key[] = "RandomX dataset benchmark";
+    randomx_init_cache(cache, key, sizeof(key));
+    return cache;
+}
+
+static void RandomXDatasetInitScalar(benchmark::State& state)
+{
+    randomx_cache* cache = GetCache(RANDOMX_FLAG_DEFAULT);
+    std::vector<uint8_t> out(DATASET_ITEMS * randomx::CacheLineSize);
+    while (state.KeepRunning())
+        randomx::initDataset(cache, out.data(), 0, DATASET_ITEMS);
+    randomx_release_cache(cache);
+}
+
+static void RandomXDatasetInitSimd(benchmark::State& state)
+{
+    randomx_cache* cache = GetCache(RANDOMX_FLAG_DEFAULT);
+    std::vector<uint8_t> out(DATASET_ITEMS * randomx::CacheLineSize);
+    while (state.KeepRunning())
+        randomx::initDatasetSimd(cache, out.data(), 0, DATASET_ITEMS);
+    randomx_release_cache(cache);
+}
+
+static void RandomXDatasetInitJIT(benchmark::State& state)
+{
+    randomx_cache* cache = GetCache(RANDOMX_FLAG_JIT);
+    std::vector<uint8_t> out(DATASET_ITEMS * randomx::CacheLineSize);
+    while (state.KeepRunning())
+        cache->datasetInit(cache, out.data(), 0, DATASET_ITEMS);
+    randomx_release_cache(cache);
+}
+
+/* The AES generators dispatch to VAES at runtime where the CPU has it. */
+static void RandomXFillAes4Rx4(benchmark::State& state)
+{
+    alignas(16) uint8_t seed[64] = {};
+    alignas(16) uint8_t program[2176];
+    while (state.KeepRunning())
+        fillAes4Rx4<false>(seed, sizeof(program), program);
+}
+
+static void RandomXHashAndFillAes1Rx4(benchmark::State& state)
+{
+    std::vector<uint8_t> scratchpad(RANDOMX_SCRATCHPAD_L3);
+    alignas(16) uint8_t fillState[64] = {};
+    alignas(16) uint8_t hash[64];
+    while (state.KeepRunning())
+        hashAndFillAes1Rx4<false>(scratchpad.data(), scratchpad.size(), hash, fillState);
+}
+
+BENCHMARK(RandomXDatasetInitScalar);
+BENCHMARK(RandomXDatasetInitSimd);
+BENCHMARK(RandomXDatasetInitJIT);
+BENCHMARK(RandomXFillAes4Rx4);
+BENCHMARK(RandomXHashAndFillAes1Rx4);
@@ -10,6 +10,8 @@
 #include "version.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <iterator>
 
 #include <rust/history.h>
 
@@ -1042,6 +1044,96 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
     return true;
 }
 
+void CCoinsPrefetch::AddTransaction(const CTransaction& tx) {
+    if (!tx.IsCoinBase()) {
+        for (const CTxIn& txin : tx.vin) {
+            vTxids.push_back(txin.prevout.hash);
+        }
+    }
+    for (const auto& spendDescription : tx.GetSaplingSpends()) {
+        vSaplingNullifiers.push_back(uint256::FromRawBytes(spendDescription.nullifier()));
+    }
+    for (const uint256& nf : tx.GetOrchardBundle().GetNullifiers()) {
+        vOrchardNullifiers.push_back(nf);
+    }
+}
+
+void CCoinsPrefetch::RemoveTxids(std::vector<uint256> vRemove) {
+    // Transactions often spend several outputs of the same transaction.
+    std::sort(vTxids.begin(), vTxids.end());
+    vTxids.erase(std::unique(vTxids.begin(), vTxids.end()), vTxids.end());
+    std::sort(vRemove.begin(), vRemove.end());
+    std::vector<uint256> vKept;
+    std::set_difference(vTxids.begin(), vTxids.end(), vRemove.begin(), vRemove.end(), std::back_inserter(vKept));
+    vTxids.swap(vKept);
+}
+
+size_t CCoinsPrefetch::Prepare() {
+    std::sort(vTxids.begin(), vTxids.end());
+    vTxids.erase(std::unique(vTxids.begin(), vTxids.end()), vTxids.end());
+
+    vCoins.assign(vTxids.size(), CCoins());
+    vHaveCoins.assign(vTxids.size(), 0);
+    vSaplingSpent.assign(vSaplingNullifiers.size(), 0);
+    vHaveSaplingSpent.assign(vSaplingNullifiers.size(), 0);
+    vOrchardSpent.assign(vOrchardNullifiers.size(), 0);
+    vHaveOrchardSpent.assign(vOrchardNullifiers.size(), 0);
+    return vTxids.size() + vSaplingNullifiers.size() + vOrchardNullifiers.size();
+}
+
+void CCoinsPrefetch::ReadRange(const CCoinsView* view, size_t nBegin, size_t nEnd) {
+    // Lookup i is a txid, then a Sapling nullifier, then an Orchard nullifier.
+    // A lookup that fails is left out, and made again by the cache if needed.
+    try {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            if (i < vTxids.size()) {
+                vHaveCoins[i] = view->GetCoins(vTxids[i], vCoins[i]);
+            } else if (i < vTxids.size() + vSaplingNullifiers.size()) {
+                size_t j = i - vTxids.size();
+                vSaplingSpent[j] = view->GetNullifier(vSaplingNullifiers[j], SAPLING);
+                vHaveSaplingSpent[j] = true;
+            } else {
+                size_t j = i - vTxids.size() - vSaplingNullifiers.size();
+                vOrchardSpent[j] = view->GetNullifier(vOrchardNullifiers[j], ORCHARD);
+                vHaveOrchardSpent[j] = true;
+            }
+        }
+    } catch (const std::exception&) {
+        // The cache will make the rest of this range's lookups itself,
+        // and report any error then.
+    }
+}
+
+void CCoinsViewCache::AddPrefetched(CCoinsPrefetch& prefetch) {
+    assert(!hasModifier);
+    for (size_t i = 0; i < prefetch.vTxids.size(); i++) {
+        if (!prefetch.vHaveCoins[i] || cacheCoins.count(prefetch.vTxids[i]))
+            continue;
+        // As in FetchCoins
+        CCoinsMap::iterator it = cacheCoins.insert(std::make_pair(prefetch.vTxids[i], CCoinsCacheEntry())).first;
+        prefetch.vCoins[i].swap(it->second.coins);
+        if (it->second.coins.IsPruned()) {
+            it->second.flags = CCoinsCacheEntry::FRESH;
+        }
+        cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+    }
+    // insert leaves the entries that the cache already has untouched.
+    for (size_t i = 0; i < prefetch.vSaplingNullifiers.size(); i++) {
+        if (!prefetch.vHaveSaplingSpent[i])
+            continue;
+        CNullifiersCacheEntry entry;
+        entry.entered = prefetch.vSaplingSpent[i];
+        cacheSaplingNullifiers.insert(std::make_pair(prefetch.vSaplingNullifiers[i], entry));
+    }
+    for (size_t i = 0; i < prefetch.vOrchardNullifiers.size(); i++) {
+        if (!prefetch.vHaveOrchardSpent[i])
+            continue;
+        CNullifiersCacheEntry entry;
+        entry.entered = prefetch.vOrchardSpent[i];
+        cacheOrchardNullifiers.insert(std::make_pair(prefetch.vOrchardNullifiers[i], entry));
+    }
+}
+
 bool CCoinsViewCache::Flush() {
     // This ensures that before we pass the subtree caches
     // they have been initialized correctly
@@ -614,6 +614,52 @@ enum class UnsatisfiedShieldedReq {
     OrchardUnknownAnchor,
 };
 
+/**
+ * The coins and nullifiers that a block will look up, read from a view on
+ * several threads ahead of time so that they can be added to a cache in one
+ * go (see CCoinsViewCache::AddPrefetched).
+ */
+class CCoinsPrefetch
+{
+private:
+    std::vector<uint256> vTxids;
+    std::vector<uint256> vSaplingNullifiers;
+    std::vector<uint256> vOrchardNullifiers;
+
+    // Results of Read, by position in the vectors above. A lookup that
+    // could not be made is left out of the vHave vectors.
+    std::vector<CCoins> vCoins;
+    std::vector<char> vHaveCoins;
+    std::vector<char> vSaplingSpent;
+    std::vector<char> vHaveSaplingSpent;
+    std::vector<char> vOrchardSpent;
+    std::vector<char> vHaveOrchardSpent;
+
+    friend class CCoinsViewCache;
+
+public:
+    /** Add the inputs and shielded nullifiers of a transaction to the lookups. */
+    void AddTransaction(const CTransaction& tx);
+    /** Skip the coins of these transactions, for example ones that the same block creates. */
+    void RemoveTxids(std::vector<uint256> vRemove);
+
+    bool empty() const {
+        return vTxids.empty() && vSaplingNullifiers.empty() && vOrchardNullifiers.empty();
+    }
+
+    /** Size the results for the lookups, and return how many lookups there are. */
+    size_t Prepare();
+    /**
+     * Make lookups [nBegin, nEnd) against the given view. Disjoint ranges
+     * may be read on different threads once Prepare has been called.
+     */
+    void ReadRange(const CCoinsView* view, size_t nBegin, size_t nEnd);
+    /** Make all the lookups against the given view on this thread. */
+    void Read(const CCoinsView* view) {
+        ReadRange(view, 0, Prepare());
+    }
+};
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -733,6 +779,13 @@ public:
      */
     CCoinsModifier ModifyNewCoins(const uint256 &txid);
 
+    /**
+     * Add the results of a prefetch to the cache, except for entries that
+     * the cache already has. The prefetch must have been read from this
+     * cache's base, and the base must not have changed since.
+     */
+    void AddPrefetched(CCoinsPrefetch& prefetch);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
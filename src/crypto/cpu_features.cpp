@@ -12,6 +12,7 @@ bool CPUFeatures::m_detected = false;
 bool CPUFeatures::m_has_aes = false;
 bool CPUFeatures::m_has_avx2 = false;
 bool CPUFeatures::m_has_avx512f = false;
+bool CPUFeatures::m_has_vaes = false;
 bool CPUFeatures::m_has_bmi2 = false;
 char CPUFeatures::m_brand[64] = {0};
 
@@ -26,6 +27,13 @@ static void cpuid(uint32_t level, uint32_t sublevel, uint32_t* eax, uint32_t* eb
     );
 }
 
+// Read an extended control register; only valid when CPUID reports OSXSAVE
+static uint64_t xgetbv(uint32_t index) {
+    uint32_t eax, edx;
+    __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+    return ((uint64_t)edx << 32) | eax;
+}
+
 #else
 
 // Stub for non-x86_64 platforms
@@ -73,17 +81,31 @@ void CPUFeatures::Detect() {
     // ECX register (leaf 1)
     m_has_aes = (ecx & (1 << 25)) != 0;  // AES-NI
 
+    // The OS must save the YMM (and for AVX-512, the opmask and ZMM) state
+    // across context switches before those registers can be used.
+    bool os_avx = false;
+    bool os_avx512 = false;
+    if ((ecx & (1 << 27)) != 0) {  // OSXSAVE
+        uint64_t xcr0 = xgetbv(0);
+        os_avx = (xcr0 & 0x6) == 0x6;
+        os_avx512 = os_avx && (xcr0 & 0xe0) == 0xe0;
+    }
+
     // Check for AVX2, AVX-512, and BMI2
     cpuid(7, 0, &eax, &ebx, &ecx, &edx);
 
     // EBX register (leaf 7, sublevel 0)
-    m_has_avx2 = (ebx & (1 << 5)) != 0;      // AVX2
-    m_has_avx512f = (ebx & (1 << 16)) != 0;  // AVX-512F
+    m_has_avx2 = os_avx && (ebx & (1 << 5)) != 0;         // AVX2
+    m_has_avx512f = os_avx512 && (ebx & (1 << 16)) != 0;  // AVX-512F
     m_has_bmi2 = (ebx & (1 << 8)) != 0;      // BMI2
 
+    // ECX register (leaf 7, sublevel 0)
+    // The VAES kernels also use AVX2 lane permutes.
+    m_has_vaes = m_has_avx2 && m_has_aes && (ecx & (1 << 9)) != 0;  // VAES
+
     LogPrintf("CPU: %s\n", m_brand);
-    LogPrintf("CPU Features: AES=%d, AVX2=%d, AVX512F=%d, BMI2=%d\n",
-              m_has_aes, m_has_avx2, m_has_avx512f, m_has_bmi2);
+    LogPrintf("CPU Features: AES=%d, AVX2=%d, AVX512F=%d, VAES=%d, BMI2=%d\n",
+              m_has_aes, m_has_avx2, m_has_avx512f, m_has_vaes, m_has_bmi2);
 
 #else
     strcpy(m_brand, "Non-x86_64 CPU");
@@ -106,6 +128,11 @@ bool CPUFeatures::HasAVX512F() {
     return m_has_avx512f;
 }
 
+bool CPUFeatures::HasVAES() {
+    if (!m_detected) Detect();
+    return m_has_vaes;
+}
+
 bool CPUFeatures::HasBMI2() {
     if (!m_detected) Detect();
     return m_has_bmi2;
@@ -25,6 +25,9 @@ public:
     // Check if AVX-512F is supported
     static bool HasAVX512F();
 
+    // Check if VAES (AES on 256-bit vectors) is supported
+    static bool HasVAES();
+
     // Check if BMI2 (Bit Manipulation Instruction Set 2) is supported
     static bool HasBMI2();
 
@@ -36,6 +39,7 @@ private:
     static bool m_has_aes;
     static bool m_has_avx2;
     static bool m_has_avx512f;
+    static bool m_has_vaes;
     static bool m_has_bmi2;
     static char m_brand[64];
 };
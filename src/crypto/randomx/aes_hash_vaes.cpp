@@ -0,0 +1,170 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifdef ENABLE_VAES
+
+#include <cassert>
+#include <cstdint>
+#include <immintrin.h>
+#include "aes_hash_vaes.hpp"
+
+namespace {
+
+	//Two 128-bit lanes: lo in bits 0-127, hi in bits 128-255
+	inline __m256i pair(__m128i lo, __m128i hi) {
+		return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+	}
+
+	//Memory order m0 m1 m2 m3 -> even = [m0 | m2], odd = [m1 | m3]. Plain
+	//128-bit loads and stores are cheaper here than cross-lane permutes.
+	inline void load4(const void* p, __m256i& even, __m256i& odd) {
+		const __m128i* q = (const __m128i*)p;
+		even = pair(_mm_loadu_si128(q + 0), _mm_loadu_si128(q + 2));
+		odd = pair(_mm_loadu_si128(q + 1), _mm_loadu_si128(q + 3));
+	}
+
+	inline void store4(void* p, __m256i even, __m256i odd) {
+		__m128i* q = (__m128i*)p;
+		_mm_storeu_si128(q + 0, _mm256_castsi256_si128(even));
+		_mm_storeu_si128(q + 1, _mm256_castsi256_si128(odd));
+		_mm_storeu_si128(q + 2, _mm256_extracti128_si256(even, 1));
+		_mm_storeu_si128(q + 3, _mm256_extracti128_si256(odd, 1));
+	}
+
+}
+
+void hashAes1Rx4VAES(const void *input, size_t inputSize, void *hash) {
+	assert(inputSize % 64 == 0);
+	const uint8_t* inptr = (const uint8_t*)input;
+	const uint8_t* inputEnd = inptr + inputSize;
+
+	//lanes 0 and 2 encrypt, lanes 1 and 3 decrypt
+	__m256i stateEnc = pair(_mm_set_epi32(AES_HASH_1R_STATE0), _mm_set_epi32(AES_HASH_1R_STATE2));
+	__m256i stateDec = pair(_mm_set_epi32(AES_HASH_1R_STATE1), _mm_set_epi32(AES_HASH_1R_STATE3));
+
+	while (inptr < inputEnd) {
+		__m256i inEnc, inDec;
+		load4(inptr, inEnc, inDec);
+		stateEnc = _mm256_aesenc_epi128(stateEnc, inEnc);
+		stateDec = _mm256_aesdec_epi128(stateDec, inDec);
+		inptr += 64;
+	}
+
+	__m256i xkey0 = _mm256_broadcastsi128_si256(_mm_set_epi32(AES_HASH_1R_XKEY0));
+	__m256i xkey1 = _mm256_broadcastsi128_si256(_mm_set_epi32(AES_HASH_1R_XKEY1));
+
+	stateEnc = _mm256_aesenc_epi128(stateEnc, xkey0);
+	stateDec = _mm256_aesdec_epi128(stateDec, xkey0);
+	stateEnc = _mm256_aesenc_epi128(stateEnc, xkey1);
+	stateDec = _mm256_aesdec_epi128(stateDec, xkey1);
+
+	store4(hash, stateEnc, stateDec);
+}
+
+void fillAes1Rx4VAES(void *state, size_t outputSize, void *buffer) {
+	assert(outputSize % 64 == 0);
+	uint8_t* outptr = (uint8_t*)buffer;
+	const uint8_t* outputEnd = outptr + outputSize;
+
+	//lanes 0 and 2 decrypt, lanes 1 and 3 encrypt
+	const __m256i keyDec = pair(_mm_set_epi32(AES_GEN_1R_KEY0), _mm_set_epi32(AES_GEN_1R_KEY2));
+	const __m256i keyEnc = pair(_mm_set_epi32(AES_GEN_1R_KEY1), _mm_set_epi32(AES_GEN_1R_KEY3));
+
+	__m256i stateDec, stateEnc;
+	load4(state, stateDec, stateEnc);
+
+	while (outptr < outputEnd) {
+		stateDec = _mm256_aesdec_epi128(stateDec, keyDec);
+		stateEnc = _mm256_aesenc_epi128(stateEnc, keyEnc);
+		store4(outptr, stateDec, stateEnc);
+		outptr += 64;
+	}
+
+	store4(state, stateDec, stateEnc);
+}
+
+void fillAes4Rx4VAES(void *state, size_t outputSize, void *buffer) {
+	assert(outputSize % 64 == 0);
+	uint8_t* outptr = (uint8_t*)buffer;
+	const uint8_t* outputEnd = outptr + outputSize;
+
+	//lanes 0 and 1 use keys 0-3, lanes 2 and 3 use keys 4-7
+	const __m256i key0 = pair(_mm_set_epi32(AES_GEN_4R_KEY0), _mm_set_epi32(AES_GEN_4R_KEY4));
+	const __m256i key1 = pair(_mm_set_epi32(AES_GEN_4R_KEY1), _mm_set_epi32(AES_GEN_4R_KEY5));
+	const __m256i key2 = pair(_mm_set_epi32(AES_GEN_4R_KEY2), _mm_set_epi32(AES_GEN_4R_KEY6));
+	const __m256i key3 = pair(_mm_set_epi32(AES_GEN_4R_KEY3), _mm_set_epi32(AES_GEN_4R_KEY7));
+
+	//lanes 0 and 2 decrypt, lanes 1 and 3 encrypt
+	__m256i stateDec, stateEnc;
+	load4(state, stateDec, stateEnc);
+
+	while (outptr < outputEnd) {
+		stateDec = _mm256_aesdec_epi128(stateDec, key0);
+		stateEnc = _mm256_aesenc_epi128(stateEnc, key0);
+
+		stateDec = _mm256_aesdec_epi128(stateDec, key1);
+		stateEnc = _mm256_aesenc_epi128(stateEnc, key1);
+
+		stateDec = _mm256_aesdec_epi128(stateDec, key2);
+		stateEnc = _mm256_aesenc_epi128(stateEnc, key2);
+
+		stateDec = _mm256_aesdec_epi128(stateDec, key3);
+		stateEnc = _mm256_aesenc_epi128(stateEnc, key3);
+
+		store4(outptr, stateDec, stateEnc);
+		outptr += 64;
+	}
+}
+
+void hashAndFillAes1Rx4VAES(void *scratchpad, size_t scratchpadSize, void *hash, void* fill_state) {
+	uint8_t* scratchpadPtr = (uint8_t*)scratchpad;
+	const uint8_t* scratchpadEnd = scratchpadPtr + scratchpadSize;
+
+	__m256i hashEnc = pair(_mm_set_epi32(AES_HASH_1R_STATE0), _mm_set_epi32(AES_HASH_1R_STATE2));
+	__m256i hashDec = pair(_mm_set_epi32(AES_HASH_1R_STATE1), _mm_set_epi32(AES_HASH_1R_STATE3));
+
+	const __m256i keyDec = pair(_mm_set_epi32(AES_GEN_1R_KEY0), _mm_set_epi32(AES_GEN_1R_KEY2));
+	const __m256i keyEnc = pair(_mm_set_epi32(AES_GEN_1R_KEY1), _mm_set_epi32(AES_GEN_1R_KEY3));
+
+	__m256i fillDec, fillEnc;
+	load4(fill_state, fillDec, fillEnc);
+
+	constexpr int PREFETCH_DISTANCE = 4096;
+	const char* prefetchPtr = ((const char*)scratchpad) + PREFETCH_DISTANCE;
+	scratchpadEnd -= PREFETCH_DISTANCE;
+
+	for (int i = 0; i < 2; ++i) {
+		while (scratchpadPtr < scratchpadEnd) {
+			__m256i inEnc, inDec;
+			load4(scratchpadPtr, inEnc, inDec);
+			hashEnc = _mm256_aesenc_epi128(hashEnc, inEnc);
+			hashDec = _mm256_aesdec_epi128(hashDec, inDec);
+
+			fillDec = _mm256_aesdec_epi128(fillDec, keyDec);
+			fillEnc = _mm256_aesenc_epi128(fillEnc, keyEnc);
+			store4(scratchpadPtr, fillDec, fillEnc);
+
+			_mm_prefetch(prefetchPtr, _MM_HINT_T0);
+
+			scratchpadPtr += 64;
+			prefetchPtr += 64;
+		}
+		prefetchPtr = (const char*)scratchpad;
+		scratchpadEnd += PREFETCH_DISTANCE;
+	}
+
+	store4(fill_state, fillDec, fillEnc);
+
+	__m256i xkey0 = _mm256_broadcastsi128_si256(_mm_set_epi32(AES_HASH_1R_XKEY0));
+	__m256i xkey1 = _mm256_broadcastsi128_si256(_mm_set_epi32(AES_HASH_1R_XKEY1));
+
+	hashEnc = _mm256_aesenc_epi128(hashEnc, xkey0);
+	hashDec = _mm256_aesdec_epi128(hashDec, xkey0);
+	hashEnc = _mm256_aesenc_epi128(hashEnc, xkey1);
+	hashDec = _mm256_aesdec_epi128(hashDec, xkey1);
+
+	store4(hash, hashEnc, hashDec);
+}
+
+#endif // ENABLE_VAES
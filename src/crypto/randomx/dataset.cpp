@@ -32,6 +32,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Daniel Dinu, Dmitry Khovratovich, Jean-Philippe Aumasson, and Samuel Neves
 */
 
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include <new>
 #include <algorithm>
 #include <stdexcept>
@@ -51,6 +55,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "argon2_core.h"
 #include "jit_compiler.hpp"
 #include "intrin_portable.h"
+#include "dataset_simd.hpp"
+#include "crypto/cpu_features.h"
 
 static_assert(RANDOMX_ARGON_MEMORY % (RANDOMX_ARGON_LANES * ARGON2_SYNC_POINTS) == 0, "RANDOMX_ARGON_MEMORY - invalid value");
 static_assert(ARGON2_BLOCK_SIZE == randomx::ArgonBlockSize, "Unpexpected value of ARGON2_BLOCK_SIZE");
@@ -147,15 +153,6 @@ namespace randomx {
 		cache->jit->enableExecution();
 	}
 
-	constexpr uint64_t superscalarMul0 = 6364136223846793005ULL;
-	constexpr uint64_t superscalarAdd1 = 9298411001130361340ULL;
-	constexpr uint64_t superscalarAdd2 = 12065312585734608966ULL;
-	constexpr uint64_t superscalarAdd3 = 9306329213124626780ULL;
-	constexpr uint64_t superscalarAdd4 = 5281919268842080866ULL;
-	constexpr uint64_t superscalarAdd5 = 10536153434571861004ULL;
-	constexpr uint64_t superscalarAdd6 = 3398623926847679864ULL;
-	constexpr uint64_t superscalarAdd7 = 9549104520008361294ULL;
-
 	static inline uint8_t* getMixBlock(uint64_t registerValue, uint8_t *memory) {
 		constexpr uint32_t mask = CacheSize / CacheLineSize - 1;
 		return memory + (registerValue & mask) * CacheLineSize;
@@ -193,4 +190,114 @@ namespace randomx {
 		for (uint32_t itemNumber = startItem; itemNumber < endItem; ++itemNumber, dataset += CacheLineSize)
 			initDatasetItem(cache, dataset, itemNumber);
 	}
+
+	//Flatten the cache's superscalar programs for the vectorized kernels.
+	static void decodeSuperscalar(randomx_cache* cache, std::vector<SimdSuperscalarOp>& ops, SimdDatasetContext& ctx) {
+		size_t total = 0;
+		for (unsigned i = 0; i < RANDOMX_CACHE_ACCESSES; ++i)
+			total += cache->programs[i].getSize();
+		ops.resize(total);
+
+		size_t pos = 0;
+		ctx.cacheMemory = cache->memory;
+		ctx.cacheLineMask = CacheSize / CacheLineSize - 1;
+		for (unsigned i = 0; i < RANDOMX_CACHE_ACCESSES; ++i) {
+			SuperscalarProgram& prog = cache->programs[i];
+			ctx.programs[i].ops = ops.data() + pos;
+			ctx.programs[i].size = prog.getSize();
+			ctx.programs[i].addressRegister = prog.getAddressRegister();
+			for (unsigned j = 0; j < prog.getSize(); ++j, ++pos) {
+				Instruction& instr = prog(j);
+				SimdSuperscalarOp& op = ops[pos];
+				op.dst = instr.dst;
+				op.src = instr.src;
+				op.imm = 0;
+				switch ((SuperscalarInstructionType)instr.opcode)
+				{
+				case SuperscalarInstructionType::ISUB_R:
+					op.type = SimdSuperscalarOpType::SUB_R;
+					break;
+				case SuperscalarInstructionType::IXOR_R:
+					op.type = SimdSuperscalarOpType::XOR_R;
+					break;
+				case SuperscalarInstructionType::IADD_RS:
+					op.type = SimdSuperscalarOpType::ADD_RS;
+					op.imm = instr.getModShift();
+					break;
+				case SuperscalarInstructionType::IMUL_R:
+					op.type = SimdSuperscalarOpType::MUL_R;
+					break;
+				case SuperscalarInstructionType::IROR_C:
+					op.type = SimdSuperscalarOpType::ROR_C;
+					op.imm = instr.getImm32() & 63;
+					break;
+				case SuperscalarInstructionType::IADD_C7:
+				case SuperscalarInstructionType::IADD_C8:
+				case SuperscalarInstructionType::IADD_C9:
+					op.type = SimdSuperscalarOpType::ADD_C;
+					op.imm = signExtend2sCompl(instr.getImm32());
+					break;
+				case SuperscalarInstructionType::IXOR_C7:
+				case SuperscalarInstructionType::IXOR_C8:
+				case SuperscalarInstructionType::IXOR_C9:
+					op.type = SimdSuperscalarOpType::XOR_C;
+					op.imm = signExtend2sCompl(instr.getImm32());
+					break;
+				case SuperscalarInstructionType::IMULH_R:
+					op.type = SimdSuperscalarOpType::MULH_R;
+					break;
+				case SuperscalarInstructionType::ISMULH_R:
+					op.type = SimdSuperscalarOpType::SMULH_R;
+					break;
+				case SuperscalarInstructionType::IMUL_RCP:
+					op.type = SimdSuperscalarOpType::MUL_C;
+					op.imm = cache->reciprocalCache[instr.getImm32()];
+					break;
+				default:
+					UNREACHABLE;
+				}
+			}
+		}
+	}
+
+	const char* simdDatasetKernel() {
+#if defined(ENABLE_AVX512F)
+		if (CPUFeatures::HasAVX512F())
+			return "avx512";
+#endif
+#if defined(ENABLE_AVX2)
+		if (CPUFeatures::HasAVX2())
+			return "avx2";
+#endif
+		return nullptr;
+	}
+
+	void initDatasetSimd(randomx_cache* cache, uint8_t* dataset, uint32_t startItem, uint32_t endItem) {
+		const char* kernel = simdDatasetKernel();
+		uint32_t itemNumber = startItem;
+		if (kernel != nullptr) {
+			std::vector<SimdSuperscalarOp> ops;
+			SimdDatasetContext ctx;
+			decodeSuperscalar(cache, ops, ctx);
+#if defined(ENABLE_AVX512F)
+			if (strcmp(kernel, "avx512") == 0) {
+				uint32_t count = (endItem - itemNumber) / SimdDatasetLanesAVX512 * SimdDatasetLanesAVX512;
+				initDatasetAVX512(ctx, dataset, itemNumber, count);
+				itemNumber += count;
+				dataset += count * CacheLineSize;
+			}
+#endif
+#if defined(ENABLE_AVX2)
+			if (strcmp(kernel, "avx2") == 0) {
+				uint32_t count = (endItem - itemNumber) / SimdDatasetLanesAVX2 * SimdDatasetLanesAVX2;
+				initDatasetAVX2(ctx, dataset, itemNumber, count);
+				itemNumber += count;
+				dataset += count * CacheLineSize;
+			}
+#endif
+		}
+		//Items that do not fill a whole vector
+		for (; itemNumber < endItem; ++itemNumber, dataset += CacheLineSize)
+			initDatasetItem(cache, dataset, itemNumber);
+	}
 }
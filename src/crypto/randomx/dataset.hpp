@@ -90,6 +90,12 @@ namespace randomx {
 	void initCacheCompile(randomx_cache*, const void*, size_t);
 	void initDatasetItem(randomx_cache* cache, uint8_t* out, uint64_t blockNumber);
 	void initDataset(randomx_cache* cache, uint8_t* dataset, uint32_t startBlock, uint32_t endBlock);
+	//Same result as initDataset, using the widest vectorized kernel this CPU
+	//supports (see dataset_simd.hpp).
+	void initDatasetSimd(randomx_cache* cache, uint8_t* dataset, uint32_t startBlock, uint32_t endBlock);
+	//Name of the kernel initDatasetSimd uses ("avx512", "avx2"), or nullptr if it
+	//falls back to initDataset.
+	const char* simdDatasetKernel();
 
 	inline randomx_argon2_impl* selectArgonImpl(randomx_flags flags) {
 		if (flags & RANDOMX_FLAG_ARGON2_AVX2) {
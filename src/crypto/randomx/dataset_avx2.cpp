@@ -0,0 +1,43 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifdef ENABLE_AVX2
+
+#include "dataset_simd_kernel.hpp"
+
+namespace randomx {
+namespace {
+
+	struct VecAVX2 {
+		typedef __m256i Vec;
+		static constexpr int Lanes = SimdDatasetLanesAVX2;
+
+		static inline Vec set1(uint64_t x) { return _mm256_set1_epi64x((long long)x); }
+		static inline Vec load(const uint64_t* p) { return _mm256_load_si256((const __m256i*)p); }
+		static inline void store(uint64_t* p, Vec a) { _mm256_store_si256((__m256i*)p, a); }
+		static inline Vec add(Vec a, Vec b) { return _mm256_add_epi64(a, b); }
+		static inline Vec sub(Vec a, Vec b) { return _mm256_sub_epi64(a, b); }
+		static inline Vec xorv(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+		static inline Vec andv(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+		static inline Vec mul32(Vec a, Vec b) { return _mm256_mul_epu32(a, b); }
+		static inline Vec srli32(Vec a) { return _mm256_srli_epi64(a, 32); }
+		static inline Vec slli32(Vec a) { return _mm256_slli_epi64(a, 32); }
+		static inline Vec sll(Vec a, int s) { return _mm256_sll_epi64(a, _mm_cvtsi32_si128(s)); }
+		static inline Vec ror(Vec a, int s) {
+			return _mm256_or_si256(_mm256_srl_epi64(a, _mm_cvtsi32_si128(s)), _mm256_sll_epi64(a, _mm_cvtsi32_si128((64 - s) & 63)));
+		}
+		static inline Vec signMask(Vec a) { return _mm256_cmpgt_epi64(_mm256_setzero_si256(), a); }
+		static inline Vec gather(const uint64_t* base, Vec index) {
+			return _mm256_i64gather_epi64((const long long*)base, index, 8);
+		}
+	};
+
+}
+
+	void initDatasetAVX2(const SimdDatasetContext& ctx, uint8_t* out, uint64_t startItem, uint64_t itemCount) {
+		SimdSuperscalar<VecAVX2>::initDataset(ctx, out, startItem, itemCount);
+	}
+}
+
+#endif // ENABLE_AVX2
@@ -0,0 +1,43 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifdef ENABLE_AVX512F
+
+#include "dataset_simd_kernel.hpp"
+
+namespace randomx {
+namespace {
+
+	//AVX-512F only: the 64-bit multiply (AVX-512DQ) is not used so that the
+	//kernel runs on every AVX-512 CPU.
+	struct VecAVX512 {
+		typedef __m512i Vec;
+		static constexpr int Lanes = SimdDatasetLanesAVX512;
+
+		static inline Vec set1(uint64_t x) { return _mm512_set1_epi64((long long)x); }
+		static inline Vec load(const uint64_t* p) { return _mm512_load_si512((const void*)p); }
+		static inline void store(uint64_t* p, Vec a) { _mm512_store_si512((void*)p, a); }
+		static inline Vec add(Vec a, Vec b) { return _mm512_add_epi64(a, b); }
+		static inline Vec sub(Vec a, Vec b) { return _mm512_sub_epi64(a, b); }
+		static inline Vec xorv(Vec a, Vec b) { return _mm512_xor_si512(a, b); }
+		static inline Vec andv(Vec a, Vec b) { return _mm512_and_si512(a, b); }
+		static inline Vec mul32(Vec a, Vec b) { return _mm512_mul_epu32(a, b); }
+		static inline Vec srli32(Vec a) { return _mm512_srli_epi64(a, 32); }
+		static inline Vec slli32(Vec a) { return _mm512_slli_epi64(a, 32); }
+		static inline Vec sll(Vec a, int s) { return _mm512_sll_epi64(a, _mm_cvtsi32_si128(s)); }
+		static inline Vec ror(Vec a, int s) { return _mm512_rorv_epi64(a, set1((uint64_t)s)); }
+		static inline Vec signMask(Vec a) { return _mm512_srai_epi64(a, 63); }
+		static inline Vec gather(const uint64_t* base, Vec index) {
+			return _mm512_i64gather_epi64(index, (const void*)base, 8);
+		}
+	};
+
+}
+
+	void initDatasetAVX512(const SimdDatasetContext& ctx, uint8_t* out, uint64_t startItem, uint64_t itemCount) {
+		SimdSuperscalar<VecAVX512>::initDataset(ctx, out, startItem, itemCount);
+	}
+}
+
+#endif // ENABLE_AVX512F
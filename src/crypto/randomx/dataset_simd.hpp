@@ -0,0 +1,73 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#pragma once
+
+#include <cstdint>
+#include "configuration.h"
+
+/*
+ * Vectorized dataset initialization.
+ *
+ * Every dataset item runs the same RANDOMX_CACHE_ACCESSES superscalar
+ * programs; only the register values and the cache lines they mix in differ.
+ * The kernels below therefore evaluate one item per 64-bit vector lane (4 per
+ * AVX2 register, 8 per AVX-512 register), with the programs pre-decoded into
+ * a flat form that needs nothing from the rest of RandomX. Keeping the kernel
+ * translation units free of other RandomX headers means no inline function
+ * compiled with -mavx2/-mavx512f can leak into the scalar code paths.
+ */
+
+namespace randomx {
+
+	constexpr uint64_t superscalarMul0 = 6364136223846793005ULL;
+	constexpr uint64_t superscalarAdd1 = 9298411001130361340ULL;
+	constexpr uint64_t superscalarAdd2 = 12065312585734608966ULL;
+	constexpr uint64_t superscalarAdd3 = 9306329213124626780ULL;
+	constexpr uint64_t superscalarAdd4 = 5281919268842080866ULL;
+	constexpr uint64_t superscalarAdd5 = 10536153434571861004ULL;
+	constexpr uint64_t superscalarAdd6 = 3398623926847679864ULL;
+	constexpr uint64_t superscalarAdd7 = 9549104520008361294ULL;
+
+	enum class SimdSuperscalarOpType : uint8_t {
+		SUB_R,    //dst -= src
+		XOR_R,    //dst ^= src
+		ADD_RS,   //dst += src << imm
+		MUL_R,    //dst *= src
+		ROR_C,    //dst = rotr(dst, imm)
+		ADD_C,    //dst += imm
+		XOR_C,    //dst ^= imm
+		MULH_R,   //dst = high 64 bits of dst * src, unsigned
+		SMULH_R,  //dst = high 64 bits of dst * src, signed
+		MUL_C,    //dst *= imm (IMUL_RCP with the reciprocal resolved)
+	};
+
+	struct SimdSuperscalarOp {
+		SimdSuperscalarOpType type;
+		uint8_t dst;
+		uint8_t src;
+		uint64_t imm;
+	};
+
+	struct SimdSuperscalarProgram {
+		const SimdSuperscalarOp* ops;
+		uint32_t size;
+		uint32_t addressRegister;
+	};
+
+	struct SimdDatasetContext {
+		const uint8_t* cacheMemory;
+		//Cache line index mask (CacheSize / CacheLineSize - 1)
+		uint64_t cacheLineMask;
+		SimdSuperscalarProgram programs[RANDOMX_CACHE_ACCESSES];
+	};
+
+	constexpr int SimdDatasetLanesAVX2 = 4;
+	constexpr int SimdDatasetLanesAVX512 = 8;
+
+	//Initialize itemCount items starting at startItem; itemCount must be a
+	//multiple of the kernel's lane count.
+	void initDatasetAVX2(const SimdDatasetContext& ctx, uint8_t* out, uint64_t startItem, uint64_t itemCount);
+	void initDatasetAVX512(const SimdDatasetContext& ctx, uint8_t* out, uint64_t startItem, uint64_t itemCount);
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#pragma once
+
+#include <cstring>
+#include <immintrin.h>
+#include "dataset_simd.hpp"
+
+/*
+ * Lane-parallel superscalar hash, shared by the AVX2 and AVX-512 kernels.
+ * Only include this from a translation unit compiled for the target ISA.
+ *
+ * V provides the vector type and the handful of 64-bit lane operations the
+ * superscalar instruction set needs. Neither ISA has a full 64x64-bit
+ * multiply, so products are assembled from 32x32->64-bit partial products.
+ */
+
+namespace randomx {
+namespace {
+
+	template<class V>
+	struct SimdSuperscalar {
+		typedef typename V::Vec Vec;
+
+		static inline Vec lo32(Vec a) {
+			return V::andv(a, V::set1(0xFFFFFFFFULL));
+		}
+
+		static inline Vec mulLo(Vec a, Vec b) {
+			Vec lo = V::mul32(a, b);
+			Vec cross = V::add(V::mul32(V::srli32(a), b), V::mul32(a, V::srli32(b)));
+			return V::add(lo, V::slli32(cross));
+		}
+
+		static inline Vec mulHi(Vec a, Vec b) {
+			Vec ah = V::srli32(a);
+			Vec bh = V::srli32(b);
+			Vec ll = V::mul32(a, b);
+			Vec lh = V::mul32(a, bh);
+			Vec hl = V::mul32(ah, b);
+			Vec hh = V::mul32(ah, bh);
+			Vec mid = V::add(V::add(V::srli32(ll), lo32(lh)), lo32(hl));
+			return V::add(V::add(hh, V::srli32(lh)), V::add(V::srli32(hl), V::srli32(mid)));
+		}
+
+		//Signed high product from the unsigned one: subtract b where a < 0
+		//and a where b < 0.
+		static inline Vec smulHi(Vec a, Vec b) {
+			Vec hi = mulHi(a, b);
+			hi = V::sub(hi, V::andv(V::signMask(a), b));
+			return V::sub(hi, V::andv(V::signMask(b), a));
+		}
+
+		static inline void execute(Vec (&r)[8], const SimdSuperscalarProgram& prog) {
+			for (uint32_t j = 0; j < prog.size; ++j) {
+				const SimdSuperscalarOp& op = prog.ops[j];
+				Vec& dst = r[op.dst];
+				switch (op.type) {
+				case SimdSuperscalarOpType::SUB_R:
+					dst = V::sub(dst, r[op.src]);
+					break;
+				case SimdSuperscalarOpType::XOR_R:
+					dst = V::xorv(dst, r[op.src]);
+					break;
+				case SimdSuperscalarOpType::ADD_RS:
+					dst = V::add(dst, V::sll(r[op.src], (int)op.imm));
+					break;
+				case SimdSuperscalarOpType::MUL_R:
+					dst = mulLo(dst, r[op.src]);
+					break;
+				case SimdSuperscalarOpType::ROR_C:
+					dst = V::ror(dst, (int)op.imm);
+					break;
+				case SimdSuperscalarOpType::ADD_C:
+					dst = V::add(dst, V::set1(op.imm));
+					break;
+				case SimdSuperscalarOpType::XOR_C:
+					dst = V::xorv(dst, V::set1(op.imm));
+					break;
+				case SimdSuperscalarOpType::MULH_R:
+					dst = mulHi(dst, r[op.src]);
+					break;
+				case SimdSuperscalarOpType::SMULH_R:
+					dst = smulHi(dst, r[op.src]);
+					break;
+				case SimdSuperscalarOpType::MUL_C:
+					dst = mulLo(dst, V::set1(op.imm));
+					break;
+				}
+			}
+		}
+
+		static void initDataset(const SimdDatasetContext& ctx, uint8_t* out, uint64_t startItem, uint64_t itemCount) {
+			constexpr int Lanes = V::Lanes;
+			const uint64_t* cache64 = (const uint64_t*)ctx.cacheMemory;
+			const Vec lineMask = V::set1(ctx.cacheLineMask);
+
+			for (uint64_t item = startItem; item < startItem + itemCount; item += Lanes, out += Lanes * 64) {
+				alignas(64) uint64_t lanes[Lanes];
+				for (int l = 0; l < Lanes; ++l)
+					lanes[l] = item + l;
+				Vec registerValue = V::load(lanes);
+				for (int l = 0; l < Lanes; ++l)
+					lanes[l] = (item + l + 1) * superscalarMul0;
+
+				Vec r[8];
+				r[0] = V::load(lanes);
+				r[1] = V::xorv(r[0], V::set1(superscalarAdd1));
+				r[2] = V::xorv(r[0], V::set1(superscalarAdd2));
+				r[3] = V::xorv(r[0], V::set1(superscalarAdd3));
+				r[4] = V::xorv(r[0], V::set1(superscalarAdd4));
+				r[5] = V::xorv(r[0], V::set1(superscalarAdd5));
+				r[6] = V::xorv(r[0], V::set1(superscalarAdd6));
+				r[7] = V::xorv(r[0], V::set1(superscalarAdd7));
+
+				for (unsigned i = 0; i < RANDOMX_CACHE_ACCESSES; ++i) {
+					//Index of the first qword of each lane's mix block
+					Vec base = V::sll(V::andv(registerValue, lineMask), 3);
+					V::store(lanes, base);
+					for (int l = 0; l < Lanes; ++l)
+						_mm_prefetch((const char*)(cache64 + lanes[l]), _MM_HINT_NTA);
+
+					const SimdSuperscalarProgram& prog = ctx.programs[i];
+					execute(r, prog);
+
+					for (int q = 0; q < 8; ++q)
+						r[q] = V::xorv(r[q], V::gather(cache64, V::add(base, V::set1(q))));
+
+					registerValue = r[prog.addressRegister];
+				}
+
+				//Transpose from one register per vector to one item per lane
+				alignas(64) uint64_t regs[8][Lanes];
+				for (int q = 0; q < 8; ++q)
+					V::store(regs[q], r[q]);
+				for (int l = 0; l < Lanes; ++l) {
+					uint64_t itemOut[8];
+					for (int q = 0; q < 8; ++q)
+						itemOut[q] = regs[q][l];
+					memcpy(out + l * 64, itemOut, 64);
+				}
+			}
+		}
+	};
+
+}
+}
@@ -81,7 +81,7 @@ extern "C" {
 					cache->dealloc = &randomx::deallocCache<randomx::DefaultAllocator>;
 					cache->jit = nullptr;
 					cache->initialize = &randomx::initCache;
-					cache->datasetInit = &randomx::initDataset;
+					cache->datasetInit = &randomx::initDatasetSimd;
 					cache->memory = (uint8_t*)randomx::DefaultAllocator::allocMemory(randomx::CacheSize);
 					break;
 
@@ -97,7 +97,7 @@ extern "C" {
 					cache->dealloc = &randomx::deallocCache<randomx::LargePageAllocator>;
 					cache->jit = nullptr;
 					cache->initialize = &randomx::initCache;
-					cache->datasetInit = &randomx::initDataset;
+					cache->datasetInit = &randomx::initDatasetSimd;
 					cache->memory = (uint8_t*)randomx::LargePageAllocator::allocMemory(randomx::CacheSize);
 					break;
 
@@ -192,6 +192,18 @@ extern "C" {
 		cache->datasetInit(cache, dataset->memory + startItem * randomx::CacheLineSize, startItem, startItem + itemCount);
 	}
 
+	void randomx_init_dataset_simd(randomx_dataset *dataset, randomx_cache *cache, unsigned long startItem, unsigned long itemCount) {
+		assert(dataset != nullptr);
+		assert(cache != nullptr);
+		assert(startItem < DatasetItemCount && itemCount <= DatasetItemCount);
+		assert(startItem + itemCount <= DatasetItemCount);
+		randomx::initDatasetSimd(cache, dataset->memory + startItem * randomx::CacheLineSize, startItem, startItem + itemCount);
+	}
+
+	const char *randomx_dataset_simd_kernel() {
+		return randomx::simdDatasetKernel();
+	}
+
 	void *randomx_get_dataset_memory(randomx_dataset *dataset) {
 		assert(dataset != nullptr);
 		return dataset->memory;
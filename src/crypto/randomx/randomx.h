@@ -157,6 +157,24 @@ RANDOMX_EXPORT unsigned long randomx_dataset_item_count(void);
 */
 RANDOMX_EXPORT void randomx_init_dataset(randomx_dataset *dataset, randomx_cache *cache, unsigned long startItem, unsigned long itemCount);
 
+/**
+ * Initializes dataset items like randomx_init_dataset, but always with the vectorized
+ * (AVX-512 or AVX2) kernel when the CPU supports one, even if the cache was compiled
+ * by the JIT. The result is identical to randomx_init_dataset.
+ *
+ * @param dataset is a pointer to a previously allocated randomx_dataset structure. Must not be NULL.
+ * @param cache is a pointer to a previously allocated and initialized randomx_cache structure. Must not be NULL.
+ * @param startItem is the item number where intialization should start.
+ * @param itemCount is the number of items that should be initialized.
+*/
+RANDOMX_EXPORT void randomx_init_dataset_simd(randomx_dataset *dataset, randomx_cache *cache, unsigned long startItem, unsigned long itemCount);
+
+/**
+ * @return the name of the vectorized dataset kernel used by randomx_init_dataset_simd
+ *         ("avx512" or "avx2"), or NULL if this CPU or build has none.
+*/
+RANDOMX_EXPORT const char *randomx_dataset_simd_kernel(void);
+
 /**
  * Returns a pointer to the internal memory buffer of the dataset structure. The size
  * of the internal memory buffer is randomx_dataset_item_count() * RANDOMX_DATASET_ITEM_SIZE.
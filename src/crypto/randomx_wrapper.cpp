@@ -175,14 +175,43 @@ static std::shared_ptr<CacheEntry> GetOrCreateCache(const uint256& seedhash)
     return entry;
 }
 
+typedef void (*DatasetInitFn)(randomx_dataset*, randomx_cache*, unsigned long, unsigned long);
+
+// Number of items timed with each dataset init method before choosing one
+static const unsigned long DATASET_INIT_SAMPLE_ITEMS = 2048;
+
+// Choose between the JIT-compiled and the vectorized dataset init by timing
+// both on the same leading items; they produce identical output, so the
+// sample is simply initialized twice.
+static DatasetInitFn SelectDatasetInit(randomx_dataset* dataset, randomx_cache* cache)
+{
+    const char* kernel = randomx_dataset_simd_kernel();
+    if (kernel == nullptr) {
+        return randomx_init_dataset;
+    }
+
+    auto timeInit = [&](DatasetInitFn fn) {
+        auto start = std::chrono::steady_clock::now();
+        fn(dataset, cache, 0, DATASET_INIT_SAMPLE_ITEMS);
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+    int64_t jitMicros = timeInit(randomx_init_dataset);
+    int64_t simdMicros = timeInit(randomx_init_dataset_simd);
+    bool useSimd = simdMicros < jitMicros;
+    LogPrintf("RandomX: Dataset init using %s (%s kernel %d us, JIT %d us per %u items)\n",
+              useSimd ? kernel : "JIT", kernel, simdMicros, jitMicros, DATASET_INIT_SAMPLE_ITEMS);
+    return useSimd ? randomx_init_dataset_simd : randomx_init_dataset;
+}
+
 // Initialize dataset in parallel using multiple threads
 static void InitDatasetParallel(randomx_dataset* dataset, randomx_cache* cache, int numThreads)
 {
     unsigned long itemCount = randomx_dataset_item_count();
+    DatasetInitFn initFn = SelectDatasetInit(dataset, cache);
 
     if (numThreads <= 1) {
         // Single-threaded initialization
-        randomx_init_dataset(dataset, cache, 0, itemCount);
+        initFn(dataset, cache, 0, itemCount);
         return;
     }
 
@@ -196,8 +225,8 @@ static void InitDatasetParallel(randomx_dataset* dataset, randomx_cache* cache,
         unsigned long endItem = startItem + itemsPerThread + (t < (int)remainder ? 1 : 0);
         unsigned long count = endItem - startItem;
 
-        threads.emplace_back([dataset, cache, startItem, count]() {
-            randomx_init_dataset(dataset, cache, startItem, count);
+        threads.emplace_back([initFn, dataset, cache, startItem, count]() {
+            initFn(dataset, cache, startItem, count);
         });
     }
 
@@ -265,7 +294,6 @@ static std::shared_ptr<DatasetEntry> GetOrCreateDataset(const uint256& seedhash,
     // Initialize dataset from cache using multiple threads
     int numThreads = std::thread::hardware_concurrency();
     if (numThreads < 1) numThreads = 4;  // Fallback
-    if (numThreads > 16) numThreads = 16;  // Cap at 16 threads
 
     auto startTime = std::chrono::steady_clock::now();
     InitDatasetParallel(entry->dataset, cache_entry->cache, numThreads);
@@ -6,24 +6,140 @@
 #include "dbwrapper.h"
 
 #include "fs.h"
+#include "sync.h"
+#include "util/strencodings.h"
 #include "util/system.h"
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
+#include <set>
+#include <sstream>
 #include <stdint.h>
 
 #include <boost/scoped_ptr.hpp>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/** Block cache that counts lookups and hits of the LRU cache it wraps. */
+class CCountingCache : public leveldb::Cache
+{
+private:
+    leveldb::Cache* inner;
+
+public:
+    std::atomic<uint64_t> nLookups{0};
+    std::atomic<uint64_t> nHits{0};
+
+    explicit CCountingCache(size_t capacity) : inner(leveldb::NewLRUCache(capacity)) {}
+    ~CCountingCache() { delete inner; }
+
+    Handle* Insert(const leveldb::Slice& key, void* value, size_t charge,
+                   void (*deleter)(const leveldb::Slice& key, void* value)) override
+    {
+        return inner->Insert(key, value, charge, deleter);
+    }
+    Handle* Lookup(const leveldb::Slice& key) override
+    {
+        Handle* handle = inner->Lookup(key);
+        nLookups.fetch_add(1, std::memory_order_relaxed);
+        if (handle)
+            nHits.fetch_add(1, std::memory_order_relaxed);
+        return handle;
+    }
+    void Release(Handle* handle) override { inner->Release(handle); }
+    void* Value(Handle* handle) override { return inner->Value(handle); }
+    void Erase(const leveldb::Slice& key) override { inner->Erase(key); }
+    uint64_t NewId() override { return inner->NewId(); }
+    void Prune() override { inner->Prune(); }
+    size_t TotalCharge() const override { return inner->TotalCharge(); }
+};
+
+static bool ParseDBOption(const std::string& str, std::string& db, std::string& key, int& value)
+{
+    size_t nColon = str.find(':');
+    size_t nEquals = str.find('=', nColon == std::string::npos ? 0 : nColon);
+    if (nColon == std::string::npos || nEquals == std::string::npos)
+        return false;
+    db = str.substr(0, nColon);
+    key = str.substr(nColon + 1, nEquals - nColon - 1);
+    return ParseInt32(str.substr(nEquals + 1), &value);
+}
+
+static bool ApplyDBOption(DBTuning& tuning, const std::string& key, int value)
+{
+    if (key == "maxopenfiles" && value >= 16) {
+        tuning.nMaxOpenFiles = value;
+    } else if (key == "bloombits" && value >= 0 && value <= 32) {
+        tuning.nBloomBits = value;
+    } else if (key == "compression" && (value == 0 || value == 1)) {
+        tuning.fCompression = value;
+    } else if (key == "writebuffer" && value >= 5 && value <= 45) {
+        tuning.nWriteBufferPercent = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+DBTuning DBTuning::FromArgs(const std::string& name)
+{
+    DBTuning tuning;
+    if (name.empty() || !mapMultiArgs.count("-dboption"))
+        return tuning;
+    for (const std::string& str : mapMultiArgs.at("-dboption")) {
+        std::string db, key;
+        int value;
+        if (ParseDBOption(str, db, key, value) && db == name)
+            ApplyDBOption(tuning, key, value);
+    }
+    return tuning;
+}
+
+bool DBTuning::CheckArgs(std::string& strError)
+{
+    if (!mapMultiArgs.count("-dboption"))
+        return true;
+    for (const std::string& str : mapMultiArgs.at("-dboption")) {
+        std::string db, key;
+        int value;
+        DBTuning tuning;
+        if (!ParseDBOption(str, db, key, value) || (db != "chainstate" && db != "blockindex") ||
+            !ApplyDBOption(tuning, key, value)) {
+            strError = strprintf("Invalid -dboption '%s'", str);
+            return false;
+        }
+    }
+    return true;
+}
+
+static CCriticalSection cs_dbwrappers;
+static std::set<CDBWrapper*> setDBWrappers;
+
+std::vector<DBStats> GetDBStats()
+{
+    LOCK(cs_dbwrappers);
+    std::vector<DBStats> vStats;
+    for (const CDBWrapper* pdbw : setDBWrappers)
+        vStats.push_back(pdbw->GetStats());
+    return vStats;
+}
+
+void SampleDBStats()
+{
+    LOCK(cs_dbwrappers);
+    for (CDBWrapper* pdbw : setDBWrappers)
+        pdbw->SampleLevel0();
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const DBTuning& tuning)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.write_buffer_size = nCacheSize * tuning.nWriteBufferPercent / 100;
+    // up to two write buffers may be held in memory simultaneously
+    options.block_cache = new CCountingCache(nCacheSize - 2 * options.write_buffer_size);
+    options.filter_policy = tuning.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(tuning.nBloomBits) : NULL;
+    options.compression = tuning.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = tuning.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -33,14 +149,17 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, const std::string& nameIn) :
+    name(nameIn), tuning(DBTuning::FromArgs(nameIn)),
+    nWrites(0), nWriteMicros(0), nLevel0Samples(0), nLevel0Throttled(0)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, tuning);
+    nBlockCacheSize = nCacheSize - 2 * options.write_buffer_size;
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -57,10 +176,21 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    if (!name.empty()) {
+        LogPrintf("LevelDB %s: max_open_files=%d bloombits=%d compression=%d block_cache=%u write_buffer=%u\n",
+            name, tuning.nMaxOpenFiles, tuning.nBloomBits, tuning.fCompression,
+            nBlockCacheSize, options.write_buffer_size);
+        LOCK(cs_dbwrappers);
+        setDBWrappers.insert(this);
+    }
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    if (!name.empty()) {
+        LOCK(cs_dbwrappers);
+        setDBWrappers.erase(this);
+    }
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -73,11 +203,28 @@ CDBWrapper::~CDBWrapper()
 
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
+    int64_t nStart = GetTimeMicros();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    int64_t nElapsed = GetTimeMicros() - nStart;
+    nWrites++;
+    nWriteMicros += nElapsed;
     dbwrapper_private::HandleError(status);
     return true;
 }
 
+void CDBWrapper::SampleLevel0()
+{
+    // LevelDB delays every write while level 0 is at its slowdown trigger,
+    // but does not count these delays. Sampling here keeps the property
+    // lookup, which takes LevelDB's mutex, off the write path.
+    std::string strValue;
+    if (!pdb->GetProperty("leveldb.num-files-at-level0", &strValue))
+        return;
+    nLevel0Samples++;
+    if (atoi(strValue) >= DBWRAPPER_L0_SLOWDOWN_FILES)
+        nLevel0Throttled++;
+}
+
 bool CDBWrapper::IsEmpty()
 {
     boost::scoped_ptr<CDBIterator> it(NewIterator());
@@ -85,6 +232,73 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+DBStats CDBWrapper::GetStats() const
+{
+    DBStats stats;
+    stats.name = name;
+    stats.tuning = tuning;
+    stats.nBlockCacheSize = nBlockCacheSize;
+    stats.nWriteBufferSize = options.write_buffer_size;
+
+    const CCountingCache* pcache = static_cast<const CCountingCache*>(options.block_cache);
+    stats.nCacheLookups = pcache->nLookups;
+    stats.nCacheHits = pcache->nHits;
+
+    std::string strValue;
+    stats.nMemoryUsage = 0;
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nMemoryUsage = atoi64(strValue);
+
+    // "leveldb.stats" is a table with one row per non-empty level:
+    //   level files size(MiB) compaction-time(s) compaction-read(MiB) compaction-write(MiB)
+    stats.vLevelFiles.fill(0);
+    stats.vLevelMiB.fill(0);
+    stats.nCompactionSeconds = stats.nCompactionReadMiB = stats.nCompactionWriteMiB = 0;
+    if (pdb->GetProperty("leveldb.stats", &strValue)) {
+        std::istringstream ss(strValue);
+        std::string strLine;
+        while (std::getline(ss, strLine)) {
+            std::istringstream row(strLine);
+            int nLevel, nFiles;
+            double nMiB, nSeconds, nReadMiB, nWriteMiB;
+            if (!(row >> nLevel >> nFiles >> nMiB >> nSeconds >> nReadMiB >> nWriteMiB))
+                continue;
+            if (nLevel < 0 || nLevel >= DBWRAPPER_NUM_LEVELS)
+                continue;
+            stats.vLevelFiles[nLevel] = nFiles;
+            stats.vLevelMiB[nLevel] = nMiB;
+            stats.nCompactionSeconds += nSeconds;
+            stats.nCompactionReadMiB += nReadMiB;
+            stats.nCompactionWriteMiB += nWriteMiB;
+        }
+    }
+
+    stats.nWrites = nWrites;
+    stats.nWriteMicros = nWriteMicros;
+    stats.nLevel0Samples = nLevel0Samples;
+    stats.nLevel0Throttled = nLevel0Throttled;
+    return stats;
+}
+
+CDBSnapshot::CDBSnapshot(const CDBWrapper &_parent) :
+    parent(_parent), psnapshot(_parent.pdb->GetSnapshot())
+{
+    readoptions = parent.readoptions;
+    readoptions.snapshot = psnapshot;
+    iteroptions = parent.iteroptions;
+    iteroptions.snapshot = psnapshot;
+}
+
+CDBSnapshot::~CDBSnapshot()
+{
+    parent.pdb->ReleaseSnapshot(psnapshot);
+}
+
+CDBIterator *CDBSnapshot::NewIterator() const
+{
+    return new CDBIterator(parent, parent.pdb->NewIterator(iteroptions));
+}
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
@@ -13,12 +13,68 @@
 #include "util/system.h"
 #include "version.h"
 
+#include <array>
+#include <atomic>
+#include <vector>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 static const size_t DBWRAPPER_MAX_FILE_SIZE = 32 << 20; // 32 MiB
+//! Number of LevelDB levels (leveldb::config::kNumLevels)
+static const int DBWRAPPER_NUM_LEVELS = 7;
+//! Level-0 file count at which LevelDB starts delaying writes (leveldb::config::kL0_SlowdownWritesTrigger)
+static const int DBWRAPPER_L0_SLOWDOWN_FILES = 8;
+//! Seconds between background samples of each database's level-0 file count
+static const int64_t DBWRAPPER_STATS_SAMPLE_INTERVAL = 1;
+
+/**
+ * Per-database LevelDB settings. The defaults are the values that used to be
+ * hard-coded; each can be overridden with -dboption=<database>:<key>=<value>.
+ */
+struct DBTuning
+{
+    int nMaxOpenFiles = 64;
+    int nBloomBits = 10;
+    bool fCompression = false;
+    //! Size of one write buffer as a percentage of the database cache. Up to
+    //! two write buffers may be held at once; the rest is block cache.
+    int nWriteBufferPercent = 25;
+
+    /** Settings for the named database, after applying -dboption. */
+    static DBTuning FromArgs(const std::string& name);
+    /** Check every -dboption entry; on failure set strError and return false. */
+    static bool CheckArgs(std::string& strError);
+};
+
+/** Snapshot of the configuration and activity of one open database. */
+struct DBStats
+{
+    std::string name;
+    DBTuning tuning;
+    size_t nBlockCacheSize;
+    size_t nWriteBufferSize;
+    size_t nMemoryUsage;
+    std::array<int, DBWRAPPER_NUM_LEVELS> vLevelFiles;
+    std::array<double, DBWRAPPER_NUM_LEVELS> vLevelMiB;
+    double nCompactionSeconds;
+    double nCompactionReadMiB;
+    double nCompactionWriteMiB;
+    uint64_t nWrites;
+    int64_t nWriteMicros;
+    uint64_t nLevel0Samples;
+    //! Samples that found level 0 at DBWRAPPER_L0_SLOWDOWN_FILES or more files
+    uint64_t nLevel0Throttled;
+    uint64_t nCacheLookups;
+    uint64_t nCacheHits;
+};
+
+/** Statistics of every open database that was given a name. */
+std::vector<DBStats> GetDBStats();
+/** Sample the level-0 file count of every open database that was given a name. */
+void SampleDBStats();
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -141,6 +197,7 @@ public:
 
 class CDBWrapper
 {
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
@@ -163,18 +220,18 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
-public:
-    /**
-     * @param[in] path        Location in the filesystem where leveldb data will be stored.
-     * @param[in] nCacheSize  Configures various leveldb cache settings.
-     * @param[in] fMemory     If true, use leveldb's memory environment.
-     * @param[in] fWipe       If true, remove all existing data.
-     */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
-    ~CDBWrapper();
+    //! name used for -dboption and statistics; empty for unnamed databases
+    std::string name;
+    DBTuning tuning;
+    size_t nBlockCacheSize;
+
+    std::atomic<uint64_t> nWrites;
+    std::atomic<int64_t> nWriteMicros;
+    std::atomic<uint64_t> nLevel0Samples;
+    std::atomic<uint64_t> nLevel0Throttled;
 
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool ReadWithOptions(const leveldb::ReadOptions& options, const K& key, V& value) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -182,7 +239,7 @@ public:
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(options, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -198,6 +255,23 @@ public:
         return true;
     }
 
+public:
+    /**
+     * @param[in] path        Location in the filesystem where leveldb data will be stored.
+     * @param[in] nCacheSize  Configures various leveldb cache settings.
+     * @param[in] fMemory     If true, use leveldb's memory environment.
+     * @param[in] fWipe       If true, remove all existing data.
+     * @param[in] nameIn      Name under which the database is tuned and reported (see DBTuning).
+     */
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, const std::string& nameIn = "");
+    ~CDBWrapper();
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const
+    {
+        return ReadWithOptions(readoptions, key, value);
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -235,6 +309,9 @@ public:
 
     bool WriteBatch(CDBBatch& batch, bool fSync = false);
 
+    //! Record whether level 0 is at the file count that LevelDB throttles writes on.
+    void SampleLevel0();
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
@@ -256,6 +333,37 @@ public:
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    DBStats GetStats() const;
+};
+
+/**
+ * Read-only view of a CDBWrapper as it was when the view was created. Writes
+ * made to the database afterwards are not visible through it, so a long scan
+ * can run without keeping the writers out. The database must outlive it.
+ */
+class CDBSnapshot
+{
+private:
+    const CDBWrapper &parent;
+    const leveldb::Snapshot *psnapshot;
+    leveldb::ReadOptions readoptions;
+    leveldb::ReadOptions iteroptions;
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper &_parent);
+    ~CDBSnapshot();
+
+    template <typename K, typename V>
+    bool Read(const K& key, V& value) const
+    {
+        return parent.ReadWithOptions(readoptions, key, value);
+    }
+
+    CDBIterator *NewIterator() const;
 };
 
 #endif // BITCOIN_DBWRAPPER_H
@@ -13,3 +13,55 @@ TEST(BlockTests, HeaderSizeIsExpected) {
 
     ASSERT_EQ(ss.size(), CBlockHeader::HEADER_SIZE);
 }
+
+TEST(BlockTests, CompactHeadersRoundTrip) {
+    std::vector<CBlockHeader> headers;
+    for (int i = 0; i < 5; i++) {
+        CBlockHeader header;
+        header.nVersion = i == 3 ? 5 : 4;
+        if (i > 0) {
+            header.hashPrevBlock = headers.back().GetHash();
+        }
+        header.hashMerkleRoot = uint256S(std::to_string(100 + i));
+        header.hashBlockCommitments = uint256S(std::to_string(200 + i));
+        // The times need not be increasing.
+        header.nTime = i == 2 ? 1000 : 1000 + 75 * i;
+        header.nBits = i < 2 ? 0x1f07ffff : 0x1f07fff0;
+        header.nNonce = uint256S(std::to_string(300 + i));
+        header.nSolution.assign(32, 0x10 + i);
+        headers.push_back(header);
+    }
+
+    CDataStream ssCompact(SER_NETWORK, PROTOCOL_VERSION);
+    ssCompact << CCompactHeaders(headers);
+    CDataStream ssFull(SER_NETWORK, PROTOCOL_VERSION);
+    ssFull << headers;
+    EXPECT_LT(ssCompact.size(), ssFull.size());
+
+    CCompactHeaders decoded;
+    ssCompact >> decoded;
+    EXPECT_TRUE(ssCompact.empty());
+    ASSERT_EQ(decoded.vHeaders.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        CDataStream ssExpected(SER_NETWORK, PROTOCOL_VERSION);
+        ssExpected << headers[i];
+        CDataStream ssDecoded(SER_NETWORK, PROTOCOL_VERSION);
+        ssDecoded << decoded.vHeaders[i];
+        EXPECT_EQ(ssExpected.str(), ssDecoded.str());
+    }
+}
+
+TEST(BlockTests, CompactHeadersRejectUnknownFlags) {
+    std::vector<CBlockHeader> headers(2);
+    headers[0].nSolution.assign(32, 1);
+    headers[1].nSolution.assign(32, 2);
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CCompactHeaders(headers);
+    // The flags byte of the second header follows the count and the first header.
+    size_t nFlagsPos = 1 + CBlockHeader::HEADER_SIZE + 1 + 32;
+    ss[nFlagsPos] = 0x80;
+
+    CCompactHeaders decoded;
+    EXPECT_THROW(ss >> decoded, std::ios_base::failure);
+}
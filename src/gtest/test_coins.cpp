@@ -845,6 +845,106 @@ TEST(CoinsTests, NullifiersTest)
 }
 
 
+TEST(CoinsTests, PrefetchTest)
+{
+    LoadProofParameters();
+
+    CCoinsViewTest base;
+    TxWithNullifiers txWithNullifiers;
+
+    // A transaction whose first output is spent below
+    CMutableTransaction mtxPrev;
+    mtxPrev.vout.resize(2);
+    mtxPrev.vout[0].nValue = 5;
+    mtxPrev.vout[1].nValue = 6;
+    CTransaction txPrev(mtxPrev);
+    {
+        CCoinsViewCacheTest cache(&base);
+        cache.ModifyNewCoins(txPrev.GetHash())->FromTx(txPrev, 1);
+        cache.SetNullifiers(txWithNullifiers.txV5, true);
+        cache.Flush();
+    }
+
+    CMutableTransaction mtxSpend;
+    mtxSpend.vin.resize(2);
+    mtxSpend.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    mtxSpend.vin[1].prevout = COutPoint(GetRandHash(), 0);
+    CTransaction txSpend(mtxSpend);
+
+    {
+        SCOPED_TRACE("prefetch into an empty cache");
+        CCoinsViewCacheTest cache(&base);
+        CCoinsPrefetch prefetch;
+        prefetch.AddTransaction(txSpend);
+        prefetch.AddTransaction(txWithNullifiers.txV5);
+        EXPECT_FALSE(prefetch.empty());
+        prefetch.Read(&base);
+        cache.AddPrefetched(prefetch);
+        cache.SelfTest();
+
+        // Only the coins that exist are added.
+        EXPECT_EQ(cache.GetCacheSize(), 1);
+        const CCoins* coins = cache.AccessCoins(txPrev.GetHash());
+        ASSERT_NE(coins, nullptr);
+        EXPECT_TRUE(coins->IsAvailable(0));
+        EXPECT_EQ(coins->vout[1].nValue, 6);
+        EXPECT_TRUE(cache.GetNullifier(txWithNullifiers.saplingNullifier, SAPLING));
+        EXPECT_TRUE(cache.GetNullifier(txWithNullifiers.orchardNullifier, ORCHARD));
+    }
+
+    {
+        SCOPED_TRACE("prefetch does not replace cached entries");
+        CCoinsViewCacheTest cache(&base);
+        cache.ModifyCoins(txPrev.GetHash())->Spend(0);
+        cache.SetNullifiers(txWithNullifiers.txV5, false);
+
+        CCoinsPrefetch prefetch;
+        prefetch.AddTransaction(txSpend);
+        prefetch.AddTransaction(txWithNullifiers.txV5);
+        prefetch.Read(&base);
+        cache.AddPrefetched(prefetch);
+        cache.SelfTest();
+
+        EXPECT_FALSE(cache.AccessCoins(txPrev.GetHash())->IsAvailable(0));
+        EXPECT_FALSE(cache.GetNullifier(txWithNullifiers.saplingNullifier, SAPLING));
+        EXPECT_FALSE(cache.GetNullifier(txWithNullifiers.orchardNullifier, ORCHARD));
+    }
+
+    {
+        SCOPED_TRACE("transactions created by the same block are skipped");
+        CCoinsViewCacheTest cache(&base);
+        CCoinsPrefetch prefetch;
+        prefetch.AddTransaction(txSpend);
+        prefetch.RemoveTxids({txPrev.GetHash(), mtxSpend.vin[1].prevout.hash});
+        EXPECT_TRUE(prefetch.empty());
+    }
+
+    {
+        SCOPED_TRACE("lookups that fail are not added");
+        class CCoinsViewFailing : public CCoinsViewTest {
+        public:
+            bool GetCoins(const uint256& txid, CCoins& coins) const override {
+                throw std::runtime_error("read failed");
+            }
+            bool GetNullifier(const uint256& nf, ShieldedType type) const override {
+                throw std::runtime_error("read failed");
+            }
+        } failing;
+        CCoinsViewTest unspentBase;
+        CCoinsViewCacheTest cache(&unspentBase);
+
+        CCoinsPrefetch prefetch;
+        prefetch.AddTransaction(txWithNullifiers.txV5);
+        prefetch.Read(&failing);
+        cache.AddPrefetched(prefetch);
+        cache.SelfTest();
+
+        EXPECT_FALSE(cache.GetNullifier(txWithNullifiers.saplingNullifier, SAPLING));
+        EXPECT_FALSE(cache.GetNullifier(txWithNullifiers.orchardNullifier, ORCHARD));
+    }
+}
+
+
 template<typename Tree> void anchorsFlushImpl(ShieldedType type)
 {
     CCoinsViewTest base;
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+
+#include "validationstats.h"
+
+TEST(ValidationStats, BucketsAreExactBelowSubBucketCount) {
+    for (int64_t n = 0; n < CLatencyHistogram::SUB_BUCKETS * 2; n++) {
+        size_t i = CLatencyHistogram::BucketIndex(n);
+        EXPECT_EQ(CLatencyHistogram::BucketUpperBound(i), n);
+    }
+}
+
+TEST(ValidationStats, BucketBoundsContainTheirValues) {
+    size_t nPrev = 0;
+    for (int64_t n = 1; n < (int64_t(1) << CLatencyHistogram::MAX_EXPONENT); n += n / 7 + 1) {
+        size_t i = CLatencyHistogram::BucketIndex(n);
+        ASSERT_LT(i, CLatencyHistogram::BUCKETS);
+        EXPECT_GE(i, nPrev);
+        EXPECT_GE(CLatencyHistogram::BucketUpperBound(i), n);
+        // Each bucket is within 1/SUB_BUCKETS of the values it holds.
+        EXPECT_LE(CLatencyHistogram::BucketUpperBound(i) - n, n / CLatencyHistogram::SUB_BUCKETS);
+        if (i > 0) {
+            EXPECT_LT(CLatencyHistogram::BucketUpperBound(i - 1), n);
+        }
+        nPrev = i;
+    }
+    EXPECT_EQ(CLatencyHistogram::BucketIndex(-5), 0);
+    EXPECT_EQ(CLatencyHistogram::BucketIndex(int64_t(1) << 50), CLatencyHistogram::BUCKETS - 1);
+}
+
+TEST(ValidationStats, Percentiles) {
+    CLatencyHistogram histogram;
+    EXPECT_EQ(histogram.GetSnapshot().Percentile(0.5), 0);
+
+    for (int64_t n = 1; n <= 1000; n++) {
+        histogram.Record(n);
+    }
+    auto snapshot = histogram.GetSnapshot();
+    EXPECT_EQ(snapshot.nCount, 1000);
+    EXPECT_EQ(snapshot.nTotal, 500500);
+    EXPECT_EQ(snapshot.nMax, 1000);
+
+    int64_t nMedian = snapshot.Percentile(0.5);
+    EXPECT_GE(nMedian, 500);
+    EXPECT_LE(nMedian, 500 + 500 / CLatencyHistogram::SUB_BUCKETS);
+    EXPECT_GE(snapshot.Percentile(0.99), 990);
+    // Never more than the largest recorded value
+    EXPECT_EQ(snapshot.Percentile(1.0), 1000);
+}
@@ -3,6 +3,7 @@
 #include "chainparams.h"
 #include "httpserver.h"
 #include "key_io.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -15,6 +16,8 @@
 
 #include <boost/algorithm/string.hpp> // boost::trim
 
+#include <event2/buffer.h>
+
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
@@ -77,6 +80,99 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     req->WriteReply(nStatus, strReply);
 }
 
+/** Amount of streamed JSON-RPC output to collect before it is sent as a chunk */
+static const size_t RPC_STREAM_CHUNK_SIZE = 64 * 1024;
+/** Amount of streamed JSON-RPC output that may wait to be written to the client */
+static const size_t RPC_STREAM_MAX_UNWRITTEN = 16 * RPC_STREAM_CHUNK_SIZE;
+
+/**
+ * Sink that sends a streamed JSON-RPC reply in chunks. Nothing is sent until
+ * RPC_STREAM_CHUNK_SIZE bytes have accumulated, so small results and errors
+ * raised early are still sent as an ordinary, non-chunked reply.
+ */
+class HTTPRPCStreamSink : public JSONStreamSink
+{
+private:
+    HTTPRequest* req;
+    std::string strPending;
+    bool fStarted;
+
+    void Flush()
+    {
+        if (!fStarted) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->StartReplyChunks(HTTP_OK);
+            fStarted = true;
+        }
+        struct evbuffer* chunk = evbuffer_new();
+        assert(chunk);
+        evbuffer_add(chunk, strPending.data(), strPending.size());
+        req->WriteReplyChunk(chunk);
+        strPending.clear();
+        // Don't produce output faster than the client reads it.
+        if (!req->WaitForReplyChunks(RPC_STREAM_MAX_UNWRITTEN))
+            throw std::runtime_error("client stopped reading the reply");
+    }
+
+public:
+    explicit HTTPRPCStreamSink(HTTPRequest* reqIn) : req(reqIn), fStarted(false)
+    {
+        strPending.reserve(RPC_STREAM_CHUNK_SIZE);
+    }
+
+    void Write(const char* data, size_t len) override
+    {
+        strPending.append(data, len);
+        if (strPending.size() >= RPC_STREAM_CHUNK_SIZE)
+            Flush();
+    }
+
+    /** Whether part of the reply is already on its way to the client. */
+    bool Started() const { return fStarted; }
+
+    /** Send whatever is still pending and complete the reply. */
+    void Finish()
+    {
+        if (!fStarted) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strPending);
+            return;
+        }
+        if (!strPending.empty())
+            Flush();
+        req->EndReplyChunks();
+    }
+};
+
+/** Execute a singleton request for a method with a streaming variant. */
+static bool HTTPReq_JSONRPCStreamed(HTTPRequest* req, const JSONRequest& jreq)
+{
+    HTTPRPCStreamSink sink(req);
+    JSONStreamWriter out(sink);
+    try {
+        // Same layout as JSONRPCReply
+        out.BeginObject();
+        out.Key("result");
+        tableRPC.executeStreaming(jreq.strMethod, jreq.params, out);
+        out.KV("error", NullUniValue);
+        out.KV("id", jreq.id);
+        out.EndObject();
+        sink.Write("\n", 1);
+        sink.Finish();
+    } catch (...) {
+        if (!sink.Started())
+            throw; // nothing sent yet, report the error as usual
+        // The status line and part of the result have already been sent, so
+        // the error can no longer be reported. Drop the connection without
+        // the final chunk, so the client can't mistake the result for a
+        // complete one.
+        LogPrintf("%s: %s failed after %u bytes of output\n", __func__, jreq.strMethod, out.BytesWritten());
+        req->AbortReplyChunks();
+        return false;
+    }
+    return true;
+}
+
 //This function checks username and password against -rpcauth
 //entries from config file.
 static bool multiUserAuthorized(std::string strUserPass)
@@ -178,6 +274,10 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            const CRPCCommand* pcmd = tableRPC[jreq.strMethod];
+            if (pcmd && pcmd->streamActor)
+                return HTTPReq_JSONRPCStreamed(req, jreq);
+
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
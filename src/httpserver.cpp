@@ -520,7 +520,9 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       nChunkBytesQueued(0),
+                                                       replySent(false),
+                                                       chunkedReplyStarted(false)
 {
 }
 HTTPRequest::~HTTPRequest()
@@ -528,7 +530,10 @@ HTTPRequest::~HTTPRequest()
     if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
-        WriteReply(HTTP_INTERNAL, "Unhandled request");
+        if (chunkedReplyStarted)
+            AbortReplyChunks(); // status line is already out; cut the body short
+        else
+            WriteReply(HTTP_INTERNAL, "Unhandled request");
     }
     // evhttpd cleans up the request, as long as a reply was sent.
 }
@@ -571,6 +576,22 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket once a reply has been handed to libevent.
+ * This is the second part of the libevent workaround in http_request_cb.
+ */
+static void ReenableReading(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -586,16 +607,139 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
+        ReenableReading(req_copy);
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+/** Progress of a chunked reply. The counters are only updated on the main
+ * http thread; the worker writing the reply waits on them.
+ */
+struct HTTPRequest::ChunkedReplyState
+{
+    Mutex cs;
+    std::condition_variable cond;
+    //! Bytes of the body handed to libevent (main http thread only)
+    size_t nHanded = 0;
+    //! Bytes of the body that libevent has written to the socket
+    size_t nWritten GUARDED_BY(cs) = 0;
+    //! Whether the connection was closed before the reply was complete
+    bool fClosed GUARDED_BY(cs) = false;
+};
+
+/** libevent callback for when the connection's output buffer has drained. */
+static void http_reply_chunk_written_cb(struct evhttp_connection*, void* arg)
+{
+    auto state = static_cast<HTTPRequest::ChunkedReplyState*>(arg);
+    LOCK(state->cs);
+    state->nWritten = state->nHanded;
+    state->cond.notify_all();
+}
+
+/** libevent callback for when the connection closes under a chunked reply. */
+static void http_reply_chunk_closed_cb(struct evhttp_connection*, void* arg)
+{
+    auto state = static_cast<HTTPRequest::ChunkedReplyState*>(arg);
+    LOCK(state->cs);
+    state->fClosed = true;
+    state->cond.notify_all();
+}
+
+/* The chunked reply calls below are queued to the main http thread like
+ * WriteReply. Activated events run in the order they were triggered, so the
+ * chunks reach libevent in order and after the start of the reply. The
+ * callbacks registered with libevent point at chunkState; they are removed
+ * by EndReplyChunks or AbortReplyChunks, whose closures keep it alive until
+ * then.
+ */
+void HTTPRequest::StartReplyChunks(int nStatus)
+{
+    assert(!replySent && !chunkedReplyStarted && req);
+    chunkState = std::make_shared<ChunkedReplyState>();
+    auto req_copy = req;
+    auto state = chunkState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus, state]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (!conn) {
+            http_reply_chunk_closed_cb(nullptr, state.get());
+            return;
+        }
+        evhttp_connection_set_closecb(conn, http_reply_chunk_closed_cb, state.get());
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(0);
+    chunkedReplyStarted = true;
+}
+
+void HTTPRequest::WriteReplyChunk(struct evbuffer* chunk)
+{
+    assert(!replySent && chunkedReplyStarted && req);
+    size_t nLen = evbuffer_get_length(chunk);
+    nChunkBytesQueued += nLen;
+    auto req_copy = req;
+    auto state = chunkState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, chunk, nLen, state]{
+        if (evhttp_request_get_connection(req_copy)) {
+            state->nHanded += nLen;
+            evhttp_send_reply_chunk_with_cb(req_copy, chunk, http_reply_chunk_written_cb, state.get());
+        }
+        evbuffer_free(chunk);
+    });
+    ev->trigger(0);
+}
+
+bool HTTPRequest::WaitForReplyChunks(size_t nMaxPending)
+{
+    assert(!replySent && chunkedReplyStarted && req);
+    const std::chrono::seconds timeout(GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    WAIT_LOCK(chunkState->cs, lock);
+    size_t nWritten = chunkState->nWritten;
+    while (!chunkState->fClosed && nChunkBytesQueued - chunkState->nWritten > nMaxPending) {
+        if (chunkState->cond.wait_for(lock, timeout) == std::cv_status::timeout) {
+            if (chunkState->nWritten == nWritten)
+                return false; // no progress
+            nWritten = chunkState->nWritten;
+        }
+    }
+    return !chunkState->fClosed;
+}
+
+void HTTPRequest::EndReplyChunks()
+{
+    assert(!replySent && chunkedReplyStarted && req);
+    auto req_copy = req;
+    auto state = chunkState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, state]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn)
+            evhttp_connection_set_closecb(conn, nullptr, nullptr);
+        // Also replaces the chunk written callback, or frees the request if
+        // the connection is already gone.
+        evhttp_send_reply_end(req_copy);
+        ReenableReading(req_copy);
+    });
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+void HTTPRequest::AbortReplyChunks()
+{
+    assert(!replySent && chunkedReplyStarted && req);
+    auto req_copy = req;
+    auto state = chunkState;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, state]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn) {
+            // Freeing the connection also frees the request, and does not
+            // send the zero-length chunk that would mark the body complete.
+            evhttp_connection_set_closecb(conn, nullptr, nullptr);
+            evhttp_connection_free(conn);
+        } else {
+            // The connection is already gone; this only frees the request.
+            evhttp_send_reply_end(req_copy);
         }
     });
     ev->trigger(0);
@@ -9,6 +9,7 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -53,12 +54,20 @@ struct event_base* EventBase();
  */
 class HTTPRequest
 {
+public:
+    struct ChunkedReplyState;
+
 private:
     struct evhttp_request* req;
+    //! Progress of a chunked reply, shared with the main http thread
+    std::shared_ptr<ChunkedReplyState> chunkState;
+    //! Bytes of the chunked reply body queued with WriteReplyChunk
+    size_t nChunkBytesQueued;
 
     // For test access
 protected:
     bool replySent;
+    bool chunkedReplyStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -114,6 +123,48 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     virtual void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start an HTTP reply whose body is sent incrementally, using chunked
+     * transfer encoding where the client supports it.
+     *
+     * @note Write all headers before calling this. Follow with any number of
+     * WriteReplyChunk calls and exactly one EndReplyChunks; WriteReply must not
+     * be called for this request.
+     */
+    virtual void StartReplyChunks(int nStatus);
+
+    /**
+     * Queue a chunk of the reply body. Takes ownership of chunk, which is freed
+     * on the main http thread once its contents have been handed to libevent.
+     */
+    virtual void WriteReplyChunk(struct evbuffer* chunk);
+
+    /**
+     * Wait until at most nMaxPending bytes of the chunks queued so far have
+     * not yet been written to the socket. Returns false if the connection was
+     * closed, or the client read nothing for -rpcservertimeout seconds, in
+     * which case the reply should be aborted.
+     */
+    virtual bool WaitForReplyChunks(size_t nMaxPending);
+
+    /**
+     * Finish a reply started with StartReplyChunks.
+     *
+     * @note As this will give the request back to the main thread, do not call
+     * any other HTTPRequest methods after calling this.
+     */
+    virtual void EndReplyChunks();
+
+    /**
+     * Abandon a reply started with StartReplyChunks, closing the connection
+     * without the terminating chunk so that the client can tell that the body
+     * is incomplete.
+     *
+     * @note As this will give the request back to the main thread, do not call
+     * any other HTTPRequest methods after calling this.
+     */
+    virtual void AbortReplyChunks();
 };
 
 /** Event handler closure.
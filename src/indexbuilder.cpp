@@ -0,0 +1,341 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "indexbuilder.h"
+
+#include "chainparams.h"
+#include "init.h"
+#include "main.h"
+#include "ui_interface.h"
+#include "undo.h"
+#include "util/system.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <boost/thread.hpp>
+
+CIndexBuilder* pindexBuilder = NULL;
+
+// The builder writes progress to the log at most this often while catching up.
+static const int64_t INDEX_BUILDER_LOG_INTERVAL = 30;
+
+static bool IndexBuilderError(const std::string& strMessage)
+{
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(
+        strprintf(_("Error: A fatal internal error occurred, see %s for details"), GetDebugLogPath()),
+        "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+    return false;
+}
+
+static bool ReadBlockAndUndo(const CBlockIndex* pindex, CBlock& block, CBlockUndo& blockUndo)
+{
+    if (!(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO))
+        return IndexBuilderError(strprintf(
+            "Block %s at height %d is not on disk (the block files have been pruned?); the indexes can only be rebuilt with -reindex",
+            pindex->GetBlockHash().ToString(), pindex->nHeight));
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return IndexBuilderError(strprintf("Failed to read block %s", pindex->GetBlockHash().ToString()));
+    if (!UndoReadFromDisk(blockUndo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()))
+        return IndexBuilderError(strprintf("Failed to read undo data for block %s", pindex->GetBlockHash().ToString()));
+    return true;
+}
+
+void GetInsightIndexEntries(const CBlock& block, const CBlockUndo& blockUndo, int nHeight,
+                            bool fConnect, CInsightIndexEntries& entries)
+{
+    // Disconnecting visits the transactions and their outputs and inputs in
+    // the reverse order, so that an output created and spent in the same
+    // block ends up absent from the unspent index either way.
+    auto addOutputs = [&](const CTransaction& tx, const uint256& hash, int i) {
+        if (!fAddressIndex)
+            return;
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            unsigned int n = fConnect ? k : tx.vout.size() - 1 - k;
+            const CTxOut &out = tx.vout[n];
+            CScript::ScriptType scriptType = out.scriptPubKey.GetType();
+            if (scriptType == CScript::UNKNOWN)
+                continue;
+            uint160 const addrHash = out.scriptPubKey.AddressHash();
+
+            // receiving activity
+            entries.addressIndex.push_back(std::make_pair(
+                CAddressIndexKey(scriptType, addrHash, nHeight, i, hash, n, false),
+                out.nValue));
+
+            // unspent output
+            entries.addressUnspentIndex.push_back(std::make_pair(
+                CAddressUnspentKey(scriptType, addrHash, hash, n),
+                fConnect ? CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight) : CAddressUnspentValue()));
+        }
+    };
+    auto addInputs = [&](const CTransaction& tx, const uint256& hash, int i) {
+        const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+        for (unsigned int k = 0; k < tx.vin.size(); k++) {
+            unsigned int j = fConnect ? k : tx.vin.size() - 1 - k;
+            const CTxIn &input = tx.vin[j];
+            const CTxInUndo &undo = txundo.vprevout[j];
+            const CTxOut &prevout = undo.txout;
+            CScript::ScriptType scriptType = prevout.scriptPubKey.GetType();
+            const uint160 addrHash = prevout.scriptPubKey.AddressHash();
+            if (fAddressIndex && scriptType != CScript::UNKNOWN) {
+                // spending activity
+                entries.addressIndex.push_back(std::make_pair(
+                    CAddressIndexKey(scriptType, addrHash, nHeight, i, hash, j, true),
+                    prevout.nValue * -1));
+
+                // the spent output leaves (or returns to) the unspent index
+                entries.addressUnspentIndex.push_back(std::make_pair(
+                    CAddressUnspentKey(scriptType, addrHash, input.prevout.hash, input.prevout.n),
+                    fConnect ? CAddressUnspentValue() : CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
+            }
+            if (fSpentIndex) {
+                // If we do not recognize the script type, we still add an entry to the
+                // spentindex db, with a script type of 0 and addrhash of all zeroes.
+                entries.spentIndex.push_back(std::make_pair(
+                    CSpentIndexKey(input.prevout.hash, input.prevout.n),
+                    fConnect ? CSpentIndexValue(hash, j, nHeight, prevout.nValue, scriptType, addrHash) : CSpentIndexValue()));
+            }
+        }
+    };
+
+    for (size_t k = 0; k < block.vtx.size(); k++) {
+        int i = fConnect ? k : block.vtx.size() - 1 - k;
+        const CTransaction &tx = block.vtx[i];
+        uint256 const hash = tx.GetHash();
+        if (fConnect) {
+            if (i > 0)
+                addInputs(tx, hash, i);
+            addOutputs(tx, hash, i);
+        } else {
+            addOutputs(tx, hash, i);
+            if (i > 0)
+                addInputs(tx, hash, i);
+        }
+    }
+}
+
+CIndexBuilder::CIndexBuilder(int nBatchBlocksIn, int64_t nThrottleIn) :
+    pindexBest(nullptr), fSynced(false), fTipChanged(false),
+    nBatchBlocks(std::max(nBatchBlocksIn, 1)), nThrottle(std::max<int64_t>(nThrottleIn, 0))
+{
+}
+
+bool CIndexBuilder::Init()
+{
+    LOCK(cs_main);
+
+    CBlockLocator locator;
+    const CBlockIndex* pindex;
+    if (!pblocktree->ReadIndexBuilderBestBlock(locator)) {
+        // Indexes created before the builder existed were written while
+        // connecting blocks, and so are in step with the chain tip.
+        pindex = chainActive.Tip();
+    } else if (locator.IsNull()) {
+        pindex = nullptr;
+    } else {
+        BlockMap::iterator mi = mapBlockIndex.find(locator.vHave[0]);
+        if (mi != mapBlockIndex.end()) {
+            pindex = mi->second;
+        } else {
+            pindex = FindForkInGlobalIndex(chainActive, locator);
+        }
+    }
+    if (pindex) {
+        LogPrintf("%s: indexes are at height %d (%s), chain tip at height %d\n", __func__,
+                  pindex->nHeight, pindex->GetBlockHash().GetHex(), chainActive.Height());
+    } else {
+        LogPrintf("%s: indexes will be built from the genesis block\n", __func__);
+    }
+    SetBestBlock(pindex);
+    return true;
+}
+
+void CIndexBuilder::SetBestBlock(const CBlockIndex* pindex)
+{
+    {
+        LOCK(cs_builder);
+        pindexBest = pindex;
+    }
+    condBuilder.notify_all();
+}
+
+bool CIndexBuilder::IsSynced() const
+{
+    LOCK(cs_builder);
+    return fSynced;
+}
+
+int CIndexBuilder::GetBestHeight() const
+{
+    LOCK(cs_builder);
+    return pindexBest ? pindexBest->nHeight : -1;
+}
+
+void CIndexBuilder::UpdatedBlockTip(const CBlockIndex *pindex)
+{
+    {
+        LOCK(cs_builder);
+        fTipChanged = true;
+    }
+    condBuilder.notify_all();
+}
+
+bool CIndexBuilder::BlockUntilSyncedToCurrentChain()
+{
+    AssertLockNotHeld(cs_main);
+
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+    }
+
+    WAIT_LOCK(cs_builder, lock);
+    if (!fSynced)
+        return false;
+    fTipChanged = true;
+    condBuilder.notify_all();
+    while (!ShutdownRequested()) {
+        // The chain may have moved on since we looked at it; indexing past
+        // the tip we saw is good enough.
+        if (pindexTip == nullptr ||
+            (pindexBest && pindexBest->GetAncestor(pindexTip->nHeight) == pindexTip))
+            break;
+        condBuilder.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    return true;
+}
+
+bool CIndexBuilder::WriteEntries(const CInsightIndexEntries& entries, bool fConnect, const CBlockIndex* pindex)
+{
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindex);
+    }
+    if (!pblocktree->WriteInsightIndexEntries(entries, fConnect, locator))
+        return IndexBuilderError("Failed to write index entries");
+    SetBestBlock(pindex);
+    return true;
+}
+
+bool CIndexBuilder::ConnectBlocks(const std::vector<const CBlockIndex*>& vBlocks)
+{
+    // Logical timestamps must increase, so each block's depends on its
+    // predecessor's.
+    unsigned int prevLogicalTS = 0;
+    if (fTimestampIndex && vBlocks.front()->pprev)
+        if (!pblocktree->ReadTimestampBlockIndex(vBlocks.front()->pprev->GetBlockHash(), prevLogicalTS))
+            LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+    CInsightIndexEntries entries;
+    for (const CBlockIndex* pindex : vBlocks) {
+        boost::this_thread::interruption_point();
+
+        // The genesis block's outputs are not in the UTXO set, and it has no
+        // undo data.
+        if (pindex->pprev == nullptr)
+            continue;
+
+        if (fAddressIndex || fSpentIndex) {
+            CBlock block;
+            CBlockUndo blockUndo;
+            if (!ReadBlockAndUndo(pindex, block, blockUndo))
+                return false;
+            GetInsightIndexEntries(block, blockUndo, pindex->nHeight, true, entries);
+        }
+
+        if (fTimestampIndex) {
+            unsigned int logicalTS = pindex->nTime;
+            if (logicalTS <= prevLogicalTS) {
+                logicalTS = prevLogicalTS + 1;
+                LogPrint("indexbuilder", "%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n",
+                         __func__, pindex->nTime, prevLogicalTS, logicalTS);
+            }
+            entries.timestampIndex.push_back(CTimestampIndexKey(logicalTS, pindex->GetBlockHash()));
+            prevLogicalTS = logicalTS;
+        }
+    }
+    return WriteEntries(entries, true, vBlocks.back());
+}
+
+bool CIndexBuilder::DisconnectBlock(const CBlockIndex* pindex)
+{
+    // Timestamp index entries of disconnected blocks are kept, as they were
+    // when the indexes were maintained in DisconnectBlock; queries for active
+    // blocks only filter them out.
+    CInsightIndexEntries entries;
+    if (pindex->pprev && (fAddressIndex || fSpentIndex)) {
+        CBlock block;
+        CBlockUndo blockUndo;
+        if (!ReadBlockAndUndo(pindex, block, blockUndo))
+            return false;
+        GetInsightIndexEntries(block, blockUndo, pindex->nHeight, false, entries);
+    }
+    LogPrint("indexbuilder", "%s: disconnected block %s at height %d\n", __func__,
+             pindex->GetBlockHash().ToString(), pindex->nHeight);
+    return WriteEntries(entries, false, pindex->pprev);
+}
+
+void CIndexBuilder::ThreadSync()
+{
+    int64_t nLastLog = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        // Find the blocks to roll back and the next batch to add.
+        std::vector<const CBlockIndex*> vDisconnect;
+        std::vector<const CBlockIndex*> vConnect;
+        bool fCaughtUp;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindex;
+            {
+                LOCK(cs_builder);
+                pindex = pindexBest;
+                fTipChanged = false;
+            }
+            const CBlockIndex* pindexFork = pindex ? chainActive.FindFork(pindex) : nullptr;
+            for (; pindex != pindexFork; pindex = pindex->pprev)
+                vDisconnect.push_back(pindex);
+            const CBlockIndex* pindexNext = pindexFork ? chainActive.Next(pindexFork) : chainActive.Genesis();
+            while (pindexNext && vConnect.size() < (size_t)nBatchBlocks) {
+                vConnect.push_back(pindexNext);
+                pindexNext = chainActive.Next(pindexNext);
+            }
+            fCaughtUp = pindexNext == nullptr;
+        }
+
+        for (const CBlockIndex* pindex : vDisconnect) {
+            if (!DisconnectBlock(pindex))
+                return;
+        }
+        if (!vConnect.empty() && !ConnectBlocks(vConnect))
+            return;
+
+        bool fWasSynced = IsSynced();
+        if (!fWasSynced && (fCaughtUp || GetTime() - nLastLog >= INDEX_BUILDER_LOG_INTERVAL)) {
+            LogPrintf("%s: indexed blocks up to height %d\n", __func__, GetBestHeight());
+            nLastLog = GetTime();
+        }
+
+        if (fCaughtUp) {
+            WAIT_LOCK(cs_builder, lock);
+            if (!fSynced) {
+                fSynced = true;
+                LogPrintf("%s: indexes are in sync with the chain tip\n", __func__);
+            }
+            condBuilder.notify_all();
+            // Wait for the next tip notification; the timeout catches up
+            // during initial block download, when no notifications are sent.
+            if (!fTipChanged)
+                condBuilder.wait_for(lock, std::chrono::seconds(1));
+        } else if (!fWasSynced && nThrottle > 0) {
+            MilliSleep(nThrottle);
+        }
+    }
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_INDEXBUILDER_H
+#define BITCOIN_INDEXBUILDER_H
+
+#include "addressindex.h"
+#include "spentindex.h"
+#include "sync.h"
+#include "timestampindex.h"
+#include "txdb.h"
+#include "validationinterface.h"
+
+#include <condition_variable>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+
+/** Default number of blocks whose index entries are written in one batch. */
+static const int DEFAULT_INDEX_BATCH_BLOCKS = 100;
+/** Default pause between batches while the indexes catch up, in milliseconds. */
+static const int64_t DEFAULT_INDEX_THROTTLE = 0;
+
+/**
+ * Address, address unspent, spent and timestamp index entries for a run of
+ * blocks, in the order they must be applied.
+ */
+struct CInsightIndexEntries
+{
+    std::vector<CAddressIndexDbEntry> addressIndex;
+    std::vector<CAddressUnspentDbEntry> addressUnspentIndex;
+    std::vector<CSpentIndexDbEntry> spentIndex;
+    std::vector<CTimestampIndexKey> timestampIndex;
+
+    bool empty() const {
+        return addressIndex.empty() && addressUnspentIndex.empty() &&
+               spentIndex.empty() && timestampIndex.empty();
+    }
+};
+
+/**
+ * Compute the address, address unspent and spent index entries that
+ * connecting (or disconnecting) a block adds (or removes). The previous
+ * outputs are taken from the block's undo data, so this does not need the
+ * UTXO set and can run on any block that has been connected once.
+ */
+void GetInsightIndexEntries(const CBlock& block, const CBlockUndo& blockUndo, int nHeight,
+                            bool fConnect, CInsightIndexEntries& entries);
+
+/**
+ * Maintains the insightexplorer and lightwalletd indexes (the address,
+ * spent and timestamp indexes) on a background thread, off the block
+ * connection path.
+ *
+ * The builder keeps its own best block, stored as a locator in the block
+ * tree database. When it is behind the active chain (for example because
+ * the indexes were just enabled on an existing node) it catches up from the
+ * block and undo files in batches, optionally pausing between batches. Once
+ * it has caught up it follows the tip, woken by UpdatedBlockTip, and rolls
+ * back blocks that have been disconnected by a reorg using their undo data.
+ */
+class CIndexBuilder : public CValidationInterface
+{
+private:
+    mutable Mutex cs_builder;
+    std::condition_variable condBuilder;
+
+    //! The last block whose entries have been written. Guarded by cs_builder.
+    const CBlockIndex* pindexBest;
+    //! Whether the builder has caught up with the active chain at least once.
+    bool fSynced;
+    //! Set when the tip changes, to wake the builder thread.
+    bool fTipChanged;
+
+    const int nBatchBlocks;
+    const int64_t nThrottle;
+
+    void SetBestBlock(const CBlockIndex* pindex);
+    bool WriteEntries(const CInsightIndexEntries& entries, bool fConnect, const CBlockIndex* pindex);
+    bool ConnectBlocks(const std::vector<const CBlockIndex*>& vBlocks);
+    bool DisconnectBlock(const CBlockIndex* pindex);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindex) override;
+
+public:
+    CIndexBuilder(int nBatchBlocksIn, int64_t nThrottleIn);
+
+    /**
+     * Load the builder's best block from the block tree database. Must be
+     * called after the block index has been loaded and before any block is
+     * connected. Returns false if the stored locator cannot be read.
+     */
+    bool Init();
+
+    /** Body of the builder thread. Returns only on interruption or error. */
+    void ThreadSync();
+
+    bool IsSynced() const;
+    int GetBestHeight() const;
+
+    /**
+     * Wait until the indexes include the current chain tip. Returns false
+     * immediately, without waiting, if the builder is still catching up.
+     * Must not be called with cs_main held.
+     */
+    bool BlockUntilSyncedToCurrentChain();
+};
+
+/** The index builder, or NULL if no indexes are enabled. */
+extern CIndexBuilder* pindexBuilder;
+
+#endif // BITCOIN_INDEXBUILDER_H
@@ -22,10 +22,12 @@
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexbuilder.h"
 #include "key.h"
 #ifdef ENABLE_MINING
 #include "key_io.h"
 #endif
+#include "lockprofile.h"
 #include "main.h"
 #include "mempool_limit.h"
 #include "metrics.h"
@@ -37,6 +39,7 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "snapshot.h"
 #include "txdb.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
@@ -174,7 +177,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 
 void Interrupt(boost::thread_group& threadGroup)
@@ -254,6 +256,8 @@ void Shutdown()
     }
 #endif
     UnregisterAllValidationInterfaces();
+    delete pindexBuilder;
+    pindexBuilder = NULL;
 #ifdef ENABLE_WALLET
     delete pwalletMain;
     pwalletMain = NULL;
@@ -344,9 +348,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory (this path cannot use '~')"));
     strUsage += HelpMessageOpt("-paramsdir=<dir>", _("Specify Juno Cash network parameters directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dboption=<db>:<key>=<n>", _("Tune a LevelDB database; <db> is chainstate or blockindex (which also holds the transaction, address, spent and timestamp indexes). "
+            "Keys: maxopenfiles (>= 16, default: 64), bloombits (0 to 32, default: 10), compression (0 or 1, default: 0), "
+            "writebuffer (percentage of the database cache per write buffer, 5 to 45, default: 25; the rest is block cache). Can be specified multiple times"));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)"), DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-exportdir=<dir>", _("Specify directory to be used when exporting data"));
     strUsage += HelpMessageOpt("-ibdskiptxverification", strprintf(_("Skip transaction verification during initial block download up to the last checkpoint height. Incompatible with flags that disable checkpoints. (default = %u)"), DEFAULT_IBD_SKIP_TX_VERIFICATION));
+    strUsage += HelpMessageOpt("-indexbatchsize=<n>", strprintf(_("Number of blocks whose address, spent and timestamp index entries are written in one batch (default: %u)"), DEFAULT_INDEX_BATCH_BLOCKS));
+    strUsage += HelpMessageOpt("-indexthrottle=<n>", strprintf(_("Pause for <n> milliseconds between batches while the address, spent and timestamp indexes are being built (default: %u)"), DEFAULT_INDEX_THROTTLE));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
@@ -357,6 +366,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode disables wallet support and is incompatible with -txindex. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-prunekeepblocks=<n>", strprintf(_("With -prune, keep at least the last <n> blocks so that they can be served to peers. "
+            "Above %u, the undo data of older blocks is deleted before any blocks are (default: %u)"), MIN_BLOCKS_TO_KEEP, MIN_BLOCKS_TO_KEEP));
 #ifdef ENABLE_WALLET
     strUsage += HelpMessageOpt("-skipwalletinit", _("Create wallet without generating seed (for wallet recovery with z_recoverwallet)"));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks (implies -rescan)"));
@@ -375,6 +386,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), DEFAULT_BANSCORE_THRESHOLD));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), DEFAULT_MISBEHAVING_BANTIME));
+    strUsage += HelpMessageOpt("-blockpushpeer=<netmask>", _("Send new blocks in full, without waiting for a request, to peers connecting from the given netmask or IP address. Can be specified multiple times"));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s); -noconnect or -connect=0 alone to disable automatic connections"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
@@ -431,6 +443,8 @@ std::string HelpMessage(HelpMessageMode mode)
             "An HTTP listener will be started on <port>, which responds to GET requests on any request path. "
             "Use -metricsallowip and -metricsbind to control access."));
     strUsage += HelpMessageOpt("-debugmetrics", _("Include debug metrics in exposed node metrics."));
+    strUsage += HelpMessageOpt("-lockprofilerate=<n>", strprintf(_("Record the time spent waiting for every contended lock, and how long one in every <n> locks is held, "
+            "for getlockstats and the exposed node metrics (0 to disable, default: %u)"), DEFAULT_LOCK_PROFILE_SAMPLE_RATE));
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
     strUsage += HelpMessageOpt("-uacomment=<cmt>", _("Append comment to the user agent string"));
@@ -444,6 +458,9 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
         strUsage += HelpMessageOpt("-fuzzmessagestest=<n>", "Randomly fuzz 1 of every <n> network messages");
         strUsage += HelpMessageOpt("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT));
+        strUsage += HelpMessageOpt("-loadsnapshot=<file>", "Experimental: bootstrap an empty datadir from a UTXO snapshot written by dumpsnapshot. "
+            "The chain below the snapshot is trusted, not validated. Requires -prune and -snapshothash");
+        strUsage += HelpMessageOpt("-snapshothash=<hex>", "Commitment that the snapshot given to -loadsnapshot must match, as reported by dumpsnapshot");
         strUsage += HelpMessageOpt("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT));
         strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
@@ -529,6 +546,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 8232, 18232));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the number of threads used to execute read-only elements of JSON-RPC batch requests in parallel, 0 = execute batches sequentially (default: %d)"), DEFAULT_RPC_BATCH_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
@@ -642,6 +660,11 @@ void CleanupBlockRevFiles()
     }
 }
 
+void ThreadIndexBuilder()
+{
+    pindexBuilder->ThreadSync();
+}
+
 void ThreadStartWalletNotifier()
 {
     CBlockIndex *pindexLastTip{nullptr};
@@ -1173,6 +1196,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    int64_t nLockProfileRate = GetArg("-lockprofilerate", DEFAULT_LOCK_PROFILE_SAMPLE_RATE);
+    if (nLockProfileRate < 0 || nLockProfileRate > std::numeric_limits<unsigned int>::max()) {
+        return InitError(strprintf(_("Invalid -lockprofilerate=<n>: '%d'"), nLockProfileRate));
+    }
+    g_lock_profile_sample_rate = nLockProfileRate;
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -1188,6 +1217,23 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
         fPruneMode = true;
     }
+    if (mapArgs.count("-prunekeepblocks")) {
+        if (!fPruneMode)
+            return InitError(_("-prunekeepblocks requires -prune."));
+        int64_t nKeepBlocks = GetArg("-prunekeepblocks", MIN_BLOCKS_TO_KEEP);
+        if (nKeepBlocks < MIN_BLOCKS_TO_KEEP || nKeepBlocks > std::numeric_limits<int>::max())
+            return InitError(strprintf(_("-prunekeepblocks must be at least %u."), MIN_BLOCKS_TO_KEEP));
+        nPruneKeepBlocks = nKeepBlocks;
+        LogPrintf("Prune configured to keep the last %u blocks.\n", nPruneKeepBlocks);
+    }
+
+    if (mapArgs.count("-loadsnapshot")) {
+        if (!fPruneMode)
+            return InitError(_("-loadsnapshot requires -prune, as no block data exists below the snapshot."));
+        std::string strSnapshotHash = GetArg("-snapshothash", "");
+        if (strSnapshotHash.size() != 64 || !IsHex(strSnapshotHash))
+            return InitError(_("-loadsnapshot requires -snapshothash to be set to the 64-character snapshot commitment."));
+    }
 
     RegisterAllCoreRPCCommands(tableRPC);
 #ifdef ENABLE_WALLET
@@ -1538,13 +1584,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadValidationTasks);
+        }
     }
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    scheduler.scheduleEvery(&SampleDBStats, DBWRAPPER_STATS_SAMPLE_INTERVAL);
 
     // Count uptime
     MarkStartTime();
@@ -1571,6 +1620,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         if (!metrics_run(metricsBindCstr, vAllowCstr.data(), vAllowCstr.size(), prometheusPort, debugMetrics)) {
             return InitError(strprintf(_("Failed to start Prometheus metrics exporter")));
         }
+
+        if (g_lock_profile_sample_rate > 0) {
+            scheduler.scheduleEvery(&ExportLockProfileMetrics, LOCK_PROFILE_METRICS_INTERVAL);
+        }
     }
 
     // Expose binary metadata to metrics, using a single time series with value 1.
@@ -1655,6 +1708,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    if (mapArgs.count("-blockpushpeer")) {
+        for (const std::string& net : mapMultiArgs["-blockpushpeer"]) {
+            CSubNet subnet(net);
+            if (!subnet.IsValid())
+                return InitError(strprintf(_("Invalid netmask specified in -blockpushpeer: '%s'"), net));
+            AddBlockPushRange(subnet);
+        }
+    }
+
     bool proxyRandomize = GetBoolArg("-proxyrandomize", DEFAULT_PROXYRANDOMIZE);
     // -proxy sets a proxy for all outgoing network traffic
     // -noproxy (or -proxy=0) as well as the empty string can be used to not set a proxy, this is the default
@@ -1753,6 +1815,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     fs::create_directories(GetDataDir() / "blocks");
 
+    std::string strDBOptionError;
+    if (!DBTuning::CheckArgs(strDBOptionError))
+        return InitError(strDBOptionError);
+
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
@@ -1814,6 +1880,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 bool randomxHugePages = GetBoolArg("-randomxhugepages", false);
                 RandomX_Init(randomxFastMode, randomxHugePages);
 
+                if (mapArgs.count("-loadsnapshot") && !fReindex) {
+                    uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+                    if (!LoadSnapshot(chainparams, *pcoinsdbview, *pblocktree,
+                            GetArg("-loadsnapshot", ""), uint256S(GetArg("-snapshothash", "")))) {
+                        strLoadError = _("Error loading UTXO snapshot");
+                        break;
+                    }
+                    // TODO: download and validate the blocks below the
+                    // snapshot base in the background. Until then the
+                    // snapshot is only as trustworthy as -snapshothash.
+                    InitWarning(_("The chain below the loaded UTXO snapshot has not been validated by this node. Only use snapshots from a source you trust."));
+                }
+
                 if (!LoadBlockIndex()) {
                     strLoadError = _("Error loading block database");
                     break;
@@ -1838,21 +1917,29 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
-                // Check for changed -insightexplorer state
+                // Check for changed -insightexplorer and -lightwalletd state.
+                // Their indexes can be added to an existing database, in which
+                // case the index builder creates them in the background, but
+                // removing them requires a rebuild.
                 bool fInsightExplorerPreviouslySet = false;
                 pblocktree->ReadFlag("insightexplorer", fInsightExplorerPreviouslySet);
-                if (fExperimentalInsightExplorer != fInsightExplorerPreviouslySet) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -insightexplorer");
+                if (fInsightExplorerPreviouslySet && !fExperimentalInsightExplorer) {
+                    strLoadError = _("You need to rebuild the database using -reindex to turn off -insightexplorer");
                     break;
                 }
-
-                // Check for changed -lightwalletd state
                 bool fLightWalletdPreviouslySet = false;
                 pblocktree->ReadFlag("lightwalletd", fLightWalletdPreviouslySet);
-                if (fExperimentalLightWalletd != fLightWalletdPreviouslySet) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -lightwalletd");
+                if (fLightWalletdPreviouslySet && !fExperimentalLightWalletd) {
+                    strLoadError = _("You need to rebuild the database using -reindex to turn off -lightwalletd");
                     break;
                 }
+                if (fExperimentalInsightExplorer != fInsightExplorerPreviouslySet ||
+                    fExperimentalLightWalletd != fLightWalletdPreviouslySet) {
+                    if (!EnableInsightIndexes(fExperimentalInsightExplorer, fExperimentalLightWalletd)) {
+                        strLoadError = _("Error enabling the address, spent and timestamp indexes");
+                        break;
+                    }
+                }
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
@@ -2035,6 +2122,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 #endif // ENABLE_MINING
 
+    // Maintain the address, spent and timestamp indexes in the background.
+    if (fAddressIndex || fSpentIndex || fTimestampIndex) {
+        pindexBuilder = new CIndexBuilder(
+            GetArg("-indexbatchsize", DEFAULT_INDEX_BATCH_BLOCKS),
+            GetArg("-indexthrottle", DEFAULT_INDEX_THROTTLE));
+        if (!pindexBuilder->Init())
+            return InitError(_("Error loading the index builder state from the block database"));
+        RegisterValidationInterface(pindexBuilder);
+        threadGroup.create_thread(
+            boost::bind(&TraceThread<void (*)()>, "indexbuilder", &ThreadIndexBuilder)
+        );
+    }
+
     // Spawn a thread that will wait for the chain state needed for
     // ThreadNotifyWallets to become available.
     threadGroup.create_thread(
@@ -2046,8 +2146,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // if pruning, unset the service bit and perform the initial blockstore prune
     // after any wallet rescanning has taken place.
     if (fPruneMode) {
-        LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
+        LogPrintf("Unsetting NODE_NETWORK and setting NODE_NETWORK_LIMITED on prune mode\n");
         nLocalServices &= ~NODE_NETWORK;
+        nLocalServices |= NODE_NETWORK_LIMITED;
         if (!fReindex) {
             uiInterface.InitMessage(_("Pruning blockstore..."));
             PruneAndFlush();
@@ -2125,6 +2226,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl(threadGroup, scheduler);
 
+    // Connect blocks received from peers off the message handler thread.
+    threadGroup.create_thread(
+        boost::bind(&TraceThread<void (*)()>, "blockvalidation", &ThreadBlockValidation)
+    );
+
     StartNode(threadGroup, scheduler);
 
 #ifdef ENABLE_MINING
@@ -0,0 +1,55 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "lockprofile.h"
+
+#include "tinyformat.h"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <tuple>
+
+#include <rust/metrics.h>
+
+static void SortLockSites(std::vector<CLockSiteStats>& vStats, size_t nCount, bool fByHold)
+{
+    nCount = std::min(nCount, vStats.size());
+    std::partial_sort(vStats.begin(), vStats.begin() + nCount, vStats.end(),
+        [fByHold](const CLockSiteStats& a, const CLockSiteStats& b) {
+            if (fByHold)
+                return a.nHoldMicros > b.nHoldMicros;
+            return a.nWaitMicros > b.nWaitMicros;
+        });
+    vStats.resize(nCount);
+}
+
+std::vector<CLockSiteStats> GetTopLockSites(size_t nCount, bool fByHold)
+{
+    std::vector<CLockSiteStats> vStats = GetLockProfile();
+    SortLockSites(vStats, nCount, fByHold);
+    return vStats;
+}
+
+void ExportLockProfileMetrics()
+{
+    std::vector<CLockSiteStats> vStats = GetLockProfile();
+    std::vector<CLockSiteStats> vByWait = vStats;
+    SortLockSites(vByWait, LOCK_PROFILE_METRICS_SITES, false);
+    SortLockSites(vStats, LOCK_PROFILE_METRICS_SITES, true);
+    vStats.insert(vStats.end(), vByWait.begin(), vByWait.end());
+
+    std::set<std::tuple<std::string, std::string, int>> setExported;
+    for (const CLockSiteStats& stats : vStats) {
+        if (!setExported.insert(std::make_tuple(stats.strName, stats.strFile, stats.nLine)).second)
+            continue;
+        std::string strSite = strprintf("%s:%d", stats.strFile, stats.nLine);
+        MetricsGauge("zcash.sync.lock.contentions", stats.nContentions,
+            "lock", stats.strName.c_str(), "site", strSite.c_str());
+        MetricsGauge("zcash.sync.lock.wait.seconds", stats.nWaitMicros * 0.000001,
+            "lock", stats.strName.c_str(), "site", strSite.c_str());
+        MetricsGauge("zcash.sync.lock.hold.seconds", stats.GetEstimatedHoldMicros() * 0.000001,
+            "lock", stats.strName.c_str(), "site", strSite.c_str());
+    }
+}
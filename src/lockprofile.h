@@ -0,0 +1,31 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_LOCKPROFILE_H
+#define BITCOIN_LOCKPROFILE_H
+
+#include "sync.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Seconds between exports of the lock profile as metrics. */
+static const int64_t LOCK_PROFILE_METRICS_INTERVAL = 10;
+/** The number of lock sites exported as metrics, by wait and by hold time each. */
+static const size_t LOCK_PROFILE_METRICS_SITES = 20;
+
+/**
+ * The nCount lock sites that spent the most time waiting for their locks,
+ * or, if fByHold, that held their locks the longest.
+ */
+std::vector<CLockSiteStats> GetTopLockSites(size_t nCount, bool fByHold);
+
+/**
+ * Export the top lock sites by wait and by hold time as the
+ * zcash.sync.lock.* metrics, labelled by lock and site.
+ */
+void ExportLockProfileMetrics();
+
+#endif // BITCOIN_LOCKPROFILE_H
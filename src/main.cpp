@@ -18,8 +18,10 @@
 #include "consensus/merkle.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
+#include "crypto/randomx_wrapper.h"
 #include "deprecation.h"
 #include "experimental_features.h"
+#include "indexbuilder.h"
 #include "init.h"
 #include "key_io.h"
 #include "merkleblock.h"
@@ -35,6 +37,7 @@
 #include "util/system.h"
 #include "util/moneystr.h"
 #include "validationinterface.h"
+#include "validationstats.h"
 #include "wallet/asyncrpcoperation_sendmany.h"
 #include "wallet/asyncrpcoperation_shieldcoinbase.h"
 #include "warnings.h"
@@ -42,7 +45,13 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <sstream>
+#include <thread>
 #include <variant>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -103,6 +112,7 @@ bool fIBDSkipTxVerification = DEFAULT_IBD_SKIP_TX_VERIFICATION;
 bool fCoinbaseEnforcedShieldingEnabled = true;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
+unsigned int nPruneKeepBlocks = MIN_BLOCKS_TO_KEEP;
 bool fAlerts = DEFAULT_ALERTS;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -355,6 +365,10 @@ struct CNodeState {
     bool fSyncStarted;
     //! When we started headers sync with this peer (microseconds), for stall detection.
     int64_t nHeadersSyncStarted;
+    //! Whether we sent the peer a getheaders that it has not answered yet.
+    bool fGetHeadersOutstanding;
+    //! Number of headers announcements in a row that did not connect to our block index.
+    int nUnconnectingHeaders;
     //! Since when we're stalling block download progress (in microseconds), or 0.
     int64_t nStallingSince;
     list<QueuedBlock> vBlocksInFlight;
@@ -362,6 +376,40 @@ struct CNodeState {
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether the peer asked for its headers as "cheaders" messages.
+    bool fPreferCompactHeaders;
+    //! Smoothed rate in bytes per second at which the peer delivers the blocks we request, or 0 if unknown.
+    double dBlockDownloadRate;
+    //! Smoothed size of the blocks we requested from the peer.
+    double dBlockSizeAverage;
+    //! Total size of the blocks we requested from the peer and it delivered.
+    uint64_t nBlockBytesReceived;
+    //! When the peer last delivered a block we requested (in microseconds), or 0.
+    int64_t nLastBlockReceived;
+    //! The peer's last measured ping time (in microseconds), or 0.
+    int64_t nPingUsecTime;
+    //! Number of blocks requested from this peer that were re-requested from a faster one.
+    int nBlocksStolen;
+    //! Whether the peer is pruned, and only serves the last NODE_NETWORK_LIMITED_MIN_BLOCKS blocks.
+    bool fLimitedNode;
+    //! Whether the peer asked for new blocks to be announced with headers ("sendheaders").
+    bool fPreferHeaders;
+    //! Whether we send new blocks to the peer in full without waiting to be asked (-blockpushpeer).
+    bool fBlockPush;
+    //! The last header we announced or sent to the peer.
+    CBlockIndex *pindexBestHeaderSent;
+    //! Number of new blocks we announced to the peer with headers, with an inv, and by sending them in full.
+    int nBlocksAnnouncedByHeaders;
+    int nBlocksAnnouncedByInv;
+    int nBlocksPushedTo;
+    //! Number of new blocks the peer sent us in full without being asked.
+    int nBlocksPushedFrom;
+    //! When the peer announced blocks we did not have (in microseconds), and whether it used headers.
+    map<uint256, pair<int64_t, bool>> mapBlockAnnounceTime;
+    //! Smoothed time (in microseconds) from the peer announcing a block with headers, or with an inv,
+    //! to it delivering the block, or 0 if unknown.
+    double dHeadersRelayTime;
+    double dInvRelayTime;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -372,10 +420,29 @@ struct CNodeState {
         pindexLastCommonBlock = NULL;
         fSyncStarted = false;
         nHeadersSyncStarted = 0;
+        fGetHeadersOutstanding = false;
+        nUnconnectingHeaders = 0;
         nStallingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
+        fPreferCompactHeaders = false;
+        dBlockDownloadRate = 0;
+        dBlockSizeAverage = 0;
+        nBlockBytesReceived = 0;
+        nLastBlockReceived = 0;
+        nPingUsecTime = 0;
+        nBlocksStolen = 0;
+        fLimitedNode = false;
+        fPreferHeaders = false;
+        fBlockPush = false;
+        pindexBestHeaderSent = NULL;
+        nBlocksAnnouncedByHeaders = 0;
+        nBlocksAnnouncedByInv = 0;
+        nBlocksPushedTo = 0;
+        nBlocksPushedFrom = 0;
+        dHeadersRelayTime = 0;
+        dInvRelayTime = 0;
     }
 };
 
@@ -412,11 +479,20 @@ int64_t GetBlockTimeout(int64_t nTime, int nValidatedQueuedBefore, const Consens
     return nTime + 500000 * consensusParams.PoWTargetSpacing(nHeight) * (4 + nValidatedQueuedBefore);
 }
 
+/** The ranges of -blockpushpeer. Requires cs_main. */
+std::vector<CSubNet> vBlockPushRanges;
+
 void InitializeNode(NodeId nodeid, const CNode *pnode) {
     LOCK(cs_main);
     CNodeState &state = mapNodeState.insert(std::make_pair(nodeid, CNodeState())).first->second;
     state.name = pnode->GetAddrName();
     state.address = pnode->addr;
+    for (const CSubNet& subnet : vBlockPushRanges) {
+        if (subnet.Match(pnode->addr)) {
+            state.fBlockPush = true;
+            break;
+        }
+    }
 }
 
 void FinalizeNode(NodeId nodeid) {
@@ -473,6 +549,137 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+// Requires cs_main.
+// Update a peer's download rate with a block we requested from it, received at nTimeReceived.
+void MarkBlockAsDelivered(NodeId nodeid, const uint256& hash, size_t nBytes, int64_t nTimeReceived) {
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid)
+        return;
+    CNodeState *state = State(nodeid);
+    assert(state != NULL);
+
+    // The peer serves our requests one after another, so it has been busy
+    // with this block since the later of our request and its last delivery.
+    int64_t nStart = std::max(itInFlight->second.second->nTime, state->nLastBlockReceived);
+    int64_t nElapsed = std::max<int64_t>(nTimeReceived - nStart, 1000);
+    double dRate = nBytes * 1000000.0 / nElapsed;
+    if (state->dBlockDownloadRate == 0) {
+        state->dBlockDownloadRate = dRate;
+        state->dBlockSizeAverage = nBytes;
+    } else {
+        state->dBlockDownloadRate += BLOCK_DOWNLOAD_RATE_SMOOTHING * (dRate - state->dBlockDownloadRate);
+        state->dBlockSizeAverage += BLOCK_DOWNLOAD_RATE_SMOOTHING * (nBytes - state->dBlockSizeAverage);
+    }
+    state->nBlockBytesReceived += nBytes;
+    state->nLastBlockReceived = std::max(state->nLastBlockReceived, nTimeReceived);
+}
+
+// Requires cs_main.
+// Remember when a peer announced a block we don't have, to time its delivery.
+void MarkBlockAsAnnounced(CNodeState* state, const uint256& hash, bool fHeaders) {
+    if (state->mapBlockAnnounceTime.count(hash))
+        return;
+    if (state->mapBlockAnnounceTime.size() >= MAX_BLOCK_ANNOUNCE_TIMES) {
+        auto itOldest = state->mapBlockAnnounceTime.begin();
+        for (auto it = state->mapBlockAnnounceTime.begin(); it != state->mapBlockAnnounceTime.end(); it++) {
+            if (it->second.first < itOldest->second.first)
+                itOldest = it;
+        }
+        state->mapBlockAnnounceTime.erase(itOldest);
+    }
+    state->mapBlockAnnounceTime[hash] = std::make_pair(GetTimeMicros(), fHeaders);
+}
+
+// Requires cs_main.
+// Record how long a peer took from announcing a block to delivering it at
+// nTimeReceived, or that it sent the block without announcing it first.
+void MarkBlockRelayed(NodeId nodeid, const uint256& hash, bool fRequested, int64_t nTimeReceived) {
+    CNodeState *state = State(nodeid);
+    assert(state != NULL);
+    if (!fRequested) {
+        state->nBlocksPushedFrom++;
+        MetricsIncrementCounter("zcash.net.block.relay.total", "announce", "push");
+    }
+    auto it = state->mapBlockAnnounceTime.find(hash);
+    if (it == state->mapBlockAnnounceTime.end())
+        return;
+    int64_t nElapsed = std::max<int64_t>(nTimeReceived - it->second.first, 0);
+    bool fHeaders = it->second.second;
+    state->mapBlockAnnounceTime.erase(it);
+    double& dRelayTime = fHeaders ? state->dHeadersRelayTime : state->dInvRelayTime;
+    if (dRelayTime == 0)
+        dRelayTime = nElapsed;
+    else
+        dRelayTime += BLOCK_DOWNLOAD_RATE_SMOOTHING * (nElapsed - dRelayTime);
+    const char* announce = fHeaders ? "headers" : "inv";
+    MetricsIncrementCounter("zcash.net.block.relay.total", "announce", announce);
+    MetricsHistogram("zcash.net.block.relay.seconds", nElapsed * 0.000001, "announce", announce);
+}
+
+// Requires cs_main.
+// Whether the peer has announced the block to us or we announced it to the peer.
+bool PeerHasHeader(const CNodeState* state, const CBlockIndex* pindex) {
+    if (state->pindexBestKnownBlock && pindex == state->pindexBestKnownBlock->GetAncestor(pindex->nHeight))
+        return true;
+    if (state->pindexBestHeaderSent && pindex == state->pindexBestHeaderSent->GetAncestor(pindex->nHeight))
+        return true;
+    return false;
+}
+
+/** Expected time (in microseconds) for a peer to deliver nBlocks more blocks, or 0 if its rate is unknown. */
+int64_t GetBlockDeliveryTime(const CNodeState* state, int nBlocks) {
+    if (state->dBlockDownloadRate == 0)
+        return 0;
+    return nBlocks * state->dBlockSizeAverage * 1000000.0 / state->dBlockDownloadRate;
+}
+
+/** Number of blocks that can be requested at any given time from a peer. */
+int GetBlocksInTransitLimit(const CNodeState* state) {
+    if (state->dBlockDownloadRate == 0 || state->dBlockSizeAverage == 0)
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    // Keep enough blocks in flight to cover the round trip and the target latency.
+    double dSeconds = state->nPingUsecTime * 0.000001 + BLOCK_DOWNLOAD_TARGET_LATENCY;
+    int nLimit = std::min<double>(std::ceil(state->dBlockDownloadRate * dSeconds / state->dBlockSizeAverage),
+                                  MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+    return std::max(nLimit, MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+// Requires cs_main.
+// Whether the block holding back the download window, which is in flight from
+// the staller, should be re-requested from this peer because this peer would
+// deliver it much sooner.
+bool ShouldStealBlock(const CNodeState* state, const uint256& hash, int64_t nNow) {
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || state->dBlockDownloadRate == 0)
+        return false;
+    const CNodeState *stallerState = State(itInFlight->second.first);
+    assert(stallerState != NULL);
+    if (stallerState == state)
+        return false;
+
+    // This peer would deliver the block after everything it has in flight.
+    int64_t nOurs = state->nPingUsecTime + GetBlockDeliveryTime(state, state->nBlocksInFlight + 1);
+
+    // The staller should deliver it after the blocks requested from it before
+    // it. Without a rate for the staller, only the stalling timeout applies.
+    const QueuedBlock& queued = *itInFlight->second.second;
+    int64_t nExpected;
+    if (stallerState->dBlockDownloadRate == 0) {
+        nExpected = queued.nTime + 1000000 * BLOCK_STALLING_TIMEOUT;
+    } else {
+        int nAhead = 0;
+        for (list<QueuedBlock>::const_iterator it = stallerState->vBlocksInFlight.begin(); it != itInFlight->second.second; it++)
+            nAhead++;
+        nExpected = std::max(queued.nTime, stallerState->nLastBlockReceived) + GetBlockDeliveryTime(stallerState, nAhead + 1);
+    }
+
+    // Steal the block if the staller is late by more than this peer would
+    // take, or if this peer would take less than half as long.
+    if (nExpected <= nNow)
+        return nNow - nExpected > nOurs;
+    return 2 * nOurs < nExpected - nNow;
+}
+
 /** Check whether the last unknown block a peer advertized is not yet known. */
 void ProcessBlockAvailability(NodeId nodeid) {
     CNodeState *state = State(nodeid);
@@ -526,8 +733,9 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller) {
+ *  at most count entries. If the download window keeps this peer from fetching anything, set
+ *  nodeStaller to the peer holding it back and pindexStalled to the block it is holding. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, CBlockIndex*& pindexStalled) {
     if (count == 0)
         return;
 
@@ -563,6 +771,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -587,6 +796,11 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
+            } else if (state->fLimitedNode &&
+                       state->pindexBestKnownBlock->nHeight - pindex->nHeight >= (int)NODE_NETWORK_LIMITED_MIN_BLOCKS - 2) {
+                // The peer is pruned and may not have this block any more.
+                // (Two blocks of margin in case its tip moved meanwhile.)
+                continue;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
                 // The block is not already downloaded, and not yet in flight.
                 if (pindex->nHeight > nWindowEnd) {
@@ -594,6 +808,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalled = pindexWaitingFor;
                     }
                     return;
                 }
@@ -604,6 +819,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -623,6 +839,18 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.dBlockDownloadRate = state->dBlockDownloadRate;
+    stats.nBlockBytesReceived = state->nBlockBytesReceived;
+    stats.nBlocksInTransitLimit = GetBlocksInTransitLimit(state);
+    stats.nBlocksStolen = state->nBlocksStolen;
+    stats.fPreferHeaders = state->fPreferHeaders;
+    stats.fBlockPush = state->fBlockPush;
+    stats.nBlocksAnnouncedByHeaders = state->nBlocksAnnouncedByHeaders;
+    stats.nBlocksAnnouncedByInv = state->nBlocksAnnouncedByInv;
+    stats.nBlocksPushedTo = state->nBlocksPushedTo;
+    stats.nBlocksPushedFrom = state->nBlocksPushedFrom;
+    stats.dHeadersRelayTime = state->dHeadersRelayTime;
+    stats.dInvRelayTime = state->dInvRelayTime;
     return true;
 }
 
@@ -635,6 +863,12 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals)
     nodeSignals.FinalizeNode.connect(&FinalizeNode);
 }
 
+void AddBlockPushRange(const CSubNet& subnet)
+{
+    LOCK(cs_main);
+    vBlockPushRanges.push_back(subnet);
+}
+
 void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.disconnect(&GetHeight);
@@ -664,6 +898,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -2178,6 +2413,34 @@ bool GetAddressIndex(const uint160& addressHash, int type,
     return true;
 }
 
+bool GetAddressIndexPage(const uint160& addressHash, int type,
+                         int startHeight, unsigned int startTxIndex, int endHeight, size_t nMaxTxs,
+                         std::vector<CAddressIndexDbEntry>& addressIndex)
+{
+    if (!fAddressIndex) {
+        LogPrint("rpc", "address index not enabled");
+        return false;
+    }
+    if (!pblocktree->ReadAddressIndexPage(addressHash, type, startHeight, startTxIndex, endHeight, nMaxTxs, addressIndex)) {
+        LogPrint("rpc", "unable to get txids for address");
+        return false;
+    }
+    return true;
+}
+
+bool GetAddressBalance(const uint160& addressHash, int type, CAddressBalanceValue& value)
+{
+    if (!fAddressIndex) {
+        LogPrint("rpc", "address index not enabled");
+        return false;
+    }
+    if (!pblocktree->ReadAddressBalance(addressHash, type, value)) {
+        LogPrint("rpc", "unable to get balance for address");
+        return false;
+    }
+    return true;
+}
+
 bool GetAddressUnspent(const uint160& addressHash, int type,
                        std::vector<CAddressUnspentDbEntry>& unspentOutputs)
 {
@@ -2795,6 +3058,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -2822,8 +3087,6 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
-} // anon namespace
-
 /**
  * Apply the undo operation of a CTxInUndo to the given chain state.
  * @param undo The undo object.
@@ -2866,11 +3129,10 @@ enum DisconnectResult
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When UNCLEAN or FAILED is returned, view is left in an indeterminate state.
- *  The addressIndex and spentIndex will be updated if requested.
+ *  The insightexplorer indexes are rolled back separately, by the index builder.
  */
 static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state,
-    const CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams,
-    const bool updateIndices)
+    const CBlockIndex* pindex, CCoinsViewCache& view, const CChainParams& chainparams)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
@@ -2891,37 +3153,12 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
         error("DisconnectBlock(): block and undo data inconsistent");
         return DISCONNECT_FAILED;
     }
-    std::vector<CAddressIndexDbEntry> addressIndex;
-    std::vector<CAddressUnspentDbEntry> addressUnspentIndex;
-    std::vector<CSpentIndexDbEntry> spentIndex;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = block.vtx[i];
         uint256 const hash = tx.GetHash();
 
-        // insightexplorer
-        // https://github.com/bitpay/bitcoin/commit/017f548ea6d89423ef568117447e61dd5707ec42#diff-7ec3c68a81efff79b6ca22ac1f1eabbaR2236
-        if (fAddressIndex && updateIndices) {
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-                CScript::ScriptType scriptType = out.scriptPubKey.GetType();
-                if (scriptType != CScript::UNKNOWN) {
-                    uint160 const addrHash = out.scriptPubKey.AddressHash();
-
-                    // undo receiving activity
-                    addressIndex.push_back(make_pair(
-                        CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, k, false),
-                        out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(make_pair(
-                        CAddressUnspentKey(scriptType, addrHash, hash, k),
-                        CAddressUnspentValue()));
-                }
-            }
-        }
-
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         {
@@ -2956,34 +3193,6 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
                 const CTxInUndo &undo = txundo.vprevout[j];
                 if (!ApplyTxInUndo(undo, view, out))
                     fClean = false;
-
-                // insightexplorer
-                // https://github.com/bitpay/bitcoin/commit/017f548ea6d89423ef568117447e61dd5707ec42#diff-7ec3c68a81efff79b6ca22ac1f1eabbaR2304
-                const CTxIn input = tx.vin[j];
-                if (fAddressIndex && updateIndices) {
-                    const CTxOut &prevout = view.GetOutputFor(input);
-                    CScript::ScriptType scriptType = prevout.scriptPubKey.GetType();
-                    if (scriptType != CScript::UNKNOWN) {
-                        uint160 const addrHash = prevout.scriptPubKey.AddressHash();
-
-                        // undo spending activity
-                        addressIndex.push_back(make_pair(
-                            CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, j, true),
-                            prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(make_pair(
-                            CAddressUnspentKey(scriptType, addrHash, input.prevout.hash, input.prevout.n),
-                            CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-                    }
-                }
-                // insightexplorer
-                if (fSpentIndex && updateIndices) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(make_pair(
-                        CSpentIndexKey(input.prevout.hash, input.prevout.n),
-                        CSpentIndexValue()));
-                }
             }
         }
     }
@@ -3052,24 +3261,6 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    // insightexplorer
-    if (fAddressIndex && updateIndices) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            AbortNode(state, "Failed to delete address index");
-            return DISCONNECT_FAILED;
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            AbortNode(state, "Failed to write address unspent index");
-            return DISCONNECT_FAILED;
-        }
-    }
-    // insightexplorer
-    if (fSpentIndex && updateIndices) {
-        if (!pblocktree->UpdateSpentIndex(spentIndex)) {
-            AbortNode(state, "Failed to write transaction index");
-            return DISCONNECT_FAILED;
-        }
-    }
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -3105,6 +3296,57 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Work other than script checks that validation spreads over the -par
+ * threads, such as reading a block's inputs or hashing headers. A task
+ * stores its own result, so the queue never stops early.
+ */
+class CValidationTask
+{
+private:
+    std::function<void()> func;
+
+public:
+    CValidationTask() {}
+    explicit CValidationTask(std::function<void()> funcIn) : func(std::move(funcIn)) {}
+
+    bool operator()() {
+        func();
+        return true;
+    }
+
+    void swap(CValidationTask& other) {
+        func.swap(other.func);
+    }
+};
+
+// Kept apart from scriptcheckqueue, whose control ConnectBlock may hold while
+// tasks are running. The threads live as long as the node, so thread-local
+// state such as RandomX VMs is reused from one call to the next.
+static CCheckQueue<CValidationTask> taskqueue(1);
+
+void ThreadValidationTasks() {
+    RenameThread("zc-valtask");
+    taskqueue.Thread();
+}
+
+/**
+ * Run the tasks on the validation task threads and this one, and wait for
+ * them to finish. Tasks must not take cs_main.
+ */
+static void RunValidationTasks(std::vector<CValidationTask>& vTasks)
+{
+    if (!nScriptCheckThreads) {
+        for (CValidationTask& task : vTasks) {
+            task();
+        }
+        return;
+    }
+    CCheckQueueControl<CValidationTask> control(&taskqueue);
+    control.Add(vTasks);
+    control.Wait();
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
@@ -3297,6 +3539,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CCheckQueueControl<CScriptCheck> control(fExpensiveChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     int64_t nTimeStart = GetTimeMicros();
+    // Per-stage totals for this block, in microseconds
+    int64_t nTimeCoins = 0;
+    int64_t nTimeNullifiers = 0;
+    int64_t nTimeScripts = 0;
     std::vector<uint256> vOrphanErase;
     CAmount nFees = 0;
     int nInputs = 0;
@@ -3305,9 +3551,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<CAddressIndexDbEntry> addressIndex;
-    std::vector<CAddressUnspentDbEntry> addressUnspentIndex;
-    std::vector<CSpentIndexDbEntry> spentIndex;
 
     // Juno Cash: Sprout is never used, tree is always empty.
     // Use empty_root() directly instead of GetBestAnchor() which may return
@@ -3382,12 +3625,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         std::vector<CTxOut> allPrevOutputs;
 
         // Are the shielded spends' requirements met?
+        int64_t nTimeStage = GetTimeMicros();
         if (!Consensus::CheckTxShieldedInputs(tx, state, view, 100)) {
             return false;
         }
+        nTimeNullifiers += GetTimeMicros() - nTimeStage;
 
         if (!tx.IsCoinBase())
         {
+            nTimeStage = GetTimeMicros();
             if (!view.HaveInputs(tx))
                 return state.DoS(100, error("%s: inputs missing/spent", __func__),
                                  REJECT_INVALID, "bad-txns-inputs-missingorspent");
@@ -3397,6 +3643,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 transparentValueDelta -= prevout.nValue;
                 allPrevOutputs.push_back(prevout);
             }
+            nTimeCoins += GetTimeMicros() - nTimeStage;
 
             // Which orphan pool entries must we evict?
             for (size_t j = 0; j < tx.vin.size(); j++) {
@@ -3409,38 +3656,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 }
             }
 
-            // insightexplorer
-            // https://github.com/bitpay/bitcoin/commit/017f548ea6d89423ef568117447e61dd5707ec42#diff-7ec3c68a81efff79b6ca22ac1f1eabbaR2597
-            if (fAddressIndex || fSpentIndex) {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = allPrevOutputs[j];
-                    CScript::ScriptType scriptType = prevout.scriptPubKey.GetType();
-                    const uint160 addrHash = prevout.scriptPubKey.AddressHash();
-                    if (fAddressIndex && scriptType != CScript::UNKNOWN) {
-                        // record spending activity
-                        addressIndex.push_back(make_pair(
-                            CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, j, true),
-                            prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(make_pair(
-                            CAddressUnspentKey(scriptType, addrHash, input.prevout.hash, input.prevout.n),
-                            CAddressUnspentValue()));
-                    }
-                    if (fSpentIndex) {
-                        // Add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input.
-                        // If we do not recognize the script type, we still add an entry to the
-                        // spentindex db, with a script type of 0 and addrhash of all zeroes.
-                        spentIndex.push_back(make_pair(
-                            CSpentIndexKey(input.prevout.hash, input.prevout.n),
-                            CSpentIndexValue(hash, j, pindex->nHeight, prevout.nValue, scriptType, addrHash)));
-                    }
-                }
-            }
-
             // Add in sigops done by pay-to-script-hash inputs;
             // this is to prevent a "rogue miner" from creating
             // an incredibly-expensive-to-validate block.
@@ -3471,10 +3686,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             chainSupplyDelta -= txFee;
 
             std::vector<CScriptCheck> vChecks;
+            nTimeStage = GetTimeMicros();
             if (!ContextualCheckInputs(tx, state, view, fExpensiveChecks, flags, fCacheResults, txdata.back(), consensusParams, consensusBranchId, nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: CheckInputs on %s failed with %s", __func__,
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
+            nTimeScripts += GetTimeMicros() - nTimeStage;
         }
 
         // Check shielded inputs.
@@ -3496,28 +3713,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 FormatStateMessage(state));
         }
 
-        // insightexplorer
-        // https://github.com/bitpay/bitcoin/commit/017f548ea6d89423ef568117447e61dd5707ec42#diff-7ec3c68a81efff79b6ca22ac1f1eabbaR2656
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-                CScript::ScriptType scriptType = out.scriptPubKey.GetType();
-                if (scriptType != CScript::UNKNOWN) {
-                    uint160 const addrHash = out.scriptPubKey.AddressHash();
-
-                    // record receiving activity
-                    addressIndex.push_back(make_pair(
-                        CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, k, false),
-                        out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(
-                        CAddressUnspentKey(scriptType, addrHash, hash, k),
-                        CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                }
-            }
-        }
-
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -3776,6 +3971,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     // Ensure Sapling authorizations are valid (if we are checking them)
+    int64_t nTimeProofs = GetTimeMicros();
     if (saplingAuth.has_value() && !saplingAuth.value()->validate()) {
         return state.DoS(100,
             error("%s: a Sapling bundle within the block is invalid", __func__),
@@ -3788,9 +3984,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             error("%s: an Orchard bundle within the block is invalid", __func__),
             REJECT_INVALID, "bad-orchard-bundle-authorization");
     }
+    nTimeProofs = GetTimeMicros() - nTimeProofs;
 
+    int64_t nTimeWait = GetTimeMicros();
     if (!control.Wait())
         return state.DoS(100, false);
+    nTimeScripts += GetTimeMicros() - nTimeWait;
     int64_t nTime2 = GetTimeMicros(); nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs-1), nTimeVerify * 0.000001);
 
@@ -3838,41 +4037,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
-    // START insightexplorer
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-    if (fSpentIndex) {
-        if (!pblocktree->UpdateSpentIndex(spentIndex)) {
-            return AbortNode(state, "Failed to write spent index");
-        }
-    }
-    if (fTimestampIndex) {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
-    }
-    // END insightexplorer
+    // The insightexplorer indexes are written by the index builder, from
+    // the block and undo data, once the block is part of the active chain.
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -3880,6 +4046,15 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTime3 = GetTimeMicros(); nTimeIndex += nTime3 - nTime2;
     LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
 
+    // Only blocks that are being connected are recorded, not block templates
+    // or blocks checked by TestBlockValidity.
+    RecordValidationStage(ValidationStage::Coins, nTimeCoins);
+    RecordValidationStage(ValidationStage::Nullifiers, nTimeNullifiers);
+    RecordValidationStage(ValidationStage::Scripts, nTimeScripts);
+    RecordValidationStage(ValidationStage::Proofs, nTimeProofs);
+    RecordValidationStage(ValidationStage::Index, nTime3 - nTime2);
+    RecordValidationStage(ValidationStage::ConnectBlock, nTime3 - nTimeStart);
+
     // Erase orphan transactions include or precluded by this block
     if (vOrphanErase.size()) {
         int nErased = 0;
@@ -3913,12 +4088,13 @@ bool static FlushStateToDisk(
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     std::set<int> setFilesToPrune;
+    std::set<int> setUndoFilesToPrune;
     bool fFlushForPrune = false;
     try {
     if (fPruneMode && fCheckForPruning && !fReindex) {
-        FindFilesToPrune(setFilesToPrune, chainparams.PruneAfterHeight());
+        FindFilesToPrune(setFilesToPrune, setUndoFilesToPrune, chainparams.PruneAfterHeight());
         fCheckForPruning = false;
-        if (!setFilesToPrune.empty()) {
+        if (!setFilesToPrune.empty() || !setUndoFilesToPrune.empty()) {
             fFlushForPrune = true;
             if (!fHavePruned) {
                 pblocktree->WriteFlag("prunedblockfiles", true);
@@ -3972,7 +4148,7 @@ bool static FlushStateToDisk(
         }
         // Finally remove any pruned files
         if (fFlushForPrune)
-            UnlinkPrunedFiles(setFilesToPrune);
+            UnlinkPrunedFiles(setFilesToPrune, setUndoFilesToPrune);
         nLastWrite = nNow;
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -4101,6 +4277,47 @@ struct PoolMetrics {
         }                                        \
     } while (0)
 
+/**
+ * The disk positions of the last nPruneKeepBlocks blocks of the active
+ * chain, which are never pruned, as of the last tip update. getdata requests
+ * for them are answered from here without waiting for cs_main.
+ */
+static Mutex cs_recentBlocks;
+static std::deque<uint256> recentBlockHashes GUARDED_BY(cs_recentBlocks);
+static std::map<uint256, CDiskBlockPos> mapRecentBlockPos GUARDED_BY(cs_recentBlocks);
+
+static void UpdateRecentBlocks(const CBlockIndex* pindexNew) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_recentBlocks);
+    if (pindexNew->pprev && !recentBlockHashes.empty() &&
+        recentBlockHashes.back() == pindexNew->pprev->GetBlockHash()) {
+        if (pindexNew->nStatus & BLOCK_HAVE_DATA) {
+            recentBlockHashes.push_back(pindexNew->GetBlockHash());
+            mapRecentBlockPos[pindexNew->GetBlockHash()] = pindexNew->GetBlockPos();
+        }
+    } else if (recentBlockHashes.size() >= 2 &&
+               recentBlockHashes[recentBlockHashes.size() - 2] == pindexNew->GetBlockHash()) {
+        // The tip was disconnected.
+        mapRecentBlockPos.erase(recentBlockHashes.back());
+        recentBlockHashes.pop_back();
+    } else {
+        // The tip moved back, or to another branch.
+        recentBlockHashes.clear();
+        mapRecentBlockPos.clear();
+        for (const CBlockIndex* pindex = pindexNew;
+             pindex && recentBlockHashes.size() < nPruneKeepBlocks && (pindex->nStatus & BLOCK_HAVE_DATA);
+             pindex = pindex->pprev) {
+            recentBlockHashes.push_front(pindex->GetBlockHash());
+            mapRecentBlockPos[pindex->GetBlockHash()] = pindex->GetBlockPos();
+        }
+    }
+    while (recentBlockHashes.size() > nPruneKeepBlocks) {
+        mapRecentBlockPos.erase(recentBlockHashes.front());
+        recentBlockHashes.pop_front();
+    }
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
     chainActive.SetTip(pindexNew);
@@ -4153,6 +4370,8 @@ void static UpdateTip(CBlockIndex *pindexNew, const CChainParams& chainParams) {
         g_best_block_height = pindexNew->nHeight;
         g_best_block_cv.notify_all();
     }
+
+    UpdateRecentBlocks(pindexNew);
 }
 
 /**
@@ -4174,8 +4393,7 @@ bool static DisconnectTip(CValidationState &state, const CChainParams& chainpara
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(pcoinsTip);
-        // insightexplorer: update indices (true)
-        if (DisconnectBlock(block, state, pindexDelete, view, chainparams, true) != DISCONNECT_OK)
+        if (DisconnectBlock(block, state, pindexDelete, view, chainparams) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
@@ -4242,6 +4460,8 @@ std::map<const CBlockIndex*, std::list<CTransaction>> recentlyConflictedTxs;
 uint64_t nConnectedSequence = 0;
 uint64_t nNotifiedSequence = 0;
 
+static void PrefetchBlockInputs(const CBlock& block);
+
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -4269,11 +4489,13 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    RecordValidationStage(ValidationStage::Flush, nTime4 - nTime3);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    RecordValidationStage(ValidationStage::ChainState, nTime5 - nTime4);
     // Remove conflicting transactions from the mempool.
     std::list<CTransaction> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted);
@@ -4299,6 +4521,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
+    RecordValidationStage(ValidationStage::ConnectTip, nTime6 - nTime2);
     // Total connection time benchmarking occurs in ActivateBestChainStep.
     MetricsIncrementCounter("zcash.chain.verified.block.total");
     return true;
@@ -4482,6 +4705,10 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
                 if (!ReadBlockFromDisk(block, pindexConnect, chainparams.GetConsensus()))
                     return AbortNode(state, "Failed to read block");
                 pconnectBlock = &block;
+                // Blocks that arrived out of order were not prefetched when
+                // they were accepted.
+                if (nScriptCheckThreads)
+                    PrefetchBlockInputs(block);
             }
             int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
             LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
@@ -4576,8 +4803,10 @@ bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams,
 
         bool fInitialDownload;
         int nNewHeight;
+        const CBlockIndex *pindexFork;
         {
             LOCK(cs_main);
+            CBlockIndex *pindexOldTip = chainActive.Tip();
             if (pindexMostWork == NULL) {
                 pindexMostWork = FindMostWorkChain();
             }
@@ -4595,6 +4824,7 @@ bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams,
                 pindexMostWork = NULL;
             }
             pindexNewTip = chainActive.Tip();
+            pindexFork = pindexOldTip ? chainActive.FindFork(pindexOldTip) : NULL;
             fInitialDownload = IsInitialBlockDownload(chainparams.GetConsensus());
             nNewHeight = chainActive.Height();
         }
@@ -4604,16 +4834,27 @@ bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams,
         // Always notify the UI if a new block tip was connected
         uiInterface.NotifyBlockTip(fInitialDownload, pindexNewTip);
         if (!fInitialDownload) {
-            uint256 hashNewTip = pindexNewTip->GetBlockHash();
+            // Find the hashes of all the newly connected blocks, so that they can
+            // be announced with headers. Limit announcements in case of a huge
+            // reorganization; the peer will be sent an inv of the tip instead.
+            std::vector<uint256> vHashes;
+            const CBlockIndex *pindexToAnnounce = pindexNewTip;
+            while (pindexToAnnounce && pindexToAnnounce != pindexFork && vHashes.size() < MAX_BLOCKS_TO_ANNOUNCE) {
+                vHashes.push_back(pindexToAnnounce->GetBlockHash());
+                pindexToAnnounce = pindexToAnnounce->pprev;
+            }
             // Relay inventory, but don't relay old inventory during initial block download.
             int nBlockEstimate = 0;
             if (fCheckpointsEnabled)
                 nBlockEstimate = Checkpoints::GetTotalBlocksEstimate(chainparams.Checkpoints());
             {
                 LOCK(cs_vNodes);
-                for (CNode* pnode : vNodes)
-                    if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushBlockInventory(hashNewTip);
+                for (CNode* pnode : vNodes) {
+                    if (nNewHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate)) {
+                        for (auto it = vHashes.rbegin(); it != vHashes.rend(); ++it)
+                            pnode->PushBlockHash(*it);
+                    }
+                }
             }
             // Notify external listeners about the new tip.
             GetMainSignals().UpdatedBlockTip(pindexNewTip);
@@ -5096,12 +5337,31 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
+/** Check that a header's RandomX solution is the hash of the header with the seed for its height. */
+static bool CheckBlockHeaderSolution(
+    const CBlockHeader& block,
+    CValidationState& state,
+    const CChainParams& chainparams,
+    const CBlockIndex* pindexPrev)
+{
+    bool fValidSolution;
+    {
+        CValidationStageTimer timer(ValidationStage::RandomX);
+        fValidSolution = CheckRandomXSolution(&block, chainparams.GetConsensus(), pindexPrev);
+    }
+    if (!fValidSolution)
+        return state.DoS(100, error("CheckBlockHeader(): RandomX solution invalid"),
+                         REJECT_INVALID, "invalid-solution");
+    return true;
+}
+
 bool CheckBlockHeader(
     const CBlockHeader& block,
     CValidationState& state,
     const CChainParams& chainparams,
     bool fCheckPOW,
-    const CBlockIndex* pindexPrev)
+    const CBlockIndex* pindexPrev,
+    bool fCheckSolution)
 {
     // Check block version
     if (block.nVersion < MIN_BLOCK_VERSION)
@@ -5110,12 +5370,7 @@ bool CheckBlockHeader(
 
     // Skip POW validation for genesis block (may have old Equihash solution)
     if (fCheckPOW && block.GetHash() != chainparams.GetConsensus().hashGenesisBlock) {
-        // Check RandomX solution is valid
-        if (!CheckRandomXSolution(&block, chainparams.GetConsensus(), pindexPrev))
-            return state.DoS(100, error("CheckBlockHeader(): RandomX solution invalid"),
-                             REJECT_INVALID, "invalid-solution");
-
-        // Check proof of work matches claimed amount
+        // Check proof of work matches claimed amount first, as it is nearly free
         // For RandomX, the POW hash is the RandomX hash stored in nSolution
         uint256 randomxHash;
         if (block.nSolution.size() == 32) {
@@ -5124,6 +5379,10 @@ bool CheckBlockHeader(
         if (!CheckProofOfWork(randomxHash, block.nBits, chainparams.GetConsensus()))
             return state.DoS(50, error("CheckBlockHeader(): proof of work failed"),
                              REJECT_INVALID, "high-hash");
+
+        // Check RandomX solution is valid
+        if (fCheckSolution && !CheckBlockHeaderSolution(block, state, chainparams, pindexPrev))
+            return false;
     }
 
     return true;
@@ -5357,7 +5616,14 @@ bool ContextualCheckBlock(
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+/** What CheckHeaderSolutions found out about the RandomX solution of a header. */
+enum class HeaderSolution : char {
+    Unchecked,
+    Valid,
+    Invalid,
+};
+
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL, HeaderSolution solution=HeaderSolution::Unchecked)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -5385,12 +5651,23 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return state.DoS(100, error("%s: prev block invalid", __func__), REJECT_INVALID, "bad-prevblk");
     }
 
-    if (!CheckBlockHeader(block, state, chainparams, true, pindexPrev))
+    // Do the cheap checks first, so that a header with the wrong target or
+    // time, or forking before a checkpoint, costs no RandomX hash.
+    if (!CheckBlockHeader(block, state, chainparams, true, pindexPrev, false))
         return false;
 
     if (!ContextualCheckBlockHeader(block, state, chainparams, pindexPrev))
         return false;
 
+    if (pindexPrev != NULL) {
+        if (solution == HeaderSolution::Invalid)
+            return state.DoS(100, error("%s: RandomX solution invalid", __func__),
+                             REJECT_INVALID, "invalid-solution");
+        if (solution == HeaderSolution::Unchecked &&
+            !CheckBlockHeaderSolution(block, state, chainparams, pindexPrev))
+            return false;
+    }
+
     if (pindex == NULL)
         pindex = AddToBlockIndex(block, chainparams.GetConsensus());
 
@@ -5497,25 +5774,101 @@ static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned
 }
 
 
+/**
+ * Add the coins and nullifiers that a block will look up when it is
+ * connected to pcoinsTip, reading them from the chainstate database on the
+ * validation task threads. This turns the cache misses of ConnectBlock, which
+ * are made one at a time, into parallel reads. Blocks that extend the tip are
+ * prefetched before cs_main is taken; blocks read back from disk by
+ * ActivateBestChainStep are prefetched with it held.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    CCoinsPrefetch prefetch;
+    for (const CTransaction& tx : block.vtx) {
+        prefetch.AddTransaction(tx);
+    }
+    // Outputs created by the block itself are not in the database yet.
+    std::vector<uint256> vBlockTxids;
+    for (const CTransaction& tx : block.vtx) {
+        vBlockTxids.push_back(tx.GetHash());
+    }
+    prefetch.RemoveTxids(std::move(vBlockTxids));
+    if (prefetch.empty())
+        return;
+
+    // pcoinsdbview only changes when pcoinsTip is flushed, which moves its
+    // best block. The reads are only added if no flush happened meanwhile.
+    uint256 hashBestBlock = pcoinsdbview->GetBestBlock();
+    const size_t nLookups = prefetch.Prepare();
+    const size_t nTasks = std::max<size_t>(1, std::min<size_t>(nScriptCheckThreads, nLookups));
+    std::vector<CValidationTask> vTasks;
+    for (size_t n = 0; n < nTasks; n++) {
+        size_t nBegin = nLookups * n / nTasks;
+        size_t nEnd = nLookups * (n + 1) / nTasks;
+        vTasks.emplace_back([&prefetch, nBegin, nEnd]() {
+            prefetch.ReadRange(pcoinsdbview, nBegin, nEnd);
+        });
+    }
+    RunValidationTasks(vTasks);
+
+    LOCK(cs_main);
+    if (pcoinsdbview->GetBestBlock() == hashBestBlock) {
+        pcoinsTip->AddPrefetched(prefetch);
+    }
+}
+
+/** Whether a stored block is about to be connected on top of the current tip. */
+static bool ExtendsTip(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    return pindex && pindex->pprev == chainActive.Tip() &&
+           pindex->nChainWork > chainActive.Tip()->nChainWork;
+}
+
+/**
+ * Mark a new block as received and store it, recording pfrom as its source.
+ * This is the part of ProcessNewBlock that runs before the chain is
+ * activated. fMayActivate is set if the block was stored by this call and
+ * some chain with more work than the tip can now be connected.
+ */
+static bool AcceptNewBlock(CValidationState& state, const CChainParams& chainparams, const CNode* pfrom, const CBlock* pblock, bool fForceProcessing, const CDiskBlockPos* dbp, bool& fExtendsTip, bool& fMayActivate)
+{
+    LOCK(cs_main);
+    bool fRequested = MarkBlockAsReceived(pblock->GetHash()) | fForceProcessing;
+    BlockMap::iterator mi = mapBlockIndex.find(pblock->GetHash());
+    bool fHadData = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+
+    // Store to disk
+    CBlockIndex *pindex = NULL;
+    bool ret = AcceptBlock(*pblock, state, chainparams, &pindex, fRequested, dbp);
+    if (pindex && pfrom) {
+        mapBlockSource[pindex->GetBlockHash()] = pfrom->GetId();
+    }
+    CheckBlockIndex(chainparams.GetConsensus());
+    if (!ret)
+        return false;
+    fExtendsTip = ExtendsTip(pindex);
+    // AcceptBlock also succeeds for blocks it did not store, such as ones we
+    // already have or unrequested ones with too little work.
+    fMayActivate = !fHadData && pindex && (pindex->nStatus & BLOCK_HAVE_DATA) &&
+                   chainActive.Tip() && !setBlockIndexCandidates.empty() &&
+                   (*setBlockIndexCandidates.rbegin())->nChainWork > chainActive.Tip()->nChainWork;
+    return true;
+}
+
 bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, const CNode* pfrom, const CBlock* pblock, bool fForceProcessing, const CDiskBlockPos* dbp)
 {
     auto span = TracingSpan("info", "main", "ProcessNewBlock");
     auto spanGuard = span.Enter();
 
-    {
-        LOCK(cs_main);
-        bool fRequested = MarkBlockAsReceived(pblock->GetHash()) | fForceProcessing;
+    bool fExtendsTip = false;
+    bool fMayActivate = false;
+    if (!AcceptNewBlock(state, chainparams, pfrom, pblock, fForceProcessing, dbp, fExtendsTip, fMayActivate))
+        return error("%s: AcceptBlock FAILED", __func__);
 
-        // Store to disk
-        CBlockIndex *pindex = NULL;
-        bool ret = AcceptBlock(*pblock, state, chainparams, &pindex, fRequested, dbp);
-        if (pindex && pfrom) {
-            mapBlockSource[pindex->GetBlockHash()] = pfrom->GetId();
-        }
-        CheckBlockIndex(chainparams.GetConsensus());
-        if (!ret)
-            return error("%s: AcceptBlock FAILED", __func__);
-    }
+    if (nScriptCheckThreads && fExtendsTip)
+        PrefetchBlockInputs(*pblock);
 
     NotifyHeaderTip(chainparams.GetConsensus());
 
@@ -5525,6 +5878,122 @@ bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, c
     return true;
 }
 
+/** A block received from a peer that is waiting to be connected. */
+struct CQueuedBlock {
+    std::shared_ptr<const CBlock> pblock;
+    //! Referenced until the block has been processed.
+    CNode* pfrom{nullptr};
+};
+
+static Mutex cs_blockValidationQueue;
+static std::condition_variable condBlockValidationQueue;
+static std::deque<CQueuedBlock> blockValidationQueue GUARDED_BY(cs_blockValidationQueue);
+static std::atomic<bool> fBlockValidationThreadRunning{false};
+
+bool ProcessNewBlockAsync(CValidationState& state, const CChainParams& chainparams, CNode* pfrom, std::shared_ptr<const CBlock> pblock, bool fForceProcessing)
+{
+    if (!fBlockValidationThreadRunning)
+        return ProcessNewBlock(state, chainparams, pfrom, pblock.get(), fForceProcessing, NULL);
+
+    auto span = TracingSpan("info", "main", "ProcessNewBlockAsync");
+    auto spanGuard = span.Enter();
+
+    bool fExtendsTip = false;
+    bool fMayActivate = false;
+    if (!AcceptNewBlock(state, chainparams, pfrom, pblock.get(), fForceProcessing, NULL, fExtendsTip, fMayActivate))
+        return error("%s: AcceptBlock FAILED", __func__);
+
+    NotifyHeaderTip(chainparams.GetConsensus());
+
+    // Only blocks that were stored and can move the tip are worth holding in
+    // memory until the validation thread gets to them.
+    if (!fMayActivate)
+        return true;
+
+    // A peer that already has MAX_BLOCKS_VALIDATING_PER_PEER blocks queued
+    // waits for this one to be connected, as without the validation thread.
+    // The socket thread also stops reading from it meanwhile.
+    if (pfrom->nBlocksValidating >= MAX_BLOCKS_VALIDATING_PER_PEER) {
+        if (nScriptCheckThreads && fExtendsTip)
+            PrefetchBlockInputs(*pblock);
+        if (!ActivateBestChain(state, chainparams, pblock.get()))
+            return error("%s: ActivateBestChain failed", __func__);
+        return true;
+    }
+
+    pfrom->nBlocksValidating++;
+    size_t nQueued;
+    {
+        LOCK(cs_blockValidationQueue);
+        blockValidationQueue.push_back(CQueuedBlock{std::move(pblock), pfrom->AddRef()});
+        nQueued = blockValidationQueue.size();
+    }
+    condBlockValidationQueue.notify_one();
+    MetricsGauge("zcash.chain.validation.queue.blocks", nQueued);
+    return true;
+}
+
+static void ReleaseQueuedBlock(CQueuedBlock& queued)
+{
+    if (!queued.pfrom)
+        return;
+    queued.pfrom->nBlocksValidating--;
+    queued.pfrom->Release();
+    queued.pfrom = nullptr;
+    // The peer's pings may have been waiting for this block.
+    WakeMessageHandler();
+}
+
+void ThreadBlockValidation()
+{
+    const CChainParams& chainparams = Params();
+    fBlockValidationThreadRunning = true;
+    CQueuedBlock queued;
+    try {
+        while (true) {
+            size_t nQueued;
+            {
+                WAIT_LOCK(cs_blockValidationQueue, lock);
+                while (blockValidationQueue.empty()) {
+                    condBlockValidationQueue.wait_for(lock, std::chrono::milliseconds(100));
+                    boost::this_thread::interruption_point();
+                }
+                queued = std::move(blockValidationQueue.front());
+                blockValidationQueue.pop_front();
+                nQueued = blockValidationQueue.size();
+            }
+            MetricsGauge("zcash.chain.validation.queue.blocks", nQueued);
+
+            // The tip may have moved since the block was accepted.
+            bool fPrefetch = false;
+            if (nScriptCheckThreads) {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(queued.pblock->GetHash());
+                fPrefetch = mi != mapBlockIndex.end() && ExtendsTip(mi->second);
+            }
+            if (fPrefetch)
+                PrefetchBlockInputs(*queued.pblock);
+
+            // A block that turns out to be invalid is reported to its peer
+            // through mapBlockSource, as it would be synchronously.
+            CValidationState state;
+            if (!ActivateBestChain(state, chainparams, queued.pblock.get()))
+                LogPrintf("%s: ActivateBestChain failed: %s\n", __func__, FormatStateMessage(state));
+
+            ReleaseQueuedBlock(queued);
+        }
+    } catch (const boost::thread_interrupted&) {
+        fBlockValidationThreadRunning = false;
+        ReleaseQueuedBlock(queued);
+        LOCK(cs_blockValidationQueue);
+        for (CQueuedBlock& pending : blockValidationQueue) {
+            ReleaseQueuedBlock(pending);
+        }
+        blockValidationQueue.clear();
+        throw;
+    }
+}
+
 /**
  * This is only invoked by the miner.
  * The block's proof-of-work is assumed invalid and not checked.
@@ -5611,18 +6080,40 @@ void PruneOneBlockFile(const int fileNumber)
 }
 
 
-void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
+/* Prune the undo file of a block file, keeping the blocks (modify associated database entries)*/
+void PruneOneUndoFile(const int fileNumber)
 {
-    for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
-        CDiskBlockPos pos(*it, 0);
-        fs::remove(GetBlockPosFilename(pos, "blk"));
-        fs::remove(GetBlockPosFilename(pos, "rev"));
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == fileNumber && (pindex->nStatus & BLOCK_HAVE_UNDO)) {
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+        }
+    }
+
+    vinfoBlockFile[fileNumber].nUndoSize = 0;
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune, const std::set<int>& setUndoFilesToPrune)
+{
+    for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        fs::remove(GetBlockPosFilename(pos, "blk"));
+        fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
+    for (set<int>::iterator it = setUndoFilesToPrune.begin(); it != setUndoFilesToPrune.end(); ++it) {
+        CDiskBlockPos pos(*it, 0);
+        fs::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted rev (%05u)\n", __func__, *it);
+    }
 }
 
 /* Calculate the block/rev files that should be deleted to remain under target*/
-void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight)
+void FindFilesToPrune(std::set<int>& setFilesToPrune, std::set<int>& setUndoFilesToPrune, uint64_t nPruneAfterHeight)
 {
     LOCK2(cs_main, cs_LastBlockFile);
     if (chainActive.Tip() == NULL || nPruneTarget == 0) {
@@ -5632,7 +6123,21 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
         return;
     }
 
-    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
+    // Undo data is only needed to disconnect blocks, which never happens
+    // further than MIN_BLOCKS_TO_KEEP below the tip. The blocks themselves
+    // are kept for nPruneKeepBlocks so that they can be served to peers.
+    int nLastUndoWeCanPrune = chainActive.Tip()->nHeight - (int)MIN_BLOCKS_TO_KEEP;
+    int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - (int)std::max(nPruneKeepBlocks, MIN_BLOCKS_TO_KEEP);
+    // The index builder still needs the blocks it has not indexed yet, and
+    // the recent ones in case they are disconnected.
+    if (pindexBuilder) {
+        int nIndexedHeight = pindexBuilder->GetBestHeight();
+        if (nIndexedHeight <= (int)MIN_BLOCKS_TO_KEEP) {
+            return;
+        }
+        nLastUndoWeCanPrune = std::min(nLastUndoWeCanPrune, nIndexedHeight - (int)MIN_BLOCKS_TO_KEEP);
+        nLastBlockWeCanPrune = std::min(nLastBlockWeCanPrune, nIndexedHeight - (int)MIN_BLOCKS_TO_KEEP);
+    }
     uint64_t nCurrentUsage = CalculateCurrentUsage();
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
@@ -5640,8 +6145,30 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
     uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
     uint64_t nBytesToPrune;
     int count=0;
+    int nUndoCount=0;
 
     if (nCurrentUsage + nBuffer >= nPruneTarget) {
+        // When keeping more blocks than needed to reorganize, first drop the
+        // undo data of the old ones, so that they stay available to peers.
+        for (int fileNumber = 0; nPruneKeepBlocks > MIN_BLOCKS_TO_KEEP && fileNumber < nLastBlockFile; fileNumber++) {
+            nBytesToPrune = vinfoBlockFile[fileNumber].nUndoSize;
+
+            if (vinfoBlockFile[fileNumber].nSize == 0 || nBytesToPrune == 0)
+                continue;
+
+            if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
+                break;
+
+            // don't prune undo files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
+            if ((int)vinfoBlockFile[fileNumber].nHeightLast > nLastUndoWeCanPrune)
+                continue;
+
+            PruneOneUndoFile(fileNumber);
+            setUndoFilesToPrune.insert(fileNumber);
+            nCurrentUsage -= nBytesToPrune;
+            nUndoCount++;
+        }
+
         for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
             nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
 
@@ -5651,22 +6178,23 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
             if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
                 break;
 
-            // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
-            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+            // don't prune files that could have a block within nPruneKeepBlocks of the main chain's tip but keep scanning
+            if ((int)vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
                 continue;
 
             PruneOneBlockFile(fileNumber);
             // Queue up the files for removal
             setFilesToPrune.insert(fileNumber);
+            setUndoFilesToPrune.erase(fileNumber);
             nCurrentUsage -= nBytesToPrune;
             count++;
         }
     }
 
-    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d max_undo_prune_height=%d removed %d blk/rev pairs and %d rev files\n",
            nPruneTarget/1024/1024, nCurrentUsage/1024/1024,
            ((int64_t)nPruneTarget - (int64_t)nCurrentUsage)/1024/1024,
-           nLastBlockWeCanPrune, count);
+           nLastBlockWeCanPrune, nLastUndoWeCanPrune, count, nUndoCount);
 }
 
 bool CheckDiskSpace(uint64_t nAdditionalBytes)
@@ -5738,10 +6266,11 @@ CBlockIndex * InsertBlockIndex(const uint256& hash)
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, chainparams))
+    auto reserveBlockIndex = [](size_t nEntries) { mapBlockIndex.reserve(nEntries); };
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, reserveBlockIndex, chainparams, std::max(1, nScriptCheckThreads)))
         return false;
 
-    // Calculate nChainWork
+    // Calculate nChainWork, in a single pass over the entries ordered by height
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
@@ -5750,9 +6279,13 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    set<int> setBlkDataFiles;
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
+        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            setBlkDataFiles.insert(pindex->nFile);
+        }
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
@@ -5895,14 +6428,6 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
-    set<int> setBlkDataFiles;
-    for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
-            setBlkDataFiles.insert(pindex->nFile);
-        }
-    }
     for (std::set<int>::iterator it = setBlkDataFiles.begin(); it != setBlkDataFiles.end(); it++)
     {
         CDiskBlockPos pos(*it, 0);
@@ -5941,6 +6466,18 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     else if (fLightWalletd) {
         fAddressIndex = true;
     }
+    if (fAddressIndex) {
+        // Address indexes created before per-address totals were kept get
+        // them computed once here.
+        bool fAddressBalance = false;
+        pblocktree->ReadFlag("addressbalance", fAddressBalance);
+        if (!fAddressBalance) {
+            LogPrintf("%s: computing address balances from the address index...\n", __func__);
+            if (!pblocktree->BuildAddressBalances())
+                return false;
+            pblocktree->WriteFlag("addressbalance", true);
+        }
+    }
 
     // Fill in-memory data
     for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
@@ -6064,41 +6601,141 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     int nGoodTransactions = 0;
     CValidationState state;
 
-    // Flags used to permit skipping checks for efficiency
-    auto verifier = ProofVerifier::Disabled(); // No need to verify JoinSplits twice
-    bool fCheckTransactions = true;
-
+    // Collect the blocks to check, newest first. Whether a block's
+    // transactions are checked is decided here, since that takes cs_main.
+    std::vector<std::pair<CBlockIndex*, bool>> vBlocks;
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
     {
-        boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruned (or bootstrapped from a snapshot), only go back as far as we have data.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+            break;
+        }
+        vBlocks.emplace_back(pindex, ShouldCheckTransactions(chainparams, pindex));
+    }
 
+    // Levels 0 to 2 only look at one block at a time, so they run on worker
+    // threads that read ahead of the serial level 3 disconnects below. Each
+    // worker holds at most VERIFYDB_READ_AHEAD blocks that are waiting to be
+    // disconnected.
+    struct CheckedBlock {
         CBlock block;
+        std::string strError;
+    };
+    const size_t nWorkers = std::max(1, nScriptCheckThreads);
+    const size_t nWindow = nWorkers * VERIFYDB_READ_AHEAD;
+    Mutex cs_verify;
+    std::condition_variable condVerify;
+    size_t nNextBlock = 0;
+    size_t nConsumed = 0;
+    bool fStop = false;
+    std::map<size_t, CheckedBlock> mapChecked;
+
+    auto checkBlock = [&](size_t i, CheckedBlock& checked) {
+        CBlockIndex* pindex = vBlocks[i].first;
+        CValidationState state;
+        // No need to verify JoinSplits twice
+        auto verifier = ProofVerifier::Disabled();
+
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        if (!ReadBlockFromDisk(checked.block, pindex, chainparams.GetConsensus())) {
+            checked.strError = strprintf("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
 
         // check level 1: verify block validity
-        fCheckTransactions = ShouldCheckTransactions(chainparams, pindex);
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams, verifier, true, true, fCheckTransactions))
-            return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+        if (nCheckLevel >= 1 && !CheckBlock(checked.block, state, chainparams, verifier, true, true, vBlocks[i].second)) {
+            checked.strError = strprintf("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
 
         // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
+        if (nCheckLevel >= 2) {
             CBlockUndo undo;
             CDiskBlockPos pos = pindex->GetUndoPos();
             if (!pos.IsNull()) {
                 if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+                    checked.strError = strprintf("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
+            }
+        }
+    };
+
+    auto threadCheck = [&]() {
+        while (true) {
+            size_t i;
+            {
+                WAIT_LOCK(cs_verify, lock);
+                condVerify.wait(lock, [&] {
+                    return fStop || nNextBlock >= vBlocks.size() || nNextBlock < nConsumed + nWindow;
+                });
+                if (fStop || nNextBlock >= vBlocks.size())
+                    return;
+                i = nNextBlock++;
             }
+            CheckedBlock checked;
+            try {
+                checkBlock(i, checked);
+            } catch (const std::exception& e) {
+                checked.strError = strprintf("VerifyDB(): *** exception checking block at %d: %s", vBlocks[i].first->nHeight, e.what());
+            }
+            {
+                LOCK(cs_verify);
+                mapChecked.emplace(i, std::move(checked));
+            }
+            condVerify.notify_all();
+        }
+    };
+
+    std::vector<std::thread> vThreads;
+    for (size_t n = 0; n < std::min(nWorkers, vBlocks.size()); n++) {
+        vThreads.emplace_back(threadCheck);
+    }
+    // Stop and join the workers however this function returns.
+    struct StopWorkers {
+        std::function<void()> stop;
+        ~StopWorkers() { stop(); }
+    } stopWorkers{[&]() {
+        {
+            LOCK(cs_verify);
+            fStop = true;
+        }
+        condVerify.notify_all();
+        for (auto& thread : vThreads) {
+            thread.join();
         }
+    }};
+
+    for (size_t i = 0; i < vBlocks.size(); i++)
+    {
+        CBlockIndex* pindex = vBlocks[i].first;
+        boost::this_thread::interruption_point();
+        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
+
+        CheckedBlock checked;
+        {
+            WAIT_LOCK(cs_verify, lock);
+            condVerify.wait(lock, [&] { return mapChecked.count(i) > 0; });
+            auto it = mapChecked.find(i);
+            checked = std::move(it->second);
+            mapChecked.erase(it);
+            nConsumed = i + 1;
+        }
+        condVerify.notify_all();
+        if (!checked.strError.empty())
+            return error("%s", checked.strError);
+        const CBlock& block = checked.block;
 
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            // insightexplorer: do not update indices (false)
-            DisconnectResult res = DisconnectBlock(block, state, pindex, coins, chainparams, false);
+        // With -prunekeepblocks, old blocks may be kept without their undo
+        // data, and neither they nor the blocks below them can be disconnected.
+        bool fHaveUndo = !fHavePruned || (pindex->nStatus & BLOCK_HAVE_UNDO);
+        if (nCheckLevel >= 3 && pindex == pindexState && !fHaveUndo) {
+            LogPrintf("VerifyDB(): level 3 checks stopping at height %d (pruning, no undo data)\n", pindex->nHeight);
+        }
+        if (nCheckLevel >= 3 && pindex == pindexState && fHaveUndo && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+            DisconnectResult res = DisconnectBlock(block, state, pindex, coins, chainparams);
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
@@ -6564,6 +7201,32 @@ bool LoadBlockIndex()
     return true;
 }
 
+bool EnableInsightIndexes(bool fInsightExplorer, bool fLightWalletd)
+{
+    LOCK(cs_main);
+
+    bool fHadAddressIndex = fAddressIndex;
+    if (fInsightExplorer) {
+        fAddressIndex = true;
+        fSpentIndex = true;
+        fTimestampIndex = true;
+    }
+    else if (fLightWalletd) {
+        fAddressIndex = true;
+    }
+    LogPrintf("%s: enabling%s%s, the indexes will be built in the background\n", __func__,
+              fInsightExplorer ? " insight explorer" : "", fLightWalletd ? " light wallet daemon" : "");
+
+    // Existing index entries are rewritten as the builder passes over them;
+    // the per-address totals only count entries that were not yet present.
+    if (!pblocktree->WriteIndexBuilderBestBlock(CBlockLocator()))
+        return error("%s: failed to reset the index builder", __func__);
+    if (!fHadAddressIndex && !pblocktree->WriteFlag("addressbalance", fAddressIndex))
+        return false;
+    return pblocktree->WriteFlag("insightexplorer", fInsightExplorer) &&
+           pblocktree->WriteFlag("lightwalletd", fLightWalletd);
+}
+
 bool InitBlockIndex(const CChainParams& chainparams)
 {
     LOCK(cs_main);
@@ -6590,6 +7253,9 @@ bool InitBlockIndex(const CChainParams& chainparams)
     else if (fExperimentalLightWalletd) {
         fAddressIndex = true;
     }
+    pblocktree->WriteFlag("addressbalance", fAddressIndex);
+    // An empty locator makes the index builder start from the genesis block.
+    pblocktree->WriteIndexBuilderBestBlock(CBlockLocator());
 
     LogPrintf("Initializing databases...\n");
 
@@ -6983,8 +7649,42 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Answer a getdata request for one of the recent blocks of the active chain
+ * without cs_main, so that it is not held up by the block validation thread.
+ * Returns false if the request has to be looked up under cs_main.
+ */
+static bool ProcessGetRecentBlock(CNode* pfrom, const CInv& inv, const Consensus::Params& consensusParams)
+{
+    // Filtered blocks and the end of a getblocks batch need the chain state.
+    if (inv.type != MSG_BLOCK || inv.hash == pfrom->hashContinue)
+        return false;
+
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_recentBlocks);
+        auto it = mapRecentBlockPos.find(inv.hash);
+        if (it == mapRecentBlockPos.end())
+            return false;
+        pos = it->second;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos, consensusParams) || block.GetHash() != inv.hash)
+        return false;
+    pfrom->PushMessage("block", block);
+    return true;
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams)
 {
+    // Like the loop below, this sends at most one block per call.
+    if (!pfrom->vRecvGetData.empty() && pfrom->nSendSize < SendBufferSize() &&
+        ProcessGetRecentBlock(pfrom, pfrom->vRecvGetData.front(), consensusParams)) {
+        pfrom->vRecvGetData.pop_front();
+        return;
+    }
+
     int currentHeight = GetHeight();
 
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -7088,6 +7788,10 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                         pfrom->PushMessage("inv", vInv);
                         pfrom->hashContinue.SetNull();
                     }
+                } else if (send && inv.type == MSG_BLOCK) {
+                    // The block was pruned. Say so, so that the peer can ask
+                    // another peer rather than wait for the download to time out.
+                    vNotFound.push_back(inv);
                 }
             }
             else if (inv.type == MSG_TX || inv.type == MSG_WTX)
@@ -7216,6 +7920,317 @@ void static ProcessOrphanTx(const CChainParams& chainparams, std::set<uint256>&
     }
 }
 
+/**
+ * Ask a peer for headers. The peer may then make us check the RandomX
+ * solutions of a full batch of headers without spending its own budget.
+ */
+static void PushGetHeaders(CNode* pnode, const CBlockLocator& locator, const uint256& hashStop)
+{
+    AssertLockHeld(cs_main);
+    State(pnode->GetId())->fGetHeadersOutstanding = true;
+    pnode->m_header_randomx_tokens = std::min<double>(
+        pnode->m_header_randomx_tokens + MAX_COMPACT_HEADERS_RESULTS, MAX_HEADER_RANDOMX_TOKEN_CREDIT);
+    pnode->PushMessage("getheaders", locator, hashStop);
+}
+
+/**
+ * Check the RandomX solutions of a run of consecutive headers in parallel on
+ * the validation task threads, before AcceptBlockHeader takes them one at a
+ * time under cs_main. Those threads keep their RandomX VMs between messages.
+ *
+ * The cheap checks of AcceptBlockHeader are made first: the first header is
+ * checked against the block index, and each of the others against the
+ * headers before it in the run, so that a header with the wrong target or
+ * time costs no hash. The seed of each header is found among the known
+ * ancestors of the first header or earlier in the run. Headers whose seed
+ * is earlier in the run are only hashed once the seed's own header has been
+ * found valid.
+ *
+ * Unless it is whitelisted, each new header costs the peer a token from its
+ * RandomX verification budget, and the peer may only make us use a few seeds
+ * that are not on our best header chain, counting seeds earlier in the run
+ * until their headers are accepted. Returns how many of the headers are
+ * within these limits; the rest must be ignored. vSolutions is set to the
+ * verdict on each header's solution, to be passed to AcceptBlockHeader.
+ * Headers left unchecked, including ones that are already known or that
+ * fail the cheap checks, are left to AcceptBlockHeader to check or reject.
+ */
+static size_t CheckHeaderSolutions(CNode* pfrom, const std::vector<CBlockHeader>& headers, const CChainParams& chainparams, std::vector<HeaderSolution>& vSolutions)
+{
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+    vSolutions.assign(headers.size(), HeaderSolution::Unchecked);
+    std::vector<char> vKnown(headers.size(), false);
+    std::vector<uint256> vSeeds(headers.size());
+    size_t nAllowed = headers.size();
+    // The first header whose seed is a header earlier in the run that is not
+    // accepted yet. A run is shorter than a RandomX epoch, so it holds at
+    // most one such seed.
+    size_t nFirstSeededInRun = 0;
+    // The number of headers that passed the cheap checks.
+    size_t nContextChecked = 0;
+    int nFirstHeight;
+    {
+        LOCK(cs_main);
+        if (headers.empty())
+            return 0;
+        BlockMap::iterator mi = mapBlockIndex.find(headers[0].hashPrevBlock);
+        if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_FAILED_MASK))
+            return nAllowed;
+        CBlockIndex* pindexPrev = mi->second;
+        nFirstHeight = pindexPrev->nHeight + 1;
+
+        // Temporary index entries for the headers of the run, linked to the
+        // block index, so that each header is checked as it would be once
+        // the ones before it are accepted. Nothing after the first header
+        // that fails is checked or hashed.
+        std::deque<uint256> vRunHashes;
+        std::deque<CBlockIndex> vRunIndex;
+        CBlockIndex* pindexRunPrev = pindexPrev;
+        for (; nContextChecked < headers.size(); nContextChecked++) {
+            const CBlockHeader& header = headers[nContextChecked];
+            CValidationState state;
+            if (header.hashPrevBlock != pindexRunPrev->GetBlockHash() ||
+                !CheckBlockHeader(header, state, chainparams, true, pindexRunPrev, false) ||
+                !ContextualCheckBlockHeader(header, state, chainparams, pindexRunPrev))
+                break;
+            vRunHashes.push_back(header.GetHash());
+            vRunIndex.emplace_back(header);
+            CBlockIndex& index = vRunIndex.back();
+            index.phashBlock = &vRunHashes.back();
+            index.pprev = pindexRunPrev;
+            index.nHeight = pindexRunPrev->nHeight + 1;
+            pindexRunPrev = &index;
+        }
+        nAllowed = std::min(nAllowed, nContextChecked + 1);
+        nFirstSeededInRun = nContextChecked;
+
+        // Update the RandomX verification budget.
+        const int64_t current_time = GetTimeMicros();
+        if (pfrom->m_header_randomx_tokens < MAX_HEADER_RANDOMX_TOKEN_BUCKET) {
+            // Don't increment bucket if it's already full
+            const auto time_diff = std::max(current_time - pfrom->m_header_randomx_timestamp, (int64_t) 0);
+            const double increment = (time_diff / 1000000.0) * MAX_HEADER_RANDOMX_RATE_PER_SECOND;
+            pfrom->m_header_randomx_tokens = std::min<double>(pfrom->m_header_randomx_tokens + increment, MAX_HEADER_RANDOMX_TOKEN_BUCKET);
+        }
+        pfrom->m_header_randomx_timestamp = current_time;
+
+        for (size_t i = 0; i < nContextChecked; i++) {
+            vKnown[i] = mapBlockIndex.count(headers[i].GetHash()) != 0;
+            if (vKnown[i])
+                continue;
+            uint64_t nSeedHeight = RandomX_SeedHeight(nFirstHeight + i);
+            bool fForkSeed;
+            if (nSeedHeight == 0) {
+                vSeeds[i] = RandomXGenesisSeedHash();
+                fForkSeed = false;
+            } else if (nSeedHeight < (uint64_t)nFirstHeight) {
+                const CBlockIndex* pindexSeed = pindexPrev->GetAncestor(nSeedHeight);
+                vSeeds[i] = pindexSeed->GetBlockHash();
+                fForkSeed = !pindexBestHeader || pindexBestHeader->GetAncestor(nSeedHeight) != pindexSeed;
+            } else {
+                // Until it is accepted, the seed's header may be made up by
+                // the peer, so it is not on our best header chain.
+                vSeeds[i] = headers[nSeedHeight - nFirstHeight].GetHash();
+                BlockMap::iterator miSeed = mapBlockIndex.find(vSeeds[i]);
+                if (miSeed == mapBlockIndex.end()) {
+                    fForkSeed = true;
+                    nFirstSeededInRun = std::min(nFirstSeededInRun, i);
+                } else {
+                    fForkSeed = !pindexBestHeader || pindexBestHeader->GetAncestor(nSeedHeight) != miSeed->second;
+                }
+            }
+
+            if (pfrom->fWhitelisted)
+                continue;
+            if (pfrom->m_header_randomx_tokens < 1.0 ||
+                (fForkSeed && pfrom->m_header_randomx_fork_seeds.count(vSeeds[i]) == 0 &&
+                 pfrom->m_header_randomx_fork_seeds.size() >= MAX_HEADER_RANDOMX_FORK_SEEDS)) {
+                nAllowed = i;
+                break;
+            }
+            pfrom->m_header_randomx_tokens -= 1.0;
+            if (fForkSeed)
+                pfrom->m_header_randomx_fork_seeds.insert(vSeeds[i]);
+        }
+    }
+
+    // Workers take headers in order and all stop at the first bad one, as the
+    // caller rejects the whole message there. Every header before it has
+    // been taken by then, so none of those is left for the caller to hash.
+    std::atomic<size_t> nNext{0};
+    std::atomic<bool> fFailed{false};
+    auto checkSolutions = [&](size_t nEnd) {
+        size_t i;
+        while (!fFailed && (i = nNext++) < nEnd) {
+            if (vKnown[i])
+                continue;
+            const CBlockHeader& header = headers[i];
+            // The target check is cheap, so a header claiming too little work
+            // costs no RandomX hash. AcceptBlockHeader rejects it.
+            if (header.nSolution.size() != 32 ||
+                !CheckProofOfWork(header.GetHash(), header.nBits, consensusParams)) {
+                fFailed = true;
+                break;
+            }
+            bool fValid;
+            {
+                CValidationStageTimer timer(ValidationStage::RandomX);
+                fValid = CheckRandomXSolutionWithSeed(&header, nFirstHeight + i, vSeeds[i]);
+            }
+            vSolutions[i] = fValid ? HeaderSolution::Valid : HeaderSolution::Invalid;
+            if (!fValid) {
+                fFailed = true;
+                break;
+            }
+        }
+    };
+
+    auto runChecks = [&](size_t nBegin, size_t nEnd) {
+        if (nBegin >= nEnd)
+            return;
+        nNext = nBegin;
+        size_t nTasks = std::min<size_t>(std::max(1, nScriptCheckThreads), nEnd - nBegin);
+        std::vector<CValidationTask> vTasks;
+        for (size_t t = 0; t < nTasks; t++)
+            vTasks.emplace_back([&checkSolutions, nEnd]() { checkSolutions(nEnd); });
+        RunValidationTasks(vTasks);
+    };
+
+    const size_t nHashEnd = std::min(nAllowed, nContextChecked);
+    const size_t nSeededEnd = std::min(nHashEnd, nFirstSeededInRun);
+    runChecks(0, nSeededEnd);
+    if (!fFailed)
+        runChecks(nSeededEnd, nHashEnd);
+    return nAllowed;
+}
+
+/**
+ * Accept a run of headers from a "headers" or "cheaders" message, which
+ * holds at most nMaxCount of them, and ask the peer for more if it was full.
+ */
+static bool ProcessHeadersMessage(const CChainParams& chainparams, CNode* pfrom, const std::vector<CBlockHeader>& headers, size_t nMaxCount)
+{
+    std::vector<HeaderSolution> vSolutions;
+    size_t nAllowed = CheckHeaderSolutions(pfrom, headers, chainparams, vSolutions);
+    if (nAllowed < headers.size()) {
+        size_t nRateLimited = headers.size() - nAllowed;
+        pfrom->m_headers_rate_limited += nRateLimited;
+        MetricsCounter("zcash.net.headers.ratelimited.total", nRateLimited);
+        LogPrint("net", "ignoring %u headers from peer=%d over its RandomX verification budget\n", nRateLimited, pfrom->id);
+    }
+
+    {
+    LOCK(cs_main);
+
+    CNodeState *nodestate = State(pfrom->GetId());
+
+    // A block announced with headers whose parent we don't know: we are
+    // probably missing the headers in between, so ask for them rather than
+    // penalize the peer, unless it keeps doing so. The getheaders is not
+    // sent while another one is unanswered, so that announcements can't be
+    // used to refill the peer's RandomX budget.
+    if (!headers.empty() && headers.size() <= MAX_BLOCKS_TO_ANNOUNCE &&
+        mapBlockIndex.count(headers[0].hashPrevBlock) == 0) {
+        nodestate->nUnconnectingHeaders++;
+        if (!nodestate->fGetHeadersOutstanding) {
+            LogPrint("net", "getheaders (%d) to connect announced header %s from peer=%d (unconnecting: %d)\n",
+                     pindexBestHeader->nHeight, headers[0].GetHash().ToString(), pfrom->id, nodestate->nUnconnectingHeaders);
+            PushGetHeaders(pfrom, chainActive.GetLocator(pindexBestHeader), uint256());
+        }
+        if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS == 0) {
+            Misbehaving(pfrom->GetId(), 20);
+        }
+        return true;
+    }
+
+    // Only an answer to our own getheaders, within the peer's budget, earns
+    // it a follow-up and the RandomX credit that comes with one.
+    bool fRequested = nodestate->fGetHeadersOutstanding;
+    nodestate->fGetHeadersOutstanding = false;
+
+    if (headers.empty()) {
+        // Nothing interesting. Stop asking this peer for more headers.
+        return true;
+    }
+
+    // If we already know the last header in the message, then it contains
+    // no new information for us.  In this case, we do not request
+    // more headers later.  This prevents multiple chains of redundant
+    // getheader requests from running in parallel if triggered by incoming
+    // blocks while the node is still in initial headers sync.
+    //
+    // (Allow disabling optimization in case there are unexpected problems.)
+    bool hasNewHeaders = true;
+    if (GetBoolArg("-optimize-getheaders", true) && IsInitialBlockDownload(chainparams.GetConsensus())) {
+        hasNewHeaders = (mapBlockIndex.count(headers.back().GetHash()) == 0);
+    }
+
+    CBlockIndex *pindexLast = NULL;
+    for (size_t n = 0; n < nAllowed; n++) {
+        const CBlockHeader& header = headers[n];
+        CValidationState state;
+        if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+            Misbehaving(pfrom->GetId(), 20);
+            return error("non-continuous headers sequence");
+        }
+        if (!AcceptBlockHeader(header, state, chainparams, &pindexLast, vSolutions[n])) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                MetricsIncrementCounter("zcash.net.headers.rejected.total", "reason", state.GetRejectReason().c_str());
+                if (nDoS > 0)
+                    Misbehaving(pfrom->GetId(), nDoS);
+                return error("invalid header received");
+            }
+        }
+    }
+
+    if (pindexLast) {
+        UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+        nodestate->nUnconnectingHeaders = 0;
+    }
+
+    // Seeds on our best header chain no longer count against the peer.
+    for (auto it = pfrom->m_header_randomx_fork_seeds.begin(); it != pfrom->m_header_randomx_fork_seeds.end(); ) {
+        BlockMap::iterator mi = mapBlockIndex.find(*it);
+        if (mi != mapBlockIndex.end() && pindexBestHeader &&
+            pindexBestHeader->GetAncestor(mi->second->nHeight) == mi->second) {
+            it = pfrom->m_header_randomx_fork_seeds.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // A short run of headers ending in a block we don't have is an announcement.
+    if (pindexLast && headers.size() <= MAX_BLOCKS_TO_ANNOUNCE && !(pindexLast->nStatus & BLOCK_HAVE_DATA))
+        MarkBlockAsAnnounced(State(pfrom->GetId()), pindexLast->GetBlockHash(), true);
+
+    // Reset header sync timer if we received new headers
+    if (hasNewHeaders && pindexLast) {
+        if (nodestate && nodestate->fSyncStarted) {
+            nodestate->nHeadersSyncStarted = GetTimeMicros();
+        }
+    }
+
+    // Temporary, until we're sure the optimization works
+    if (headers.size() == nMaxCount && pindexLast && !hasNewHeaders) {
+        LogPrint("net", "NO more getheaders (%d) to send to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+    }
+
+    if (headers.size() == nMaxCount && pindexLast && hasNewHeaders && fRequested && nAllowed == headers.size()) {
+        // Headers message had its maximum size; the peer may have more headers.
+        // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
+        // from there instead.
+        LogPrint("net", "more getheaders (%d) to send to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+        PushGetHeaders(pfrom, chainActive.GetLocator(pindexLast), uint256());
+    }
+
+    CheckBlockIndex(chainparams.GetConsensus());
+    }
+
+    NotifyHeaderTip(chainparams.GetConsensus());
+    return true;
+}
+
 bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     LogPrint("net", "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->id);
@@ -7343,11 +8358,12 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             pfrom->strSubVer = strSubVer;
             pfrom->cleanSubVer = cleanSubVer;
         }
-        pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
+        pfrom->fClient = !(pfrom->nServices & NODE_NETWORK) && !(pfrom->nServices & NODE_NETWORK_LIMITED);
 
         // Potentially mark this peer as a preferred download peer.
         {
             LOCK(cs_main);
+            State(pfrom->GetId())->fLimitedNode = !(pfrom->nServices & NODE_NETWORK) && (pfrom->nServices & NODE_NETWORK_LIMITED);
             UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
         }
 
@@ -7438,6 +8454,28 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         if (pfrom->fNetworkNode) {
             state->fCurrentlyConnected = true;
         }
+
+        // Ask for our headers as "cheaders". Peers that don't know the
+        // message ignore it and keep sending "headers".
+        pfrom->PushMessage("sendcmpcthdrs");
+
+        // Ask for new blocks to be announced with headers rather than
+        // with an inv, which saves us a getheaders round trip.
+        pfrom->PushMessage("sendheaders");
+    }
+
+
+    else if (strCommand == "sendcmpcthdrs")
+    {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fPreferCompactHeaders = true;
+    }
+
+
+    else if (strCommand == "sendheaders")
+    {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fPreferHeaders = true;
     }
 
 
@@ -7594,6 +8632,8 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
 
             if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
+                if (!fAlreadyHave)
+                    MarkBlockAsAnnounced(State(pfrom->GetId()), inv.hash, false);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // Headers-first is the primary method of announcement on
                     // the network. If a node fell back to sending blocks by inv,
@@ -7617,7 +8657,7 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
         }
 
         if (best_block != nullptr) {
-            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), *best_block);
+            PushGetHeaders(pfrom, chainActive.GetLocator(pindexBestHeader), *best_block);
             LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, best_block->ToString(), pfrom->id);
         }
     }
@@ -7670,7 +8710,7 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             }
             // If pruning, don't inv blocks unless we have on disk and are likely to still have
             // for some reasonable time window (1 hour) that block relay might require.
-            const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / chainparams.GetConsensus().PoWTargetSpacing(pindex->nHeight);
+            const int nPrunedBlocksLikelyToHave = nPruneKeepBlocks - 3600 / chainparams.GetConsensus().PoWTargetSpacing(pindex->nHeight);
             if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave))
             {
                 LogPrint("net", " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
@@ -7719,7 +8759,9 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
 
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
+        CNodeState *nodestate = State(pfrom->GetId());
+        bool fCompact = nodestate && nodestate->fPreferCompactHeaders;
+        int nLimit = fCompact ? MAX_COMPACT_HEADERS_RESULTS : MAX_HEADERS_RESULTS;
         LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
         for (; pindex; pindex = chainActive.Next(pindex))
         {
@@ -7727,7 +8769,14 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
                 break;
         }
-        pfrom->PushMessage("headers", vHeaders);
+        // The peer now has these headers, so new blocks on top of them can
+        // be announced to it with headers.
+        if (nodestate && !vHeaders.empty())
+            nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
+        if (fCompact)
+            pfrom->PushMessage("cheaders", CCompactHeaders(std::vector<CBlockHeader>(vHeaders.begin(), vHeaders.end())));
+        else
+            pfrom->PushMessage("headers", vHeaders);
     }
 
 
@@ -7871,87 +8920,50 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
-        {
-        LOCK(cs_main);
-
-        if (nCount == 0) {
-            // Nothing interesting. Stop asking this peer for more headers.
-            return true;
-        }
-
-        // If we already know the last header in the message, then it contains
-        // no new information for us.  In this case, we do not request
-        // more headers later.  This prevents multiple chains of redundant
-        // getheader requests from running in parallel if triggered by incoming
-        // blocks while the node is still in initial headers sync.
-        //
-        // (Allow disabling optimization in case there are unexpected problems.)
-        bool hasNewHeaders = true;
-        if (GetBoolArg("-optimize-getheaders", true) && IsInitialBlockDownload(chainparams.GetConsensus())) {
-            hasNewHeaders = (mapBlockIndex.count(headers.back().GetHash()) == 0);
-        }
-
-        CBlockIndex *pindexLast = NULL;
-        for (const CBlockHeader& header : headers) {
-            CValidationState state;
-            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
-                Misbehaving(pfrom->GetId(), 20);
-                return error("non-continuous headers sequence");
-            }
-            if (!AcceptBlockHeader(header, state, chainparams, &pindexLast)) {
-                int nDoS;
-                if (state.IsInvalid(nDoS)) {
-                    if (nDoS > 0)
-                        Misbehaving(pfrom->GetId(), nDoS);
-                    return error("invalid header received");
-                }
-            }
-        }
-
-        if (pindexLast)
-            UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
-
-        // Reset header sync timer if we received new headers
-        if (hasNewHeaders && pindexLast) {
-            CNodeState *nodestate = State(pfrom->GetId());
-            if (nodestate && nodestate->fSyncStarted) {
-                nodestate->nHeadersSyncStarted = GetTimeMicros();
-            }
-        }
-
-        // Temporary, until we're sure the optimization works
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast && !hasNewHeaders) {
-            LogPrint("net", "NO more getheaders (%d) to send to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-        }
+        return ProcessHeadersMessage(chainparams, pfrom, headers, MAX_HEADERS_RESULTS);
+    }
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast && hasNewHeaders) {
-            // Headers message had its maximum size; the peer may have more headers.
-            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-            // from there instead.
-            LogPrint("net", "more getheaders (%d) to send to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256());
-        }
 
-        CheckBlockIndex(chainparams.GetConsensus());
+    else if (strCommand == "cheaders" && !fImporting && !fReindex) // Ignore headers received while importing
+    {
+        unsigned int nCount = ReadCompactSize(vRecv);
+        if (nCount > MAX_COMPACT_HEADERS_RESULTS) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("cheaders message size = %u", nCount);
         }
+        CCompactHeaders compactHeaders;
+        compactHeaders.UnserializeHeaders(vRecv, nCount);
 
-        NotifyHeaderTip(chainparams.GetConsensus());
+        return ProcessHeadersMessage(chainparams, pfrom, compactHeaders.vHeaders, MAX_COMPACT_HEADERS_RESULTS);
     }
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
-        CBlock block;
+        size_t nBytes = vRecv.size();
+        auto pblock = std::make_shared<CBlock>();
+        CBlock& block = *pblock;
         vRecv >> block;
 
         LogPrint("net", "received block %s peer=%d\n", block.GetHash().ToString(), pfrom->id);
 
+        {
+            LOCK(cs_main);
+            auto itInFlight = mapBlocksInFlight.find(block.GetHash());
+            bool fRequested = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+            MarkBlockRelayed(pfrom->GetId(), block.GetHash(), fRequested, nTimeReceived);
+            MarkBlockAsDelivered(pfrom->GetId(), block.GetHash(), nBytes, nTimeReceived);
+        }
+
         CValidationState state;
         // Process all blocks from whitelisted peers, even if not requested,
         // unless we're still syncing with the network.
         // Such an unrequested block may still be processed, subject to the
         // conditions in AcceptBlock().
         bool forceProcessing = pfrom->fWhitelisted && !IsInitialBlockDownload(chainparams.GetConsensus());
-        ProcessNewBlock(state, chainparams, pfrom, &block, forceProcessing, NULL);
+        // The block is connected by the block validation thread, so only
+        // errors found before that are reported here.
+        ProcessNewBlockAsync(state, chainparams, pfrom, pblock, forceProcessing);
         int nDoS;
         if (state.IsInvalid(nDoS)) {
             assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
@@ -8214,11 +9226,26 @@ bool static ProcessMessage(const CChainParams& chainparams, CNode* pfrom, string
     }
 
     else if (strCommand == "notfound") {
-        // We do not care about the NOTFOUND message, but logging an Unknown Command
-        // message would be undesirable as we transmit it ourselves.
+        // A pruned peer may no longer have a block we asked it for, so stop
+        // waiting for it and let the block be requested from another peer.
+        // The transactions are not tracked, and so are ignored.
+        vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() <= MAX_INV_SZ) {
+            LOCK(cs_main);
+            for (const CInv& inv : vInv) {
+                if (inv.type != MSG_BLOCK)
+                    continue;
+                auto itInFlight = mapBlocksInFlight.find(inv.hash);
+                if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId()) {
+                    LogPrint("net", "peer=%d does not have block %s\n", pfrom->id, inv.hash.ToString());
+                    MarkBlockAsReceived(inv.hash);
+                }
+            }
+        }
     }
 
-    else if (!(strCommand == "tx" || strCommand == "block" || strCommand == "headers" || strCommand == "alert")) {
+    else if (!(strCommand == "tx" || strCommand == "block" || strCommand == "headers" || strCommand == "cheaders" || strCommand == "alert")) {
         // Ignore unknown commands for extensibility
         LogPrint("net", "Unknown command \"%s\" from peer=%d\n", SanitizeString(strCommand), pfrom->id);
     }
@@ -8274,6 +9301,11 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // A pong tells the peer that everything it sent before the ping has
+        // been processed, including the blocks still being connected.
+        if (pfrom->IsPingDeferred())
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -8349,28 +9381,29 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom)
     }
 
     // In case the connection got shut down, its receive buffer was wiped
-    if (!pfrom->fDisconnect)
+    if (!pfrom->fDisconnect) {
+        for (auto msgIt = pfrom->vRecvMsg.begin(); msgIt != it; ++msgIt) {
+            pfrom->RecycleRecvBuffer(*msgIt);
+        }
         pfrom->vRecvMsg.erase(pfrom->vRecvMsg.begin(), it);
+    }
 
     return fOk;
 }
 
-class CompareInvMempoolOrder
+/**
+ * All inbound peers share one trickle timer, so that transactions are
+ * announced to them in one batch and an attacker with many connections
+ * learns nothing more from the timing than one with a single connection.
+ */
+static int64_t PoissonNextSendInbound(int64_t nNow, int average_interval_seconds)
 {
-    CTxMemPool *mp;
-public:
-    CompareInvMempoolOrder(CTxMemPool *mempool)
-    {
-        mp = mempool;
+    static int64_t nNextInvSendInbound = 0;
+    if (nNextInvSendInbound < nNow) {
+        nNextInvSendInbound = PoissonNextSend(nNow, average_interval_seconds);
     }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * highest feerate to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
+    return nNextInvSendInbound;
+}
 
 bool SendMessages(const Consensus::Params& params, CNode* pto)
 {
@@ -8507,10 +9540,90 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
                 if (pindexStart->pprev)
                     pindexStart = pindexStart->pprev;
                 LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256());
+                PushGetHeaders(pto, chainActive.GetLocator(pindexStart), uint256());
             }
         }
 
+        //
+        // Message: block announcement
+        //
+        {
+            LOCK(pto->cs_inventory);
+            // Announce the new blocks with headers if the peer asked for
+            // them, there are not too many, and they connect to a header
+            // the peer has. A single new block is sent in full to a
+            // -blockpushpeer instead. Otherwise announce the tip with an inv.
+            vector<CBlock> vHeaders;
+            bool fRevertToInv = (!state.fPreferHeaders && !state.fBlockPush) ||
+                                pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE;
+            const CBlockIndex *pBestIndex = NULL;
+            if (!fRevertToInv) {
+                bool fFoundStartingHeader = false;
+                for (const uint256& hash : pto->vBlockHashesToAnnounce) {
+                    BlockMap::iterator mi = mapBlockIndex.find(hash);
+                    assert(mi != mapBlockIndex.end());
+                    const CBlockIndex *pindex = mi->second;
+                    if (chainActive[pindex->nHeight] != pindex) {
+                        // We reorganized away from this block.
+                        fRevertToInv = true;
+                        break;
+                    }
+                    if (pBestIndex != NULL && pindex->pprev != pBestIndex) {
+                        // The blocks to announce don't form a chain.
+                        fRevertToInv = true;
+                        break;
+                    }
+                    pBestIndex = pindex;
+                    if (fFoundStartingHeader) {
+                        vHeaders.push_back(pindex->GetBlockHeader());
+                    } else if (PeerHasHeader(&state, pindex)) {
+                        continue;
+                    } else if (pindex->pprev == NULL || PeerHasHeader(&state, pindex->pprev)) {
+                        fFoundStartingHeader = true;
+                        vHeaders.push_back(pindex->GetBlockHeader());
+                    } else {
+                        // Nothing we could send would connect.
+                        fRevertToInv = true;
+                        break;
+                    }
+                }
+            }
+            if (!fRevertToInv && !vHeaders.empty()) {
+                CBlock block;
+                if (state.fBlockPush && vHeaders.size() == 1 && ReadBlockFromDisk(block, pBestIndex, params)) {
+                    LogPrint("net", "pushing block %s to peer=%d\n", pBestIndex->GetBlockHash().ToString(), pto->id);
+                    pto->PushMessage("block", block);
+                    state.nBlocksPushedTo++;
+                    MetricsIncrementCounter("zcash.net.block.announced.total", "via", "push");
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else if (state.fPreferHeaders) {
+                    LogPrint("net", "sending %d headers up to %s to peer=%d\n", vHeaders.size(), pBestIndex->GetBlockHash().ToString(), pto->id);
+                    if (state.fPreferCompactHeaders)
+                        pto->PushMessage("cheaders", CCompactHeaders(std::vector<CBlockHeader>(vHeaders.begin(), vHeaders.end())));
+                    else
+                        pto->PushMessage("headers", vHeaders);
+                    state.nBlocksAnnouncedByHeaders += vHeaders.size();
+                    MetricsCounter("zcash.net.block.announced.total", vHeaders.size(), "via", "headers");
+                    state.pindexBestHeaderSent = pBestIndex;
+                } else {
+                    fRevertToInv = true;
+                }
+            }
+            if (fRevertToInv && !pto->vBlockHashesToAnnounce.empty()) {
+                // Only the tip is announced; the peer asks for the headers
+                // leading to it.
+                const uint256& hashToAnnounce = pto->vBlockHashesToAnnounce.back();
+                BlockMap::iterator mi = mapBlockIndex.find(hashToAnnounce);
+                assert(mi != mapBlockIndex.end());
+                if (!PeerHasHeader(&state, mi->second)) {
+                    pto->PushBlockInventory(hashToAnnounce);
+                    state.nBlocksAnnouncedByInv++;
+                    MetricsIncrementCounter("zcash.net.block.announced.total", "via", "inv");
+                }
+            }
+            pto->vBlockHashesToAnnounce.clear();
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -8547,8 +9660,12 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
             bool fSendTrickle = pto->fWhitelisted;
             if (pto->nNextInvSend < nNow) {
                 fSendTrickle = true;
-                // Use half the delay for outbound peers, as there is less privacy concern for them.
-                pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
+                if (pto->fInbound) {
+                    pto->nNextInvSend = PoissonNextSendInbound(nNow, INVENTORY_BROADCAST_INTERVAL);
+                } else {
+                    // Use half the delay for outbound peers, as there is less privacy concern for them.
+                    pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> 1);
+                }
             }
 
             // Time to send but the peer has requested we not relay transactions.
@@ -8590,34 +9707,30 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                vector<std::set<uint256>::iterator> vInvTx;
-                vInvTx.reserve(pto->setInventoryTxToSend.size());
-                for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 // Sort the inventory we send for privacy and priority reasons.
-                // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                // The candidates are looked up under one mempool lock, rather
+                // than one per comparison.
+                auto vInvTx = mempool.infoInScoreOrder(pto->setInventoryTxToSend);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
+                // A backlog is drained faster, by 5 more items per 1000 queued.
+                // MAX_INVENTORY_TX_TO_SEND bounds the queue, and so this too.
+                const size_t nBroadcastMax =
+                    INVENTORY_BROADCAST_MAX + pto->setInventoryTxToSend.size() / 1000 * 5;
                 unsigned int nRelayedTransactions = 0;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    uint256 hash = *it;
+                for (auto& candidate : vInvTx) {
+                    if (nRelayedTransactions >= nBroadcastMax)
+                        break;
+                    const uint256& hash = candidate.first;
+                    TxMempoolInfo& txinfo = candidate.second;
                     // Remove it from the to-be-sent set
-                    pto->setInventoryTxToSend.erase(it);
+                    pto->setInventoryTxToSend.erase(hash);
                     // Check if not in the filter already
                     if (pto->HasKnownTxId(hash)) {
                         continue;
                     }
                     // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
                     if (!txinfo.tx) {
                         continue;
                     }
@@ -8691,17 +9804,30 @@ bool SendMessages(const Consensus::Params& params, CNode* pto)
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload(params)) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        state.nPingUsecTime = pto->nPingUsecTime;
+        int nBlocksInTransitLimit = GetBlocksInTransitLimit(&state);
+        // Pruned peers only help with the blocks near the tip, once we have caught up.
+        if (!pto->fDisconnect && !pto->fClient && ((fFetch && !state.fLimitedNode) || !IsInitialBlockDownload(params)) && state.nBlocksInFlight < nBlocksInTransitLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            CBlockIndex* pindexStalled = NULL;
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInTransitLimit - state.nBlocksInFlight, vToDownload, staller, pindexStalled);
             for (CBlockIndex *pindex : vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), params, pindex);
                 LogPrint("net", "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(),
                     pindex->nHeight, pto->id);
             }
-            if (state.nBlocksInFlight == 0 && staller != -1) {
+            if (staller != -1 && ShouldStealBlock(&state, pindexStalled->GetBlockHash(), nNow)) {
+                // The window is held back by a block this peer would deliver
+                // much sooner. Moving it here also resets the staller's stall
+                // timer, as the staller no longer holds the window back.
+                State(staller)->nBlocksStolen++;
+                vGetData.push_back(CInv(MSG_BLOCK, pindexStalled->GetBlockHash()));
+                MarkBlockAsInFlight(pto->GetId(), pindexStalled->GetBlockHash(), params, pindexStalled);
+                LogPrint("net", "Requesting block %s (%d) peer=%d, stolen from stalling peer=%d\n", pindexStalled->GetBlockHash().ToString(),
+                    pindexStalled->nHeight, pto->id, staller);
+            } else if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
                     LogPrint("net", "Stall started peer=%d\n", staller);
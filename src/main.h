@@ -36,6 +36,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <stdint.h>
@@ -49,7 +50,9 @@
 #include <boost/unordered_map.hpp>
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
+class CCoinsViewDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -108,8 +111,18 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Number of blocks that can be requested at any given time from a single peer, until its download
+ *  rate is known. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds on the number of blocks that can be requested at any given time from a single peer, once
+ *  its download rate is known. Within them, the limit covers what the peer delivers in a round trip
+ *  plus BLOCK_DOWNLOAD_TARGET_LATENCY. */
+static const int MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 128;
+/** Time in seconds for which a peer's requested blocks should keep it busy. */
+static const double BLOCK_DOWNLOAD_TARGET_LATENCY = 2.0;
+/** Weight of the newest sample in a peer's smoothed block download rate and block size. */
+static const double BLOCK_DOWNLOAD_RATE_SMOOTHING = 0.2;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Timeout in seconds during which header sync can stall before allowing other peers to sync. */
@@ -117,10 +130,31 @@ static const unsigned int HEADERS_SYNC_STALL_TIMEOUT = 10;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 160;
+/** Number of headers sent in one compact headers ("cheaders") result, to peers that asked for them
+ *  with "sendcmpcthdrs". The same assumption applies as for MAX_HEADERS_RESULTS. */
+static const unsigned int MAX_COMPACT_HEADERS_RESULTS = 2000;
+/** Maximum number of new blocks announced to a peer with headers at once. If more were connected
+ *  since the last announcement, the new tip is announced with an inv instead. */
+static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
+/** Maximum number of headers announcements in a row that don't connect before the peer is
+ *  penalized. */
+static const int MAX_UNCONNECTING_HEADERS = 10;
+/** Number of blocks announced by a peer whose delivery is timed, per peer. */
+static const size_t MAX_BLOCK_ANNOUNCE_TIMES = 16;
+/** The rate at which a peer's headers may make us check RandomX solutions we didn't ask for. */
+static constexpr double MAX_HEADER_RANDOMX_RATE_PER_SECOND{1.0};
+/** The soft limit of the header RandomX token bucket (the regular MAX_HEADER_RANDOMX_RATE_PER_SECOND
+ *  based increments won't go above this, but the MAX_COMPACT_HEADERS_RESULTS increment following
+ *  getheaders is exempt from it, up to MAX_HEADER_RANDOMX_TOKEN_CREDIT). */
+static constexpr size_t MAX_HEADER_RANDOMX_TOKEN_BUCKET{MAX_HEADERS_RESULTS};
+static constexpr size_t MAX_HEADER_RANDOMX_TOKEN_CREDIT{2 * MAX_COMPACT_HEADERS_RESULTS};
+/** The maximum number of RandomX seeds off our best header chain that one peer's headers may make us
+ *  use, as each may need a new RandomX cache. */
+static constexpr size_t MAX_HEADER_RANDOMX_FORK_SEEDS{4};
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
- *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
+ *  harder). Blocks that hold the window back are re-requested from a faster peer. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
@@ -242,9 +276,15 @@ extern bool fPruneMode;
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Block files containing a block-height within nPruneKeepBlocks of chainActive.Tip() will not be pruned (-prunekeepblocks). */
+extern unsigned int nPruneKeepBlocks;
+/** The number of recent blocks that a NODE_NETWORK_LIMITED peer serves (BIP 159). */
+static const unsigned int NODE_NETWORK_LIMITED_MIN_BLOCKS = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = MIN_BLOCKS_TO_KEEP;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Blocks each -checkblocks worker thread may read ahead of the level 3 checks. */
+static const size_t VERIFYDB_READ_AHEAD = 4;
 
 /** Prefer to create v4 transactions. */
 static const int32_t DEFAULT_PREFERRED_TX_VERSION = ZIP225_TX_VERSION;
@@ -265,6 +305,8 @@ static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
 void UnregisterNodeSignals(CNodeSignals& nodeSignals);
+/** Send new blocks in full, unasked, to peers in the given range (-blockpushpeer). */
+void AddBlockPushRange(const CSubNet& subnet);
 
 /**
  * Process an incoming block. This only returns after the best known valid
@@ -279,6 +321,18 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
  * @return True if state.IsValid()
  */
 bool ProcessNewBlock(CValidationState& state, const CChainParams& chainparams, const CNode* pfrom, const CBlock* pblock, bool fForceProcessing, const CDiskBlockPos* dbp);
+/**
+ * Process a block received from a peer like ProcessNewBlock, but leave
+ * making it active to the block validation thread, so that the message
+ * handler can serve other peers meanwhile. Falls back to ProcessNewBlock
+ * when that thread is not running.
+ *
+ * @param[out]  state   Set to an Invalid state only if pblock failed the checks done before it is stored; a block that fails to connect is reported to pfrom through mapBlockSource.
+ * @return True if state.IsValid()
+ */
+bool ProcessNewBlockAsync(CValidationState& state, const CChainParams& chainparams, CNode* pfrom, std::shared_ptr<const CBlock> pblock, bool fForceProcessing);
+/** Make active the blocks queued by ProcessNewBlockAsync. */
+void ThreadBlockValidation();
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -293,6 +347,11 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex();
+/**
+ * Turn on the -insightexplorer or -lightwalletd indexes in a block tree
+ * database created without them; the index builder fills them in.
+ */
+bool EnableInsightIndexes(bool fInsightExplorer, bool fLightWalletd);
 /** Unload database information */
 void UnloadBlockIndex();
 /** Process protocol messages received from a given node */
@@ -306,6 +365,8 @@ bool ProcessMessages(const CChainParams& chainparams, CNode* pfrom);
 bool SendMessages(const Consensus::Params& params, CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread for validation work other than script checks */
+void ThreadValidationTasks();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload(const Consensus::Params& params);
 /** testing-only, set or reset initial block down (IBD) state, return previous */
@@ -325,20 +386,25 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
  * (which in this case means the blockchain must be re-downloaded.)
  *
  * Pruning functions are called from FlushStateToDisk when the global fCheckForPruning flag has been set.
- * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.)
+ * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.) If nPruneKeepBlocks
+ * is above MIN_BLOCKS_TO_KEEP, the undo files of blocks more than MIN_BLOCKS_TO_KEEP below the active chain's tip are
+ * deleted first on their own, as they are only needed to disconnect those blocks.
  * Pruning cannot take place until the longest chain is at least a certain length (100000 on mainnet, 1000 on testnet, 10 on regtest).
- * Pruning will never delete a block within a defined distance (currently 288) from the active chain's tip.
- * The block index is updated by unsetting HAVE_DATA and HAVE_UNDO for any blocks that were stored in the deleted files.
+ * Pruning will never delete a block within nPruneKeepBlocks (at least 288) from the active chain's tip, so that the
+ * node can still serve recent blocks to its peers.
+ * The block index is updated by unsetting HAVE_UNDO, and HAVE_DATA for deleted block files, for any blocks that were
+ * stored in the deleted files.
  * A db flag records the fact that at least some block files have been pruned.
  *
- * @param[out]   setFilesToPrune   The set of file indices that can be unlinked will be returned
+ * @param[out]   setFilesToPrune       The set of file indices whose block and undo files can be unlinked will be returned
+ * @param[out]   setUndoFilesToPrune   The set of file indices whose undo files alone can be unlinked will be returned
  */
-void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
+void FindFilesToPrune(std::set<int>& setFilesToPrune, std::set<int>& setUndoFilesToPrune, uint64_t nPruneAfterHeight);
 
 /**
  *  Actually unlink the specified files
  */
-void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
+void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune, const std::set<int>& setUndoFilesToPrune);
 
 /** Create a new block index entry for a given block hash */
 CBlockIndex * InsertBlockIndex(const uint256& hash);
@@ -365,6 +431,18 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    double dBlockDownloadRate;
+    uint64_t nBlockBytesReceived;
+    int nBlocksInTransitLimit;
+    int nBlocksStolen;
+    bool fPreferHeaders;
+    bool fBlockPush;
+    int nBlocksAnnouncedByHeaders;
+    int nBlocksAnnouncedByInv;
+    int nBlocksPushedTo;
+    int nBlocksPushedFrom;
+    double dHeadersRelayTime;
+    double dInvRelayTime;
 };
 
 
@@ -542,6 +620,10 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(const uint160& addressHash, int type,
         std::vector<CAddressIndexDbEntry> &addressIndex,
         int start = 0, int end = 0);
+bool GetAddressIndexPage(const uint160& addressHash, int type,
+        int startHeight, unsigned int startTxIndex, int endHeight, size_t nMaxTxs,
+        std::vector<CAddressIndexDbEntry> &addressIndex);
+bool GetAddressBalance(const uint160& addressHash, int type, CAddressBalanceValue& value);
 bool GetAddressUnspent(const uint160& addressHash, int type,
         std::vector<CAddressUnspentDbEntry>& unspentOutputs);
 bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
@@ -551,14 +633,20 @@ bool GetTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
 
+/**
+ * fCheckSolution may be false when fCheckPOW is set to skip only the RandomX
+ * hash, for headers whose solution is checked against their seed separately.
+ */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
     const CChainParams& chainparams,
-    bool fCheckPOW = true, const CBlockIndex* pindexPrev = nullptr);
+    bool fCheckPOW = true, const CBlockIndex* pindexPrev = nullptr,
+    bool fCheckSolution = true);
 
 bool CheckBlock(const CBlock& block, CValidationState& state,
                 const CChainParams& chainparams,
@@ -661,6 +749,9 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the chainstate database backing pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
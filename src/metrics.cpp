@@ -9,6 +9,7 @@
 #include "init.h"
 #include "key_io.h"
 #include "checkpoints.h"
+#include "dbwrapper.h"
 #include "main.h"
 #include "miner.h"
 #include "rpc/server.h"
@@ -1147,6 +1148,20 @@ int printStats(MetricsStats stats, bool isScreen, bool mining)
     drawRow("Network Hash", DisplayHashRate(stats.netsolps));
     lines++;
 
+    // Chainstate database health, for sizing -dbcache
+    for (const DBStats& dbStats : GetDBStats()) {
+        if (dbStats.name != "chainstate")
+            continue;
+        double hitRate = dbStats.nCacheLookups ? 100.0 * dbStats.nCacheHits / dbStats.nCacheLookups : 0.0;
+        double throttledRate = dbStats.nLevel0Samples ? 100.0 * dbStats.nLevel0Throttled / dbStats.nLevel0Samples : 0.0;
+        drawRow("Chainstate DB", strprintf("%.1f%% cache hits, %.1f%% throttled, %s compacting",
+            hitRate,
+            throttledRate,
+            DisplayDuration((int64_t)dbStats.nCompactionSeconds, DurationFormat::REDUCED)));
+        lines++;
+        break;
+    }
+
     if (mining && miningTimer.running()) {
         drawRow("Your Hash Rate", DisplayHashRate(localsolps));
         lines++;
@@ -1173,41 +1188,21 @@ int printWalletStatus()
     drawBoxTop("WALLET");
     lines++;
 
+    // Balances come from the wallet summary, which the wallet notification
+    // thread keeps up to date, so refreshing the screen takes no locks.
+    std::shared_ptr<const WalletSummary> summary;
     if (pwalletMain) {
-        // Get transparent (mined) balances
-        CAmount immature = pwalletMain->GetImmatureBalance(std::nullopt);
-        CAmount mature = pwalletMain->GetBalance(std::nullopt);
-
-        // Get shielded balances from account 0
-        CAmount shieldedBalance = 0;
-        CAmount shieldedUnconfirmed = 0;
-
-        {
-            LOCK2(cs_main, pwalletMain->cs_wallet);
-
-            auto selector = pwalletMain->ZTXOSelectorForAccount(0, false, TransparentCoinbasePolicy::Allow);
-            if (selector.has_value()) {
-                // Get confirmed shielded balance (minconf=1)
-                auto confirmedInputs = pwalletMain->FindSpendableInputs(selector.value(), 1, std::nullopt);
-                for (const auto& t : confirmedInputs.saplingNoteEntries) {
-                    shieldedBalance += t.note.value();
-                }
-                for (const auto& t : confirmedInputs.orchardNoteMetadata) {
-                    shieldedBalance += t.GetNoteValue();
-                }
+        summary = pwalletMain->GetSummary();
+    }
 
-                // Get unconfirmed shielded balance (minconf=0, then subtract confirmed)
-                auto allInputs = pwalletMain->FindSpendableInputs(selector.value(), 0, std::nullopt);
-                CAmount totalShielded = 0;
-                for (const auto& t : allInputs.saplingNoteEntries) {
-                    totalShielded += t.note.value();
-                }
-                for (const auto& t : allInputs.orchardNoteMetadata) {
-                    totalShielded += t.GetNoteValue();
-                }
-                shieldedUnconfirmed = totalShielded - shieldedBalance;
-            }
-        }
+    if (pwalletMain && !summary) {
+        drawRow("Status", "Loading wallet balances...");
+        lines++;
+    } else if (pwalletMain) {
+        CAmount immature = summary->transparentImmature;
+        CAmount mature = summary->transparentBalance;
+        CAmount shieldedBalance = summary->accountShieldedBalance;
+        CAmount shieldedUnconfirmed = summary->accountShieldedUnconfirmed;
 
         std::string units = Params().CurrencyUnits();
 
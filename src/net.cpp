@@ -452,8 +452,11 @@ void CNode::CloseSocketDisconnect()
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted
     TRY_LOCK(cs_vRecvMsg, lockRecv);
-    if (lockRecv)
+    if (lockRecv) {
         vRecvMsg.clear();
+        vRecvBufferPool.clear();
+        nRecvBufferPoolBytes = 0;
+    }
 }
 
 void CNode::PushVersion()
@@ -711,6 +714,7 @@ void CNode::copyStats(CNodeStats &stats)
 
     stats.m_addr_processed = m_addr_processed.load();
     stats.m_addr_rate_limited = m_addr_rate_limited.load();
+    stats.m_headers_rate_limited = m_headers_rate_limited.load();
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     CService addrLocalUnlocked = GetAddrLocal();
@@ -724,8 +728,14 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
-            vRecvMsg.back().complete())
+            vRecvMsg.back().complete()) {
             vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, nRecvVersion));
+            if (!vRecvBufferPool.empty()) {
+                nRecvBufferPoolBytes -= vRecvBufferPool.back().capacity();
+                vRecvMsg.back().vRecv.swap(vRecvBufferPool.back());
+                vRecvBufferPool.pop_back();
+            }
+        }
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -761,6 +771,22 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
     return true;
 }
 
+void CNode::RecycleRecvBuffer(CNetMessage& msg)
+{
+    CSerializeData vch;
+    msg.vRecv.swap(vch);
+    // Network data is not secret, so the buffer is not zeroed before reuse.
+    vch.clear();
+    // The pool takes from the peer's receive budget, so it is only kept
+    // while the budget has room for it.
+    if (vch.capacity() > 0 && vRecvBufferPool.size() < MAX_RECV_BUFFER_POOL_SIZE &&
+        nRecvBufferPoolBytes + vch.capacity() <= MAX_RECV_BUFFER_POOL_BYTES &&
+        GetTotalRecvSize() + vch.capacity() <= ReceiveFloodSize()) {
+        nRecvBufferPoolBytes += vch.capacity();
+        vRecvBufferPool.push_back(std::move(vch));
+    }
+}
+
 int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -1222,6 +1248,9 @@ void ThreadSocketHandler()
                 //   or there is space left in the buffer, select() for receiving data.
                 // * (if neither of the above applies, there is certainly one message
                 //   in the receiver buffer ready to be processed).
+                // * Reading also pauses while the peer has MAX_BLOCKS_VALIDATING_PER_PEER
+                //   blocks waiting for the block validation thread, which works
+                //   through them on its own.
                 // Together, that means that at least one of the following is always possible,
                 // so we don't deadlock:
                 // * We send some data.
@@ -1237,7 +1266,7 @@ void ThreadSocketHandler()
                 bool select_recv;
                 {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    select_recv = lockRecv && (
+                    select_recv = lockRecv && pnode->nBlocksValidating < MAX_BLOCKS_VALIDATING_PER_PEER && (
                         pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
                         pnode->GetTotalRecvSize() <= ReceiveFloodSize());
                 }
@@ -1739,7 +1768,8 @@ void ThreadMessageHandler()
 
                     if (pnode->nSendSize < SendBufferSize())
                     {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
+                        if (!pnode->vRecvGetData.empty() ||
+                            (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete() && !pnode->IsPingDeferred()))
                         {
                             fSleep = false;
                         }
@@ -1767,6 +1797,11 @@ void ThreadMessageHandler()
     }
 }
 
+void WakeMessageHandler()
+{
+    messageHandlerCondition.notify_one();
+}
+
 
 
 
@@ -59,6 +59,13 @@ static constexpr double MAX_ADDR_RATE_PER_SECOND{0.1};
 static constexpr size_t MAX_ADDR_PROCESSING_TOKEN_BUCKET{MAX_ADDR_TO_SEND};
 /** Maximum length of incoming protocol messages (no message over 2 MiB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 2 * 1024 * 1024;
+/** The maximum number of message buffers a peer keeps for reuse. */
+static const size_t MAX_RECV_BUFFER_POOL_SIZE = 4;
+/** The maximum total capacity of the message buffers a peer keeps for reuse. */
+static const size_t MAX_RECV_BUFFER_POOL_BYTES = MAX_PROTOCOL_MESSAGE_LENGTH;
+/** The maximum number of blocks from a peer that wait for the block validation thread.
+ *  We stop reading from the peer while it has this many. */
+static const int MAX_BLOCKS_VALIDATING_PER_PEER = 16;
 /** Maximum length of strSubVer in `version` message */
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** -listen default */
@@ -67,6 +74,9 @@ static const bool DEFAULT_LISTEN = true;
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 /** The maximum number of entries in setAskFor (larger due to getdata latency)*/
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
+/** The maximum number of transactions queued for announcement to a peer.
+ *  This is more than a full mempool; later transactions are not announced. */
+static const size_t MAX_INVENTORY_TX_TO_SEND = 10000;
 /** The maximum number of peer connections to maintain. */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 /** The default for -maxuploadtarget. 0 = Unlimited */
@@ -102,6 +112,8 @@ bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+/** Wake the message handler thread, e.g. when a peer's deferred messages can be processed. */
+void WakeMessageHandler();
 
 typedef int64_t NodeId;
 
@@ -214,6 +226,7 @@ public:
     std::string addrLocal;
     uint64_t m_addr_processed{0};
     uint64_t m_addr_rate_limited{0};
+    uint64_t m_headers_rate_limited{0};
 };
 
 
@@ -280,6 +293,13 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // Buffers of processed messages, reused for the next messages received
+    // so that they are neither reallocated nor zeroed on free. Their capacity
+    // counts against -maxreceivebuffer. Protected by cs_vRecvMsg.
+    std::vector<CSerializeData> vRecvBufferPool;
+    size_t nRecvBufferPoolBytes{0};
+    // Blocks from this peer that are queued for the block validation thread.
+    std::atomic<int> nBlocksValidating{0};
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -363,6 +383,16 @@ public:
     /** Total number of addresses that were processed (excludes rate limited ones). */
     std::atomic<uint64_t> m_addr_processed{0};
 
+    /** Number of header RandomX solutions that this peer can make us check. Start at 1 to
+     *  permit a block announcement. */
+    double m_header_randomx_tokens{1.0};
+    /** When m_header_randomx_tokens was last updated */
+    int64_t m_header_randomx_timestamp{GetTimeMicros()};
+    /** The RandomX seeds off our best header chain that this peer's headers made us use. */
+    std::set<uint256> m_header_randomx_fork_seeds;
+    /** Total number of headers that were dropped due to RandomX verification limits. */
+    std::atomic<uint64_t> m_headers_rate_limited{0};
+
     // Set of transaction ids we still have to announce.
     // They are sorted by the mempool before relay, so the order is not important.
     std::set<uint256> setInventoryTxToSend;
@@ -370,6 +400,9 @@ public:
     // There is no final sorting before sending, as they are always sent immediately
     // and in the order requested.
     std::vector<uint256> vInventoryBlockToSend;
+    // List of new tips of our active chain still to announce, with headers
+    // if the peer asked for them, oldest first. Also protected by cs_inventory.
+    std::vector<uint256> vBlockHashesToAnnounce;
     mutable CCriticalSection cs_inventory;
     std::set<WTxId> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
@@ -437,9 +470,10 @@ public:
     }
 
     // requires LOCK(cs_vRecvMsg)
+    // Pooled buffers are counted too, as they hold on to their memory.
     unsigned int GetTotalRecvSize()
     {
-        unsigned int total = 0;
+        unsigned int total = nRecvBufferPoolBytes;
         for (const CNetMessage &msg : vRecvMsg)
             total += msg.vRecv.size() + 24;
         return total;
@@ -447,6 +481,8 @@ public:
 
     // requires LOCK(cs_vRecvMsg)
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
+    // Return the buffer of a processed message to the pool. Requires cs_vRecvMsg.
+    void RecycleRecvBuffer(CNetMessage& msg);
 
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
@@ -471,6 +507,14 @@ public:
         nRefCount--;
     }
 
+    // Whether the next message is a ping that has to wait until the blocks
+    // this peer sent before it are connected. Requires cs_vRecvMsg.
+    bool IsPingDeferred() const
+    {
+        return nBlocksValidating > 0 && !vRecvMsg.empty() && vRecvMsg.front().complete() &&
+               vRecvMsg.front().hdr.GetCommand() == "ping";
+    }
+
 
     bool AddAddressIfNotAlreadyKnown(const CAddress& addr)
     {
@@ -533,7 +577,10 @@ public:
     void PushTxInventory(const WTxId& wtxid)
     {
         LOCK(cs_inventory);
-        if (!fDisconnect && !filterInventoryKnown.contains(wtxid.ToBytes())) {
+        // The peer may know the transaction from its announcement (by wtxid)
+        // or from ours (by txid).
+        if (!fDisconnect && setInventoryTxToSend.size() < MAX_INVENTORY_TX_TO_SEND &&
+            !filterInventoryKnown.contains(wtxid.ToBytes()) && !filterInventoryKnown.contains(wtxid.hash)) {
             setInventoryTxToSend.insert(wtxid.hash);
         }
     }
@@ -546,6 +593,14 @@ public:
         }
     }
 
+    void PushBlockHash(const uint256& hash)
+    {
+        LOCK(cs_inventory);
+        if (!fDisconnect) {
+            vBlockHashesToAnnounce.push_back(hash);
+        }
+    }
+
     void AskFor(const CInv& inv);
 
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?
@@ -129,8 +129,15 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const Consensus::Params&
 }
 */
 
-bool CheckRandomXSolution(const CBlockHeader *pblock, const Consensus::Params& params,
-                         const CBlockIndex* pindexPrev)
+uint256 RandomXGenesisSeedHash()
+{
+    uint256 seedHash;
+    *seedHash.begin() = 0x08;
+    return seedHash;
+}
+
+bool CheckRandomXSolutionWithSeed(const CBlockHeader *pblock, uint64_t blockHeight,
+                                  const uint256& seedHash)
 {
     // Serialize header (minus solution) + nonce for RandomX input
     CEquihashInput I{*pblock};
@@ -138,17 +145,44 @@ bool CheckRandomXSolution(const CBlockHeader *pblock, const Consensus::Params& p
     ss << I;
     ss << pblock->nNonce;
 
-    uint64_t blockHeight = 0;
-    uint256 seedHash;
+    // Calculate RandomX hash with specific seed
+    uint256 hash;
+    if (!RandomX_Hash_WithSeed(seedHash.begin(), 32, ss.data(), ss.size(), hash.begin())) {
+        LogPrintf("CheckRandomXSolution: RandomX_Hash_WithSeed failed for height %d\n", blockHeight);
+        return false;
+    }
+
+    // Verify stored solution matches calculated hash
+    if (pblock->nSolution.size() != 32) {
+        LogPrintf("CheckRandomXSolution: Invalid solution size %d for height %d\n", pblock->nSolution.size(), blockHeight);
+        return false;
+    }
 
+    uint256 storedHash;
+    memcpy(storedHash.begin(), pblock->nSolution.data(), 32);
+
+    bool match = (hash == storedHash);
+    if (!match) {
+        LogPrintf("CheckRandomXSolution: Hash mismatch at height %d\n", blockHeight);
+        LogPrintf("  Seed height: %d, Seed hash: %s\n", RandomX_SeedHeight(blockHeight), seedHash.GetHex());
+        LogPrintf("  Input size: %d bytes\n", ss.size());
+        LogPrintf("  Calculated: %s\n", hash.GetHex());
+        LogPrintf("  Stored:     %s\n", storedHash.GetHex());
+    }
+    return match;
+}
+
+bool CheckRandomXSolution(const CBlockHeader *pblock, const Consensus::Params& params,
+                         const CBlockIndex* pindexPrev)
+{
     if (pindexPrev != nullptr) {
-        blockHeight = pindexPrev->nHeight + 1;
+        uint64_t blockHeight = pindexPrev->nHeight + 1;
         uint64_t seedHeight = RandomX_SeedHeight(blockHeight);
 
+        uint256 seedHash;
         if (seedHeight == 0) {
             // Genesis epoch - use genesis seed
-            seedHash.SetNull();
-            *seedHash.begin() = 0x08;
+            seedHash = RandomXGenesisSeedHash();
         } else {
             // Get seed block hash from chain
             const CBlockIndex* pindexSeed = pindexPrev->GetAncestor(seedHeight);
@@ -156,32 +190,14 @@ bool CheckRandomXSolution(const CBlockHeader *pblock, const Consensus::Params& p
             seedHash = pindexSeed->GetBlockHash();
         }
 
-        // Calculate RandomX hash with specific seed
-        uint256 hash;
-        if (!RandomX_Hash_WithSeed(seedHash.begin(), 32, ss.data(), ss.size(), hash.begin())) {
-            LogPrintf("CheckRandomXSolution: RandomX_Hash_WithSeed failed for height %d\n", blockHeight);
-            return false;
-        }
-
-        // Verify stored solution matches calculated hash
-        if (pblock->nSolution.size() != 32) {
-            LogPrintf("CheckRandomXSolution: Invalid solution size %d for height %d\n", pblock->nSolution.size(), blockHeight);
-            return false;
-        }
-
-        uint256 storedHash;
-        memcpy(storedHash.begin(), pblock->nSolution.data(), 32);
-
-        bool match = (hash == storedHash);
-        if (!match) {
-            LogPrintf("CheckRandomXSolution: Hash mismatch at height %d\n", blockHeight);
-            LogPrintf("  Seed height: %d, Seed hash: %s\n", seedHeight, seedHash.GetHex());
-            LogPrintf("  Input size: %d bytes\n", ss.size());
-            LogPrintf("  Calculated: %s\n", hash.GetHex());
-            LogPrintf("  Stored:     %s\n", storedHash.GetHex());
-        }
-        return match;
+        return CheckRandomXSolutionWithSeed(pblock, blockHeight, seedHash);
     } else {
+        // Serialize header (minus solution) + nonce for RandomX input
+        CEquihashInput I{*pblock};
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << I;
+        ss << pblock->nNonce;
+
         // No pindexPrev - use current main seed (for mining/mempool)
         uint256 hash;
         if (!RandomX_Hash_Block(ss.data(), ss.size(), hash)) return false;
@@ -31,6 +31,17 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const Consensus::Params&)
 bool CheckRandomXSolution(const CBlockHeader *pblock, const Consensus::Params&,
                          const CBlockIndex* pindexPrev = nullptr);
 
+/**
+ * Check the RandomX solution of a block at the given height against an
+ * explicit seed hash, for callers that know the seed block without having
+ * it in the block index (such as a batch of headers being synced).
+ */
+bool CheckRandomXSolutionWithSeed(const CBlockHeader *pblock, uint64_t blockHeight,
+                                  const uint256& seedHash);
+
+/** The RandomX seed hash used by blocks in the first seed epoch. */
+uint256 RandomXGenesisSeedHash();
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
 arith_uint256 GetBlockProof(const CBlockIndex& block);
@@ -167,6 +167,107 @@ public:
 };
 
 
+/**
+ * A run of consecutive block headers in the compact encoding of the
+ * "cheaders" message. The first header is sent in full. Each later header
+ * omits hashPrevBlock, which is the hash (the RandomX solution) of the header
+ * before it, sends nTime as a signed delta from that header's, and sends
+ * nVersion and nBits only when they differ from that header's.
+ */
+class CCompactHeaders
+{
+public:
+    enum : uint8_t {
+        VERSION_CHANGED = 0x01,
+        BITS_CHANGED = 0x02,
+    };
+
+    std::vector<CBlockHeader> vHeaders;
+
+    CCompactHeaders() {}
+
+    explicit CCompactHeaders(std::vector<CBlockHeader> vHeadersIn) : vHeaders(std::move(vHeadersIn)) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, vHeaders.size());
+        for (size_t i = 0; i < vHeaders.size(); i++) {
+            const CBlockHeader& header = vHeaders[i];
+            if (i == 0) {
+                s << header;
+                continue;
+            }
+            const CBlockHeader& prev = vHeaders[i - 1];
+            uint8_t nFlags = 0;
+            if (header.nVersion != prev.nVersion)
+                nFlags |= VERSION_CHANGED;
+            if (header.nBits != prev.nBits)
+                nFlags |= BITS_CHANGED;
+            s << nFlags;
+            if (nFlags & VERSION_CHANGED)
+                s << header.nVersion;
+            int64_t nTimeDelta = (int64_t)header.nTime - (int64_t)prev.nTime;
+            uint64_t nZigZag = ((uint64_t)nTimeDelta << 1) ^ (uint64_t)(nTimeDelta >> 63);
+            s << VARINT(nZigZag);
+            if (nFlags & BITS_CHANGED)
+                s << header.nBits;
+            s << header.hashMerkleRoot;
+            s << header.hashBlockCommitments;
+            s << header.nNonce;
+            s << header.nSolution;
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        UnserializeHeaders(s, ReadCompactSize(s));
+    }
+
+    /**
+     * Read nCount headers that follow the count, so that the caller can
+     * check the count before reading them.
+     */
+    template <typename Stream>
+    void UnserializeHeaders(Stream& s, uint64_t nCount)
+    {
+        vHeaders.clear();
+        vHeaders.resize(nCount);
+        for (size_t i = 0; i < nCount; i++) {
+            CBlockHeader& header = vHeaders[i];
+            if (i == 0) {
+                s >> header;
+                continue;
+            }
+            const CBlockHeader& prev = vHeaders[i - 1];
+            uint8_t nFlags;
+            s >> nFlags;
+            if (nFlags & ~(VERSION_CHANGED | BITS_CHANGED))
+                throw std::ios_base::failure("CCompactHeaders: unknown header flags");
+            header.nVersion = prev.nVersion;
+            if (nFlags & VERSION_CHANGED)
+                s >> header.nVersion;
+            header.hashPrevBlock = prev.GetHash();
+            uint64_t nZigZag;
+            s >> VARINT(nZigZag);
+            int64_t nTimeDelta = (int64_t)(nZigZag >> 1) ^ -(int64_t)(nZigZag & 1);
+            int64_t nTime = (int64_t)prev.nTime + nTimeDelta;
+            if (nTime < 0 || nTime > std::numeric_limits<uint32_t>::max())
+                throw std::ios_base::failure("CCompactHeaders: header time out of range");
+            header.nTime = nTime;
+            header.nBits = prev.nBits;
+            if (nFlags & BITS_CHANGED)
+                s >> header.nBits;
+            s >> header.hashMerkleRoot;
+            s >> header.hashBlockCommitments;
+            s >> header.nNonce;
+            s >> header.nSolution;
+        }
+    }
+};
+
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
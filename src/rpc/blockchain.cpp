@@ -15,10 +15,14 @@
 #include "main.h"
 #include "metrics.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
+#include "snapshot.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "util/system.h"
+#include "validationstats.h"
 
 #include <stdint.h>
 
@@ -223,13 +227,13 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** Members of the getblock result that precede "tx". */
+static void blockHeadToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result)
 {
     AssertLockHeld(cs_main);
     bool nu5Active = Params().GetConsensus().NetworkUpgradeActive(
         blockindex->nHeight, Consensus::UPGRADE_NU5);
 
-    UniValue result(UniValue::VOBJ);
     result.pushKV("hash", block.GetHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
@@ -248,19 +252,12 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
         result.pushKV("finalorchardroot", HexStr(finalOrchardRootBytes.begin(), finalOrchardRootBytes.end()));
     }
     result.pushKV("chainhistoryroot", blockindex->hashChainHistoryRoot.GetHex());
-    UniValue txs(UniValue::VARR);
-    for (const CTransaction&tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx.GetHash().GetHex());
-    }
-    result.pushKV("tx", txs);
+}
+
+/** Members of the getblock result that follow "tx". */
+static void blockTailToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result)
+{
+    AssertLockHeld(cs_main);
     result.pushKV("time", block.GetBlockTime());
     result.pushKV("nonce", block.nNonce.GetHex());
     result.pushKV("solution", HexStr(block.nSolution));
@@ -302,9 +299,63 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
         result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
+}
+
+static UniValue blockTxToJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToJSON(tx, uint256(), objTx);
+    return objTx;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    AssertLockHeld(cs_main);
+    UniValue result(UniValue::VOBJ);
+    blockHeadToJSON(block, blockindex, result);
+    UniValue txs(UniValue::VARR);
+    for (const CTransaction&tx : block.vtx)
+        txs.push_back(blockTxToJSON(tx, txDetails));
+    result.pushKV("tx", txs);
+    blockTailToJSON(block, blockindex, result);
     return result;
 }
 
+/**
+ * Streaming form of blockToJSON; only one transaction is expanded at a time.
+ * Takes cs_main itself, and only while it builds part of the result, so that
+ * a slow client doesn't hold up validation.
+ */
+void blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, JSONStreamWriter& out)
+{
+    AssertLockNotHeld(cs_main);
+    UniValue head(UniValue::VOBJ);
+    UniValue tail(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        blockHeadToJSON(block, blockindex, head);
+        blockTailToJSON(block, blockindex, tail);
+    }
+    out.BeginObject();
+    out.Fields(head);
+    out.Key("tx");
+    out.BeginArray();
+    for (const CTransaction&tx : block.vtx) {
+        UniValue objTx;
+        {
+            // The spent index lookups need cs_main.
+            LOCK(cs_main);
+            objTx = blockTxToJSON(tx, txDetails);
+        }
+        out.Value(objTx);
+    }
+    out.EndArray();
+    out.Fields(tail);
+    out.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -357,6 +408,36 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
     return GetNetworkDifficulty();
 }
 
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    AssertLockHeld(mempool.cs);
+    UniValue info(UniValue::VOBJ);
+    info.pushKV("size", (int)e.GetTxSize());
+    info.pushKV("fee", ValueFromAmount(e.GetFee()));
+    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
+    info.pushKV("time", e.GetTime());
+    info.pushKV("height", (int)e.GetHeight());
+    info.pushKV("descendantcount", e.GetCountWithDescendants());
+    info.pushKV("descendantsize", e.GetSizeWithDescendants());
+    info.pushKV("descendantfees", e.GetModFeesWithDescendants());
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    for (const CTxIn& txin : tx.vin)
+    {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    for (const string& dep : setDepends)
+    {
+        depends.push_back(dep);
+    }
+
+    info.pushKV("depends", depends);
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
@@ -366,31 +447,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
         for (const CTxMemPoolEntry& e : mempool.mapTx)
         {
             const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            info.pushKV("size", (int)e.GetTxSize());
-            info.pushKV("fee", ValueFromAmount(e.GetFee()));
-            info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-            info.pushKV("time", e.GetTime());
-            info.pushKV("height", (int)e.GetHeight());
-            info.pushKV("descendantcount", e.GetCountWithDescendants());
-            info.pushKV("descendantsize", e.GetSizeWithDescendants());
-            info.pushKV("descendantfees", e.GetModFeesWithDescendants());
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            for (const CTxIn& txin : tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            for (const string& dep : setDepends)
-            {
-                depends.push_back(dep);
-            }
-
-            info.pushKV("depends", depends);
-            o.pushKV(hash.ToString(), info);
+            o.pushKV(hash.ToString(), mempoolEntryToJSON(e));
         }
         return o;
     }
@@ -407,6 +464,45 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/**
+ * Streaming form of mempoolToJSON; only one entry is expanded at a time.
+ * The mempool lock is only held while an entry is expanded, not while it is
+ * written, so transactions removed in the meantime are left out.
+ */
+void mempoolToJSON(bool fVerbose, JSONStreamWriter& out)
+{
+    if (fVerbose)
+    {
+        vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        out.BeginObject();
+        for (const uint256& hash : vtxid)
+        {
+            UniValue entry;
+            {
+                LOCK(mempool.cs);
+                auto it = mempool.mapTx.find(hash);
+                if (it == mempool.mapTx.end())
+                    continue;
+                entry = mempoolEntryToJSON(*it);
+            }
+            out.KV(hash.ToString(), entry);
+        }
+        out.EndObject();
+    }
+    else
+    {
+        vector<uint256> vtxid;
+        mempool.queryHashes(vtxid);
+
+        out.BeginArray();
+        for (const uint256& hash : vtxid)
+            out.Value(hash.ToString());
+        out.EndArray();
+    }
+}
+
 UniValue getrawmempool(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() > 1)
@@ -450,6 +546,15 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+static void getrawmempool_stream(const UniValue& params, JSONStreamWriter& out)
+{
+    bool fVerbose = false;
+    if (params.size() > 0)
+        fVerbose = params[0].get_bool();
+
+    mempoolToJSON(fVerbose, out);
+}
+
 // insightexplorer
 UniValue getblockdeltas(const UniValue& params, bool fHelp)
 {
@@ -512,6 +617,7 @@ UniValue getblockdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_MISC_ERROR, "Error: getblockdeltas is disabled. "
             "Run './junocash-cli help getblockdeltas' for instructions on how to enable this feature.");
     }
+    EnsureIndexesSynced();
 
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
@@ -575,6 +681,7 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_MISC_ERROR, "Error: getblockhashes is disabled. "
             "Run './junocash-cli help getblockhashes' for instructions on how to enable this feature.");
     }
+    EnsureIndexesSynced();
 
     unsigned int high = params[0].get_int();
     unsigned int low = params[1].get_int();
@@ -726,6 +833,50 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     }
 }
 
+/**
+ * Parse the arguments of getblock and read the requested block from disk.
+ * Returns its index entry and sets verbosity.
+ */
+static CBlockIndex* readBlockForGetBlock(const UniValue& params, CBlock& block, int& verbosity)
+{
+    AssertLockHeld(cs_main);
+
+    std::string strHash = params[0].get_str();
+
+    // If height is supplied, find the hash
+    if (strHash.size() < (2 * sizeof(uint256))) {
+        strHash = chainActive[parseHeightArg(strHash, chainActive.Height())]->GetBlockHash().GetHex();
+    }
+
+    uint256 hash(uint256S(strHash));
+
+    verbosity = 1;
+    if (params.size() > 1) {
+        if(params[1].isNum()) {
+            verbosity = params[1].get_int();
+        } else {
+            verbosity = params[1].get_bool() ? 1 : 0;
+        }
+    }
+
+    if (verbosity < 0 || verbosity > 2) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+    }
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -809,49 +960,42 @@ UniValue getblock(const UniValue& params, bool fHelp)
 
     LOCK(cs_main);
 
-    std::string strHash = params[0].get_str();
-
-    // If height is supplied, find the hash
-    if (strHash.size() < (2 * sizeof(uint256))) {
-        strHash = chainActive[parseHeightArg(strHash, chainActive.Height())]->GetBlockHash().GetHex();
-    }
-
-    uint256 hash(uint256S(strHash));
-
-    int verbosity = 1;
-    if (params.size() > 1) {
-        if(params[1].isNum()) {
-            verbosity = params[1].get_int();
-        } else {
-            verbosity = params[1].get_bool() ? 1 : 0;
-        }
-    }
+    CBlock block;
+    int verbosity;
+    CBlockIndex* pblockindex = readBlockForGetBlock(params, block, verbosity);
 
-    if (verbosity < 0 || verbosity > 2) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+    if (verbosity == 0)
+    {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
+        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        return strHex;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    return blockToJSON(block, pblockindex, verbosity >= 2);
+}
 
+static void getblock_stream(const UniValue& params, JSONStreamWriter& out)
+{
+    // The block is read under cs_main and written without it. Block index
+    // entries are never deleted, so pblockindex stays valid.
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    int verbosity;
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        pblockindex = readBlockForGetBlock(params, block, verbosity);
+    }
 
     if (verbosity == 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        out.Value(HexStr(ssBlock.begin(), ssBlock.end()));
+        return;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    blockToJSON(block, pblockindex, verbosity >= 2, out);
 }
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
@@ -892,6 +1036,209 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getdbstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the configuration and activity counters of the LevelDB databases, to help size -dbcache and -dboption.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                    (object) One entry per database: chainstate, blockindex\n"
+            "    \"maxopenfiles\": n,         (numeric) The max_open_files setting\n"
+            "    \"bloombits\": n,            (numeric) Bloom filter bits per key (0 = no filter)\n"
+            "    \"compression\": true|false, (boolean) Whether table blocks are Snappy-compressed\n"
+            "    \"blockcache\": n,           (numeric) The block cache capacity in bytes\n"
+            "    \"writebuffer\": n,          (numeric) The write buffer size in bytes\n"
+            "    \"memoryusage\": n,          (numeric) Approximate memory held by caches and memtables in bytes\n"
+            "    \"levels\": [                (array) Per level, from level 0\n"
+            "      {\n"
+            "        \"files\": n,            (numeric) Number of table files\n"
+            "        \"size\": x.xx           (numeric) Size in MiB\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"compaction\": {\n"
+            "      \"seconds\": n,            (numeric) Total time spent compacting\n"
+            "      \"read\": n,               (numeric) MiB read by compactions\n"
+            "      \"written\": n             (numeric) MiB written by compactions\n"
+            "    },\n"
+            "    \"writes\": {\n"
+            "      \"count\": n,              (numeric) Number of write batches\n"
+            "      \"ms\": n                  (numeric) Total time spent writing in milliseconds\n"
+            "    },\n"
+            "    \"level0\": {\n"
+            "      \"samples\": n,            (numeric) Times the level 0 file count was sampled, about once a second\n"
+            "      \"throttled\": n           (numeric) Samples that found level 0 full enough for LevelDB to delay writes\n"
+            "    },\n"
+            "    \"cache\": {\n"
+            "      \"lookups\": n,            (numeric) Block cache lookups\n"
+            "      \"hits\": n,               (numeric) Block cache hits\n"
+            "      \"hitrate\": x.xxxx        (numeric) hits / lookups, or 0 before the first lookup\n"
+            "    }\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    for (const DBStats& stats : GetDBStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("maxopenfiles", stats.tuning.nMaxOpenFiles);
+        obj.pushKV("bloombits", stats.tuning.nBloomBits);
+        obj.pushKV("compression", stats.tuning.fCompression);
+        obj.pushKV("blockcache", (uint64_t)stats.nBlockCacheSize);
+        obj.pushKV("writebuffer", (uint64_t)stats.nWriteBufferSize);
+        obj.pushKV("memoryusage", (uint64_t)stats.nMemoryUsage);
+
+        UniValue levels(UniValue::VARR);
+        for (int i = 0; i < DBWRAPPER_NUM_LEVELS; i++) {
+            UniValue level(UniValue::VOBJ);
+            level.pushKV("files", stats.vLevelFiles[i]);
+            level.pushKV("size", stats.vLevelMiB[i]);
+            levels.push_back(level);
+        }
+        obj.pushKV("levels", levels);
+
+        UniValue compaction(UniValue::VOBJ);
+        compaction.pushKV("seconds", stats.nCompactionSeconds);
+        compaction.pushKV("read", stats.nCompactionReadMiB);
+        compaction.pushKV("written", stats.nCompactionWriteMiB);
+        obj.pushKV("compaction", compaction);
+
+        UniValue writes(UniValue::VOBJ);
+        writes.pushKV("count", stats.nWrites);
+        writes.pushKV("ms", stats.nWriteMicros / 1000);
+        obj.pushKV("writes", writes);
+
+        UniValue level0(UniValue::VOBJ);
+        level0.pushKV("samples", stats.nLevel0Samples);
+        level0.pushKV("throttled", stats.nLevel0Throttled);
+        obj.pushKV("level0", level0);
+
+        UniValue cache(UniValue::VOBJ);
+        cache.pushKV("lookups", stats.nCacheLookups);
+        cache.pushKV("hits", stats.nCacheHits);
+        cache.pushKV("hitrate", stats.nCacheLookups ? (double)stats.nCacheHits / stats.nCacheLookups : 0.0);
+        obj.pushKV("cache", cache);
+
+        ret.pushKV(stats.name, obj);
+    }
+    return ret;
+}
+
+UniValue getvalidationstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getvalidationstats\n"
+            "\nReturns latency statistics for the stages of block validation since the node started.\n"
+            "Percentiles are accurate to within 12.5%, and are never more than the maximum.\n"
+            "The same distributions are exported as the zcash.chain.validation.seconds metric.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"stage\": {                   (object) One entry per stage: randomx, coins, nullifiers, scripts,\n"
+            "                                 proofs, index, connectblock, flush, chainstate, connecttip\n"
+            "    \"count\": n,                (numeric) Number of times the stage has been recorded\n"
+            "    \"totalms\": n,              (numeric) Total time spent in the stage in milliseconds\n"
+            "    \"meanms\": x.xxx,           (numeric) Mean time in milliseconds\n"
+            "    \"p50ms\": x.xxx,            (numeric) Median time in milliseconds\n"
+            "    \"p90ms\": x.xxx,            (numeric) 90th percentile in milliseconds\n"
+            "    \"p99ms\": x.xxx,            (numeric) 99th percentile in milliseconds\n"
+            "    \"maxms\": x.xxx             (numeric) Maximum time in milliseconds\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationstats", "")
+            + HelpExampleRpc("getvalidationstats", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    for (size_t i = 0; i < VALIDATION_STAGE_COUNT; i++) {
+        ValidationStage stage = static_cast<ValidationStage>(i);
+        CLatencyHistogram::Snapshot snapshot = GetValidationStageSnapshot(stage);
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", snapshot.nCount);
+        obj.pushKV("totalms", snapshot.nTotal * 0.001);
+        obj.pushKV("meanms", snapshot.nCount ? snapshot.nTotal * 0.001 / snapshot.nCount : 0.0);
+        obj.pushKV("p50ms", snapshot.Percentile(0.5) * 0.001);
+        obj.pushKV("p90ms", snapshot.Percentile(0.9) * 0.001);
+        obj.pushKV("p99ms", snapshot.Percentile(0.99) * 0.001);
+        obj.pushKV("maxms", snapshot.nMax * 0.001);
+        ret.pushKV(ValidationStageName(stage), obj);
+    }
+    return ret;
+}
+
+UniValue dumpsnapshot(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumpsnapshot \"filename\"\n"
+            "\nWrites a snapshot of the chainstate at the current tip to a file. The snapshot holds the\n"
+            "transparent coins, shielded nullifiers, commitment tree anchors, history trees and subtree\n"
+            "roots, and the block index up to the tip. A new node can be bootstrapped from it with\n"
+            "-loadsnapshot=<file> -snapshothash=<hash>.\n"
+            "Note this call may take some time. Block processing is only paused while the chainstate is flushed.\n"
+            "\nArguments:\n"
+            "1. \"filename\"    (string, required) The file to write; relative paths are resolved against the datadir\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockhash\": \"hex\",      (string) The block the snapshot was taken at\n"
+            "  \"height\": n,             (numeric) The height of that block\n"
+            "  \"path\": \"path\",         (string) The absolute path of the written file\n"
+            "  \"headers\": n,            (numeric) The number of block index entries\n"
+            "  \"coins\": n,              (numeric) The number of transparent coin records\n"
+            "  \"nullifiers\": n,         (numeric) The number of shielded nullifiers\n"
+            "  \"anchors\": n,            (numeric) The number of commitment tree anchors\n"
+            "  \"historynodes\": n,       (numeric) The number of history tree nodes\n"
+            "  \"subtrees\": n,           (numeric) The number of note commitment subtree roots\n"
+            "  \"hash\": \"hex\"            (string) The snapshot commitment, to be passed to -snapshothash\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumpsnapshot", "\"snapshot.dat\"")
+            + HelpExampleRpc("dumpsnapshot", "\"snapshot.dat\"")
+        );
+
+    fs::path path = fs::absolute(params[0].get_str(), GetDataDir());
+    if (fs::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    // Flush and pin both databases at the tip, then write the file from the
+    // pinned state so that block processing only waits for the flush.
+    CBlockIndex* pindexBase;
+    std::unique_ptr<CDBSnapshot> viewSnapshot, blocktreeSnapshot;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pindexBase = chainActive.Tip();
+        viewSnapshot.reset(pcoinsdbview->NewSnapshot());
+        blocktreeSnapshot.reset(new CDBSnapshot(*pblocktree));
+    }
+
+    CSnapshotStats stats;
+    uint256 hash;
+    try {
+        hash = DumpSnapshot(Params(), *pcoinsdbview, *viewSnapshot, *pblocktree, *blocktreeSnapshot, pindexBase, path, stats);
+    } catch (const std::exception& e) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Failed to write snapshot: %s", e.what()));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("blockhash", pindexBase->GetBlockHash().GetHex());
+    ret.pushKV("height", pindexBase->nHeight);
+    ret.pushKV("path", path.string());
+    ret.pushKV("headers", (uint64_t)stats.nHeaders);
+    ret.pushKV("coins", (uint64_t)stats.nCoins);
+    ret.pushKV("nullifiers", (uint64_t)stats.nNullifiers);
+    ret.pushKV("anchors", (uint64_t)stats.nAnchors);
+    ret.pushKV("historynodes", (uint64_t)stats.nHistoryNodes);
+    ret.pushKV("subtrees", (uint64_t)stats.nSubtrees);
+    ret.pushKV("hash", hash.GetHex());
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -1694,27 +2041,30 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "z_gettreestate",         &z_gettreestate,         true  },
-    { "blockchain",         "z_getsubtreesbyindex",   &z_getsubtreesbyindex,   true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
+{ //  category              name                      actor (function)         okSafeMode  concurrency  streamActor
+  //  --------------------- ------------------------  -----------------------  ----------  ----------------------
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  RPCConcurrency::Shared },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  RPCConcurrency::Shared },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  RPCConcurrency::Shared },
+    { "blockchain",         "getblock",               &getblock,               true,  RPCConcurrency::Shared, &getblock_stream },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  RPCConcurrency::Shared },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  RPCConcurrency::Shared },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,  RPCConcurrency::Shared },
+    { "blockchain",         "z_gettreestate",         &z_gettreestate,         true,  RPCConcurrency::Shared },
+    { "blockchain",         "z_getsubtreesbyindex",   &z_getsubtreesbyindex,   true,  RPCConcurrency::Shared },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  RPCConcurrency::Shared },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  RPCConcurrency::Shared },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  RPCConcurrency::Shared, &getrawmempool_stream },
+    { "blockchain",         "gettxout",               &gettxout,               true,  RPCConcurrency::Shared },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "dumpsnapshot",           &dumpsnapshot,           true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true,  RPCConcurrency::Shared },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     true,  RPCConcurrency::Shared },
     { "blockchain",         "verifychain",            &verifychain,            true  },
 
     // insightexplorer
-    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
+    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false, RPCConcurrency::Shared },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,  RPCConcurrency::Shared },
 
     /* Not shown in help */
     { "hidden",             "preciousblock",          &preciousblock,          true  },
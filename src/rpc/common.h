@@ -54,6 +54,9 @@ static const CRPCConvertTable rpcCvtTable =
     { "getblockheader",              {{s}, {o}} },
     { "getblock",                    {{s}, {o}} },
     { "gettxoutsetinfo",             {{}, {}} },
+    { "dumpsnapshot",                {{s}, {}} },
+    { "getdbstats",                  {{}, {}} },
+    { "getvalidationstats",          {{}, {}} },
     { "gettxout",                    {{s, o}, {o}} },
     { "verifychain",                 {{}, {o, o}} },
     { "getblockchaininfo",           {{}, {}} },
@@ -92,6 +95,7 @@ static const CRPCConvertTable rpcCvtTable =
     { "getaddresstxids",             {{o}, {}} },
     { "getspentinfo",                {{o}, {}} },
     { "getmemoryinfo",               {{}, {}} },
+    { "getlockstats",                {{}, {o, s}} },
     // net
     { "getconnectioncount",          {{}, {}} },
     { "ping",                        {{}, {}} },
@@ -183,7 +187,7 @@ static const CRPCConvertTable rpcCvtTable =
     { "z_send",                      {{s, s, o}, {n, o, o}} },
     { "z_setmigration",              {{o}, {}} },
     { "z_getmigrationstatus",        {{}, {o}} },
-    { "z_shieldcoinbase",            {{s, s}, {o, o, n}} },
+    { "z_shieldcoinbase",            {{s, s}, {o, o, n, o}} },
     { "z_mergetoaddress",            {{o, s}, {o, o, o, n, s}} },
     { "z_listoperationids",          {{}, {s}} },
     { "z_getnotescount",             {{}, {o, o}} },
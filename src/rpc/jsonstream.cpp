@@ -0,0 +1,88 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+JSONStreamWriter::JSONStreamWriter(JSONStreamSink& sinkIn) :
+    sink(sinkIn), fAfterKey(false), nBytesWritten(0)
+{
+}
+
+void JSONStreamWriter::Raw(const std::string& str)
+{
+    sink.Write(str.data(), str.size());
+    nBytesWritten += str.size();
+}
+
+void JSONStreamWriter::BeginElement()
+{
+    if (fAfterKey) {
+        // The key already took care of the separator.
+        fAfterKey = false;
+        return;
+    }
+    if (vNonEmpty.empty()) {
+        assert(nBytesWritten == 0); // only one top-level value
+        return;
+    }
+    if (vNonEmpty.back())
+        Raw(",");
+    vNonEmpty.back() = true;
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    BeginElement();
+    Raw("{");
+    vNonEmpty.push_back(false);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vNonEmpty.empty() && !fAfterKey);
+    vNonEmpty.pop_back();
+    Raw("}");
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    BeginElement();
+    Raw("[");
+    vNonEmpty.push_back(false);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vNonEmpty.empty() && !fAfterKey);
+    vNonEmpty.pop_back();
+    Raw("]");
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vNonEmpty.empty() && !fAfterKey);
+    BeginElement();
+    // Let UniValue do the escaping so keys match UniValue::write() byte for byte.
+    Raw(UniValue(key).write());
+    Raw(":");
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    BeginElement();
+    Raw(value.write());
+}
+
+void JSONStreamWriter::Fields(const UniValue& obj)
+{
+    assert(obj.isObject());
+    const std::vector<std::string>& keys = obj.getKeys();
+    const std::vector<UniValue>& values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); i++) {
+        KV(keys[i], values[i]);
+    }
+}
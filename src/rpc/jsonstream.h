@@ -0,0 +1,80 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/** Destination for the text produced by a JSONStreamWriter. */
+class JSONStreamSink
+{
+public:
+    virtual ~JSONStreamSink() {}
+    virtual void Write(const char* data, size_t len) = 0;
+};
+
+/** Sink that appends to a string; used by tests and non-streaming callers. */
+class JSONStringSink : public JSONStreamSink
+{
+private:
+    std::string& str;
+
+public:
+    explicit JSONStringSink(std::string& strIn) : str(strIn) {}
+    void Write(const char* data, size_t len) override { str.append(data, len); }
+};
+
+/**
+ * Incremental JSON emitter for large RPC results.
+ *
+ * Produces exactly the compact text UniValue::write() would produce for the
+ * same document, but hands it to the sink piece by piece, so the caller only
+ * ever materialises one element (a transaction, a mempool entry, ...) at a
+ * time instead of the whole result tree and its serialised copy.
+ */
+class JSONStreamWriter
+{
+private:
+    JSONStreamSink& sink;
+    /** One entry per open container: whether it already has an element. */
+    std::vector<bool> vNonEmpty;
+    /** A key was written and its value is still outstanding. */
+    bool fAfterKey;
+    size_t nBytesWritten;
+
+    void Raw(const std::string& str);
+    void BeginElement();
+
+public:
+    explicit JSONStreamWriter(JSONStreamSink& sinkIn);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write the key of the next member of the current object. */
+    void Key(const std::string& key);
+    /** Write a complete value as the next array element or member value. */
+    void Value(const UniValue& value);
+    /** Write every key/value pair of obj as members of the current object. */
+    void Fields(const UniValue& obj);
+
+    void KV(const std::string& key, const UniValue& value)
+    {
+        Key(key);
+        Value(value);
+    }
+
+    /** True once a complete top-level value has been written. */
+    bool Complete() const { return vNonEmpty.empty() && nBytesWritten > 0 && !fAfterKey; }
+    size_t BytesWritten() const { return nBytesWritten; }
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
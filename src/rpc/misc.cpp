@@ -10,6 +10,7 @@
 #include "init.h"
 #include "key_io.h"
 #include "experimental_features.h"
+#include "lockprofile.h"
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
@@ -772,6 +773,7 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_MISC_ERROR, "Error: getaddressutxos is disabled. "
             "Run './junocash-cli help getaddressutxos' for instructions on how to enable this feature.");
     }
+    EnsureIndexesSynced();
 
     bool includeChainInfo = false;
     if (params[0].isObject()) {
@@ -878,6 +880,101 @@ static void getAddressesInHeightRange(
     }
 }
 
+// A page of address index results starts at a cursor, which is the height of
+// a block and the index of a transaction within it, encoded as
+// "<height>:<blockindex>". Pages always end at a transaction boundary.
+struct AddressIndexPage {
+    bool fPaged = false;
+    size_t nLimit = 0;
+    int nCursorHeight = 0;
+    unsigned int nCursorTxIndex = 0;
+};
+
+static AddressIndexPage getPageParams(const UniValue& params)
+{
+    AddressIndexPage page;
+    if (!params[0].isObject()) {
+        return page;
+    }
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (limitValue.isNull()) {
+        if (!cursorValue.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "cursor requires limit");
+        }
+        return page;
+    }
+    int limit = limitValue.get_int();
+    if (limit <= 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit must be positive");
+    }
+    page.fPaged = true;
+    page.nLimit = limit;
+    if (!cursorValue.isNull()) {
+        const std::string& cursor = cursorValue.get_str();
+        size_t sep = cursor.find(':');
+        int32_t height, txindex;
+        if (sep == std::string::npos ||
+            !ParseInt32(cursor.substr(0, sep), &height) || height < 0 ||
+            !ParseInt32(cursor.substr(sep + 1), &txindex) || txindex < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        page.nCursorHeight = height;
+        page.nCursorTxIndex = txindex;
+    }
+    return page;
+}
+
+// Fetch one page of addressindex entries for all addresses in params, merged
+// in block order. Sets nextCursor to the start of the following page, or to
+// the empty string if this is the last one.
+static void getAddressesPage(
+    const UniValue& params,
+    int start, int end,
+    const AddressIndexPage& page,
+    std::vector<std::pair<uint160, int>>& addresses,
+    std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+    std::string& nextCursor)
+{
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+    int startHeight = start;
+    unsigned int startTxIndex = 0;
+    if (page.nCursorHeight > start || (page.nCursorHeight == start && page.nCursorTxIndex > 0)) {
+        startHeight = page.nCursorHeight;
+        startTxIndex = page.nCursorTxIndex;
+    }
+
+    // One transaction more than the limit per address tells whether there is
+    // another page.
+    std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+    for (const auto& it : addresses) {
+        if (!GetAddressIndexPage(it.first, it.second, startHeight, startTxIndex, end, page.nLimit + 1, entries)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
+        }
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+        [](const std::pair<CAddressIndexKey, CAmount>& a, const std::pair<CAddressIndexKey, CAmount>& b) {
+            return std::make_pair(a.first.blockHeight, a.first.txindex) < std::make_pair(b.first.blockHeight, b.first.txindex);
+        });
+
+    nextCursor.clear();
+    size_t nTxs = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const CAddressIndexKey& key = entries[i].first;
+        if (i == 0 || key.blockHeight != entries[i - 1].first.blockHeight || key.txindex != entries[i - 1].first.txindex) {
+            if (nTxs == page.nLimit) {
+                nextCursor = strprintf("%d:%u", key.blockHeight, key.txindex);
+                break;
+            }
+            nTxs++;
+        }
+        addressIndex.push_back(entries[i]);
+    }
+}
+
 // insightexplorer
 UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 {
@@ -887,7 +984,7 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() != 1)
         throw runtime_error(
-            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false)}\n"
+            "getaddressdeltas {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"chainInfo\": true|false), (\"limit\": n), (\"cursor\": \"c\")}\n"
             "\nReturns all changes for an address.\n"
             "\nReturns information about all changes to the given transparent addresses within the given (inclusive)\n"
             "\nblock height range, default is the full blockchain."
@@ -905,6 +1002,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "  \"start\"       (number, optional) The start block height\n"
             "  \"end\"         (number, optional) The end block height\n"
             "  \"chainInfo\"   (boolean, optional, default=false) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\"       (number, optional) Return the deltas of at most this many transactions, in block order\n"
+            "  \"cursor\"      (string, optional) The nextCursor of the previous page\n"
             "}\n"
             "(or)\n"
             "\"address\"       (string) The base58check encoded address\n"
@@ -940,6 +1039,10 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "      \"hash\"          (string)  The end block hash\n"
             "      \"height\"        (numeric) The height of the end block\n"
             "    }\n"
+            "}\n\n"
+            "(or, if limit is given, the object above without start and end unless chainInfo is true, and):\n\n"
+            "{\n"
+            "  \"nextCursor\"      (string, optional) Pass as cursor to get the next page; absent on the last page\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000, \"chainInfo\": true}'")
@@ -950,14 +1053,21 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_MISC_ERROR, "Error: getaddressdeltas is disabled. "
             "Run './junocash-cli help getaddressdeltas' for instructions on how to enable this feature.");
     }
+    EnsureIndexesSynced();
 
     int start = 0;
     int end = 0;
     getHeightRange(params, start, end);
 
+    AddressIndexPage page = getPageParams(params);
+    std::string nextCursor;
     std::vector<std::pair<uint160, int>> addresses;
     std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+    if (page.fPaged) {
+        getAddressesPage(params, start, end, page, addresses, addressIndex, nextCursor);
+    } else {
+        getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+    }
 
     bool includeChainInfo = false;
     if (params[0].isObject()) {
@@ -986,8 +1096,14 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 
     UniValue result(UniValue::VOBJ);
 
+    if (page.fPaged) {
+        result.pushKV("deltas", deltas);
+        if (!nextCursor.empty()) {
+            result.pushKV("nextCursor", nextCursor);
+        }
+    }
     if (!(includeChainInfo && start > 0 && end > 0)) {
-        return deltas;
+        return page.fPaged ? result : deltas;
     }
 
     UniValue startInfo(UniValue::VOBJ);
@@ -1003,7 +1119,9 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     startInfo.pushKV("height", start);
     endInfo.pushKV("height", end);
 
-    result.pushKV("deltas", deltas);
+    if (!page.fPaged) {
+        result.pushKV("deltas", deltas);
+    }
     result.pushKV("start", startInfo);
     result.pushKV("end", endInfo);
 
@@ -1046,20 +1164,25 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_MISC_ERROR, "Error: getaddressbalance is disabled. "
             "Run './junocash-cli help getaddressbalance' for instructions on how to enable this feature.");
     }
+    EnsureIndexesSynced();
 
     std::vector<std::pair<uint160, int>> addresses;
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    // this method doesn't take start and end block height params, so set
-    // to zero (full range, entire blockchain)
-    getAddressesInHeightRange(params, 0, 0, addresses, addressIndex);
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
 
+    // The index keeps running totals per address, so this does not depend on
+    // the length of the address history.
     CAmount balance = 0;
     CAmount received = 0;
-    for (const auto& it : addressIndex) {
-        if (it.second > 0) {
-            received += it.second;
+    for (const auto& it : addresses) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance(it.first, it.second, value)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                "No information available for address");
         }
-        balance += it.second;
+        balance += value.balance;
+        received += value.received;
     }
     UniValue result(UniValue::VOBJ);
     result.pushKV("balance", balance);
@@ -1076,7 +1199,7 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
     }
     if (fHelp || params.size() != 1)
         throw runtime_error(
-            "getaddresstxids {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n)}\n"
+            "getaddresstxids {\"addresses\": [\"taddr\", ...], (\"start\": n), (\"end\": n), (\"limit\": n), (\"cursor\": \"c\")}\n"
             "\nReturns the txids for given transparent addresses within the given (inclusive)\n"
             "\nblock height range, default is the full blockchain."
             "\nIf start or end are not specified, they default to zero."
@@ -1095,6 +1218,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number, optional) The start block height\n"
             "  \"end\" (number, optional) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids\n"
+            "  \"cursor\" (string, optional) The nextCursor of the previous page\n"
             "}\n"
             "(or)\n"
             "\"address\"  (string) The base58check encoded address\n"
@@ -1102,7 +1227,12 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
-            "]\n"
+            "]\n\n"
+            "(or, if limit is given):\n\n"
+            "{\n"
+            "  \"txids\": [\"transactionid\", ...]\n"
+            "  \"nextCursor\"  (string, optional) Pass as cursor to get the next page; absent on the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"tmYXBYJj1K7vhejSec5osXK2QsGa5MTisUQ\"], \"start\": 1000, \"end\": 2000}")
@@ -1112,14 +1242,21 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_MISC_ERROR, "Error: getaddresstxids is disabled. "
             "Run './junocash-cli help getaddresstxids' for instructions on how to enable this feature.");
     }
+    EnsureIndexesSynced();
 
     int start = 0;
     int end = 0;
     getHeightRange(params, start, end);
 
+    AddressIndexPage page = getPageParams(params);
+    std::string nextCursor;
     std::vector<std::pair<uint160, int>> addresses;
     std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+    if (page.fPaged) {
+        getAddressesPage(params, start, end, page, addresses, addressIndex, nextCursor);
+    } else {
+        getAddressesInHeightRange(params, start, end, addresses, addressIndex);
+    }
 
     // This is an ordered set, sorted by (height,txindex) so result also sorted by height.
     std::set<std::tuple<int, int, std::string>> txids;
@@ -1137,6 +1274,14 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         result.push_back(std::get<2>(it));
     }
 
+    if (page.fPaged) {
+        UniValue pageResult(UniValue::VOBJ);
+        pageResult.pushKV("txids", result);
+        if (!nextCursor.empty()) {
+            pageResult.pushKV("nextCursor", nextCursor);
+        }
+        return pageResult;
+    }
     return result;
 }
 
@@ -1172,6 +1317,7 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_MISC_ERROR, "Error: getspentinfo is disabled. "
             "Run './junocash-cli help getspentinfo' for instructions on how to enable this feature.");
     }
+    EnsureIndexesSynced();
 
     UniValue txidValue = find_value(params[0].get_obj(), "txid");
     UniValue indexValue = find_value(params[0].get_obj(), "index");
@@ -1242,25 +1388,89 @@ UniValue getmemoryinfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getlockstats ( count \"sortby\" )\n"
+            "\nReturns the lock sites that have waited longest for, or held longest, their locks since the node started.\n"
+            "A lock site is a lock together with the file and line that takes it. Every wait for a lock that was\n"
+            "not free is recorded; hold times are sampled once in every -lockprofilerate acquisitions and scaled up.\n"
+            "The same statistics are exported as the zcash.sync.lock.* metrics.\n"
+            "\nArguments:\n"
+            "1. count       (numeric, optional, default=20) The number of lock sites to return\n"
+            "2. \"sortby\"    (string, optional, default=\"wait\") \"wait\" to sort by total wait time, \"hold\" by estimated hold time\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"lock\": \"name\",         (string) The lock, as named in the LOCK macro\n"
+            "    \"site\": \"file:line\",    (string) Where the lock was taken\n"
+            "    \"contentions\": n,        (numeric) Number of times the lock was not free\n"
+            "    \"totalwaitms\": x.xxx,    (numeric) Total time spent waiting for the lock in milliseconds\n"
+            "    \"maxwaitms\": x.xxx,      (numeric) Longest wait in milliseconds\n"
+            "    \"holdsamples\": n,        (numeric) Number of sampled holds\n"
+            "    \"totalholdms\": x.xxx,    (numeric) Estimated total time the lock was held in milliseconds\n"
+            "    \"maxholdms\": x.xxx       (numeric) Longest sampled hold in milliseconds\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleCli("getlockstats", "10 \"hold\"")
+            + HelpExampleRpc("getlockstats", "10, \"hold\"")
+        );
+
+    size_t nCount = LOCK_PROFILE_METRICS_SITES;
+    if (params.size() > 0) {
+        int nCountIn = params[0].get_int();
+        if (nCountIn < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must be non-negative");
+        nCount = nCountIn;
+    }
+    bool fByHold = false;
+    if (params.size() > 1) {
+        std::string strSortBy = params[1].get_str();
+        if (strSortBy == "hold")
+            fByHold = true;
+        else if (strSortBy != "wait")
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sortby, must be \"wait\" or \"hold\"");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const CLockSiteStats& stats : GetTopLockSites(nCount, fByHold)) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("lock", stats.strName);
+        obj.pushKV("site", strprintf("%s:%d", stats.strFile, stats.nLine));
+        obj.pushKV("contentions", stats.nContentions);
+        obj.pushKV("totalwaitms", stats.nWaitMicros * 0.001);
+        obj.pushKV("maxwaitms", stats.nMaxWaitMicros * 0.001);
+        obj.pushKV("holdsamples", stats.nHoldSamples);
+        obj.pushKV("totalholdms", stats.GetEstimatedHoldMicros() * 0.001);
+        obj.pushKV("maxholdms", stats.nMaxHoldMicros * 0.001);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  concurrency
+  //  --------------------- ------------------------  -----------------------  ----------  ----------------------
     { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "control",            "getmemoryinfo",          &getmemoryinfo,          true  },
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "z_validateaddress",      &z_validateaddress,      true  }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "verifymessage",          &verifymessage,          true  },
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  RPCConcurrency::Shared },
+    { "control",            "getlockstats",           &getlockstats,           true,  RPCConcurrency::Shared },
+    { "util",               "validateaddress",        &validateaddress,        true,  RPCConcurrency::Shared }, /* uses wallet if enabled */
+    { "util",               "z_validateaddress",      &z_validateaddress,      true,  RPCConcurrency::Shared }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,  RPCConcurrency::Shared },
+    { "util",               "verifymessage",          &verifymessage,          true,  RPCConcurrency::Shared },
     { "control",            "getexperimentalfeatures",&getexperimentalfeatures,true  },
 
     // START insightexplorer
     /* Address index */
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false }, /* insight explorer */
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false }, /* insight explorer */
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false }, /* insight explorer */
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false }, /* insight explorer */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  }, /* insight explorer */
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false }, /* insight explorer */
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false, RPCConcurrency::Shared }, /* insight explorer */
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false, RPCConcurrency::Shared }, /* insight explorer */
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false, RPCConcurrency::Shared }, /* insight explorer */
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false, RPCConcurrency::Shared }, /* insight explorer */
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,  RPCConcurrency::Shared }, /* insight explorer */
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false, RPCConcurrency::Shared }, /* insight explorer */
     // END insightexplorer
 
     /* Not shown in help */
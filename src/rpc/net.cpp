@@ -107,7 +107,28 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"inflight_limit\": n,       (numeric) The number of blocks we may ask from this peer at once\n"
+            "    \"block_download_rate\": n,  (numeric) The smoothed rate in bytes per second at which this peer delivers\n"
+            "                                 the blocks we ask for, or 0 if not yet known\n"
+            "    \"block_bytes_received\": n, (numeric) The total size of the blocks we asked for that this peer delivered\n"
+            "    \"blocks_stolen\": n,        (numeric) The number of blocks asked from this peer that were asked again from\n"
+            "                                 a faster peer, because this peer was holding back the download\n"
+            "    \"prefer_headers\": true|false, (boolean) Whether the peer asked for new blocks to be announced with headers\n"
+            "    \"block_push\": true|false,   (boolean) Whether new blocks are sent to the peer in full (see -blockpushpeer)\n"
+            "    \"blocks_announced\": {      (json object) The number of new blocks announced to this peer\n"
+            "      \"headers\": n,             (numeric) with headers\n"
+            "      \"inv\": n,                 (numeric) with an inv of the tip\n"
+            "      \"push\": n                 (numeric) by sending the block itself\n"
+            "    },\n"
+            "    \"blocks_pushed_from\": n,   (numeric) The number of new blocks this peer sent us without a request\n"
+            "    \"block_relay_ms\": {        (json object) The smoothed time in milliseconds from this peer announcing a\n"
+            "                                 new block to delivering it, or 0 if not yet known\n"
+            "      \"headers\": n,             (numeric) for blocks announced with headers\n"
+            "      \"inv\": n                  (numeric) for blocks announced with an inv\n"
+            "    },\n"
+            "    \"headers_rate_limited\": n, (numeric) The number of headers from this peer that were ignored because\n"
+            "                                 it exceeded its RandomX verification budget\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -158,9 +179,26 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("inflight_limit", statestats.nBlocksInTransitLimit);
+            obj.pushKV("block_download_rate", statestats.dBlockDownloadRate);
+            obj.pushKV("block_bytes_received", statestats.nBlockBytesReceived);
+            obj.pushKV("blocks_stolen", statestats.nBlocksStolen);
+            obj.pushKV("prefer_headers", statestats.fPreferHeaders);
+            obj.pushKV("block_push", statestats.fBlockPush);
+            UniValue announced(UniValue::VOBJ);
+            announced.pushKV("headers", statestats.nBlocksAnnouncedByHeaders);
+            announced.pushKV("inv", statestats.nBlocksAnnouncedByInv);
+            announced.pushKV("push", statestats.nBlocksPushedTo);
+            obj.pushKV("blocks_announced", announced);
+            obj.pushKV("blocks_pushed_from", statestats.nBlocksPushedFrom);
+            UniValue relay(UniValue::VOBJ);
+            relay.pushKV("headers", statestats.dHeadersRelayTime * 0.001);
+            relay.pushKV("inv", statestats.dInvRelayTime * 0.001);
+            obj.pushKV("block_relay_ms", relay);
         }
         obj.pushKV("addr_processed", stats.m_addr_processed);
         obj.pushKV("addr_rate_limited", stats.m_addr_rate_limited);
+        obj.pushKV("headers_rate_limited", stats.m_headers_rate_limited);
         obj.pushKV("whitelisted", stats.fWhitelisted);
 
         ret.push_back(obj);
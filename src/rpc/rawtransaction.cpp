@@ -10,6 +10,7 @@
 #include "core_io.h"
 #include "init.h"
 #include "deprecation.h"
+#include "indexbuilder.h"
 #include "key_io.h"
 #include "keystore.h"
 #include "main.h"
@@ -506,6 +507,11 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             + HelpExampleCli("getrawtransaction", "\"mytxid\" 1 \"myblockhash\"")
         );
 
+    // Spent information is optional here, so this waits for the spent index
+    // only if it is following the tip.
+    if (fSpentIndex && pindexBuilder)
+        pindexBuilder->BlockUntilSyncedToCurrentChain();
+
     LOCK(cs_main);
 
     bool in_active_chain = true;
@@ -1315,17 +1321,17 @@ UniValue sendrawtransaction(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
+{ //  category              name                      actor (function)         okSafeMode  concurrency
+  //  --------------------- ------------------------  -----------------------  ----------  ----------------------
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,  RPCConcurrency::Shared },
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,  RPCConcurrency::Shared },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,  RPCConcurrency::Shared },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,  RPCConcurrency::Shared },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
 
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,  RPCConcurrency::Shared },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,  RPCConcurrency::Shared },
 };
 
 void RegisterRawTransactionRPCCommands(CRPCTable &tableRPC)
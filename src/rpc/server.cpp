@@ -8,7 +8,9 @@
 #include "rpc/server.h"
 
 #include "fs.h"
+#include "indexbuilder.h"
 #include "init.h"
+#include "main.h"
 #include "key_io.h"
 #include "random.h"
 #include "rpc/common.h"
@@ -18,7 +20,11 @@
 #include "util/strencodings.h"
 #include "asyncrpcqueue.h"
 
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <memory>
+#include <thread>
 
 #include <univalue.h>
 
@@ -46,6 +52,82 @@ static std::vector<RPCTimerInterface*> timerInterfaces;
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
 
+/**
+ * Executes the Shared elements of JSON-RPC batch requests on a small pool of
+ * dedicated threads, so that a large batch of read-only calls is not limited to
+ * the single HTTP worker thread that received it.
+ */
+class CRPCBatchExecutor
+{
+private:
+    Mutex cs;
+    std::condition_variable cond;
+    std::deque<std::packaged_task<void()>> queue;
+    std::vector<std::thread> workers;
+    bool running{false};
+
+    void Run()
+    {
+        RenameThread("zc-rpc-batch");
+        while (true) {
+            std::packaged_task<void()> task;
+            {
+                WAIT_LOCK(cs, lock);
+                while (running && queue.empty())
+                    cond.wait(lock);
+                // Drain the queue on shutdown so no caller waits on an abandoned task.
+                if (queue.empty())
+                    break;
+                task = std::move(queue.front());
+                queue.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    void Start(int nThreads)
+    {
+        LOCK(cs);
+        running = nThreads > 0;
+        for (int i = 0; i < nThreads; i++) {
+            workers.emplace_back(&CRPCBatchExecutor::Run, this);
+        }
+    }
+
+    void Stop()
+    {
+        {
+            LOCK(cs);
+            running = false;
+            cond.notify_all();
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    /** Queue a task, or run it on the calling thread if the executor is not running. */
+    std::future<void> Submit(std::function<void()> func)
+    {
+        std::packaged_task<void()> task(std::move(func));
+        std::future<void> result = task.get_future();
+        {
+            LOCK(cs);
+            if (running) {
+                queue.emplace_back(std::move(task));
+                cond.notify_one();
+                return result;
+            }
+        }
+        task();
+        return result;
+    }
+};
+
+static CRPCBatchExecutor rpcBatchExecutor;
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -344,6 +426,8 @@ bool StartRPC()
     fRPCRunning = true;
     g_rpcSignals.Started();
 
+    StartRPCBatchExecutor(std::max((int)GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 0));
+
     // Launch one async rpc worker.  The ability to launch multiple workers is not recommended at present and thus the option is disabled.
     getAsyncRPCQueue()->addWorker();
 /*
@@ -361,6 +445,18 @@ bool StartRPC()
     return true;
 }
 
+void StartRPCBatchExecutor(int nThreads)
+{
+    LogPrint("rpc", "Starting %d RPC batch executor threads\n", nThreads);
+    rpcBatchExecutor.Start(nThreads);
+}
+
+void StopRPCBatchExecutor()
+{
+    // Batch requests still being served will run their remaining elements inline.
+    rpcBatchExecutor.Stop();
+}
+
 void InterruptRPC()
 {
     LogPrint("rpc", "Interrupting RPC\n");
@@ -374,6 +470,8 @@ void StopRPC()
     deadlineTimers.clear();
     g_rpcSignals.Stopped();
 
+    StopRPCBatchExecutor();
+
     // Tells async queue to cancel all operations and shutdown.
     LogPrintf("%s: waiting for async rpc workers to stop\n", __func__);
     getAsyncRPCQueue()->closeAndWait();
@@ -458,16 +556,48 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
+/** Returns true if the batch element names a method that may run concurrently with its neighbours. */
+static bool IsSharedBatchRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    if (!method.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->concurrency == RPCConcurrency::Shared;
+}
+
 std::string JSONRPCExecBatch(const UniValue& vReq)
 {
+    // Consecutive Shared elements are fanned out to the batch executor. An Exclusive
+    // element waits for every earlier element to complete and then runs here, so it
+    // observes the same state it would have seen with sequential execution.
+    std::vector<UniValue> results(vReq.size());
+    std::vector<std::future<void>> pending;
+    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++) {
+        if (IsSharedBatchRequest(vReq[reqIdx])) {
+            pending.push_back(rpcBatchExecutor.Submit([&vReq, &results, reqIdx]() {
+                results[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+            }));
+        } else {
+            for (auto& f : pending)
+                f.wait();
+            pending.clear();
+            results[reqIdx] = JSONRPCExecOne(vReq[reqIdx]);
+        }
+    }
+    for (auto& f : pending)
+        f.wait();
+
     UniValue ret(UniValue::VARR);
-    for (size_t reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    for (const auto& result : results)
+        ret.push_back(result);
 
     return ret.write() + "\n";
 }
 
-UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+const CRPCCommand* CRPCTable::prepare(const std::string &strMethod, const UniValue &params) const
 {
     // Return immediately if in warmup
     {
@@ -483,45 +613,66 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    auto paramRange = rpcCvtTable.find(strMethod);
+    if (paramRange == rpcCvtTable.end()) {
+        throw JSONRPCError(
+                RPC_INTERNAL_ERROR,
+                "Parameters for "
+                + strMethod
+                + " not found – this is an internal error, please report it.");
+    }
+
+    auto numRequired = paramRange->second.first.size();
+    auto numOptional = paramRange->second.second.size();
+    if (params.size() < numRequired || numRequired + numOptional < params.size()) {
+        std::string helpMsg;
+        try {
+            // help gets thrown – if it doesn’t throw, then no help message
+            pcmd->actor(params, true);
+        } catch (const std::runtime_error& err) {
+            helpMsg = std::string("\n\n") + err.what();
+        }
+        throw JSONRPCError(
+            RPC_INVALID_PARAMS,
+            strprintf(
+                    "%s for method `%s`. Needed %s, but received %u%s",
+                    params.size() < numRequired
+                    ? "Not enough parameters"
+                    : "Too many parameters",
+                    strMethod,
+                    numOptional == 0
+                    ? strprintf("exactly %u", numRequired)
+                    : strprintf("at least %u and at most %u", numRequired, numRequired + numOptional),
+                    params.size(),
+                    helpMsg));
+    }
+    return pcmd;
+}
+
+UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
+{
+    const CRPCCommand *pcmd = prepare(strMethod, params);
+
     try
     {
         // Execute
-        auto paramRange = rpcCvtTable.find(strMethod);
-        if (paramRange != rpcCvtTable.end()) {
-            auto numRequired = paramRange->second.first.size();
-            auto numOptional = paramRange->second.second.size();
-            if (params.size() < numRequired || numRequired + numOptional < params.size()) {
-                std::string helpMsg;
-                try {
-                    // help gets thrown – if it doesn’t throw, then no help message
-                    pcmd->actor(params, true);
-                } catch (const std::runtime_error& err) {
-                    helpMsg = std::string("\n\n") + err.what();
-                }
-                throw JSONRPCError(
-                    RPC_INVALID_PARAMS,
-                    strprintf(
-                            "%s for method `%s`. Needed %s, but received %u%s",
-                            params.size() < numRequired
-                            ? "Not enough parameters"
-                            : "Too many parameters",
-                            strMethod,
-                            numOptional == 0
-                            ? strprintf("exactly %u", numRequired)
-                            : strprintf("at least %u and at most %u", numRequired, numRequired + numOptional),
-                            params.size(),
-                            helpMsg));
-            } else {
-                return pcmd->actor(params, false);
-            }
-        } else {
-            throw JSONRPCError(
-                    RPC_INTERNAL_ERROR,
-                    "Parameters for "
-                    + strMethod
-                    + " not found – this is an internal error, please report it.");
-        }
+        return pcmd->actor(params, false);
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
+void CRPCTable::executeStreaming(const std::string &strMethod, const UniValue &params, JSONStreamWriter& out) const
+{
+    const CRPCCommand *pcmd = prepare(strMethod, params);
+    assert(pcmd->streamActor);
 
+    try
+    {
+        // Execute
+        pcmd->streamActor(params, out);
     }
     catch (const std::exception& e)
     {
@@ -579,6 +730,20 @@ std::string experimentalDisabledHelpMsg(const std::string& rpc, const std::vecto
         + config;
 }
 
+void EnsureIndexesSynced()
+{
+    if (pindexBuilder && !pindexBuilder->BlockUntilSyncedToCurrentChain()) {
+        int nHeight;
+        {
+            LOCK(cs_main);
+            nHeight = chainActive.Height();
+        }
+        throw JSONRPCError(RPC_IN_WARMUP, strprintf(
+            "The address, spent and timestamp indexes are still being built (at height %d of %d)",
+            pindexBuilder->GetBestHeight(), nHeight));
+    }
+}
+
 std::string asOfHeightMessage(bool hasMinconf) {
     std::string minconfInteraction = hasMinconf
         ? "                    `minconf` must be at least 1 when `asOfHeight` is provided.\n"
@@ -117,8 +117,35 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface);
  */
 void RPCRunLater(const std::string& name, std::function<void(void)> func, int64_t nSeconds);
 
+class JSONStreamWriter;
+
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+/**
+ * Alternative implementation of a method that writes its result to a
+ * JSONStreamWriter as it is produced. Used for singleton HTTP requests so that
+ * large results never have to be held in memory in full; batch requests and
+ * in-process callers keep using the regular actor.
+ */
+typedef void(*rpcstreamfn_type)(const UniValue& params, JSONStreamWriter& out);
+
+/** Default number of threads used to execute the read-only elements of batch requests */
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+
+/**
+ * How an RPC method may be scheduled relative to the other elements of a
+ * JSON-RPC batch request.
+ */
+enum class RPCConcurrency {
+    /** Runs on the HTTP worker thread after every earlier batch element has completed. */
+    Exclusive,
+    /**
+     * Only reads state under short-lived locks, so consecutive Shared elements of a
+     * batch may run in parallel on the RPC batch executor.
+     */
+    Shared,
+};
+
 class CRPCCommand
 {
 public:
@@ -126,6 +153,9 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    RPCConcurrency concurrency = RPCConcurrency::Exclusive;
+    /** Optional streaming variant of actor; must produce the same result. */
+    rpcstreamfn_type streamActor = nullptr;
 };
 
 /**
@@ -135,6 +165,12 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+
+    /**
+     * Common checks before executing a method: warmup, lookup and parameter
+     * count. Returns the command to run.
+     */
+    const CRPCCommand* prepare(const std::string &method, const UniValue &params) const;
 public:
     CRPCTable();
     const CRPCCommand* operator[](const std::string& name) const;
@@ -149,6 +185,16 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method through its streaming variant.
+     * @param method   Method to execute; must have a streamActor
+     * @param params   UniValue Array of arguments (JSON objects)
+     * @param out      Writer that receives the result as it is produced
+     * @throws an exception (UniValue) when an error happens. Part of the
+     * result may already have been written by then.
+     */
+    void executeStreaming(const std::string &method, const UniValue &params, JSONStreamWriter& out) const;
+
     /**
     * Returns a list of registered commands
     * @returns List of registered commands.
@@ -189,9 +235,18 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
+/** Start and stop the threads that run the Shared elements of batch requests; done by StartRPC and StopRPC. */
+void StartRPCBatchExecutor(int nThreads);
+void StopRPCBatchExecutor();
 std::string JSONRPCExecBatch(const UniValue& vReq);
 
 extern std::string experimentalDisabledHelpMsg(const std::string& rpc, const std::vector<std::string>& enableArgs);
+/**
+ * Wait for the address, spent and timestamp indexes to include the chain
+ * tip; throws while they are still being built. Must not be called with
+ * cs_main held.
+ */
+extern void EnsureIndexesSynced();
 
 std::string asOfHeightMessage(bool hasMinconf);
 std::optional<int> parseAsOfHeight(const UniValue& params, int index);
@@ -1,6 +1,6 @@
 use libc::{c_char, c_double};
 use metrics::{try_recorder, Key, Label};
-use metrics_exporter_prometheus::{BuildError, PrometheusBuilder};
+use metrics_exporter_prometheus::{BuildError, Matcher, PrometheusBuilder};
 use metrics_util::layers::{FilterLayer, Stack};
 
 use std::ffi::CStr;
@@ -11,6 +11,16 @@ use std::thread;
 
 use tracing::error;
 
+/// Bucket bounds, in seconds, for the block validation stage histograms recorded
+/// by `RecordValidationStage`. Other histograms are exported as summaries.
+///
+/// The exporter matches these against metric names after sanitizing them for
+/// Prometheus, so `zcash.chain.validation.seconds` is matched with underscores.
+const VALIDATION_STAGE_BUCKETS: &[f64] = &[
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5,
+    5.0, 10.0, 30.0, 60.0,
+];
+
 /// Builds the recorder and exporter, applies the given filters to the recorder, and
 /// installs both of them globally.
 fn metrics_install(builder: PrometheusBuilder, filters: &[&str]) -> Result<(), BuildError> {
@@ -91,17 +101,20 @@ pub extern "C" fn metrics_run(
         &["zcashd.debug."]
     };
 
-    allow_ips
-        .into_iter()
-        .try_fold(
-            PrometheusBuilder::new().with_http_listener(bind_address),
-            |builder, subnet| {
+    PrometheusBuilder::new()
+        .with_http_listener(bind_address)
+        .set_buckets_for_metric(
+            Matcher::Full("zcash_chain_validation_seconds".to_string()),
+            VALIDATION_STAGE_BUCKETS,
+        )
+        .and_then(|builder| {
+            allow_ips.into_iter().try_fold(builder, |builder, subnet| {
                 builder.add_allowed_address(subnet).map_err(|e| {
                     error!("Invalid -metricsallowip argument '{}': {}", subnet, e);
                     e
                 })
-            },
-        )
+            })
+        })
         .and_then(|builder| {
             metrics_install(builder, filters).map_err(|e| {
                 error!("Could not install Prometheus exporter: {}", e);
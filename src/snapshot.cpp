@@ -0,0 +1,201 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "snapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "main.h"
+#include "txdb.h"
+#include "util/system.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+uint256 DumpSnapshot(
+    const CChainParams& chainparams,
+    const CCoinsViewDB& view,
+    const CDBSnapshot& viewSnapshot,
+    const CBlockTreeDB& blocktree,
+    const CDBSnapshot& blocktreeSnapshot,
+    const CBlockIndex* pindexBase,
+    const fs::path& path,
+    CSnapshotStats& stats)
+{
+    if (view.GetBestBlock(viewSnapshot) != pindexBase->GetBlockHash())
+        throw std::runtime_error("chainstate database is not at the snapshot base block");
+
+    // Write to a temporary name so that an interrupted dump never leaves a
+    // file behind that looks complete.
+    fs::path pathTmp = path.string() + ".incomplete";
+    CAutoFile file(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        throw std::runtime_error(strprintf("unable to open %s for writing", pathTmp.string()));
+
+    CSnapshotHeader header;
+    std::copy(chainparams.MessageStart(), chainparams.MessageStart() + header.networkMagic.size(), header.networkMagic.begin());
+    header.hashBase = pindexBase->GetBlockHash();
+    header.nHeight = pindexBase->nHeight;
+
+    uint256 hash;
+    try {
+        CSnapshotWriter out(file);
+        out << header;
+
+        // Block index entries of the chain up to the base, without block data.
+        // The pprev links of an entry never change once it is in the index,
+        // so the walk does not need cs_main.
+        WriteCompactSize(out, pindexBase->nHeight + 1);
+        for (int nHeight = 0; nHeight <= pindexBase->nHeight; nHeight++) {
+            boost::this_thread::interruption_point();
+            const CBlockIndex* pindex = pindexBase->GetAncestor(nHeight);
+            CDiskBlockIndex dbindex;
+            if (!blocktree.ReadDiskBlockIndex(blocktreeSnapshot, pindex->GetBlockHash(), dbindex))
+                throw std::runtime_error(strprintf("unable to read block index entry at height %d", nHeight));
+            dbindex.nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            dbindex.nFile = 0;
+            dbindex.nDataPos = 0;
+            dbindex.nUndoPos = 0;
+            out << dbindex;
+            stats.nHeaders++;
+        }
+
+        view.WriteSnapshot(viewSnapshot, out, stats);
+
+        hash = out.GetHash();
+        file << hash;
+        FileCommit(file.Get());
+        file.fclose();
+    } catch (...) {
+        file.fclose();
+        fs::remove(pathTmp);
+        throw;
+    }
+
+    if (!RenameOver(pathTmp, path))
+        throw std::runtime_error(strprintf("unable to rename %s to %s", pathTmp.string(), path.string()));
+
+    LogPrintf("%s: wrote snapshot of block %s (height %d) to %s, commitment %s\n",
+        __func__, header.hashBase.ToString(), header.nHeight, path.string(), hash.ToString());
+    return hash;
+}
+
+/**
+ * Hash the snapshot at path without interpreting it. Sets hash to the
+ * commitment computed over the file and hashStored to the one it ends with.
+ */
+static bool HashSnapshotFile(const fs::path& path, uint256& hash, uint256& hashStored)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: unable to open %s", __func__, path.string());
+
+    uint64_t nRemaining = fs::file_size(path);
+    if (nRemaining < sizeof(uint256))
+        return error("%s: %s is truncated", __func__, path.string());
+    nRemaining -= sizeof(uint256);
+
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    std::vector<char> vBuf(1 << 20);
+    while (nRemaining > 0) {
+        boost::this_thread::interruption_point();
+        size_t nRead = std::min<uint64_t>(nRemaining, vBuf.size());
+        file.read(vBuf.data(), nRead);
+        hasher.write(vBuf.data(), nRead);
+        nRemaining -= nRead;
+    }
+    file >> hashStored;
+    hash = hasher.GetHash();
+    return true;
+}
+
+bool LoadSnapshot(
+    const CChainParams& chainparams,
+    CCoinsViewDB& view,
+    CBlockTreeDB& blocktree,
+    const fs::path& path,
+    const uint256& hashExpected)
+{
+    bool fLoading = false;
+    blocktree.ReadFlag("loadingsnapshot", fLoading);
+    if (fLoading) {
+        return error("%s: an earlier attempt to load a snapshot was interrupted; "
+                     "remove the blocks and chainstate directories and try again", __func__);
+    }
+    if (!blocktree.IsEmpty() || !view.IsEmpty()) {
+        LogPrintf("%s: block index or chainstate already present, ignoring -loadsnapshot\n", __func__);
+        return true;
+    }
+
+    try {
+        // Check the commitment before anything is written.
+        uint256 hash, hashStored;
+        if (!HashSnapshotFile(path, hash, hashStored))
+            return false;
+        if (hash != hashStored)
+            return error("%s: %s is corrupt (commitment %s, expected %s)",
+                __func__, path.string(), hash.ToString(), hashStored.ToString());
+        if (hash != hashExpected)
+            return error("%s: snapshot commitment %s does not match -snapshothash=%s",
+                __func__, hash.ToString(), hashExpected.ToString());
+
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: unable to open %s", __func__, path.string());
+
+        CSnapshotHeader header;
+        file >> header;
+        if (header.magic != SNAPSHOT_MAGIC || header.nVersion != SNAPSHOT_VERSION)
+            return error("%s: %s is not a supported snapshot", __func__, path.string());
+        if (!std::equal(header.networkMagic.begin(), header.networkMagic.end(), chainparams.MessageStart()))
+            return error("%s: snapshot is for a different network", __func__);
+
+        LogPrintf("%s: loading snapshot of block %s (height %d)\n",
+            __func__, header.hashBase.ToString(), header.nHeight);
+        blocktree.WriteFlag("loadingsnapshot", true);
+
+        CSnapshotStats stats;
+        uint64_t nHeaders = ReadCompactSize(file);
+        if (nHeaders != (uint64_t)header.nHeight + 1)
+            return error("%s: expected %d block index entries, found %u", __func__, header.nHeight + 1, nHeaders);
+
+        std::vector<CDiskBlockIndex> vIndex;
+        uint256 hashPrev;
+        for (uint64_t i = 0; i < nHeaders; i++) {
+            boost::this_thread::interruption_point();
+            vIndex.emplace_back();
+            CDiskBlockIndex& dbindex = vIndex.back();
+            file >> dbindex;
+            if ((uint64_t)dbindex.nHeight != i || dbindex.hashPrev != hashPrev)
+                return error("%s: block index entries do not form a chain at height %u", __func__, i);
+            hashPrev = dbindex.GetBlockHash();
+            if (i == 0 && hashPrev != chainparams.GetConsensus().hashGenesisBlock)
+                return error("%s: snapshot has the wrong genesis block", __func__);
+            if (vIndex.size() >= SNAPSHOT_LOAD_BATCH_SIZE || i + 1 == nHeaders) {
+                if (!blocktree.WriteDiskBlockIndex(vIndex))
+                    return error("%s: failed to write block index", __func__);
+                vIndex.clear();
+            }
+        }
+        if (hashPrev != header.hashBase)
+            return error("%s: block index entries do not end at the snapshot base", __func__);
+        stats.nHeaders = nHeaders;
+
+        if (!view.LoadSnapshot(file, header.hashBase, stats))
+            return error("%s: failed to write chainstate", __func__);
+
+        // No block data exists below the snapshot base, which is the state a
+        // pruned node is in.
+        blocktree.WriteFlag("prunedblockfiles", true);
+        blocktree.WriteFlag("loadingsnapshot", false);
+
+        LogPrintf("%s: loaded %u block index entries, %u coins, %u nullifiers, %u anchors, %u history nodes, %u subtrees\n",
+            __func__, stats.nHeaders, stats.nCoins, stats.nNullifiers, stats.nAnchors, stats.nHistoryNodes, stats.nSubtrees);
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
@@ -0,0 +1,153 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_SNAPSHOT_H
+#define BITCOIN_SNAPSHOT_H
+
+#include "fs.h"
+#include "hash.h"
+#include "serialize.h"
+#include "streams.h"
+#include "uint256.h"
+
+#include <array>
+#include <stdint.h>
+
+class CBlockIndex;
+class CBlockTreeDB;
+class CChainParams;
+class CCoinsViewDB;
+class CDBSnapshot;
+
+/**
+ * UTXO and shielded-state snapshots.
+ *
+ * A snapshot captures the chainstate database at a block: transparent coins,
+ * the Sprout, Sapling and Orchard nullifier sets and commitment tree anchors,
+ * the ZIP 221 history trees and the note commitment subtree roots, together
+ * with the block index entries of the chain leading to that block. It is a
+ * single file that is written and read sequentially:
+ *
+ *   CSnapshotHeader | block index entries | chainstate records | commitment
+ *
+ * The commitment is the double-SHA256 of everything that precedes it. It is
+ * reported by dumpsnapshot and must be passed to -snapshothash when loading,
+ * which is what lets a fresh node trust a snapshot it did not produce.
+ *
+ * A datadir bootstrapped from a snapshot has no block data below the snapshot
+ * base and is treated exactly like a pruned datadir from then on. The blocks
+ * below the base are not downloaded or validated in the background yet, so
+ * loading a snapshot is experimental and trusts its history.
+ */
+
+static const std::array<unsigned char, 4> SNAPSHOT_MAGIC = {{'j', 's', 'n', 'p'}};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+/** Number of chainstate records written per database batch while loading. */
+static const size_t SNAPSHOT_LOAD_BATCH_SIZE = 100000;
+
+class CSnapshotHeader
+{
+public:
+    std::array<unsigned char, 4> magic;
+    uint32_t nVersion;
+    std::array<unsigned char, 4> networkMagic;
+    uint256 hashBase;
+    int nHeight;
+
+    CSnapshotHeader() : magic(SNAPSHOT_MAGIC), nVersion(SNAPSHOT_VERSION), networkMagic(), nHeight(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(magic);
+        READWRITE(nVersion);
+        READWRITE(networkMagic);
+        READWRITE(hashBase);
+        READWRITE(nHeight);
+    }
+};
+
+/** Record counts of a snapshot, as written or loaded. */
+struct CSnapshotStats
+{
+    uint64_t nHeaders;
+    uint64_t nCoins;
+    uint64_t nNullifiers;
+    uint64_t nAnchors;
+    uint64_t nHistoryNodes;
+    uint64_t nSubtrees;
+
+    CSnapshotStats() : nHeaders(0), nCoins(0), nNullifiers(0), nAnchors(0), nHistoryNodes(0), nSubtrees(0) {}
+};
+
+/** Serialization stream that writes to a file and hashes everything written. */
+class CSnapshotWriter
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    explicit CSnapshotWriter(CAutoFile& fileIn) :
+        file(fileIn), hasher(fileIn.GetType(), fileIn.GetVersion()) {}
+
+    int GetType() const { return file.GetType(); }
+    int GetVersion() const { return file.GetVersion(); }
+
+    void write_u8(const unsigned char* pch, size_t nSize)
+    {
+        write(reinterpret_cast<const char*>(pch), nSize);
+    }
+
+    void write(const char* pch, size_t nSize)
+    {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+    }
+
+    template<typename T>
+    CSnapshotWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/**
+ * Write a snapshot of the chainstate at pindexBase, which must be the best
+ * block of view as seen through viewSnapshot. Everything is read through
+ * viewSnapshot and blocktreeSnapshot, so cs_main only needs to be held while
+ * those are taken (after flushing), not while the file is written.
+ *
+ * @returns the snapshot commitment.
+ * @throws std::runtime_error or std::ios_base::failure on failure.
+ */
+uint256 DumpSnapshot(
+    const CChainParams& chainparams,
+    const CCoinsViewDB& view,
+    const CDBSnapshot& viewSnapshot,
+    const CBlockTreeDB& blocktree,
+    const CDBSnapshot& blocktreeSnapshot,
+    const CBlockIndex* pindexBase,
+    const fs::path& path,
+    CSnapshotStats& stats);
+
+/**
+ * Load the snapshot at path into an empty block index and chainstate after
+ * checking that its commitment equals hashExpected. Does nothing if a
+ * snapshot was already loaded into this datadir.
+ */
+bool LoadSnapshot(
+    const CChainParams& chainparams,
+    CCoinsViewDB& view,
+    CBlockTreeDB& blocktree,
+    const fs::path& path,
+    const uint256& hashExpected);
+
+#endif // BITCOIN_SNAPSHOT_H
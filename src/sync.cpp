@@ -10,9 +10,11 @@
 
 #include <stdio.h>
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <set>
+#include <tuple>
 
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
@@ -25,6 +27,144 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+//
+// Lock profiling
+//
+
+std::atomic<unsigned int> g_lock_profile_sample_rate{DEFAULT_LOCK_PROFILE_SAMPLE_RATE};
+
+namespace {
+
+// Within a thread, a site is identified by the addresses of its string
+// literals, which is cheap to look up.
+typedef std::tuple<const char*, const char*, int> LockSiteKey;
+
+struct ThreadLockProfile {
+    // Only contended when the profile is being read. This is a plain
+    // std::mutex, as recording must not itself be profiled.
+    std::mutex mutex;
+    std::map<LockSiteKey, CLockSiteStats> mapSites;
+};
+
+typedef std::map<std::tuple<std::string, std::string, int>, CLockSiteStats> LockSiteTotals;
+
+void AddLockSiteStats(LockSiteTotals& totals, const CLockSiteStats& stats)
+{
+    CLockSiteStats& total = totals[std::make_tuple(stats.strName, stats.strFile, stats.nLine)];
+    total.strName = stats.strName;
+    total.strFile = stats.strFile;
+    total.nLine = stats.nLine;
+    total.nContentions += stats.nContentions;
+    total.nWaitMicros += stats.nWaitMicros;
+    total.nMaxWaitMicros = std::max(total.nMaxWaitMicros, stats.nMaxWaitMicros);
+    total.nHoldSamples += stats.nHoldSamples;
+    total.nHoldMicros += stats.nHoldMicros;
+    total.nMaxHoldMicros = std::max(total.nMaxHoldMicros, stats.nMaxHoldMicros);
+}
+
+struct LockProfileRegistry {
+    std::mutex mutex;
+    std::set<std::shared_ptr<ThreadLockProfile>> setThreads;
+    //! The records of threads that have exited
+    LockSiteTotals retired;
+};
+
+LockProfileRegistry& GetLockProfileRegistry()
+{
+    // Never destroyed, as threads may record until the process exits.
+    static LockProfileRegistry* registry = new LockProfileRegistry();
+    return *registry;
+}
+
+thread_local bool fLockProfileThreadExited = false;
+
+struct ThreadLockProfileHandle {
+    std::shared_ptr<ThreadLockProfile> profile{std::make_shared<ThreadLockProfile>()};
+
+    ThreadLockProfileHandle()
+    {
+        LockProfileRegistry& registry = GetLockProfileRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.setThreads.insert(profile);
+    }
+
+    ~ThreadLockProfileHandle()
+    {
+        fLockProfileThreadExited = true;
+        LockProfileRegistry& registry = GetLockProfileRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        std::lock_guard<std::mutex> lockThread(profile->mutex);
+        for (const auto& site : profile->mapSites) {
+            AddLockSiteStats(registry.retired, site.second);
+        }
+        registry.setThreads.erase(profile);
+    }
+};
+
+CLockSiteStats* GetLockSiteStats(const char* pszName, const char* pszFile, int nLine, std::unique_lock<std::mutex>& lock)
+{
+    if (fLockProfileThreadExited)
+        return nullptr;
+    static thread_local ThreadLockProfileHandle handle;
+    lock = std::unique_lock<std::mutex>(handle.profile->mutex);
+    auto it = handle.profile->mapSites.find(LockSiteKey(pszName, pszFile, nLine));
+    if (it == handle.profile->mapSites.end()) {
+        CLockSiteStats stats;
+        stats.strName = pszName;
+        stats.strFile = pszFile;
+        stats.nLine = nLine;
+        it = handle.profile->mapSites.emplace(LockSiteKey(pszName, pszFile, nLine), std::move(stats)).first;
+    }
+    return &it->second;
+}
+
+} // namespace
+
+void RecordLockWait(const char* pszName, const char* pszFile, int nLine, int64_t nMicros)
+{
+    std::unique_lock<std::mutex> lock;
+    CLockSiteStats* stats = GetLockSiteStats(pszName, pszFile, nLine, lock);
+    if (!stats)
+        return;
+    stats->nContentions++;
+    stats->nWaitMicros += nMicros;
+    stats->nMaxWaitMicros = std::max(stats->nMaxWaitMicros, nMicros);
+}
+
+void RecordLockHold(const char* pszName, const char* pszFile, int nLine, int64_t nMicros)
+{
+    std::unique_lock<std::mutex> lock;
+    CLockSiteStats* stats = GetLockSiteStats(pszName, pszFile, nLine, lock);
+    if (!stats)
+        return;
+    stats->nHoldSamples++;
+    stats->nHoldMicros += nMicros;
+    stats->nMaxHoldMicros = std::max(stats->nMaxHoldMicros, nMicros);
+}
+
+std::vector<CLockSiteStats> GetLockProfile()
+{
+    LockProfileRegistry& registry = GetLockProfileRegistry();
+    LockSiteTotals totals;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        totals = registry.retired;
+        for (const auto& profile : registry.setThreads) {
+            std::lock_guard<std::mutex> lockThread(profile->mutex);
+            for (const auto& site : profile->mapSites) {
+                AddLockSiteStats(totals, site.second);
+            }
+        }
+    }
+
+    std::vector<CLockSiteStats> vStats;
+    vStats.reserve(totals.size());
+    for (auto& site : totals) {
+        vStats.push_back(std::move(site.second));
+    }
+    return vStats;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -12,9 +12,14 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <stdint.h>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 
 ////////////////////////////////////////////////
@@ -118,22 +123,98 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+//
+// Lock profiling. Each LOCK that has to wait records the wait against the
+// lock's name and the file:line of the LOCK, and one in every
+// g_lock_profile_sample_rate LOCKs records how long the lock is then held,
+// until the end of its scope. The records go to per-thread tables, which are
+// only summed by GetLockProfile.
+//
+
+static const unsigned int DEFAULT_LOCK_PROFILE_SAMPLE_RATE = 100;
+
+/** Zero disables lock profiling. */
+extern std::atomic<unsigned int> g_lock_profile_sample_rate;
+
+struct CLockSiteStats {
+    std::string strName;
+    std::string strFile;
+    int nLine = 0;
+    //! Number of times the lock was not free
+    uint64_t nContentions = 0;
+    int64_t nWaitMicros = 0;
+    int64_t nMaxWaitMicros = 0;
+    //! Number of sampled holds
+    uint64_t nHoldSamples = 0;
+    int64_t nHoldMicros = 0;
+    int64_t nMaxHoldMicros = 0;
+
+    /** The total time the lock was held from this site, scaled up from the samples. */
+    int64_t GetEstimatedHoldMicros() const
+    {
+        return nHoldMicros * g_lock_profile_sample_rate.load(std::memory_order_relaxed);
+    }
+};
+
+void RecordLockWait(const char* pszName, const char* pszFile, int nLine, int64_t nMicros);
+void RecordLockHold(const char* pszName, const char* pszFile, int nLine, int64_t nMicros);
+/** The statistics of every lock site so far, summed over all threads. */
+std::vector<CLockSiteStats> GetLockProfile();
+
+/** Whether the current lock acquisition should have its hold time sampled. */
+inline bool SampleLockHold()
+{
+    unsigned int nRate = g_lock_profile_sample_rate.load(std::memory_order_relaxed);
+    if (nRate == 0)
+        return false;
+    static thread_local unsigned int nCountdown = 0;
+    if (nCountdown == 0 || nCountdown > nRate)
+        nCountdown = nRate;
+    return --nCountdown == 0;
+}
+
+inline int64_t LockProfileMicros(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base
 {
 private:
+    // Set while the hold time of this acquisition is being sampled.
+    const char* m_sampled_name = nullptr;
+    const char* m_sampled_file = nullptr;
+    int m_sampled_line = 0;
+    std::chrono::steady_clock::time_point m_acquired;
+
+    void StartHoldSample(const char* pszName, const char* pszFile, int nLine)
+    {
+        if (SampleLockHold()) {
+            m_sampled_name = pszName;
+            m_sampled_file = pszFile;
+            m_sampled_line = nLine;
+            m_acquired = std::chrono::steady_clock::now();
+        }
+    }
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!Base::try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
-            Base::lock();
-#ifdef DEBUG_LOCKCONTENTION
+            if (g_lock_profile_sample_rate.load(std::memory_order_relaxed)) {
+                auto start = std::chrono::steady_clock::now();
+                Base::lock();
+                RecordLockWait(pszName, pszFile, nLine, LockProfileMicros(start));
+            } else {
+                Base::lock();
+            }
         }
-#endif
+        StartHoldSample(pszName, pszFile, nLine);
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -142,6 +223,8 @@ private:
         Base::try_lock();
         if (!Base::owns_lock())
             LeaveCritical();
+        else
+            StartHoldSample(pszName, pszFile, nLine);
         return Base::owns_lock();
     }
 
@@ -167,8 +250,12 @@ public:
 
     ~UniqueLock() UNLOCK_FUNCTION()
     {
-        if (Base::owns_lock())
+        if (Base::owns_lock()) {
+            // This includes any time spent waiting on a condition variable.
+            if (m_sampled_name)
+                RecordLockHold(m_sampled_name, m_sampled_file, m_sampled_line, LockProfileMicros(m_acquired));
             LeaveCritical();
+        }
     }
 
     operator bool()
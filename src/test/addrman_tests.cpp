@@ -7,8 +7,10 @@
 #include <string>
 #include <boost/test/unit_test.hpp>
 
+#include "clientversion.h"
 #include "hash.h"
 #include "random.h"
+#include "streams.h"
 
 using namespace std;
 
@@ -17,6 +19,8 @@ class CAddrManTest : public CAddrMan
     uint64_t state;
 
 public:
+    using CAddrMan::Snapshot;
+
     CAddrManTest()
     {
         state = 1;
@@ -50,6 +54,16 @@ public:
     {
         CAddrMan::Delete(nId);
     }
+
+    Snapshot GetSnapshot() const
+    {
+        return CAddrMan::GetSnapshot();
+    }
+
+    void SerializeSnapshot(CDataStream& s, const Snapshot& snapshot) const
+    {
+        CAddrMan::SerializeSnapshot(s, snapshot);
+    }
 };
 
 BOOST_FIXTURE_TEST_SUITE(addrman_tests, BasicTestingSetup)
@@ -332,6 +346,54 @@ BOOST_AUTO_TEST_CASE(addrman_delete)
     BOOST_CHECK(addrman.size() == 0);
     CAddrInfo* info2 = addrman.Find(addr1);
     BOOST_CHECK(info2 == NULL);
+
+    // The nId of a deleted entry is reused.
+    CAddress addr2 = CAddress(CService("250.1.2.2", 8333));
+    int nId2;
+    addrman.Create(addr2, source1, &nId2);
+    BOOST_CHECK_EQUAL(nId2, nId);
+    BOOST_CHECK(addrman.Find(addr2)->ToString() == "250.1.2.2:8333");
+}
+
+BOOST_AUTO_TEST_CASE(addrman_snapshot)
+{
+    CAddrManTest addrman;
+
+    // Set addrman addr placement to be deterministic.
+    addrman.MakeDeterministic();
+
+    for (unsigned int i = 1; i < 1024; i++) {
+        CAddress addr = CAddress(CService(strprintf("%d.%d.1.23", i % 256, i / 256 + 1)));
+        addr.nTime = GetTime();
+        addrman.Add(addr, CNetAddr(strprintf("%d.%d.1.1", i % 16 + 1, i / 256 + 1)));
+        if (i % 8 == 0)
+            addrman.Good(addr);
+    }
+
+    CDataStream ssBefore(SER_DISK, CLIENT_VERSION);
+    ssBefore << addrman;
+    CAddrManTest::Snapshot snapshot = addrman.GetSnapshot();
+
+    // Changes made after a snapshot is taken do not show up in it.
+    for (unsigned int i = 1024; i < 2048; i++) {
+        CAddress addr = CAddress(CService(strprintf("%d.%d.1.23", i % 256, i / 256 + 1)));
+        addr.nTime = GetTime();
+        addrman.Add(addr, CNetAddr(strprintf("%d.%d.1.1", i % 16 + 1, i / 256 + 1)));
+    }
+    for (unsigned int i = 4; i < 1024; i += 8)
+        addrman.Good(CService(strprintf("%d.%d.1.23", i % 256, i / 256 + 1)));
+
+    CDataStream ssSnapshot(SER_DISK, CLIENT_VERSION);
+    addrman.SerializeSnapshot(ssSnapshot, snapshot);
+    BOOST_CHECK(ssSnapshot.str() == ssBefore.str());
+
+    // The current tables still round-trip.
+    CDataStream ssAfter(SER_DISK, CLIENT_VERSION);
+    ssAfter << addrman;
+    BOOST_CHECK(ssAfter.str() != ssBefore.str());
+    CAddrManTest addrman2;
+    ssAfter >> addrman2;
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
 }
 
 BOOST_AUTO_TEST_CASE(addrman_getaddr)
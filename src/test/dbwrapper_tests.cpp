@@ -231,4 +231,56 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 
 
 
+BOOST_AUTO_TEST_CASE(dbwrapper_tuning_options)
+{
+    mapMultiArgs["-dboption"] = {"chainstate:maxopenfiles=256", "chainstate:compression=1", "blockindex:bloombits=0", "chainstate:writebuffer=10"};
+    std::string strError;
+    BOOST_CHECK(DBTuning::CheckArgs(strError));
+
+    DBTuning chainstate = DBTuning::FromArgs("chainstate");
+    BOOST_CHECK_EQUAL(chainstate.nMaxOpenFiles, 256);
+    BOOST_CHECK(chainstate.fCompression);
+    BOOST_CHECK_EQUAL(chainstate.nBloomBits, 10);
+    BOOST_CHECK_EQUAL(chainstate.nWriteBufferPercent, 10);
+
+    DBTuning blockindex = DBTuning::FromArgs("blockindex");
+    BOOST_CHECK_EQUAL(blockindex.nMaxOpenFiles, 64);
+    BOOST_CHECK_EQUAL(blockindex.nBloomBits, 0);
+    BOOST_CHECK(!blockindex.fCompression);
+
+    for (const std::string& str : {"chainstate:maxopenfiles=8", "unknown:bloombits=10", "chainstate:cache=10", "chainstate", "chainstate:writebuffer=x"}) {
+        mapMultiArgs["-dboption"] = {str};
+        BOOST_CHECK(!DBTuning::CheckArgs(strError));
+    }
+    mapMultiArgs.erase("-dboption");
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_stats)
+{
+    path ph = temp_directory_path() / unique_path();
+    {
+        CDBWrapper dbw(ph, (1 << 20), true, false, "stats_test");
+        for (int i = 0; i < 10; i++)
+            BOOST_CHECK(dbw.Write(i, InsecureRand256()));
+
+        DBStats stats = dbw.GetStats();
+        BOOST_CHECK_EQUAL(stats.name, "stats_test");
+        BOOST_CHECK_EQUAL(stats.nWrites, 10U);
+        BOOST_CHECK_EQUAL(stats.nBlockCacheSize + 2 * stats.nWriteBufferSize, (size_t)(1 << 20));
+        BOOST_CHECK_EQUAL(stats.nLevel0Samples, 0U);
+
+        SampleDBStats();
+        stats = dbw.GetStats();
+        BOOST_CHECK_EQUAL(stats.nLevel0Samples, 1U);
+        BOOST_CHECK_EQUAL(stats.nLevel0Throttled, 0U);
+
+        bool fFound = false;
+        for (const DBStats& s : GetDBStats())
+            fFound |= s.name == "stats_test";
+        BOOST_CHECK(fFound);
+    }
+    for (const DBStats& s : GetDBStats())
+        BOOST_CHECK(s.name != "stats_test");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
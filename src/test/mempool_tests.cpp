@@ -384,4 +384,32 @@ BOOST_AUTO_TEST_CASE(SetSanityCheck) {
     BOOST_CHECK_EQUAL(pool.GetCheckFrequency(), 0);
 }
 
+// Test that infoInScoreOrder() puts missing transactions first, then the
+// others by descending fee rate.
+BOOST_AUTO_TEST_CASE(InfoInScoreOrder) {
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    entry.hadNoDependencies = true;
+
+    std::vector<uint256> hashes;
+    for (CAmount nFee : {10000LL, 30000LL, 20000LL}) {
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = nFee;
+        pool.addUnchecked(tx.GetHash(), entry.Fee(nFee).FromTx(tx));
+        hashes.push_back(tx.GetHash());
+    }
+    uint256 missing = uint256S("01");
+
+    auto ordered = pool.infoInScoreOrder({hashes[0], hashes[1], hashes[2], missing});
+    BOOST_CHECK_EQUAL(ordered.size(), 4);
+    BOOST_CHECK(ordered[0].first == missing);
+    BOOST_CHECK(!ordered[0].second.tx);
+    BOOST_CHECK(ordered[1].first == hashes[1]);
+    BOOST_CHECK(ordered[2].first == hashes[2]);
+    BOOST_CHECK(ordered[3].first == hashes[0]);
+    BOOST_CHECK(ordered[3].second.tx->GetHash() == hashes[0]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
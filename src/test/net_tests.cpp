@@ -143,4 +143,35 @@ BOOST_AUTO_TEST_CASE(caddrdb_read_corrupted)
     BOOST_CHECK(addrman2.size() == 0);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_reuse)
+{
+    CAddress addr(CService("252.3.3.3", 8233));
+    CNode node(INVALID_SOCKET, addr, "", true);
+
+    std::vector<char> vPayload(1000, 'x');
+    CMessageHeader hdr(Params().MessageStart(), "ping", vPayload.size());
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ssMsg(SER_NETWORK, PROTOCOL_VERSION);
+    ssMsg << hdr;
+    ssMsg.insert(ssMsg.end(), vPayload.data(), vPayload.data() + vPayload.size());
+
+    LOCK(node.cs_vRecvMsg);
+    BOOST_CHECK(node.ReceiveMsgBytes(ssMsg.data(), ssMsg.size()));
+    BOOST_CHECK_EQUAL(node.vRecvMsg.size(), 1);
+    BOOST_CHECK(node.vRecvMsg.front().complete());
+    const char* pBuffer = node.vRecvMsg.front().vRecv.data();
+
+    node.RecycleRecvBuffer(node.vRecvMsg.front());
+    node.vRecvMsg.clear();
+    BOOST_CHECK_EQUAL(node.vRecvBufferPool.size(), 1);
+
+    // The next message is received into the same buffer.
+    BOOST_CHECK(node.ReceiveMsgBytes(ssMsg.data(), ssMsg.size()));
+    BOOST_CHECK(node.vRecvBufferPool.empty());
+    BOOST_CHECK(node.vRecvMsg.front().complete());
+    BOOST_CHECK(node.vRecvMsg.front().vRecv.data() == pBuffer);
+    BOOST_CHECK(std::equal(vPayload.begin(), vPayload.end(), node.vRecvMsg.front().vRecv.begin()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
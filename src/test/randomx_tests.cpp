@@ -0,0 +1,65 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "crypto/cpu_features.h"
+#include "crypto/randomx/dataset.hpp"
+#include "crypto/randomx/randomx.h"
+#include "test/test_bitcoin.h"
+#include "util/strencodings.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(randomx_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(dataset_simd_matches_scalar)
+{
+    randomx_cache* cache = randomx_alloc_cache(RANDOMX_FLAG_DEFAULT);
+    BOOST_REQUIRE(cache != nullptr);
+    const char key[] = "dataset_simd_matches_scalar";
+    randomx_init_cache(cache, key, sizeof(key));
+
+    // An odd start and count so that both the vector kernel and the scalar
+    // tail are exercised, plus the last items of the dataset.
+    const unsigned long itemCount = randomx_dataset_item_count();
+    for (unsigned long start : {0UL, 123457UL, itemCount - 1029}) {
+        const uint32_t count = 1029;
+        std::vector<uint8_t> scalar(count * randomx::CacheLineSize);
+        std::vector<uint8_t> simd(count * randomx::CacheLineSize);
+        randomx::initDataset(cache, scalar.data(), start, start + count);
+        randomx::initDatasetSimd(cache, simd.data(), start, start + count);
+        BOOST_CHECK(scalar == simd);
+    }
+
+    BOOST_TEST_MESSAGE("vectorized dataset kernel: " << (randomx::simdDatasetKernel() ? randomx::simdDatasetKernel() : "none"));
+    randomx_release_cache(cache);
+}
+
+// Reference test vector from the RandomX repository. Scratchpad init, program
+// generation and the final hash all go through the AES generators, so this
+// covers whichever of the software, AES-NI and VAES versions the CPU selects.
+BOOST_AUTO_TEST_CASE(hash_known_answer)
+{
+    const char key[] = "test key 000";
+    const char input[] = "This is a test";
+    for (randomx_flags flags : {RANDOMX_FLAG_DEFAULT, randomx_get_flags()}) {
+        randomx_cache* cache = randomx_alloc_cache(flags);
+        BOOST_REQUIRE(cache != nullptr);
+        randomx_init_cache(cache, key, sizeof(key) - 1);
+        randomx_vm* vm = randomx_create_vm(flags, cache, nullptr);
+        BOOST_REQUIRE(vm != nullptr);
+
+        unsigned char hash[RANDOMX_HASH_SIZE];
+        randomx_calculate_hash(vm, input, sizeof(input) - 1, hash);
+        BOOST_CHECK_EQUAL(HexStr(hash, hash + sizeof(hash)),
+            "639183aae1bf4c9a35884cb46b09cad9175f04efd7684e7262a0ac1c2f0b4e3f");
+
+        randomx_destroy_vm(vm);
+        randomx_release_cache(cache);
+    }
+    BOOST_TEST_MESSAGE("VAES: " << CPUFeatures::HasVAES());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/jsonstream.h"
 
 #include "experimental_features.h"
 #include "key_io.h"
@@ -15,6 +16,11 @@
 #include "test/test_bitcoin.h"
 #include "test/test_util.h"
 
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+
 #include <boost/test/unit_test.hpp>
 
 #include <univalue.h>
@@ -306,6 +312,136 @@ BOOST_AUTO_TEST_CASE(rpc_raw_create_overwinter_v3)
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
 
+// Set while rpc_batch_order runs; the PreCommand slot stays connected afterwards.
+static std::atomic<bool> fBatchOrderTest{false};
+static std::atomic<bool> fBatchOrderDelayed{false};
+static Mutex cs_batchOrderThreads;
+static std::set<std::thread::id> setBatchOrderThreads;
+
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    SetRPCWarmupFinished();
+
+    // Hold up the first Shared call to start so that the calls queued after it
+    // complete first, and record which threads the Shared calls ran on.
+    static bool fConnected = false;
+    if (!fConnected) {
+        RPCServer::OnPreCommand([](const CRPCCommand& cmd) {
+            if (!fBatchOrderTest || cmd.concurrency != RPCConcurrency::Shared)
+                return;
+            {
+                LOCK(cs_batchOrderThreads);
+                setBatchOrderThreads.insert(std::this_thread::get_id());
+            }
+            if (!fBatchOrderDelayed.exchange(true))
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        });
+        fConnected = true;
+    }
+    fBatchOrderTest = true;
+    fBatchOrderDelayed = false;
+    StartRPCBatchExecutor(DEFAULT_RPC_BATCH_THREADS);
+
+    // Interleave Shared (getblockcount) and Exclusive (help) methods, and end
+    // with an unknown method; replies must come back in request order.
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < 8; i++) {
+        UniValue req(UniValue::VOBJ);
+        req.pushKV("method", i % 3 == 2 ? "help" : "getblockcount");
+        req.pushKV("params", UniValue(UniValue::VARR));
+        req.pushKV("id", i);
+        batch.push_back(req);
+    }
+    UniValue unknown(UniValue::VOBJ);
+    unknown.pushKV("method", "nosuchmethod");
+    unknown.pushKV("id", 8);
+    batch.push_back(unknown);
+
+    UniValue reply;
+    BOOST_CHECK(reply.read(JSONRPCExecBatch(batch)));
+    StopRPCBatchExecutor();
+    fBatchOrderTest = false;
+
+    BOOST_CHECK(fBatchOrderDelayed);
+    {
+        LOCK(cs_batchOrderThreads);
+        BOOST_CHECK(!setBatchOrderThreads.empty());
+        BOOST_CHECK(!setBatchOrderThreads.count(std::this_thread::get_id()));
+    }
+    BOOST_REQUIRE(reply.isArray());
+    BOOST_REQUIRE_EQUAL(reply.size(), 9);
+    for (int i = 0; i < 9; i++) {
+        BOOST_CHECK_EQUAL(find_value(reply[i], "id").get_int(), i);
+    }
+    BOOST_CHECK_EQUAL(find_value(reply[0], "result").get_int(), chainActive.Height());
+    BOOST_CHECK(find_value(reply[2], "result").isStr());
+    BOOST_CHECK_EQUAL(find_value(find_value(reply[8], "error"), "code").get_int(), RPC_METHOD_NOT_FOUND);
+}
+
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    std::string str;
+    JSONStringSink sink(str);
+    JSONStreamWriter out(sink);
+
+    UniValue inner(UniValue::VOBJ);
+    inner.pushKV("a\"b", "c\\d\n");
+    inner.pushKV("n", 1.5);
+    UniValue expected(UniValue::VOBJ);
+    expected.pushKV("empty", UniValue(UniValue::VARR));
+    expected.pushKV("inner", inner);
+    UniValue arr(UniValue::VARR);
+    arr.push_back(NullUniValue);
+    arr.push_back(inner);
+    arr.push_back(UniValue(UniValue::VOBJ));
+    expected.pushKV("arr", arr);
+
+    out.BeginObject();
+    out.Key("empty");
+    out.BeginArray();
+    out.EndArray();
+    out.Key("inner");
+    out.BeginObject();
+    out.Fields(inner);
+    out.EndObject();
+    out.Key("arr");
+    out.BeginArray();
+    out.Value(NullUniValue);
+    out.Value(inner);
+    out.BeginObject();
+    out.EndObject();
+    out.EndArray();
+    out.EndObject();
+
+    BOOST_CHECK(out.Complete());
+    BOOST_CHECK_EQUAL(str, expected.write());
+    BOOST_CHECK_EQUAL(out.BytesWritten(), str.size());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_stream_matches_execute)
+{
+    SetRPCWarmupFinished();
+
+    const std::vector<std::pair<std::string, std::string>> calls = {
+        {"getblock", "[\"0\", 0]"},
+        {"getblock", "[\"0\", 1]"},
+        {"getblock", "[\"0\", 2]"},
+        {"getrawmempool", "[false]"},
+        {"getrawmempool", "[true]"},
+    };
+    for (const auto& call : calls) {
+        UniValue params;
+        BOOST_REQUIRE(params.read(call.second));
+
+        std::string str;
+        JSONStringSink sink(str);
+        JSONStreamWriter out(sink);
+        tableRPC.executeStreaming(call.first, params, out);
+        BOOST_CHECK(out.Complete());
+        BOOST_CHECK_EQUAL(str, tableRPC.execute(call.first, params).write());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(rpc_getnetworksolps)
 {
     BOOST_CHECK_NO_THROW(CallRPC("getnetworksolps"));
@@ -0,0 +1,112 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "clientversion.h"
+#include "coins.h"
+#include "random.h"
+#include "snapshot.h"
+#include "txdb.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(snapshot_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(snapshot_header_roundtrip)
+{
+    CSnapshotHeader header;
+    header.hashBase = GetRandHash();
+    header.nHeight = 12345;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << header;
+
+    CSnapshotHeader header2;
+    ss >> header2;
+    BOOST_CHECK(header2.magic == SNAPSHOT_MAGIC);
+    BOOST_CHECK_EQUAL(header2.nVersion, SNAPSHOT_VERSION);
+    BOOST_CHECK(header2.hashBase == header.hashBase);
+    BOOST_CHECK_EQUAL(header2.nHeight, header.nHeight);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_chainstate_roundtrip)
+{
+    CCoinsViewDB src(1 << 20, true);
+    uint256 hashBlock = GetRandHash();
+    std::vector<uint256> txids;
+    SproutMerkleTree sproutTree;
+    {
+        CCoinsViewCache cache(&src);
+        for (int i = 0; i < 50; i++) {
+            txids.push_back(GetRandHash());
+            CCoinsModifier coins = cache.ModifyCoins(txids.back());
+            coins->nHeight = i;
+            coins->vout.resize(2);
+            coins->vout[0].nValue = i + 1;
+            coins->vout[0].scriptPubKey = CScript() << OP_TRUE;
+            coins->vout[1].nValue = 2 * i + 1;
+            coins->vout[1].scriptPubKey = CScript() << OP_TRUE;
+        }
+        sproutTree.append(GetRandHash());
+        cache.PushAnchor(sproutTree);
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Writes made after the database was pinned must not reach the file.
+    std::unique_ptr<CDBSnapshot> srcSnapshot(src.NewSnapshot());
+    BOOST_CHECK(src.GetBestBlock(*srcSnapshot) == hashBlock);
+    {
+        CCoinsViewCache cache(&src);
+        CCoinsModifier coins = cache.ModifyCoins(GetRandHash());
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 1;
+        coins->vout[0].scriptPubKey = CScript() << OP_TRUE;
+        cache.SetBestBlock(GetRandHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(src.GetBestBlock() != hashBlock);
+
+    fs::path path = pathTemp / "snapshot.dat";
+    CSnapshotStats statsOut;
+    uint256 hashOut;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        CSnapshotWriter out(file);
+        src.WriteSnapshot(*srcSnapshot, out, statsOut);
+        hashOut = out.GetHash();
+    }
+    BOOST_CHECK_EQUAL(statsOut.nCoins, 50U);
+    BOOST_CHECK_EQUAL(statsOut.nAnchors, 1U);
+
+    CCoinsViewDB dst(1 << 20, true);
+    BOOST_CHECK(dst.IsEmpty());
+    CSnapshotStats statsIn;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        BOOST_CHECK(dst.LoadSnapshot(file, hashBlock, statsIn));
+    }
+    BOOST_CHECK_EQUAL(statsIn.nCoins, statsOut.nCoins);
+    BOOST_CHECK_EQUAL(statsIn.nAnchors, statsOut.nAnchors);
+
+    BOOST_CHECK(dst.GetBestBlock() == hashBlock);
+    BOOST_CHECK(dst.GetBestAnchor(SPROUT) == src.GetBestAnchor(SPROUT));
+    BOOST_CHECK(dst.GetBestAnchor(SAPLING) == src.GetBestAnchor(SAPLING));
+    BOOST_CHECK(dst.GetBestAnchor(ORCHARD) == src.GetBestAnchor(ORCHARD));
+
+    SproutMerkleTree sproutTree2;
+    BOOST_CHECK(dst.GetSproutAnchorAt(sproutTree.root(), sproutTree2));
+    BOOST_CHECK(sproutTree2.root() == sproutTree.root());
+
+    for (const uint256& txid : txids) {
+        CCoins coins, coins2;
+        BOOST_CHECK(src.GetCoins(txid, coins));
+        BOOST_CHECK(dst.GetCoins(txid, coins2));
+        BOOST_CHECK(coins == coins2);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 namespace {
 template <typename MutexType>
 void TestPotentialDeadLockDetected(MutexType& mutex1, MutexType& mutex2)
@@ -49,4 +53,45 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(lock_profile)
+{
+    unsigned int prevRate = g_lock_profile_sample_rate.exchange(1);
+
+    Mutex mutex;
+    std::atomic<bool> fLocked{false};
+    int nHoldLine = 0;
+    std::thread holder([&] {
+        LOCK(mutex); nHoldLine = __LINE__;
+        fLocked = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    });
+    while (!fLocked) {
+        std::this_thread::yield();
+    }
+    { LOCK(mutex); } const int nWaitLine = __LINE__;
+    holder.join();
+
+    const CLockSiteStats* pHold = nullptr;
+    const CLockSiteStats* pWait = nullptr;
+    std::vector<CLockSiteStats> vStats = GetLockProfile();
+    for (const CLockSiteStats& stats : vStats) {
+        if (stats.strFile != __FILE__ || stats.strName != "mutex")
+            continue;
+        if (stats.nLine == nHoldLine)
+            pHold = &stats;
+        if (stats.nLine == nWaitLine)
+            pWait = &stats;
+    }
+    // The holder thread has exited, so its records are kept as retired.
+    BOOST_REQUIRE(pHold && pWait);
+    BOOST_CHECK_EQUAL(pHold->nContentions, 0);
+    BOOST_CHECK_EQUAL(pHold->nHoldSamples, 1);
+    BOOST_CHECK(pHold->nHoldMicros >= 50000);
+    BOOST_CHECK_EQUAL(pWait->nContentions, 1);
+    BOOST_CHECK(pWait->nWaitMicros > 0);
+    BOOST_CHECK_EQUAL(pWait->nHoldSamples, 1);
+
+    g_lock_profile_sample_rate = prevRate;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,12 +8,15 @@
 
 #include "chainparams.h"
 #include "hash.h"
+#include "indexbuilder.h"
 #include "main.h"
 #include "pow.h"
+#include "snapshot.h"
 #include "uint256.h"
 #include "zcash/History.hpp"
 
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -49,17 +52,26 @@ static const char DB_MMR_ROOT = 'r';
 static const char DB_SUBTREE_LATEST = 'e';
 static const char DB_SUBTREE_DATA = 'n';
 
+// Terminates the chainstate records of a snapshot; the other snapshot record
+// types reuse the prefix of the database entries they were read from.
+static const char SNAPSHOT_RECORDS_END = 0;
+
 // insightexplorer
 static const char DB_ADDRESSINDEX = 'd';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_TIMESTAMPINDEX = 'T';
 static const char DB_BLOCKHASHINDEX = 'h';
+static const char DB_ADDRESSBALANCE = 'g';
+static const char DB_INDEX_BEST_BLOCK = 'I';
+
+// Number of per-address totals written per batch by BuildAddressBalances.
+static const size_t ADDRESS_BALANCE_BATCH_SIZE = 10000;
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, "chainstate")
 {
 }
 
@@ -126,14 +138,19 @@ bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
     return db.Exists(make_pair(DB_COINS, txid));
 }
 
-uint256 CCoinsViewDB::GetBestBlock() const {
+// The readers below take the database as a template parameter so that
+// WriteSnapshot can run them against a CDBSnapshot as well as the live db.
+
+template<typename DB>
+static uint256 ReadBestBlock(const DB &db) {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
     return hashBestChain;
 }
 
-uint256 CCoinsViewDB::GetBestAnchor(ShieldedType type) const {
+template<typename DB>
+static uint256 ReadBestAnchor(const DB &db, ShieldedType type) {
     uint256 hashBestAnchor;
 
     switch (type) {
@@ -156,7 +173,8 @@ uint256 CCoinsViewDB::GetBestAnchor(ShieldedType type) const {
     return hashBestAnchor;
 }
 
-HistoryIndex CCoinsViewDB::GetHistoryLength(uint32_t epochId) const {
+template<typename DB>
+static HistoryIndex ReadHistoryLength(const DB &db, uint32_t epochId) {
     HistoryIndex historyLength;
     if (!db.Read(make_pair(DB_MMR_LENGTH, epochId), historyLength)) {
         // Starting new history
@@ -166,10 +184,11 @@ HistoryIndex CCoinsViewDB::GetHistoryLength(uint32_t epochId) const {
     return historyLength;
 }
 
-HistoryNode CCoinsViewDB::GetHistoryAt(uint32_t epochId, HistoryIndex index) const {
+template<typename DB>
+static HistoryNode ReadHistoryAt(const DB &db, uint32_t epochId, HistoryIndex index) {
     HistoryNode mmrNode = {};
 
-    if (index >= GetHistoryLength(epochId)) {
+    if (index >= ReadHistoryLength(db, epochId)) {
         throw runtime_error("History data inconsistent - reindex?");
     }
 
@@ -196,7 +215,8 @@ HistoryNode CCoinsViewDB::GetHistoryAt(uint32_t epochId, HistoryIndex index) con
     return mmrNode;
 }
 
-uint256 CCoinsViewDB::GetHistoryRoot(uint32_t epochId) const {
+template<typename DB>
+static uint256 ReadHistoryRoot(const DB &db, uint32_t epochId) {
     uint256 root;
     if (!db.Read(make_pair(DB_MMR_ROOT, epochId), root))
     {
@@ -205,8 +225,8 @@ uint256 CCoinsViewDB::GetHistoryRoot(uint32_t epochId) const {
     return root;
 }
 
-
-std::optional<libzcash::LatestSubtree> CCoinsViewDB::GetLatestSubtree(ShieldedType type) const {
+template<typename DB>
+static std::optional<libzcash::LatestSubtree> ReadLatestSubtree(const DB &db, ShieldedType type) {
     libzcash::LatestSubtree latestSubtree;
     if (!db.Read(make_pair(DB_SUBTREE_LATEST, (uint8_t) type), latestSubtree)) {
         return std::nullopt;
@@ -215,8 +235,9 @@ std::optional<libzcash::LatestSubtree> CCoinsViewDB::GetLatestSubtree(ShieldedTy
     return latestSubtree;
 }
 
-std::optional<libzcash::SubtreeData> CCoinsViewDB::GetSubtreeData(
-        ShieldedType type, libzcash::SubtreeIndex index) const
+template<typename DB>
+static std::optional<libzcash::SubtreeData> ReadSubtreeData(
+        const DB &db, ShieldedType type, libzcash::SubtreeIndex index)
 {
     libzcash::SubtreeData subtreeData;
     if (!db.Read(make_pair(DB_SUBTREE_DATA, make_pair((uint8_t) type, index)), subtreeData)) {
@@ -225,6 +246,36 @@ std::optional<libzcash::SubtreeData> CCoinsViewDB::GetSubtreeData(
     return subtreeData;
 }
 
+uint256 CCoinsViewDB::GetBestBlock() const {
+    return ReadBestBlock(db);
+}
+
+uint256 CCoinsViewDB::GetBestAnchor(ShieldedType type) const {
+    return ReadBestAnchor(db, type);
+}
+
+HistoryIndex CCoinsViewDB::GetHistoryLength(uint32_t epochId) const {
+    return ReadHistoryLength(db, epochId);
+}
+
+HistoryNode CCoinsViewDB::GetHistoryAt(uint32_t epochId, HistoryIndex index) const {
+    return ReadHistoryAt(db, epochId, index);
+}
+
+uint256 CCoinsViewDB::GetHistoryRoot(uint32_t epochId) const {
+    return ReadHistoryRoot(db, epochId);
+}
+
+std::optional<libzcash::LatestSubtree> CCoinsViewDB::GetLatestSubtree(ShieldedType type) const {
+    return ReadLatestSubtree(db, type);
+}
+
+std::optional<libzcash::SubtreeData> CCoinsViewDB::GetSubtreeData(
+        ShieldedType type, libzcash::SubtreeIndex index) const
+{
+    return ReadSubtreeData(db, type, index);
+}
+
 void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar)
 {
     for (CNullifiersMap::iterator it = mapToUse.begin(); it != mapToUse.end();) {
@@ -401,7 +452,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins,
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, "blockindex") {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) const {
@@ -470,6 +521,248 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     return true;
 }
 
+CDBSnapshot *CCoinsViewDB::NewSnapshot() const {
+    return new CDBSnapshot(db);
+}
+
+uint256 CCoinsViewDB::GetBestBlock(const CDBSnapshot &snapshot) const {
+    return ReadBestBlock(snapshot);
+}
+
+void CCoinsViewDB::WriteSnapshot(const CDBSnapshot &snapshot, CSnapshotWriter &out, CSnapshotStats &stats) const {
+    out << ReadBestAnchor(snapshot, SPROUT) << ReadBestAnchor(snapshot, SAPLING) << ReadBestAnchor(snapshot, ORCHARD);
+
+    boost::scoped_ptr<CDBIterator> pcursor(snapshot.NewIterator());
+
+    // Entries keyed by (prefix, uint256)
+    for (char prefix : {DB_COINS,
+                        DB_NULLIFIER, DB_SAPLING_NULLIFIER, DB_ORCHARD_NULLIFIER,
+                        DB_SPROUT_ANCHOR, DB_SAPLING_ANCHOR, DB_ORCHARD_ANCHOR}) {
+        pcursor->Seek(make_pair(prefix, uint256()));
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != prefix)
+                break;
+            out << prefix << key.second;
+            bool fRead = true;
+            switch (prefix) {
+                case DB_COINS: {
+                    CCoins coins;
+                    fRead = pcursor->GetValue(coins);
+                    out << coins;
+                    stats.nCoins++;
+                    break;
+                }
+                case DB_SPROUT_ANCHOR: {
+                    SproutMerkleTree tree;
+                    fRead = pcursor->GetValue(tree);
+                    out << tree;
+                    stats.nAnchors++;
+                    break;
+                }
+                case DB_SAPLING_ANCHOR: {
+                    SaplingMerkleTree tree;
+                    fRead = pcursor->GetValue(tree);
+                    out << tree;
+                    stats.nAnchors++;
+                    break;
+                }
+                case DB_ORCHARD_ANCHOR: {
+                    OrchardMerkleFrontier tree;
+                    fRead = pcursor->GetValue(tree);
+                    // The frontier serializes through Rust, which can only
+                    // target the stream types in streams_rust.h.
+                    CDataStream ssTree(out.GetType(), out.GetVersion());
+                    ssTree << tree;
+                    out.write(ssTree.data(), ssTree.size());
+                    stats.nAnchors++;
+                    break;
+                }
+                default:
+                    // Nullifiers: the key is all there is.
+                    stats.nNullifiers++;
+                    break;
+            }
+            if (!fRead)
+                throw runtime_error("CCoinsViewDB::WriteSnapshot(): unable to read value");
+            pcursor->Next();
+        }
+    }
+
+    // History trees, one record per epoch
+    std::vector<uint32_t> epochs;
+    pcursor->Seek(make_pair(DB_MMR_LENGTH, (uint32_t) 0));
+    while (pcursor->Valid()) {
+        std::pair<char, uint32_t> key;
+        if (!pcursor->GetKey(key) || key.first != DB_MMR_LENGTH)
+            break;
+        epochs.push_back(key.second);
+        pcursor->Next();
+    }
+    for (uint32_t epochId : epochs) {
+        HistoryIndex length = ReadHistoryLength(snapshot, epochId);
+        out << DB_MMR_LENGTH << epochId << length << ReadHistoryRoot(snapshot, epochId);
+        for (HistoryIndex i = 0; i < length; i++) {
+            boost::this_thread::interruption_point();
+            out << ReadHistoryAt(snapshot, epochId, i);
+            stats.nHistoryNodes++;
+        }
+    }
+
+    // Subtree roots, in index order so that loading can push them back
+    for (ShieldedType type : {SAPLING, ORCHARD}) {
+        auto latestSubtree = ReadLatestSubtree(snapshot, type);
+        if (!latestSubtree.has_value())
+            continue;
+        for (libzcash::SubtreeIndex i = 0; i <= latestSubtree->index; i++) {
+            auto subtreeData = ReadSubtreeData(snapshot, type, i);
+            if (!subtreeData.has_value())
+                throw runtime_error("CCoinsViewDB::WriteSnapshot(): subtree data missing - reindex?");
+            out << DB_SUBTREE_DATA << (uint8_t) type << subtreeData.value();
+            stats.nSubtrees++;
+        }
+    }
+
+    out << SNAPSHOT_RECORDS_END;
+}
+
+bool CCoinsViewDB::LoadSnapshot(CAutoFile &in, const uint256 &hashBlock, CSnapshotStats &stats) {
+    uint256 hashSproutAnchor, hashSaplingAnchor, hashOrchardAnchor;
+    in >> hashSproutAnchor >> hashSaplingAnchor >> hashOrchardAnchor;
+
+    CCoinsMap mapCoins;
+    CAnchorsSproutMap mapSproutAnchors;
+    CAnchorsSaplingMap mapSaplingAnchors;
+    CAnchorsOrchardMap mapOrchardAnchors;
+    CNullifiersMap mapSproutNullifiers;
+    CNullifiersMap mapSaplingNullifiers;
+    CNullifiersMap mapOrchardNullifiers;
+    CHistoryCacheMap historyCacheMap;
+    SubtreeCache cacheSaplingSubtrees(SAPLING);
+    SubtreeCache cacheOrchardSubtrees(ORCHARD);
+    size_t nPending = 0;
+
+    // Intermediate batches leave the best block and anchors unset, so that a
+    // partially loaded chainstate is never mistaken for a usable one.
+    auto flush = [&](bool fFinal) {
+        cacheSaplingSubtrees.Initialize(this);
+        cacheOrchardSubtrees.Initialize(this);
+        bool fOk = BatchWrite(mapCoins,
+                              fFinal ? hashBlock : uint256(),
+                              fFinal ? hashSproutAnchor : uint256(),
+                              fFinal ? hashSaplingAnchor : uint256(),
+                              fFinal ? hashOrchardAnchor : uint256(),
+                              mapSproutAnchors, mapSaplingAnchors, mapOrchardAnchors,
+                              mapSproutNullifiers, mapSaplingNullifiers, mapOrchardNullifiers,
+                              historyCacheMap,
+                              cacheSaplingSubtrees, cacheOrchardSubtrees);
+        historyCacheMap.clear();
+        cacheSaplingSubtrees.clear();
+        cacheOrchardSubtrees.clear();
+        nPending = 0;
+        return fOk;
+    };
+    auto pending = [&]() {
+        return ++nPending < SNAPSHOT_LOAD_BATCH_SIZE || flush(false);
+    };
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        char prefix;
+        in >> prefix;
+        if (prefix == SNAPSHOT_RECORDS_END)
+            break;
+
+        if (prefix == DB_MMR_LENGTH) {
+            uint32_t epochId;
+            HistoryIndex length;
+            uint256 root;
+            in >> epochId >> length >> root;
+            historyCacheMap.emplace(epochId, HistoryCache(length, root, epochId));
+            for (HistoryIndex i = 0; i < length; i++) {
+                // A flush part-way through an epoch empties the map.
+                auto it = historyCacheMap.emplace(epochId, HistoryCache(length, root, epochId)).first;
+                in >> it->second.appends[i];
+                stats.nHistoryNodes++;
+                if (!pending())
+                    return false;
+            }
+            continue;
+        }
+
+        if (prefix == DB_SUBTREE_DATA) {
+            uint8_t type;
+            libzcash::SubtreeData subtreeData;
+            in >> type >> subtreeData;
+            if (type == SAPLING)
+                cacheSaplingSubtrees.PushSubtree(this, subtreeData);
+            else if (type == ORCHARD)
+                cacheOrchardSubtrees.PushSubtree(this, subtreeData);
+            else
+                return error("CCoinsViewDB::LoadSnapshot(): unknown subtree type %d", type);
+            stats.nSubtrees++;
+            if (!pending())
+                return false;
+            continue;
+        }
+
+        uint256 key;
+        in >> key;
+        switch (prefix) {
+            case DB_COINS: {
+                CCoinsCacheEntry& entry = mapCoins[key];
+                in >> entry.coins;
+                entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+                stats.nCoins++;
+                break;
+            }
+            case DB_NULLIFIER:
+            case DB_SAPLING_NULLIFIER:
+            case DB_ORCHARD_NULLIFIER: {
+                CNullifiersMap& mapNullifiers =
+                    prefix == DB_NULLIFIER ? mapSproutNullifiers :
+                    prefix == DB_SAPLING_NULLIFIER ? mapSaplingNullifiers : mapOrchardNullifiers;
+                CNullifiersCacheEntry& entry = mapNullifiers[key];
+                entry.entered = true;
+                entry.flags = CNullifiersCacheEntry::DIRTY;
+                stats.nNullifiers++;
+                break;
+            }
+            case DB_SPROUT_ANCHOR: {
+                CAnchorsSproutCacheEntry& entry = mapSproutAnchors[key];
+                in >> entry.tree;
+                entry.entered = true;
+                entry.flags = CAnchorsSproutCacheEntry::DIRTY;
+                stats.nAnchors++;
+                break;
+            }
+            case DB_SAPLING_ANCHOR: {
+                CAnchorsSaplingCacheEntry& entry = mapSaplingAnchors[key];
+                in >> entry.tree;
+                entry.entered = true;
+                entry.flags = CAnchorsSaplingCacheEntry::DIRTY;
+                stats.nAnchors++;
+                break;
+            }
+            case DB_ORCHARD_ANCHOR: {
+                CAnchorsOrchardCacheEntry& entry = mapOrchardAnchors[key];
+                in >> entry.tree;
+                entry.entered = true;
+                entry.flags = CAnchorsOrchardCacheEntry::DIRTY;
+                stats.nAnchors++;
+                break;
+            }
+            default:
+                return error("CCoinsViewDB::LoadSnapshot(): unknown record type %d", prefix);
+        }
+        if (!pending())
+            return false;
+    }
+
+    return flush(true);
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<CBlockIndex*>& blockinfo) {
     MetricsIncrementCounter("zcashd.debug.blocktree.write_batch");
     CDBBatch batch(*this);
@@ -497,6 +790,18 @@ bool CBlockTreeDB::ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex
     return Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
 }
 
+bool CBlockTreeDB::ReadDiskBlockIndex(const CDBSnapshot &snapshot, const uint256 &blockhash, CDiskBlockIndex &dbindex) const {
+    return snapshot.Read(make_pair(DB_BLOCK_INDEX, blockhash), dbindex);
+}
+
+bool CBlockTreeDB::WriteDiskBlockIndex(const std::vector<CDiskBlockIndex> &vIndex) {
+    CDBBatch batch(*this);
+    for (const CDiskBlockIndex& dbindex : vIndex) {
+        batch.Write(make_pair(DB_BLOCK_INDEX, dbindex.GetBlockHash()), dbindex);
+    }
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
@@ -543,8 +848,47 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type, std::v
     return true;
 }
 
+/**
+ * Add the amounts of the entries being connected to (or subtract those being
+ * disconnected from) the per-address totals, in the same batch as the entries.
+ * Only entries that are not yet (or are still) in the index count, so that
+ * reconnecting a block after an unclean shutdown does not count it twice.
+ */
+static void UpdateAddressBalances(
+        const CBlockTreeDB &db, CDBBatch &batch,
+        const std::vector<CAddressIndexDbEntry> &vect, bool fConnect)
+{
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceValue> deltas;
+    for (const CAddressIndexDbEntry& entry : vect) {
+        if (db.Exists(make_pair(DB_ADDRESSINDEX, entry.first)) == fConnect)
+            continue;
+        CAddressBalanceValue& delta = deltas[make_pair(entry.first.type, entry.first.hashBytes)];
+        delta.balance += entry.second;
+        if (entry.second > 0)
+            delta.received += entry.second;
+    }
+    for (const auto& it : deltas) {
+        CAddressIndexIteratorKey key(it.first.first, it.first.second);
+        CAddressBalanceValue value;
+        db.Read(make_pair(DB_ADDRESSBALANCE, key), value);
+        if (fConnect) {
+            value.balance += it.second.balance;
+            value.received += it.second.received;
+        } else {
+            value.balance -= it.second.balance;
+            value.received -= it.second.received;
+        }
+        if (value.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSBALANCE, key));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSBALANCE, key), value);
+        }
+    }
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
     CDBBatch batch(*this);
+    UpdateAddressBalances(*this, batch, vect, true);
     for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
     return WriteBatch(batch);
@@ -552,6 +896,7 @@ bool CBlockTreeDB::WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &ve
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect) {
     CDBBatch batch(*this);
+    UpdateAddressBalances(*this, batch, vect, false);
     for (std::vector<CAddressIndexDbEntry>::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
     return WriteBatch(batch);
@@ -586,6 +931,95 @@ bool CBlockTreeDB::ReadAddressIndex(
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressIndexPage(
+        uint160 addressHash, int type,
+        int startHeight, unsigned int startTxIndex, int endHeight,
+        size_t nMaxTxs, std::vector<CAddressIndexDbEntry> &addressIndex)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorTxKey(type, addressHash, startHeight, startTxIndex)));
+
+    // Stop at a transaction boundary so that a page never splits the entries
+    // of one transaction.
+    size_t nTxs = 0;
+    int nLastHeight = -1;
+    unsigned int nLastTxIndex = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+              key.second.type == (unsigned int)type && key.second.hashBytes == addressHash))
+            break;
+        if (endHeight > 0 && key.second.blockHeight > endHeight)
+            break;
+        if (key.second.blockHeight != nLastHeight || key.second.txindex != nLastTxIndex) {
+            if (nTxs == nMaxTxs)
+                break;
+            nTxs++;
+            nLastHeight = key.second.blockHeight;
+            nLastTxIndex = key.second.txindex;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        addressIndex.push_back(make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const {
+    value.SetNull();
+    Read(make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(type, addressHash)), value);
+    return true;
+}
+
+bool CBlockTreeDB::BuildAddressBalances()
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey()));
+
+    // Address index entries are sorted by address, so one pass with a single
+    // running total suffices.
+    std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue>> vBalances;
+    auto flush = [&]() {
+        CDBBatch batch(*this);
+        for (const auto& it : vBalances)
+            batch.Write(make_pair(DB_ADDRESSBALANCE, it.first), it.second);
+        vBalances.clear();
+        return WriteBatch(batch);
+    };
+
+    size_t nAddresses = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX))
+            break;
+        if (vBalances.empty() ||
+            vBalances.back().first.type != key.second.type ||
+            vBalances.back().first.hashBytes != key.second.hashBytes) {
+            if (vBalances.size() >= ADDRESS_BALANCE_BATCH_SIZE && !flush())
+                return error("%s: failed to write address balances", __func__);
+            vBalances.emplace_back(CAddressIndexIteratorKey(key.second.type, key.second.hashBytes), CAddressBalanceValue());
+            nAddresses++;
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s: failed to get address index value", __func__);
+        CAddressBalanceValue& value = vBalances.back().second;
+        value.balance += nValue;
+        if (nValue > 0)
+            value.received += nValue;
+        pcursor->Next();
+    }
+    if (!flush())
+        return error("%s: failed to write address balances", __func__);
+    LogPrintf("%s: computed balances of %u addresses\n", __func__, nAddresses);
+    return true;
+}
+
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const {
     return Read(make_pair(DB_SPENTINDEX, key), value);
 }
@@ -651,6 +1085,52 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     ltimestamp = lts.ltimestamp;
     return true;
 }
+
+bool CBlockTreeDB::WriteInsightIndexEntries(const CInsightIndexEntries &entries, bool fConnect,
+    const CBlockLocator &locator)
+{
+    // Everything for a run of blocks goes into one batch together with the
+    // index builder's locator, so the indexes never get ahead of (or fall
+    // behind) the block the builder resumes from.
+    CDBBatch batch(*this);
+    UpdateAddressBalances(*this, batch, entries.addressIndex, fConnect);
+    for (const CAddressIndexDbEntry& entry : entries.addressIndex) {
+        if (fConnect) {
+            batch.Write(make_pair(DB_ADDRESSINDEX, entry.first), entry.second);
+        } else {
+            batch.Erase(make_pair(DB_ADDRESSINDEX, entry.first));
+        }
+    }
+    for (const CAddressUnspentDbEntry& entry : entries.addressUnspentIndex) {
+        if (entry.second.IsNull()) {
+            batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, entry.first));
+        } else {
+            batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, entry.first), entry.second);
+        }
+    }
+    for (const CSpentIndexDbEntry& entry : entries.spentIndex) {
+        if (entry.second.IsNull()) {
+            batch.Erase(make_pair(DB_SPENTINDEX, entry.first));
+        } else {
+            batch.Write(make_pair(DB_SPENTINDEX, entry.first), entry.second);
+        }
+    }
+    for (const CTimestampIndexKey& key : entries.timestampIndex) {
+        batch.Write(make_pair(DB_TIMESTAMPINDEX, key), 0);
+        batch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(key.blockHash)),
+                    CTimestampBlockIndexValue(key.timestamp));
+    }
+    batch.Write(DB_INDEX_BEST_BLOCK, locator);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteIndexBuilderBestBlock(const CBlockLocator &locator) {
+    return Write(DB_INDEX_BEST_BLOCK, locator);
+}
+
+bool CBlockTreeDB::ReadIndexBuilderBestBlock(CBlockLocator &locator) const {
+    return Read(DB_INDEX_BEST_BLOCK, locator);
+}
 // END insightexplorer
 
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
@@ -667,101 +1147,156 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) const {
 
 bool CBlockTreeDB::LoadBlockIndexGuts(
     std::function<CBlockIndex*(const uint256&)> insertBlockIndex,
-    const CChainParams& chainParams)
+    std::function<void(size_t)> reserveBlockIndex,
+    const CChainParams& chainParams,
+    int nThreads)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
-
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
+    // Block index entries are keyed by block hash, so the key space splits
+    // evenly on the first byte of the hash. Each range is read, decoded and
+    // checked by its own thread with its own iterator; only the insertion
+    // into the block index map is serial.
+    const int nRanges = std::max(1, std::min(nThreads, 256));
+    std::vector<std::vector<std::pair<uint256, CDiskBlockIndex>>> vLoaded(nRanges);
+    std::vector<std::string> vErrors(nRanges);
+
+    auto loadRange = [&](int n) {
+        const unsigned int nBegin = 256 * n / nRanges;
+        const unsigned int nEnd = 256 * (n + 1) / nRanges;
+        uint256 hashBegin;
+        *hashBegin.begin() = nBegin;
+
+        boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(make_pair(DB_BLOCK_INDEX, hashBegin));
+        while (pcursor->Valid()) {
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
+                break;
             CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->hashBlockCommitments  = diskindex.hashBlockCommitments;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->SetSolution(diskindex.GetSolution());
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->nChainSupplyDelta = diskindex.nChainSupplyDelta;
-                pindexNew->nTransparentValue = diskindex.nTransparentValue;
-                pindexNew->nLockboxValue = diskindex.nLockboxValue;
-                pindexNew->nSproutValue   = diskindex.nSproutValue;
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->nOrchardValue  = diskindex.nOrchardValue;
-                pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
-                pindexNew->hashFinalOrchardRoot = diskindex.hashFinalOrchardRoot;
-                pindexNew->hashChainHistoryRoot = diskindex.hashChainHistoryRoot;
-                pindexNew->hashAuthDataRoot = diskindex.hashAuthDataRoot;
-
-                // Check the block hash against the required difficulty as encoded in the
-                // nBits field. The probability of this succeeding randomly is low enough
-                // that it is a useful check to detect logic or disk storage errors.
-                // Skip this check for genesis block (height 0) which is validated by hash match in chainparams.
-                if (pindexNew->nHeight > 0 && !CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("LoadBlockIndex(): CheckProofOfWork failed: %s", pindexNew->ToString());
-
-                // ZIP 221 consistency checks
-                // These checks should only be performed for block index entries marked
-                // as consensus-valid (at the time they were written).
+            if (!pcursor->GetValue(diskindex)) {
+                vErrors[n] = "LoadBlockIndex() : failed to read value";
+                return;
+            }
+            uint256 hash = diskindex.GetBlockHash();
+
+            // Check the block hash against the required difficulty as encoded in the
+            // nBits field. The probability of this succeeding randomly is low enough
+            // that it is a useful check to detect logic or disk storage errors.
+            // Skip this check for genesis block (height 0) which is validated by hash match in chainparams.
+            if (diskindex.nHeight > 0 && !CheckProofOfWork(hash, diskindex.nBits, chainParams.GetConsensus())) {
+                vErrors[n] = strprintf("LoadBlockIndex(): CheckProofOfWork failed: height=%d, hash=%s",
+                    diskindex.nHeight, hash.ToString());
+                return;
+            }
+
+            // ZIP 221 consistency checks
+            // These checks should only be performed for block index entries marked
+            // as consensus-valid (at the time they were written).
+            //
+            if (diskindex.IsValid(BLOCK_VALID_CONSENSUS)) {
+                // We assume block index entries on disk that are not at least
+                // CHAIN_HISTORY_ROOT_VERSION were created by nodes that were
+                // not Heartwood aware. Such a node would not see Heartwood block
+                // headers as valid, and so this must *either* be an index entry
+                // for a block header on a non-Heartwood chain, or be marked as
+                // consensus-invalid.
+                //
+                // It can also happen that the block index entry was written
+                // by this node when it was Heartwood-aware (so its version
+                // will be >= CHAIN_HISTORY_ROOT_VERSION), but received from
+                // a non-upgraded peer. However that case the entry will be
+                // marked as consensus-invalid.
                 //
-                if (pindexNew->IsValid(BLOCK_VALID_CONSENSUS)) {
-                    // We assume block index entries on disk that are not at least
-                    // CHAIN_HISTORY_ROOT_VERSION were created by nodes that were
-                    // not Heartwood aware. Such a node would not see Heartwood block
-                    // headers as valid, and so this must *either* be an index entry
-                    // for a block header on a non-Heartwood chain, or be marked as
-                    // consensus-invalid.
-                    //
-                    // It can also happen that the block index entry was written
-                    // by this node when it was Heartwood-aware (so its version
-                    // will be >= CHAIN_HISTORY_ROOT_VERSION), but received from
-                    // a non-upgraded peer. However that case the entry will be
-                    // marked as consensus-invalid.
-                    //
-                    if (diskindex.nClientVersion >= NU5_DATA_VERSION &&
-                        chainParams.GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_NU5)) {
-                        // From NU5 onwards we don't enforce a consistency check, because
-                        // after ZIP 244, hashBlockCommitments will not match any stored
-                        // commitment.
-                    } else if (diskindex.nClientVersion >= CHAIN_HISTORY_ROOT_VERSION &&
-                        chainParams.GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_HEARTWOOD)) {
-                        if (pindexNew->hashBlockCommitments != pindexNew->hashChainHistoryRoot) {
-                            return error(
-                                "LoadBlockIndex(): block index inconsistency detected (post-Heartwood; hashBlockCommitments %s != hashChainHistoryRoot %s): %s",
-                                pindexNew->hashBlockCommitments.ToString(), pindexNew->hashChainHistoryRoot.ToString(), pindexNew->ToString());
-                        }
-                    } else {
-                        if (pindexNew->hashBlockCommitments != pindexNew->hashFinalSaplingRoot) {
-                            return error(
-                                "LoadBlockIndex(): block index inconsistency detected (pre-Heartwood; hashBlockCommitments %s != hashFinalSaplingRoot %s): %s",
-                                pindexNew->hashBlockCommitments.ToString(), pindexNew->hashFinalSaplingRoot.ToString(), pindexNew->ToString());
-                        }
+                if (diskindex.nClientVersion >= NU5_DATA_VERSION &&
+                    chainParams.GetConsensus().NetworkUpgradeActive(diskindex.nHeight, Consensus::UPGRADE_NU5)) {
+                    // From NU5 onwards we don't enforce a consistency check, because
+                    // after ZIP 244, hashBlockCommitments will not match any stored
+                    // commitment.
+                } else if (diskindex.nClientVersion >= CHAIN_HISTORY_ROOT_VERSION &&
+                    chainParams.GetConsensus().NetworkUpgradeActive(diskindex.nHeight, Consensus::UPGRADE_HEARTWOOD)) {
+                    if (diskindex.hashBlockCommitments != diskindex.hashChainHistoryRoot) {
+                        vErrors[n] = strprintf(
+                            "LoadBlockIndex(): block index inconsistency detected (post-Heartwood; hashBlockCommitments %s != hashChainHistoryRoot %s): height=%d, hash=%s",
+                            diskindex.hashBlockCommitments.ToString(), diskindex.hashChainHistoryRoot.ToString(), diskindex.nHeight, hash.ToString());
+                        return;
+                    }
+                } else {
+                    if (diskindex.hashBlockCommitments != diskindex.hashFinalSaplingRoot) {
+                        vErrors[n] = strprintf(
+                            "LoadBlockIndex(): block index inconsistency detected (pre-Heartwood; hashBlockCommitments %s != hashFinalSaplingRoot %s): height=%d, hash=%s",
+                            diskindex.hashBlockCommitments.ToString(), diskindex.hashFinalSaplingRoot.ToString(), diskindex.nHeight, hash.ToString());
+                        return;
                     }
                 }
-
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
             }
-        } else {
-            break;
+
+            vLoaded[n].emplace_back(hash, std::move(diskindex));
+            pcursor->Next();
+        }
+    };
+
+    auto loadRangeChecked = [&](int n) {
+        try {
+            loadRange(n);
+        } catch (const std::exception& e) {
+            vErrors[n] = strprintf("LoadBlockIndex(): %s", e.what());
+        }
+    };
+
+    boost::this_thread::interruption_point();
+    std::vector<std::thread> vThreads;
+    for (int n = 1; n < nRanges; n++) {
+        vThreads.emplace_back(loadRangeChecked, n);
+    }
+    loadRangeChecked(0);
+    for (auto& thread : vThreads) {
+        thread.join();
+    }
+    boost::this_thread::interruption_point();
+
+    size_t nEntries = 0;
+    for (int n = 0; n < nRanges; n++) {
+        if (!vErrors[n].empty())
+            return error("%s", vErrors[n]);
+        nEntries += vLoaded[n].size();
+    }
+
+    // Load mapBlockIndex. Sizing it up front avoids rehashing as it grows.
+    reserveBlockIndex(nEntries);
+    for (auto& vEntries : vLoaded) {
+        boost::this_thread::interruption_point();
+        for (const auto& entry : vEntries) {
+            const CDiskBlockIndex& diskindex = entry.second;
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(entry.first);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->hashSproutAnchor     = diskindex.hashSproutAnchor;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->hashBlockCommitments  = diskindex.hashBlockCommitments;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->SetSolution(diskindex.GetSolution());
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nCachedBranchId = diskindex.nCachedBranchId;
+            pindexNew->nTx            = diskindex.nTx;
+            pindexNew->nChainSupplyDelta = diskindex.nChainSupplyDelta;
+            pindexNew->nTransparentValue = diskindex.nTransparentValue;
+            pindexNew->nLockboxValue = diskindex.nLockboxValue;
+            pindexNew->nSproutValue   = diskindex.nSproutValue;
+            pindexNew->nSaplingValue  = diskindex.nSaplingValue;
+            pindexNew->nOrchardValue  = diskindex.nOrchardValue;
+            pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
+            pindexNew->hashFinalOrchardRoot = diskindex.hashFinalOrchardRoot;
+            pindexNew->hashChainHistoryRoot = diskindex.hashChainHistoryRoot;
+            pindexNew->hashAuthDataRoot = diskindex.hashAuthDataRoot;
         }
+        // Free each range as soon as it has been copied into the map.
+        std::vector<std::pair<uint256, CDiskBlockIndex>>().swap(vEntries);
     }
 
     return true;
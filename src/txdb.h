@@ -19,7 +19,10 @@
 #include <boost/function.hpp>
 #include "zcash/History.hpp"
 
+class CAutoFile;
 class CBlockIndex;
+class CSnapshotWriter;
+struct CSnapshotStats;
 
 // START insightexplorer
 struct CAddressUnspentKey;
@@ -27,12 +30,14 @@ struct CAddressUnspentValue;
 struct CAddressIndexKey;
 struct CAddressIndexIteratorKey;
 struct CAddressIndexIteratorHeightKey;
+struct CAddressBalanceValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
 struct CTimestampIndexKey;
 struct CTimestampIndexIteratorKey;
 struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
+struct CInsightIndexEntries;
 
 typedef std::pair<CAddressUnspentKey, CAddressUnspentValue> CAddressUnspentDbEntry;
 typedef std::pair<CAddressIndexKey, CAmount> CAddressIndexDbEntry;
@@ -113,6 +118,16 @@ public:
                     SubtreeCache &cacheSaplingSubtrees,
                     SubtreeCache &cacheOrchardSubtrees);
     bool GetStats(CCoinsStats &stats) const;
+
+    bool IsEmpty() { return db.IsEmpty(); }
+    //! Pin the current state of the database for WriteSnapshot. The caller owns the result.
+    CDBSnapshot *NewSnapshot() const;
+    uint256 GetBestBlock(const CDBSnapshot &snapshot) const;
+    //! Write every chainstate record as of snapshot to a snapshot file (see snapshot.h).
+    void WriteSnapshot(const CDBSnapshot &snapshot, CSnapshotWriter &out, CSnapshotStats &stats) const;
+    //! Read the records written by WriteSnapshot into this (empty) database,
+    //! making hashBlock the best block once everything has been written.
+    bool LoadSnapshot(CAutoFile &in, const uint256 &hashBlock, CSnapshotStats &stats);
 };
 
 /** Access to the block database (blocks/index/) */
@@ -131,6 +146,8 @@ public:
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing) const;
     bool ReadDiskBlockIndex(const uint256 &blockhash, CDiskBlockIndex &dbindex) const;
+    bool ReadDiskBlockIndex(const CDBSnapshot &snapshot, const uint256 &blockhash, CDiskBlockIndex &dbindex) const;
+    bool WriteDiskBlockIndex(const std::vector<CDiskBlockIndex> &vIndex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) const;
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
 
@@ -140,6 +157,10 @@ public:
     bool WriteAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
     bool EraseAddressIndex(const std::vector<CAddressIndexDbEntry> &vect);
     bool ReadAddressIndex(uint160 addressHash, int type, std::vector<CAddressIndexDbEntry> &addressIndex, int start = 0, int end = 0);
+    bool ReadAddressIndexPage(uint160 addressHash, int type, int startHeight, unsigned int startTxIndex, int endHeight,
+            size_t nMaxTxs, std::vector<CAddressIndexDbEntry> &addressIndex);
+    bool ReadAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value) const;
+    bool BuildAddressBalances();
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) const;
     bool UpdateSpentIndex(const std::vector<CSpentIndexDbEntry> &vect);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
@@ -148,13 +169,25 @@ public:
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex,
             const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS) const;
+    bool WriteInsightIndexEntries(const CInsightIndexEntries &entries, bool fConnect,
+            const CBlockLocator &locator);
+    bool WriteIndexBuilderBestBlock(const CBlockLocator &locator);
+    bool ReadIndexBuilderBestBlock(CBlockLocator &locator) const;
     // END insightexplorer
 
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue) const;
+    /**
+     * Load every block index entry, calling insertBlockIndex to create the
+     * in-memory entries. The entries are read, decoded and checked on up to
+     * nThreads threads; reserveBlockIndex is called with the number of
+     * entries before any of them are inserted.
+     */
     bool LoadBlockIndexGuts(
         std::function<CBlockIndex*(const uint256&)> insertBlockIndex,
-        const CChainParams& chainParams);
+        std::function<void(size_t)> reserveBlockIndex,
+        const CChainParams& chainParams,
+        int nThreads);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -1067,6 +1067,29 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<std::pair<uint256, TxMempoolInfo>> CTxMemPool::infoInScoreOrder(const std::set<uint256>& hashes) const
+{
+    LOCK(cs);
+    std::vector<std::pair<uint256, TxMempoolInfo>> ret;
+    std::vector<indexed_transaction_set::const_iterator> iters;
+    ret.reserve(hashes.size());
+    iters.reserve(hashes.size());
+    for (const uint256& hash : hashes) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i == mapTx.end()) {
+            ret.emplace_back(hash, TxMempoolInfo());
+        } else {
+            iters.push_back(i);
+        }
+    }
+    std::sort(iters.begin(), iters.end(), DepthAndScoreComparator());
+    for (auto it : iters) {
+        ret.emplace_back(it->GetTx().GetHash(), TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize())});
+    }
+
+    return ret;
+}
+
 std::shared_ptr<const CTransaction> CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -579,6 +579,12 @@ public:
     std::shared_ptr<const CTransaction> get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /**
+     * Look up the given transactions under a single lock, for announcing them.
+     * Those that are not in the mempool come first, with a null tx; the others
+     * follow in descending score order, as in infoAll().
+     */
+    std::vector<std::pair<uint256, TxMempoolInfo>> infoInScoreOrder(const std::set<uint256>& hashes) const;
 
     size_t DynamicMemoryUsage() const;
 
@@ -0,0 +1,111 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#include "validationstats.h"
+
+#include "util/time.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <rust/metrics.h>
+
+static_assert(VALIDATION_STAGE_COUNT == static_cast<size_t>(ValidationStage::ConnectTip) + 1,
+    "VALIDATION_STAGE_COUNT must match ValidationStage");
+
+static CLatencyHistogram validationStageHistograms[VALIDATION_STAGE_COUNT];
+
+const char* ValidationStageName(ValidationStage stage)
+{
+    switch (stage) {
+        case ValidationStage::RandomX: return "randomx";
+        case ValidationStage::Coins: return "coins";
+        case ValidationStage::Nullifiers: return "nullifiers";
+        case ValidationStage::Scripts: return "scripts";
+        case ValidationStage::Proofs: return "proofs";
+        case ValidationStage::Index: return "index";
+        case ValidationStage::ConnectBlock: return "connectblock";
+        case ValidationStage::Flush: return "flush";
+        case ValidationStage::ChainState: return "chainstate";
+        case ValidationStage::ConnectTip: return "connecttip";
+    }
+    return "unknown";
+}
+
+size_t CLatencyHistogram::BucketIndex(int64_t nMicros)
+{
+    if (nMicros < SUB_BUCKETS)
+        return std::max<int64_t>(nMicros, 0);
+    if (nMicros >= (int64_t(1) << MAX_EXPONENT))
+        return BUCKETS - 1;
+    int nExponent = 63 - __builtin_clzll(nMicros);
+    int nShift = nExponent - SUB_BUCKET_BITS;
+    return SUB_BUCKETS * (nShift + 1) + ((nMicros >> nShift) & (SUB_BUCKETS - 1));
+}
+
+int64_t CLatencyHistogram::BucketUpperBound(size_t nIndex)
+{
+    if (nIndex < (size_t)SUB_BUCKETS)
+        return nIndex;
+    int nShift = nIndex / SUB_BUCKETS - 1;
+    int64_t nLower = int64_t(SUB_BUCKETS + nIndex % SUB_BUCKETS) << nShift;
+    return nLower + (int64_t(1) << nShift) - 1;
+}
+
+void CLatencyHistogram::Record(int64_t nMicros)
+{
+    nMicros = std::max<int64_t>(nMicros, 0);
+    vBuckets[BucketIndex(nMicros)].fetch_add(1, std::memory_order_relaxed);
+    nTotal.fetch_add(nMicros, std::memory_order_relaxed);
+    int64_t nPrevMax = nMax.load(std::memory_order_relaxed);
+    while (nMicros > nPrevMax && !nMax.compare_exchange_weak(nPrevMax, nMicros, std::memory_order_relaxed)) {}
+    nCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+CLatencyHistogram::Snapshot CLatencyHistogram::GetSnapshot() const
+{
+    // The fields are read one at a time while other threads may be
+    // recording, so the count is taken from the buckets themselves.
+    Snapshot snapshot;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        snapshot.vBuckets[i] = vBuckets[i].load(std::memory_order_relaxed);
+        snapshot.nCount += snapshot.vBuckets[i];
+    }
+    snapshot.nTotal = nTotal.load(std::memory_order_relaxed);
+    snapshot.nMax = nMax.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+int64_t CLatencyHistogram::Snapshot::Percentile(double q) const
+{
+    if (nCount == 0)
+        return 0;
+    uint64_t nRank = std::max<uint64_t>(1, std::ceil(q * nCount));
+    uint64_t nSeen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        nSeen += vBuckets[i];
+        if (nSeen >= nRank)
+            return std::min(BucketUpperBound(i), nMax);
+    }
+    return nMax;
+}
+
+void RecordValidationStage(ValidationStage stage, int64_t nMicros)
+{
+    validationStageHistograms[static_cast<size_t>(stage)].Record(nMicros);
+    MetricsHistogram("zcash.chain.validation.seconds", nMicros * 0.000001, "stage", ValidationStageName(stage));
+}
+
+CLatencyHistogram::Snapshot GetValidationStageSnapshot(ValidationStage stage)
+{
+    return validationStageHistograms[static_cast<size_t>(stage)].GetSnapshot();
+}
+
+CValidationStageTimer::CValidationStageTimer(ValidationStage stageIn) :
+    stage(stageIn), nStart(GetTimeMicros()) {}
+
+CValidationStageTimer::~CValidationStageTimer()
+{
+    RecordValidationStage(stage, GetTimeMicros() - nStart);
+}
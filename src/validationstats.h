@@ -0,0 +1,100 @@
+// Copyright (c) 2025 The Juno Cash developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php .
+
+#ifndef BITCOIN_VALIDATIONSTATS_H
+#define BITCOIN_VALIDATIONSTATS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The stages of block validation whose latency is recorded. */
+enum class ValidationStage {
+    //! Checking the RandomX solution of a block header
+    RandomX,
+    //! Fetching the transparent inputs of a block's transactions
+    Coins,
+    //! Checking that a block's shielded spends are unspent and anchored
+    Nullifiers,
+    //! Checking a block's transparent scripts
+    Scripts,
+    //! Validating a block's batched Sapling and Orchard proofs and signatures
+    Proofs,
+    //! Writing a block's undo data and transaction index entries
+    Index,
+    //! ConnectBlock as a whole
+    ConnectBlock,
+    //! Flushing the connected block's coins into the tip cache
+    Flush,
+    //! Writing the chain state to disk, when needed
+    ChainState,
+    //! ConnectTip as a whole
+    ConnectTip,
+};
+
+static const size_t VALIDATION_STAGE_COUNT = 10;
+
+/** The name of a validation stage, as used by getvalidationstats and as a metrics label. */
+const char* ValidationStageName(ValidationStage stage);
+
+/**
+ * A latency histogram with HDR-style log-linear buckets: each power of two
+ * is split into 2^SUB_BUCKET_BITS equal buckets, so any recorded value is
+ * known to within 1/2^SUB_BUCKET_BITS of itself. Recording is lock-free and
+ * may happen on any thread.
+ */
+class CLatencyHistogram
+{
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    //! Values of 2^MAX_EXPONENT microseconds (about 19 hours) and over share the last bucket.
+    static constexpr int MAX_EXPONENT = 36;
+    static constexpr size_t BUCKETS = SUB_BUCKETS * (MAX_EXPONENT - SUB_BUCKET_BITS + 1);
+
+    struct Snapshot {
+        uint64_t nCount = 0;
+        int64_t nTotal = 0;
+        int64_t nMax = 0;
+        uint64_t vBuckets[BUCKETS] = {};
+
+        /** The smallest bucket bound that at least a fraction q of the values are below. */
+        int64_t Percentile(double q) const;
+    };
+
+    void Record(int64_t nMicros);
+    Snapshot GetSnapshot() const;
+
+    static size_t BucketIndex(int64_t nMicros);
+    //! The largest value that falls into the given bucket.
+    static int64_t BucketUpperBound(size_t nIndex);
+
+private:
+    std::atomic<uint64_t> nCount{0};
+    std::atomic<int64_t> nTotal{0};
+    std::atomic<int64_t> nMax{0};
+    std::atomic<uint64_t> vBuckets[BUCKETS] = {};
+};
+
+/**
+ * Record how long a validation stage took, in microseconds, in its histogram
+ * and as the zcash.chain.validation.seconds metric.
+ */
+void RecordValidationStage(ValidationStage stage, int64_t nMicros);
+
+CLatencyHistogram::Snapshot GetValidationStageSnapshot(ValidationStage stage);
+
+/** Records the time from its construction to its destruction against a validation stage. */
+class CValidationStageTimer
+{
+private:
+    const ValidationStage stage;
+    const int64_t nStart;
+
+public:
+    explicit CValidationStageTimer(ValidationStage stageIn);
+    ~CValidationStageTimer();
+};
+
+#endif // BITCOIN_VALIDATIONSTATS_H
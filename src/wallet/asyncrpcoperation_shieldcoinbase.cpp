@@ -29,9 +29,12 @@
 #include "zcash/IncrementalMerkleTree.hpp"
 #include "miner.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <iostream>
 #include <chrono>
+#include <exception>
 #include <optional>
 #include <thread>
 #include <string>
@@ -49,7 +52,8 @@ AsyncRPCOperation_shieldcoinbase::AsyncRPCOperation_shieldcoinbase(
         TransactionStrategy strategy,
         int nUTXOLimit,
         std::optional<CAmount> fee,
-        UniValue contextInfo) :
+        UniValue contextInfo,
+        int nMaxTransactions) :
     builder_(std::move(builder)),
     ztxoSelector_(ztxoSelector),
     toAddress_(toAddress),
@@ -57,9 +61,11 @@ AsyncRPCOperation_shieldcoinbase::AsyncRPCOperation_shieldcoinbase(
     strategy_(strategy),
     nUTXOLimit_(nUTXOLimit),
     fee_(fee),
+    nMaxTransactions_(nMaxTransactions),
     contextinfo_(contextInfo)
 {
     assert(!fee.has_value() || MoneyRange(fee.value()));
+    assert(nMaxTransactions > 0);
     assert(ztxoSelector.RequireSpendingKeys());
 
     // Destination must be a Unified Address with Orchard receiver (validated by RPC layer)
@@ -79,7 +85,7 @@ AsyncRPCOperation_shieldcoinbase::~AsyncRPCOperation_shieldcoinbase() {
 
 void AsyncRPCOperation_shieldcoinbase::main() {
     if (isCancelled()) {
-        effects_.value().UnlockSpendable(*pwalletMain);
+        UnlockAll(*pwalletMain);
         return;
     }
 
@@ -90,9 +96,9 @@ void AsyncRPCOperation_shieldcoinbase::main() {
     GenerateBitcoins(false, 0, Params());
 #endif
 
-    std::optional<uint256> txid;
+    std::vector<uint256> txids;
     try {
-        txid = main_impl(*pwalletMain);
+        txids = main_impl(*pwalletMain);
     } catch (const UniValue& objError) {
         int code = find_value(objError, "code").get_int();
         std::string message = find_value(objError, "message").get_str();
@@ -118,15 +124,17 @@ void AsyncRPCOperation_shieldcoinbase::main() {
 
     stop_execution_clock();
 
-    if (txid.has_value()) {
+    if (!txids.empty()) {
         set_state(OperationStatus::SUCCESS);
     } else {
         set_state(OperationStatus::FAILED);
     }
 
     std::string s = strprintf("%s: z_shieldcoinbase finished (status=%s", getId(), getStateAsString());
-    if (txid.has_value()) {
-        s += strprintf(", txid=%s)\n", txid.value().GetHex());
+    if (txids.size() == 1) {
+        s += strprintf(", txid=%s)\n", txids[0].GetHex());
+    } else if (!txids.empty()) {
+        s += strprintf(", txids=%d, first=%s)\n", txids.size(), txids[0].GetHex());
     } else {
         s += strprintf(", error=%s)\n", getErrorMessage());
     }
@@ -137,7 +145,17 @@ void AsyncRPCOperation_shieldcoinbase::main() {
 Remaining AsyncRPCOperation_shieldcoinbase::prepare(CWallet& wallet) {
     auto spendable = builder_.FindAllSpendableInputs(wallet, ztxoSelector_, COINBASE_MATURITY);
 
-    // Find unspent coinbase utxos and update estimated size
+    // Every transaction in the plan pays ZIP 317 fees per transparent input, so the
+    // cheapest plan is the one with the fewest, fullest transactions. When the plan
+    // is capped at more than one transaction, shield the most valuable utxos first.
+    std::vector<COutput> candidates = spendable.utxos;
+    if (nMaxTransactions_ > 1) {
+        std::stable_sort(candidates.begin(), candidates.end(), [](const COutput& a, const COutput& b) {
+            return a.Value() > b.Value();
+        });
+    }
+
+    // Find unspent coinbase utxos and pack them into transactions by estimated size
     unsigned int max_tx_size = MAX_TX_SIZE_AFTER_SAPLING;
     CAmount shieldingValue = 0;
     CAmount remainingValue = 0;
@@ -147,8 +165,9 @@ Remaining AsyncRPCOperation_shieldcoinbase::prepare(CWallet& wallet) {
     size_t utxoCounter = 0;
     size_t numUtxos = 0;
     bool maxedOutFlag = false;
+    std::vector<std::vector<COutput>> batches(1);
 
-    for (const COutput& out : spendable.utxos) {
+    for (const COutput& out : candidates) {
         auto scriptPubKey = out.tx->vout[out.i].scriptPubKey;
         CAmount nValue = out.tx->vout[out.i].nValue;
 
@@ -162,12 +181,22 @@ Remaining AsyncRPCOperation_shieldcoinbase::prepare(CWallet& wallet) {
             size_t increase =
                 (std::get_if<CScriptID>(&address) != nullptr) ? CTXIN_SPEND_P2SH_SIZE : CTXIN_SPEND_P2PKH_SIZE;
 
-            if (estimatedTxSize + increase >= max_tx_size || (0 < nUTXOLimit_ && nUTXOLimit_ < utxoCounter)) {
-                maxedOutFlag = true;
-            } else {
+            if (estimatedTxSize + increase >= max_tx_size ||
+                (0 < nUTXOLimit_ && (size_t)nUTXOLimit_ <= batches.back().size()))
+            {
+                if (batches.size() < (size_t)nMaxTransactions_ && !batches.back().empty()) {
+                    batches.emplace_back();
+                    estimatedTxSize = MIN_TX_COST;
+                } else {
+                    maxedOutFlag = true;
+                }
+            }
+
+            if (!maxedOutFlag) {
                 estimatedTxSize += increase;
                 shieldingValue += nValue;
                 numUtxos++;
+                batches.back().push_back(out);
             }
         }
 
@@ -176,72 +205,170 @@ Remaining AsyncRPCOperation_shieldcoinbase::prepare(CWallet& wallet) {
         }
     }
 
-    spendable.LimitTransparentUtxos(numUtxos);
-
-    auto preparationResult = builder_.PrepareTransaction(
-            wallet,
-            ztxoSelector_,
-            spendable,
-            std::make_pair(toAddress_, memo_),
-            chainActive,
-            strategy_,
-            fee_,
-            nAnchorConfirmations);
-
-    (void)preparationResult
-        .map_error([&](const InputSelectionError& err) {
-            ThrowInputSelectionError(err, ztxoSelector_, strategy_);
-        })
-        .map([&](const TransactionEffects& effects) {
-            effects.LockSpendable(wallet);
-            effects_ = effects;
-        });
+    if (batches.back().empty() && batches.size() > 1) {
+        batches.pop_back();
+    }
+
+    for (size_t i = 0; i < batches.size(); i++) {
+        // Any shielded notes matched by the selector are spent by the first transaction only.
+        SpendableInputs batchInputs;
+        if (i == 0) {
+            batchInputs = spendable;
+        }
+        batchInputs.utxos = batches[i];
 
-    return Remaining(utxoCounter, numUtxos, remainingValue, shieldingValue);
+        auto preparationResult = builder_.PrepareTransaction(
+                wallet,
+                ztxoSelector_,
+                batchInputs,
+                std::make_pair(toAddress_, memo_),
+                chainActive,
+                strategy_,
+                fee_,
+                nAnchorConfirmations);
+
+        (void)preparationResult
+            .map_error([&](const InputSelectionError& err) {
+                UnlockAll(wallet);
+                effects_.clear();
+                ThrowInputSelectionError(err, ztxoSelector_, strategy_);
+            })
+            .map([&](const TransactionEffects& effects) {
+                effects.LockSpendable(wallet);
+                effects_.push_back(effects);
+            });
+    }
+
+    return Remaining(utxoCounter, numUtxos, remainingValue, shieldingValue, effects_.size());
 }
 
-uint256 AsyncRPCOperation_shieldcoinbase::main_impl(CWallet& wallet) {
-    uint256 txid;
+void AsyncRPCOperation_shieldcoinbase::UnlockAll(CWallet& wallet) const {
+    for (const auto& effects : effects_) {
+        effects.UnlockSpendable(wallet);
+    }
+}
+
+std::vector<uint256> AsyncRPCOperation_shieldcoinbase::main_impl(CWallet& wallet) {
+    std::vector<uint256> txids;
 
     try {
-        const auto& spendable = effects_->GetSpendable();
-        const auto& payments = effects_->GetPayments();
-        spendable.LogInputs(getId());
-
-        LogPrint("zrpcunsafe", "%s: spending %s to send %s with fee %s\n", getId(),
-                 FormatMoney(payments.Total()),
-                 FormatMoney(spendable.Total()),
-                 FormatMoney(effects_->GetFee()));
-        LogPrint("zrpc", "%s: total transparent input: %s (to choose from)\n", getId(),
-                 FormatMoney(spendable.GetTransparentTotal()));
-        LogPrint("zrpcunsafe", "%s: total Orchard input: %s (to choose from)\n", getId(),
-                 FormatMoney(spendable.GetOrchardTotal()));
-        LogPrint("zrpc", "%s: total transparent output: %s\n", getId(),
-                 FormatMoney(payments.GetTransparentTotal()));
-        LogPrint("zrpcunsafe", "%s: total shielded Orchard output: %s\n", getId(),
-                 FormatMoney(payments.GetOrchardTotal()));
+        for (size_t i = 0; i < effects_.size(); i++) {
+            const auto& spendable = effects_[i].GetSpendable();
+            const auto& payments = effects_[i].GetPayments();
+            spendable.LogInputs(getId());
+
+            LogPrint("zrpcunsafe", "%s: [%d/%d] spending %s to send %s with fee %s\n", getId(),
+                     i + 1, effects_.size(),
+                     FormatMoney(payments.Total()),
+                     FormatMoney(spendable.Total()),
+                     FormatMoney(effects_[i].GetFee()));
+            LogPrint("zrpc", "%s: [%d/%d] total transparent input: %s (to choose from)\n", getId(),
+                     i + 1, effects_.size(), FormatMoney(spendable.GetTransparentTotal()));
+            LogPrint("zrpcunsafe", "%s: [%d/%d] total Orchard input: %s (to choose from)\n", getId(),
+                     i + 1, effects_.size(), FormatMoney(spendable.GetOrchardTotal()));
+            LogPrint("zrpcunsafe", "%s: [%d/%d] total shielded Orchard output: %s\n", getId(),
+                     i + 1, effects_.size(), FormatMoney(payments.GetOrchardTotal()));
+            LogPrint("zrpc", "%s: [%d/%d] fee: %s\n", getId(),
+                     i + 1, effects_.size(), FormatMoney(effects_[i].GetFee()));
+        }
         LogPrint("zrpcunsafe", "%s: requested fee: %s\n", getId(),
                  fee_.has_value() ? FormatMoney(fee_.value()) : "default");
-        LogPrint("zrpc", "%s: fee: %s\n", getId(), FormatMoney(effects_->GetFee()));
 
-        auto buildResult = effects_->ApproveAndBuild(
-                Params(),
-                wallet,
-                chainActive,
-                strategy_);
+        // Proving dominates the cost of each shielding transaction, and the planned
+        // transactions spend disjoint utxos, so build them concurrently. Each build
+        // only takes cs_main and cs_wallet briefly to fetch its anchor.
+        std::vector<std::optional<CTransaction>> txs(effects_.size());
+        std::vector<std::exception_ptr> buildErrors(effects_.size());
+        std::atomic<size_t> nextIndex{0};
+        auto buildWorker = [&]() {
+            for (size_t i = nextIndex++; i < effects_.size() && !isCancelled(); i = nextIndex++) {
+                try {
+                    auto buildResult = effects_[i].ApproveAndBuild(
+                            Params(),
+                            wallet,
+                            chainActive,
+                            strategy_);
+                    txs[i] = buildResult.GetTxOrThrow();
+                } catch (...) {
+                    buildErrors[i] = std::current_exception();
+                }
+                txsProved_++;
+            }
+        };
+
+        size_t nWorkers = std::min(effects_.size(), (size_t)std::max(1, GetNumCores()));
+        if (nWorkers <= 1) {
+            buildWorker();
+        } else {
+            std::vector<std::thread> workers;
+            for (size_t w = 0; w < nWorkers; w++) {
+                workers.emplace_back(buildWorker);
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
 
-        auto tx = buildResult.GetTxOrThrow();
-        LogPrint("zrpc", "%s, conventional fee: %s\n", getId(), FormatMoney(tx.GetConventionalFee()));
+        // A single transaction keeps the original result and error shape.
+        if (effects_.size() == 1) {
+            if (buildErrors[0]) {
+                std::rethrow_exception(buildErrors[0]);
+            } else if (!txs[0].has_value()) {
+                throw JSONRPCError(RPC_WALLET_ERROR, "Operation was cancelled before the transaction was built");
+            }
+            const auto& tx = txs[0].value();
+            LogPrint("zrpc", "%s, conventional fee: %s\n", getId(), FormatMoney(tx.GetConventionalFee()));
 
-        UniValue sendResult = SendTransaction(tx, payments.GetResolvedPayments(), std::nullopt, testmode);
-        set_result(sendResult);
+            UniValue sendResult = SendTransaction(tx, effects_[0].GetPayments().GetResolvedPayments(), std::nullopt, testmode);
+            set_result(sendResult);
+            txsSent_++;
+            txids.push_back(tx.GetHash());
 
-        txid = tx.GetHash();
+            UnlockAll(wallet);
+            return txids;
+        }
 
-        effects_->UnlockSpendable(wallet);
-        return txid;
+        // Submit the batch in plan order. A failure of one transaction does not
+        // prevent the others, which spend disjoint utxos, from being sent.
+        UniValue txidArray(UniValue::VARR);
+        UniValue errorArray(UniValue::VARR);
+        for (size_t i = 0; i < effects_.size(); i++) {
+            try {
+                if (!txs[i].has_value()) {
+                    if (buildErrors[i]) {
+                        std::rethrow_exception(buildErrors[i]);
+                    }
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Operation was cancelled before the transaction was built");
+                }
+                const auto& tx = txs[i].value();
+                SendTransaction(tx, effects_[i].GetPayments().GetResolvedPayments(), std::nullopt, testmode);
+                txidArray.push_back(tx.GetHash().GetHex());
+                txids.push_back(tx.GetHash());
+                txsSent_++;
+            } catch (const UniValue& objError) {
+                errorArray.push_back(strprintf("transaction %d: %s", i, find_value(objError, "message").get_str()));
+            } catch (const std::exception& e) {
+                errorArray.push_back(strprintf("transaction %d: %s", i, e.what()));
+            }
+        }
+
+        if (txids.empty()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, strprintf(
+                "All %d shielding transactions failed, first error: %s",
+                effects_.size(), errorArray[0].get_str()));
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("txids", txidArray);
+        if (!errorArray.empty()) {
+            result.pushKV("errors", errorArray);
+        }
+        set_result(result);
+
+        UnlockAll(wallet);
+        return txids;
     } catch (...) {
-        effects_->UnlockSpendable(wallet);
+        UnlockAll(wallet);
         throw;
     }
 }
@@ -251,12 +378,21 @@ uint256 AsyncRPCOperation_shieldcoinbase::main_impl(CWallet& wallet) {
  */
 UniValue AsyncRPCOperation_shieldcoinbase::getStatus() const {
     UniValue v = AsyncRPCOperation::getStatus();
-    if (contextinfo_.isNull()) {
+    if (contextinfo_.isNull() && effects_.size() <= 1) {
         return v;
     }
 
     UniValue obj = v.get_obj();
-    obj.pushKV("method", "z_shieldcoinbase");
-    obj.pushKV("params", contextinfo_ );
+    if (!contextinfo_.isNull()) {
+        obj.pushKV("method", "z_shieldcoinbase");
+        obj.pushKV("params", contextinfo_ );
+    }
+    if (effects_.size() > 1) {
+        UniValue progress(UniValue::VOBJ);
+        progress.pushKV("planned", (uint64_t)effects_.size());
+        progress.pushKV("proved", (uint64_t)txsProved_.load());
+        progress.pushKV("sent", (uint64_t)txsSent_.load());
+        obj.pushKV("progress", progress);
+    }
     return obj;
 }
@@ -14,8 +14,10 @@
 #include "wallet.h"
 #include "wallet/wallet_tx_builder.h"
 
+#include <atomic>
 #include <unordered_map>
 #include <tuple>
+#include <vector>
 
 #include <univalue.h>
 
@@ -38,6 +40,9 @@ When estimating the number of coinbase utxos we can shield in a single transacti
 
 #define SHIELD_COINBASE_DEFAULT_LIMIT 50
 
+// By default a single shielding transaction is planned; bulk shielding is opt-in.
+#define SHIELD_COINBASE_DEFAULT_MAX_TRANSACTIONS 1
+
 // transaction.h comment: spending taddr output requires CTxIn >= 148 bytes and
 // typical taddr txout is 34 bytes
 #define CTXIN_SPEND_P2PKH_SIZE   148
@@ -45,13 +50,15 @@ When estimating the number of coinbase utxos we can shield in a single transacti
 
 class Remaining {
 public:
-    Remaining(size_t utxoCounter, size_t numUtxos, CAmount remainingValue, CAmount shieldingValue):
-        utxoCounter(utxoCounter), numUtxos(numUtxos), remainingValue(remainingValue), shieldingValue(shieldingValue) { }
+    Remaining(size_t utxoCounter, size_t numUtxos, CAmount remainingValue, CAmount shieldingValue, size_t numTransactions):
+        utxoCounter(utxoCounter), numUtxos(numUtxos), remainingValue(remainingValue), shieldingValue(shieldingValue),
+        numTransactions(numTransactions) { }
 
     size_t utxoCounter;
     size_t numUtxos;
     CAmount remainingValue;
     CAmount shieldingValue;
+    size_t numTransactions;
 };
 
 class AsyncRPCOperation_shieldcoinbase : public AsyncRPCOperation {
@@ -64,7 +71,8 @@ public:
         TransactionStrategy strategy,
         int nUTXOLimit,
         std::optional<CAmount> fee,
-        UniValue contextInfo = NullUniValue);
+        UniValue contextInfo = NullUniValue,
+        int nMaxTransactions = SHIELD_COINBASE_DEFAULT_MAX_TRANSACTIONS);
     virtual ~AsyncRPCOperation_shieldcoinbase();
 
     // We don't want to be copied or moved around
@@ -73,6 +81,13 @@ public:
     AsyncRPCOperation_shieldcoinbase& operator=(AsyncRPCOperation_shieldcoinbase const&) = delete;  // Copy assign
     AsyncRPCOperation_shieldcoinbase& operator=(AsyncRPCOperation_shieldcoinbase &&) = delete;      // Move assign
 
+    /**
+     * Plans up to `nMaxTransactions` shielding transactions, each holding at most
+     * `nUTXOLimit` coinbase utxos (0 = as many as fit under MAX_TX_SIZE_AFTER_SAPLING),
+     * and locks the selected utxos. When more than one transaction may be planned,
+     * utxos are taken in descending order of value so that a capped plan shields as
+     * much value as possible for its ZIP 317 fees.
+     */
     Remaining prepare(CWallet& wallet);
 
     virtual void main();
@@ -91,11 +106,18 @@ private:
     TransactionStrategy strategy_;
     int nUTXOLimit_;
     std::optional<CAmount> fee_;
-    std::optional<TransactionEffects> effects_;
+    int nMaxTransactions_;
+    std::vector<TransactionEffects> effects_;
+
+    // Progress of a bulk shielding operation, reported by getStatus()
+    std::atomic<size_t> txsProved_{0};
+    std::atomic<size_t> txsSent_{0};
 
     UniValue contextinfo_;     // optional data to include in return value from getStatus()
 
-    uint256 main_impl(CWallet& wallet);
+    std::vector<uint256> main_impl(CWallet& wallet);
+
+    void UnlockAll(CWallet& wallet) const;
 };
 
 // To test private methods, a friend class can act as a proxy
@@ -107,7 +129,7 @@ public:
 
     // Delegated methods
 
-    uint256 main_impl(CWallet& wallet) {
+    std::vector<uint256> main_impl(CWallet& wallet) {
         return delegate->main_impl(wallet);
     }
 
@@ -978,6 +978,109 @@ TEST(WalletTests, SproutNullifierIsSpent) {
     mapBlockIndex.erase(blockHash);
 }
 
+TEST(WalletTests, QueriesSkipTransactionsWithConfirmedSpends) {
+    SelectParams(CBaseChainParams::REGTEST);
+    CWallet wallet(Params());
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    auto sk = libzcash::SproutSpendingKey::random();
+    wallet.AddSproutSpendingKey(sk);
+
+    auto wtx = GetValidSproutReceive(sk, 10, true);
+    auto note = GetSproutNote(sk, wtx, 0, 1);
+    auto nullifier = note.nullifier(sk);
+
+    mapSproutNoteData_t noteData;
+    JSOutPoint jsoutpt {wtx.GetHash(), 0, 1};
+    SproutNoteData nd {sk.address(), nullifier};
+    noteData[jsoutpt] = nd;
+    wtx.SetSproutNoteData(noteData);
+    wallet.LoadWalletTx(wtx);
+
+    auto queried = [&]() {
+        std::set<uint256> hashes;
+        for (const auto* entry : wallet.GetWalletTxsForQuery(true)) {
+            hashes.insert(entry->first);
+        }
+        return hashes;
+    };
+    EXPECT_EQ(1, queried().count(wtx.GetHash()));
+
+    // An unconfirmed spend can still be undone, so the note is kept.
+    auto wtx2 = GetValidSproutSpend(sk, note, 5);
+    wallet.LoadWalletTx(wtx2);
+    EXPECT_EQ(1, queried().count(wtx.GetHash()));
+
+    // Fake-mine the spend
+    EXPECT_EQ(-1, chainActive.Height());
+    CBlock block;
+    block.vtx.push_back(wtx2);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    auto blockHash = block.GetHash();
+    CBlockIndex fakeIndex {block};
+    mapBlockIndex.insert(std::make_pair(blockHash, &fakeIndex));
+    chainActive.SetTip(&fakeIndex);
+
+    wtx2.SetMerkleBranch(block);
+    wallet.LoadWalletTx(wtx2);
+    EXPECT_EQ(0, queried().count(wtx.GetHash()));
+    EXPECT_EQ(wallet.mapWallet.size(), wallet.GetWalletTxsForQuery(false).size());
+
+    // Disconnecting the spend brings the note back.
+    chainActive.SetTip(NULL);
+    EXPECT_EQ(1, queried().count(wtx.GetHash()));
+
+    // Tear down
+    mapBlockIndex.erase(blockHash);
+}
+
+TEST(WalletTests, QueriesReturnTransactionsPayingToNewKeys) {
+    SelectParams(CBaseChainParams::REGTEST);
+    CWallet wallet(Params());
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    CKey key = CKey::TestOnlyRandomKey(true);
+    CMutableTransaction t;
+    t.vout.resize(1);
+    t.vout[0].nValue = 90*CENT;
+    t.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    CWalletTx wtx {&wallet, t};
+
+    // Fake-mine the transaction, so that the set of unspent transactions is
+    // kept rather than rebuilt for an empty chain.
+    EXPECT_EQ(-1, chainActive.Height());
+    CBlock block;
+    block.vtx.push_back(wtx);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    auto blockHash = block.GetHash();
+    CBlockIndex fakeIndex {block};
+    mapBlockIndex.insert(std::make_pair(blockHash, &fakeIndex));
+    chainActive.SetTip(&fakeIndex);
+    wtx.SetMerkleBranch(block);
+    wallet.LoadWalletTx(wtx);
+
+    auto queried = [&]() {
+        std::set<uint256> hashes;
+        for (const auto* entry : wallet.GetWalletTxsForQuery(true)) {
+            hashes.insert(entry->first);
+        }
+        return hashes;
+    };
+    // Nothing in it is ours yet, so there is nothing to spend.
+    EXPECT_EQ(0, queried().count(wtx.GetHash()));
+
+    // An unrelated key leaves it out, the key it pays to brings it back.
+    CKey key2 = CKey::TestOnlyRandomKey(true);
+    ASSERT_TRUE(wallet.AddKeyPubKey(key2, key2.GetPubKey()));
+    EXPECT_EQ(0, queried().count(wtx.GetHash()));
+    ASSERT_TRUE(wallet.AddKeyPubKey(key, key.GetPubKey()));
+    EXPECT_EQ(1, queried().count(wtx.GetHash()));
+
+    // Tear down
+    chainActive.SetTip(NULL);
+    mapBlockIndex.erase(blockHash);
+}
+
 TEST(WalletTests, SaplingNullifierIsSpent) {
     LoadProofParameters();
 
@@ -2412,6 +2515,55 @@ TEST(WalletTests, SaplingNoteLocking) {
     EXPECT_FALSE(wallet.IsLockedNote(sop2));
 }
 
+TEST(WalletTests, CoinLockingMarksSummaryDirty) {
+    SelectParams(CBaseChainParams::REGTEST);
+    CWallet wallet(Params());
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    CKey tsk = AddTestCKeyToKeyStore(wallet);
+    CMutableTransaction t;
+    t.vout.resize(1);
+    t.vout[0].nValue = 90*CENT;
+    t.vout[0].scriptPubKey = GetScriptForDestination(tsk.GetPubKey().GetID());
+    CWalletTx wtx {&wallet, t};
+
+    // Fake-mine the transaction
+    EXPECT_EQ(-1, chainActive.Height());
+    CBlock block;
+    block.vtx.push_back(wtx);
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    auto blockHash = block.GetHash();
+    CBlockIndex fakeIndex {block};
+    mapBlockIndex.insert(std::make_pair(blockHash, &fakeIndex));
+    chainActive.SetTip(&fakeIndex);
+    wtx.SetMerkleBranch(block);
+    wallet.LoadWalletTx(wtx);
+
+    wallet.UpdateSummary();
+    auto summary = wallet.GetSummary(true);
+    ASSERT_NE(nullptr, summary);
+    EXPECT_EQ(90*CENT, summary->transparentSpendable);
+
+    COutPoint outpt(wtx.GetHash(), 0);
+    wallet.LockCoin(outpt);
+    EXPECT_EQ(nullptr, wallet.GetSummary(true));
+    wallet.UpdateSummary();
+    summary = wallet.GetSummary(true);
+    ASSERT_NE(nullptr, summary);
+    EXPECT_EQ(0, summary->transparentSpendable);
+
+    wallet.UnlockAllCoins();
+    EXPECT_EQ(nullptr, wallet.GetSummary(true));
+    wallet.UpdateSummary();
+    summary = wallet.GetSummary(true);
+    ASSERT_NE(nullptr, summary);
+    EXPECT_EQ(90*CENT, summary->transparentSpendable);
+
+    // Tear down
+    chainActive.SetTip(NULL);
+    mapBlockIndex.erase(blockHash);
+}
+
 TEST(WalletTests, GenerateUnifiedAddress) {
     (void) RegtestActivateSapling();
     TestWallet wallet(Params());
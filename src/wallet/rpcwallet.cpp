@@ -2571,19 +2571,32 @@ UniValue getwalletinfo(const UniValue& params, bool fHelp)
 
     auto asOfHeight = parseAsOfHeight(params, 0);
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    // The current balances are kept in the wallet summary; only recompute
+    // them when it is out of date or an earlier height is requested.
+    auto summary = asOfHeight.has_value() ? nullptr : pwalletMain->GetSummary(true);
 
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("walletversion", pwalletMain->GetVersion());
-    obj.pushKV("balance",       ValueFromAmount(pwalletMain->GetBalance(asOfHeight)));
-    if (!asOfHeight.has_value()) {
-        obj.pushKV("unconfirmed_balance", ValueFromAmount(pwalletMain->GetUnconfirmedTransparentBalance()));
-    }
-    obj.pushKV("immature_balance",    ValueFromAmount(pwalletMain->GetImmatureBalance(asOfHeight)));
-    obj.pushKV("shielded_balance",    FormatMoney(getBalanceZaddr(std::nullopt, asOfHeight, 1, INT_MAX)));
-    if (!asOfHeight.has_value()) {
-        obj.pushKV("shielded_unconfirmed_balance", FormatMoney(getBalanceZaddr(std::nullopt, asOfHeight, 0, 0)));
+    if (summary) {
+        obj.pushKV("balance",       ValueFromAmount(summary->transparentBalance));
+        obj.pushKV("unconfirmed_balance", ValueFromAmount(summary->transparentUnconfirmed));
+        obj.pushKV("immature_balance",    ValueFromAmount(summary->transparentImmature));
+        obj.pushKV("shielded_balance",    FormatMoney(summary->shieldedBalance));
+        obj.pushKV("shielded_unconfirmed_balance", FormatMoney(summary->shieldedUnconfirmed));
+    } else {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+        obj.pushKV("balance",       ValueFromAmount(pwalletMain->GetBalance(asOfHeight)));
+        if (!asOfHeight.has_value()) {
+            obj.pushKV("unconfirmed_balance", ValueFromAmount(pwalletMain->GetUnconfirmedTransparentBalance()));
+        }
+        obj.pushKV("immature_balance",    ValueFromAmount(pwalletMain->GetImmatureBalance(asOfHeight)));
+        obj.pushKV("shielded_balance",    FormatMoney(getBalanceZaddr(std::nullopt, asOfHeight, 1, INT_MAX)));
+        if (!asOfHeight.has_value()) {
+            obj.pushKV("shielded_unconfirmed_balance", FormatMoney(getBalanceZaddr(std::nullopt, asOfHeight, 0, 0)));
+        }
     }
+
+    LOCK(pwalletMain->cs_wallet);
     obj.pushKV("txcount",       (int)pwalletMain->mapWallet.size());
     obj.pushKV("keypoololdest", pwalletMain->GetOldestKeyPoolTime());
     obj.pushKV("keypoolsize",   (int)pwalletMain->GetKeyPoolSize());
@@ -4278,8 +4291,6 @@ UniValue z_gettotalbalance(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_gettotalbalance", "5")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
     int nMinDepth = parseMinconf(1, params, 0, std::nullopt);
 
     bool fIncludeWatchonly = false;
@@ -4287,12 +4298,24 @@ UniValue z_gettotalbalance(const UniValue& params, bool fHelp)
         fIncludeWatchonly = params[1].get_bool();
     }
 
-    // getbalance and "getbalance * 1 true" should return the same number
-    // but they don't because wtx.GetAmounts() does not handle tx where there are no outputs
-    // pwalletMain->GetBalance() does not accept min depth parameter
-    // so we use our own method to get balance of utxos.
-    CAmount nBalance = getBalanceTaddr(std::nullopt, std::nullopt, nMinDepth, !fIncludeWatchonly);
-    CAmount nPrivateBalance = getBalanceZaddr(std::nullopt, std::nullopt, nMinDepth, INT_MAX, !fIncludeWatchonly);
+    // The wallet summary holds the balances for the default arguments.
+    auto summary = (nMinDepth == 1 && !fIncludeWatchonly) ? pwalletMain->GetSummary(true) : nullptr;
+
+    CAmount nBalance;
+    CAmount nPrivateBalance;
+    if (summary) {
+        nBalance = summary->transparentSpendable;
+        nPrivateBalance = summary->shieldedBalance;
+    } else {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        // getbalance and "getbalance * 1 true" should return the same number
+        // but they don't because wtx.GetAmounts() does not handle tx where there are no outputs
+        // pwalletMain->GetBalance() does not accept min depth parameter
+        // so we use our own method to get balance of utxos.
+        nBalance = getBalanceTaddr(std::nullopt, std::nullopt, nMinDepth, !fIncludeWatchonly);
+        nPrivateBalance = getBalanceZaddr(std::nullopt, std::nullopt, nMinDepth, INT_MAX, !fIncludeWatchonly);
+    }
     CAmount nTotalBalance = nBalance + nPrivateBalance;
     UniValue result(UniValue::VOBJ);
     result.pushKV("transparent", FormatMoney(nBalance));
@@ -5336,9 +5359,9 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
     if (!EnsureWalletIsAvailable(fHelp))
         return NullUniValue;
 
-    if (fHelp || params.size() < 2 || params.size() > 5)
+    if (fHelp || params.size() < 2 || params.size() > 6)
         throw runtime_error(
-            "z_shieldcoinbase \"fromaddress\" \"toaddress\" ( fee ) ( limit ) ( memo )\n"
+            "z_shieldcoinbase \"fromaddress\" \"toaddress\" ( fee ) ( limit ) ( memo ) ( maxtransactions )\n"
             "\nShield transparent coinbase funds by sending to an Orchard address. This is an asynchronous operation and utxos"
             "\nselected for shielding will be locked. If there is an error, they are unlocked. The RPC call `listlockunspent`"
             "\ncan be used to return a list of locked utxos. The number of coinbase utxos selected for shielding can be limited"
@@ -5352,14 +5375,19 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
             "3. fee                   (numeric, optional, default=null) The fee amount in " + CURRENCY_UNIT + " to attach to this transaction. The default behavior\n"
             "                         is to use a fee calculated according to ZIP 317.\n"
             "4. limit                 (numeric, optional, default="
-            + strprintf("%d", SHIELD_COINBASE_DEFAULT_LIMIT) + ") Limit on the maximum number of utxos to shield. Set to 0 to use as many as will fit in the transaction.\n"
+            + strprintf("%d", SHIELD_COINBASE_DEFAULT_LIMIT) + ") Limit on the maximum number of utxos to shield in each transaction. Set to 0 to use as many as will fit in the transaction.\n"
             "5. \"memo\"                (string, optional) Encoded as hex. This will be stored in the memo field of the new note.\n"
+            "6. maxtransactions       (numeric, optional, default="
+            + strprintf("%d", SHIELD_COINBASE_DEFAULT_MAX_TRANSACTIONS) + ") Bulk shielding: the maximum number of shielding transactions to plan.\n"
+            "                         The transactions are proved concurrently and submitted together; a fixed fee applies to each one.\n"
+            "                         z_getoperationstatus reports \"progress\" and the result contains a \"txids\" array.\n"
             "\nResult:\n"
             "{\n"
             "  \"remainingUTXOs\": xxx    (numeric) Number of coinbase utxos still available for shielding.\n"
             "  \"remainingValue\": xxx    (numeric) Value of coinbase utxos still available for shielding.\n"
             "  \"shieldingUTXOs\": xxx    (numeric) Number of coinbase utxos being shielded.\n"
             "  \"shieldingValue\": xxx    (numeric) Value of coinbase utxos being shielded.\n"
+            "  \"shieldingTransactions\": xxx (numeric) Number of transactions that will be created.\n"
             "  \"opid\": xxx          (string) An operationid to pass to z_getoperationstatus to get the result of the operation.\n"
             "}\n"
             "\nExamples:\n"
@@ -5487,6 +5515,13 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit on maximum number of utxos cannot be negative");
     }
 
+    int nMaxTransactions = params.size() > 5 && !params[5].isNull()
+        ? params[5].get_int()
+        : SHIELD_COINBASE_DEFAULT_MAX_TRANSACTIONS;
+    if (nMaxTransactions < 1) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Maximum number of transactions must be at least 1");
+    }
+
     // Keep record of parameters in context object
     UniValue contextInfo(UniValue::VOBJ);
     contextInfo.pushKV("fromaddress", params[0]);
@@ -5494,13 +5529,17 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
     if (nFee.has_value()) {
         contextInfo.pushKV("fee", ValueFromAmount(nFee.value()));
     }
+    if (nMaxTransactions > 1) {
+        contextInfo.pushKV("maxtransactions", nMaxTransactions);
+    }
 
     // Create the wallet builder
     WalletTxBuilder builder(chainparams, minRelayTxFee);
 
     auto async_shieldcoinbase =
         new AsyncRPCOperation_shieldcoinbase(
-                std::move(builder), ztxoSelector, destaddress.value(), memo, strategy, nUTXOLimit, nFee, contextInfo);
+                std::move(builder), ztxoSelector, destaddress.value(), memo, strategy, nUTXOLimit, nFee, contextInfo,
+                nMaxTransactions);
     auto results = async_shieldcoinbase->prepare(*pwalletMain);
 
     // Create operation and add to global queue
@@ -5515,6 +5554,7 @@ UniValue z_shieldcoinbase(const UniValue& params, bool fHelp)
     o.pushKV("remainingValue", ValueFromAmount(results.remainingValue));
     o.pushKV("shieldingUTXOs", static_cast<uint64_t>(results.numUtxos));
     o.pushKV("shieldingValue", ValueFromAmount(results.shieldingValue));
+    o.pushKV("shieldingTransactions", static_cast<uint64_t>(results.numTransactions));
     o.pushKV("opid", operationId);
     return o;
 }
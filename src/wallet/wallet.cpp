@@ -55,6 +55,67 @@ unsigned int nOrchardActionLimit = DEFAULT_ORCHARD_ACTION_LIMIT;
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
 
+namespace {
+
+/**
+ * The chain state that the wallet's depth, finality and spentness checks
+ * read, copied under cs_main. While one is installed on a thread (see
+ * ScopedChainSnapshot), those checks on that thread read it instead of
+ * chainActive, mapBlockIndex and the mempool, so they do not need cs_main.
+ */
+struct WalletChainSnapshot
+{
+    const CBlockIndex* pindexTip = nullptr;
+    int nHeight = -1;
+    //! GetTime() when the snapshot was taken, for CheckFinalTx.
+    int64_t nTime = 0;
+    //! The blocks of wallet transactions that are in the active chain.
+    std::map<uint256, const CBlockIndex*> mapBlocks;
+    //! The wallet transactions that are not in the active chain but are in the mempool.
+    std::set<uint256> setInMempool;
+
+    /** Equivalent of chainActive.FindFork for the chain ending at pindexTip. */
+    const CBlockIndex* FindFork(const CBlockIndex* pindex) const
+    {
+        if (pindexTip == nullptr || pindex == nullptr)
+            return nullptr;
+        if (pindex->nHeight > nHeight)
+            pindex = pindex->GetAncestor(nHeight);
+        while (pindex && pindexTip->GetAncestor(pindex->nHeight) != pindex)
+            pindex = pindex->pprev;
+        return pindex;
+    }
+};
+
+thread_local const WalletChainSnapshot* pchainSnapshot = nullptr;
+
+class ScopedChainSnapshot
+{
+public:
+    explicit ScopedChainSnapshot(const WalletChainSnapshot& snapshot) { pchainSnapshot = &snapshot; }
+    ~ScopedChainSnapshot() { pchainSnapshot = nullptr; }
+};
+
+void AssertChainLockHeld()
+{
+    if (pchainSnapshot == nullptr)
+        AssertLockHeld(cs_main);
+}
+
+bool CheckFinalWalletTx(const CTransaction& tx)
+{
+    if (pchainSnapshot == nullptr)
+        return CheckFinalTx(tx);
+    return IsFinalTx(tx, pchainSnapshot->nHeight + 1, pchainSnapshot->nTime);
+}
+
+} // namespace
+
+/** Lock cs_main for the rest of the scope, unless a WalletChainSnapshot is installed. */
+#define LOCK_CHAIN()                                                       \
+    std::optional<DebugLock<decltype(cs_main)>> chainlock;                 \
+    if (pchainSnapshot == nullptr) chainlock.emplace(cs_main, "cs_main", __FILE__, __LINE__)
+
 std::set<ReceiverType> CWallet::DefaultReceiverTypes(int nHeight) {
     // For now, just ignore the height information because the default
     // is always the same.
@@ -393,6 +454,9 @@ bool CWallet::AddKeyPubKey(
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    // Outputs to the key that the wallet already holds are now ours.
+    if (pindexUnspentTxs != nullptr)
+        setUnspentTxsNewKeys.insert(pubkey.GetID());
 
     // check if we need to remove from watch-only
     CScript script;
@@ -1203,6 +1267,10 @@ bool CWallet::AddCScript(const CScript& redeemScript)
 {
     if (!CCryptoKeyStore::AddCScript(redeemScript))
         return false;
+    {
+        LOCK(cs_wallet);
+        ResetUnspentTxs();
+    }
     if (!fFileBacked)
         return true;
     return CWalletDB(strWalletFile).WriteCScript(Hash160(redeemScript), redeemScript);
@@ -1230,6 +1298,10 @@ bool CWallet::AddWatchOnly(const CScript &dest)
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
+    {
+        LOCK(cs_wallet);
+        ResetUnspentTxs();
+    }
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
         return true;
@@ -1396,6 +1468,116 @@ void CWallet::ChainTip(const CBlockIndex *pindex,
         "hash", hash.c_str(),
         "height", height.c_str(),
         "kind", kind.c_str());
+
+    // Every confirmation count has changed.
+    MarkSummaryDirty();
+}
+
+void CWallet::NotificationsProcessed()
+{
+    // Recompute at most once per notification round, however many blocks
+    // and transactions it delivered.
+    if (fSummaryDirty) {
+        UpdateSummary();
+    }
+}
+
+void CWallet::UpdateSummary()
+{
+    // Copy the chain state the queries below depend on, which is one block
+    // index lookup per wallet transaction, and then run the queries holding
+    // only cs_wallet. A transaction added in between is missing from the
+    // snapshot and counts as unconfirmed until the next update, which adding
+    // it has already requested by marking the summary dirty.
+    WalletChainSnapshot snapshot;
+    {
+        LOCK2(cs_main, cs_wallet);
+        // Changes made after this point mark the summary dirty again.
+        fSummaryDirty = false;
+
+        snapshot.pindexTip = chainActive.Tip();
+        snapshot.nHeight = chainActive.Height();
+        snapshot.nTime = GetTime();
+        for (const auto& [txid, wtx] : mapWallet) {
+            if (!wtx.hashBlock.IsNull() && wtx.nIndex != -1) {
+                auto mi = mapBlockIndex.find(wtx.hashBlock);
+                if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second)) {
+                    snapshot.mapBlocks.emplace(wtx.hashBlock, mi->second);
+                    continue;
+                }
+            }
+            if (mempool.exists(txid)) {
+                snapshot.setInMempool.insert(txid);
+            }
+        }
+    }
+
+    auto newSummary = std::make_shared<WalletSummary>();
+    {
+        LOCK(cs_wallet);
+        ScopedChainSnapshot scopedSnapshot(snapshot);
+
+        newSummary->nHeight = snapshot.nHeight;
+        newSummary->transparentBalance = GetBalance(std::nullopt);
+        newSummary->transparentUnconfirmed = GetUnconfirmedTransparentBalance();
+        newSummary->transparentImmature = GetImmatureBalance(std::nullopt);
+
+        std::vector<COutput> vecOutputs;
+        AvailableCoins(vecOutputs, std::nullopt, false, NULL, true);
+        for (const COutput& out : vecOutputs) {
+            if (out.nDepth >= 1 && out.fSpendable) {
+                newSummary->transparentSpendable += out.tx->vout[out.i].nValue;
+            }
+        }
+
+        auto sumNotes = [&](int minDepth, int maxDepth) {
+            std::vector<SproutNoteEntry> sproutEntries;
+            std::vector<SaplingNoteEntry> saplingEntries;
+            std::vector<OrchardNoteMetadata> orchardEntries;
+            GetFilteredNotes(sproutEntries, saplingEntries, orchardEntries,
+                             std::nullopt, std::nullopt, minDepth, maxDepth, true, true);
+            CAmount balance = 0;
+            for (const auto& entry : sproutEntries) {
+                balance += CAmount(entry.note.value());
+            }
+            for (const auto& entry : saplingEntries) {
+                balance += CAmount(entry.note.value());
+            }
+            for (const auto& entry : orchardEntries) {
+                balance += entry.GetNoteValue();
+            }
+            return balance;
+        };
+        newSummary->shieldedBalance = sumNotes(1, INT_MAX);
+        newSummary->shieldedUnconfirmed = sumNotes(0, 0);
+
+        auto selector = ZTXOSelectorForAccount(0, false, TransparentCoinbasePolicy::Allow);
+        if (selector.has_value()) {
+            auto sumInputs = [&](uint32_t minDepth) {
+                auto inputs = FindSpendableInputs(selector.value(), minDepth, std::nullopt);
+                CAmount balance = 0;
+                for (const auto& t : inputs.saplingNoteEntries) {
+                    balance += t.note.value();
+                }
+                for (const auto& t : inputs.orchardNoteMetadata) {
+                    balance += t.GetNoteValue();
+                }
+                return balance;
+            };
+            newSummary->accountShieldedBalance = sumInputs(1);
+            newSummary->accountShieldedUnconfirmed = sumInputs(0) - newSummary->accountShieldedBalance;
+        }
+    }
+
+    std::atomic_store(&summary, std::shared_ptr<const WalletSummary>(newSummary));
+}
+
+std::shared_ptr<const WalletSummary> CWallet::GetSummary(bool fRequireCurrent) const
+{
+    if (fRequireCurrent && fSummaryDirty) {
+        return nullptr;
+    }
+    return std::atomic_load(&summary);
 }
 
 void CWallet::RunSaplingMigration(int blockHeight) {
@@ -2178,7 +2360,7 @@ SpendableInputs CWallet::FindSpendableInputs(
         ZTXOSelector selector,
         uint32_t minDepth,
         const std::optional<int>& asOfHeight) const {
-    AssertLockHeld(cs_main);
+    AssertChainLockHeld();
     AssertLockHeld(cs_wallet);
 
     KeyIO keyIO(Params());
@@ -2189,12 +2371,13 @@ SpendableInputs CWallet::FindSpendableInputs(
     bool selectOrchard{selector.SelectsOrchard()};
 
     SpendableInputs unspent;
-    for (auto const& [wtxid, wtx] : mapWallet) {
+    for (const auto* entry : GetWalletTxsForQuery(!asOfHeight.has_value())) {
+        auto const& [wtxid, wtx] = *entry;
         bool isCoinbase = wtx.IsCoinBase();
         auto nDepth = wtx.GetDepthInMainChain(asOfHeight);
 
         // Filter the transactions before checking for coins
-        if (!CheckFinalTx(wtx)) continue;
+        if (!CheckFinalWalletTx(wtx)) continue;
         if (nDepth < 0 || nDepth < minDepth) continue;
 
         if (selectTransparent && (
@@ -2418,7 +2601,7 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n, const std::optional<i
  * spends it:
  */
 bool CWallet::IsSproutSpent(const uint256& nullifier, const std::optional<int>& asOfHeight) const {
-    LOCK(cs_main);
+    LOCK_CHAIN();
     pair<TxNullifiers::const_iterator, TxNullifiers::const_iterator> range;
     range = mapTxSproutNullifiers.equal_range(nullifier);
 
@@ -2433,7 +2616,7 @@ bool CWallet::IsSproutSpent(const uint256& nullifier, const std::optional<int>&
 }
 
 bool CWallet::IsSaplingSpent(const uint256& nullifier, const std::optional<int>& asOfHeight) const {
-    LOCK(cs_main);
+    LOCK_CHAIN();
     pair<TxNullifiers::const_iterator, TxNullifiers::const_iterator> range;
     range = mapTxSaplingNullifiers.equal_range(nullifier);
 
@@ -3131,6 +3314,9 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        MarkSummaryDirty();
+        // New keys can make more outputs ours.
+        ResetUnspentTxs();
     }
 }
 
@@ -3266,6 +3452,7 @@ void CWallet::LoadWalletTx(const CWalletTx& wtxIn) {
     wtxOrdered.insert(make_pair(wtx.nOrderPos, &wtx));
     UpdateNullifierNoteMapWithTx(mapWallet[hash]);
     AddToSpends(hash);
+    ResetUnspentTxs();
 }
 
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb)
@@ -3274,6 +3461,8 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB* pwalletdb)
         uint256 hash = wtxIn.GetHash();
 
         LOCK(cs_wallet);
+        MarkSummaryDirty();
+        MarkUnspentTxChanged(hash);
         // Inserts only if not already there, returns tx inserted or tx found
         pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
         CWalletTx& wtx = (*ret.first).second;
@@ -3638,19 +3827,24 @@ BatchScanner* CWallet::GetBatchScanner()
 
 void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
 {
+    MarkSummaryDirty();
+
     // If a transaction changes 'conflicted' state, that changes the balance
     // available of the outputs it spends. So force those to be
     // recomputed, also:
     for (const CTxIn& txin : tx.vin)
     {
-        if (mapWallet.count(txin.prevout.hash))
+        if (mapWallet.count(txin.prevout.hash)) {
             mapWallet[txin.prevout.hash].MarkDirty();
+            MarkUnspentTxChanged(txin.prevout.hash);
+        }
     }
     for (const JSDescription& jsdesc : tx.vJoinSplit) {
         for (const uint256& nullifier : jsdesc.nullifiers) {
             if (mapSproutNullifiersToNotes.count(nullifier) &&
                 mapWallet.count(mapSproutNullifiersToNotes[nullifier].hash)) {
                 mapWallet[mapSproutNullifiersToNotes[nullifier].hash].MarkDirty();
+                MarkUnspentTxChanged(mapSproutNullifiersToNotes[nullifier].hash);
             }
         }
     }
@@ -3661,9 +3855,166 @@ void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
             auto itTx = mapWallet.find(it->second.hash);
             if (itTx != mapWallet.end()) {
                 itTx->second.MarkDirty();
+                MarkUnspentTxChanged(it->second.hash);
+            }
+        }
+    }
+}
+
+void CWallet::MarkUnspentTxChanged(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    if (pindexUnspentTxs != nullptr) {
+        setUnspentTxs.insert(hash);
+        setUnspentTxsToCheck.insert(hash);
+    }
+}
+
+std::optional<int> CWallet::GetConfirmedSpendHeight(const uint256& hash, const CWalletTx& wtx) const
+{
+    AssertChainLockHeld();
+    AssertLockHeld(cs_wallet);
+
+    // Unconfirmed spends can be undone without the wallet being notified,
+    // for example when the spending transaction leaves the mempool, so only
+    // spends in the active chain count here.
+    int nSpendHeight = -1;
+    auto confirmedSpend = [&](auto range) {
+        for (auto it = range.first; it != range.second; ++it) {
+            auto mit = mapWallet.find(it->second);
+            const CBlockIndex* pindex = nullptr;
+            if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(pindex, std::nullopt) > 0) {
+                nSpendHeight = std::max(nSpendHeight, pindex->nHeight);
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) != ISMINE_NO &&
+            !confirmedSpend(mapTxSpends.equal_range(COutPoint(hash, i)))) {
+            return std::nullopt;
+        }
+    }
+    for (const auto& [jsop, nd] : wtx.mapSproutNoteData) {
+        if (!nd.nullifier.has_value() ||
+            !confirmedSpend(mapTxSproutNullifiers.equal_range(nd.nullifier.value()))) {
+            return std::nullopt;
+        }
+    }
+    for (const auto& [op, nd] : wtx.mapSaplingNoteData) {
+        if (!nd.nullifier.has_value() ||
+            !confirmedSpend(mapTxSaplingNullifiers.equal_range(nd.nullifier.value()))) {
+            return std::nullopt;
+        }
+    }
+    return nSpendHeight;
+}
+
+std::vector<const std::pair<const uint256, CWalletTx>*> CWallet::GetWalletTxsForQuery(bool fUnspentOnly) const
+{
+    AssertChainLockHeld();
+    AssertLockHeld(cs_wallet);
+
+    std::vector<const std::pair<const uint256, CWalletTx>*> vWtx;
+    if (!fUnspentOnly) {
+        vWtx.reserve(mapWallet.size());
+        for (const auto& entry : mapWallet) {
+            vWtx.push_back(&entry);
+        }
+        return vWtx;
+    }
+
+    const CBlockIndex* pindexTip = pchainSnapshot ? pchainSnapshot->pindexTip : chainActive.Tip();
+    if (pindexUnspentTxs == nullptr) {
+        setUnspentTxs.clear();
+        mapSpentTxsByHeight.clear();
+        for (const auto& entry : mapWallet) {
+            setUnspentTxs.insert(setUnspentTxs.end(), entry.first);
+        }
+        setUnspentTxsToCheck = setUnspentTxs;
+    } else if (pindexUnspentTxs != pindexTip) {
+        // Spends confirmed in blocks that have since been disconnected no
+        // longer count, so put the transactions they spent back.
+        const CBlockIndex* pindexFork = pchainSnapshot ?
+            pchainSnapshot->FindFork(pindexUnspentTxs) : chainActive.FindFork(pindexUnspentTxs);
+        auto it = mapSpentTxsByHeight.upper_bound(pindexFork ? pindexFork->nHeight : -1);
+        for (auto itSpent = it; itSpent != mapSpentTxsByHeight.end(); ++itSpent) {
+            setUnspentTxs.insert(itSpent->second);
+            setUnspentTxsToCheck.insert(itSpent->second);
+        }
+        mapSpentTxsByHeight.erase(it, mapSpentTxsByHeight.end());
+    }
+    pindexUnspentTxs = pindexTip;
+
+    if (!setUnspentTxsNewKeys.empty()) {
+        // Keys added since the last query can make outputs of the
+        // transactions left out ours, so put back those paying to one.
+        auto paysToNewKey = [&](const CScript& script) {
+            txnouttype type;
+            std::vector<CTxDestination> vDest;
+            int nRequired;
+            if (!ExtractDestinations(script, type, vDest, nRequired))
+                return false;
+            for (const CTxDestination& dest : vDest) {
+                if (auto keyID = std::get_if<CKeyID>(&dest)) {
+                    if (setUnspentTxsNewKeys.count(*keyID))
+                        return true;
+                }
             }
+            return false;
+        };
+        for (auto it = mapSpentTxsByHeight.begin(); it != mapSpentTxsByHeight.end();) {
+            auto mit = mapWallet.find(it->second);
+            bool fPaysToNewKey = false;
+            if (mit != mapWallet.end()) {
+                for (const CTxOut& txout : mit->second.vout) {
+                    CTxDestination dest;
+                    CScript redeemScript;
+                    if (paysToNewKey(txout.scriptPubKey) ||
+                        (ExtractDestination(txout.scriptPubKey, dest) &&
+                         std::holds_alternative<CScriptID>(dest) &&
+                         GetCScript(std::get<CScriptID>(dest), redeemScript) &&
+                         paysToNewKey(redeemScript))) {
+                        fPaysToNewKey = true;
+                        break;
+                    }
+                }
+            }
+            if (fPaysToNewKey) {
+                setUnspentTxs.insert(it->second);
+                setUnspentTxsToCheck.insert(it->second);
+                it = mapSpentTxsByHeight.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        setUnspentTxsNewKeys.clear();
+    }
+
+    for (const uint256& hash : setUnspentTxsToCheck) {
+        auto mit = mapWallet.find(hash);
+        if (mit == mapWallet.end()) {
+            setUnspentTxs.erase(hash);
+            continue;
+        }
+        auto nSpendHeight = GetConfirmedSpendHeight(hash, mit->second);
+        if (nSpendHeight.has_value()) {
+            setUnspentTxs.erase(hash);
+            mapSpentTxsByHeight.emplace(nSpendHeight.value(), hash);
+        }
+    }
+    setUnspentTxsToCheck.clear();
+
+    vWtx.reserve(setUnspentTxs.size());
+    for (const uint256& hash : setUnspentTxs) {
+        auto mit = mapWallet.find(hash);
+        if (mit != mapWallet.end()) {
+            vWtx.push_back(&*mit);
         }
     }
+    return vWtx;
 }
 
 void CWallet::EraseFromWallet(const uint256 &hash)
@@ -3672,8 +4023,12 @@ void CWallet::EraseFromWallet(const uint256 &hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            MarkSummaryDirty();
+            // The erased transaction may have spent others.
+            ResetUnspentTxs();
+        }
     }
     return;
 }
@@ -4968,7 +5323,7 @@ bool CWalletTx::IsFromMe(const isminefilter& filter) const
 bool CWalletTx::IsTrusted(const std::optional<int>& asOfHeight) const
 {
     // Quick answer in most cases
-    if (!CheckFinalTx(*this))
+    if (!CheckFinalWalletTx(*this))
         return false;
     int nDepth = GetDepthInMainChain(asOfHeight);
     if (nDepth >= 1)
@@ -5057,10 +5412,11 @@ CAmount CWallet::GetBalance(const std::optional<int>& asOfHeight, const isminefi
 {
     CAmount nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        LOCK_CHAIN();
+        LOCK(cs_wallet);
+        for (const auto* entry : GetWalletTxsForQuery(!asOfHeight.has_value()))
         {
-            const CWalletTx* pcoin = &entry.second;
+            const CWalletTx* pcoin = &entry->second;
             if (pcoin->IsTrusted(asOfHeight) && pcoin->GetDepthInMainChain(asOfHeight) >= min_depth) {
                 nTotal += pcoin->GetAvailableCredit(asOfHeight, true, filter);
             }
@@ -5074,11 +5430,12 @@ CAmount CWallet::GetUnconfirmedTransparentBalance() const
 {
     CAmount nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        LOCK_CHAIN();
+        LOCK(cs_wallet);
+        for (const auto* entry : GetWalletTxsForQuery(true))
         {
-            const CWalletTx* pcoin = &entry.second;
-            if (!CheckFinalTx(*pcoin) || (!pcoin->IsTrusted(std::nullopt) && pcoin->GetDepthInMainChain(std::nullopt) == 0))
+            const CWalletTx* pcoin = &entry->second;
+            if (!CheckFinalWalletTx(*pcoin) || (!pcoin->IsTrusted(std::nullopt) && pcoin->GetDepthInMainChain(std::nullopt) == 0))
                 nTotal += pcoin->GetAvailableCredit(std::nullopt);
         }
     }
@@ -5089,10 +5446,12 @@ CAmount CWallet::GetImmatureBalance(const std::optional<int>& asOfHeight) const
 {
     CAmount nTotal = 0;
     {
-        LOCK2(cs_main, cs_wallet);
-        for (const auto& entry : mapWallet)
+        LOCK_CHAIN();
+        LOCK(cs_wallet);
+        // Immature coinbase outputs cannot have been spent yet.
+        for (const auto* entry : GetWalletTxsForQuery(!asOfHeight.has_value()))
         {
-            const CWalletTx* pcoin = &entry.second;
+            const CWalletTx* pcoin = &entry->second;
             nTotal += pcoin->GetImmatureCredit(asOfHeight);
         }
     }
@@ -5150,14 +5509,15 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins,
 {
     assert(nMinDepth >= 0);
     assert(!asOfHeight.has_value() || nMinDepth > 0);
-    AssertLockHeld(cs_main);
+    AssertChainLockHeld();
     AssertLockHeld(cs_wallet);
 
     vCoins.clear();
 
     {
-        for (const auto& [wtxid, pcoin] : mapWallet) {
-            if (!CheckFinalTx(pcoin))
+        for (const auto* entry : GetWalletTxsForQuery(!asOfHeight.has_value())) {
+            const auto& [wtxid, pcoin] = *entry;
+            if (!CheckFinalWalletTx(pcoin))
                 continue;
 
             if (fOnlyConfirmed && !pcoin.IsTrusted(asOfHeight))
@@ -6299,18 +6659,21 @@ void CWallet::LockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkSummaryDirty();
 }
 
 void CWallet::UnlockCoin(COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkSummaryDirty();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkSummaryDirty();
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const
@@ -6338,18 +6701,21 @@ void CWallet::LockNote(const JSOutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedSproutNotes
     setLockedSproutNotes.insert(output);
+    MarkSummaryDirty();
 }
 
 void CWallet::UnlockNote(const JSOutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedSproutNotes
     setLockedSproutNotes.erase(output);
+    MarkSummaryDirty();
 }
 
 void CWallet::UnlockAllSproutNotes()
 {
     AssertLockHeld(cs_wallet); // setLockedSproutNotes
     setLockedSproutNotes.clear();
+    MarkSummaryDirty();
 }
 
 bool CWallet::IsLockedNote(const JSOutPoint& outpt) const
@@ -6370,18 +6736,21 @@ void CWallet::LockNote(const SaplingOutPoint& output)
 {
     AssertLockHeld(cs_wallet);
     setLockedSaplingNotes.insert(output);
+    MarkSummaryDirty();
 }
 
 void CWallet::UnlockNote(const SaplingOutPoint& output)
 {
     AssertLockHeld(cs_wallet);
     setLockedSaplingNotes.erase(output);
+    MarkSummaryDirty();
 }
 
 void CWallet::UnlockAllSaplingNotes()
 {
     AssertLockHeld(cs_wallet);
     setLockedSaplingNotes.clear();
+    MarkSummaryDirty();
 }
 
 bool CWallet::IsLockedNote(const SaplingOutPoint& output) const
@@ -6951,17 +7320,29 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(const CBlockIndex* &pindexRet, const
 {
     if (hashBlock.IsNull() || nIndex == -1)
         return 0;
-    AssertLockHeld(cs_main);
-    int effectiveChainHeight = min(chainActive.Height(), asOfHeight.value_or(chainActive.Height()));
-
-    // Find the block it claims to be in
-    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi == mapBlockIndex.end())
-        return 0;
-    CBlockIndex* pindex = (*mi).second;
-    if (!pindex ||
-        !chainActive.Contains(pindex) ||
-        pindex->nHeight > effectiveChainHeight) {
+    AssertChainLockHeld();
+
+    const CBlockIndex* pindex;
+    int nChainHeight;
+    if (pchainSnapshot) {
+        nChainHeight = pchainSnapshot->nHeight;
+        auto mi = pchainSnapshot->mapBlocks.find(hashBlock);
+        if (mi == pchainSnapshot->mapBlocks.end())
+            return 0;
+        pindex = mi->second;
+    } else {
+        nChainHeight = chainActive.Height();
+
+        // Find the block it claims to be in
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi == mapBlockIndex.end())
+            return 0;
+        pindex = (*mi).second;
+        if (!pindex || !chainActive.Contains(pindex))
+            return 0;
+    }
+    int effectiveChainHeight = min(nChainHeight, asOfHeight.value_or(nChainHeight));
+    if (pindex->nHeight > effectiveChainHeight) {
         return 0;
     }
 
@@ -6971,9 +7352,10 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(const CBlockIndex* &pindexRet, const
 
 int CMerkleTx::GetDepthInMainChain(const CBlockIndex* &pindexRet, const std::optional<int>& asOfHeight) const
 {
-    AssertLockHeld(cs_main);
+    AssertChainLockHeld();
     int nResult = GetDepthInMainChainINTERNAL(pindexRet, asOfHeight);
-    if (nResult == 0 && (asOfHeight.has_value() || !mempool.exists(GetHash())))
+    if (nResult == 0 && (asOfHeight.has_value() ||
+                         !(pchainSnapshot ? pchainSnapshot->setInMempool.count(GetHash()) > 0 : mempool.exists(GetHash()))))
         return -1; // Not in chain, not in mempool
 
     return nResult;
@@ -7076,14 +7458,15 @@ void CWallet::GetFilteredNotes(
     if (noteFilter.has_value() && noteFilter.value().IsEmpty())
         return;
 
-    LOCK2(cs_main, cs_wallet);
+    LOCK_CHAIN();
+    LOCK(cs_wallet);
 
     KeyIO keyIO(Params());
-    for (auto & p : mapWallet) {
-        CWalletTx wtx = p.second;
+    for (const auto* entry : GetWalletTxsForQuery(ignoreSpent && !asOfHeight.has_value())) {
+        const CWalletTx& wtx = entry->second;
 
         // Filter the transactions before checking for notes
-        if (!CheckFinalTx(wtx) ||
+        if (!CheckFinalWalletTx(wtx) ||
             wtx.GetDepthInMainChain(asOfHeight) < minDepth ||
             wtx.GetDepthInMainChain(asOfHeight) > maxDepth) {
             continue;
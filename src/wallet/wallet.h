@@ -33,7 +33,9 @@
 #include "base58.h"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
+#include <memory>
 #include <optional>
 #include <set>
 #include <stdexcept>
@@ -385,6 +387,33 @@ struct SaplingNoteEntry
     int confirmations;
 };
 
+/**
+ * The balances shown by the metrics screen, getwalletinfo and
+ * z_gettotalbalance, as of a given chain height. The wallet notification
+ * thread recomputes this after the wallet has changed so that readers do not
+ * have to take cs_main and cs_wallet.
+ */
+struct WalletSummary
+{
+    int nHeight = -1;
+    //! Trusted, mature transparent balance (GetBalance).
+    CAmount transparentBalance = 0;
+    //! Untrusted, unconfirmed transparent balance (GetUnconfirmedTransparentBalance).
+    CAmount transparentUnconfirmed = 0;
+    //! Immature coinbase balance (GetImmatureBalance).
+    CAmount transparentImmature = 0;
+    //! Spendable transparent outputs with at least one confirmation.
+    CAmount transparentSpendable = 0;
+    //! Spendable shielded notes with at least one confirmation.
+    CAmount shieldedBalance = 0;
+    //! Spendable shielded notes with no confirmations.
+    CAmount shieldedUnconfirmed = 0;
+    //! Spendable shielded notes of account 0, with at least one confirmation.
+    CAmount accountShieldedBalance = 0;
+    //! Spendable shielded notes of account 0, with no confirmations.
+    CAmount accountShieldedUnconfirmed = 0;
+};
+
 /** A transaction with a merkle branch linking it to the block chain. */
 class CMerkleTx : public CTransaction
 {
@@ -1402,6 +1431,38 @@ protected:
      */
     WalletBatchScanner* validationInterfaceBatchScanner;
 
+    //! Set whenever the wallet changes in a way that may affect the summary.
+    std::atomic<bool> fSummaryDirty{true};
+    //! The last computed summary. Only accessed with std::atomic_load/store.
+    std::shared_ptr<const WalletSummary> summary;
+
+    /**
+     * The wallet transactions that may still hold outputs or notes that have
+     * not been spent, so that queries about the current chain state do not
+     * have to walk all of mapWallet. This is a superset: a transaction is only
+     * left out once everything it pays to the wallet has been spent by a
+     * confirmed transaction, and it is put back if one of those spends is
+     * disconnected. Guarded by cs_wallet, together with the fields below.
+     */
+    mutable std::set<uint256> setUnspentTxs;
+    //! Transactions in setUnspentTxs that may have become fully spent.
+    mutable std::set<uint256> setUnspentTxsToCheck;
+    //! Transactions left out of setUnspentTxs, by the height of the block with the last spend.
+    mutable std::multimap<int, uint256> mapSpentTxsByHeight;
+    //! The chain tip the sets above were last checked against, or nullptr to rebuild them.
+    mutable const CBlockIndex* pindexUnspentTxs = nullptr;
+    //! Keys added since the sets above were last checked.
+    mutable std::set<CKeyID> setUnspentTxsNewKeys;
+
+    /**
+     * Returns the height of the highest block confirming a spend of the
+     * transaction's outputs and notes if all of them have confirmed spends,
+     * or std::nullopt otherwise.
+     */
+    std::optional<int> GetConfirmedSpendHeight(const uint256& hash, const CWalletTx& wtx) const;
+    void MarkUnspentTxChanged(const uint256& hash);
+    void ResetUnspentTxs() { pindexUnspentTxs = nullptr; }
+
 public:
     /*
      * Main wallet lock.
@@ -1893,6 +1954,22 @@ public:
     WalletDecryptedNotes TryDecryptShieldedOutputs(const CTransaction& tx);
 
     void MarkDirty();
+    void MarkSummaryDirty() { fSummaryDirty = true; }
+    /** Recompute the summary as of the current chain tip. */
+    void UpdateSummary();
+    /**
+     * Returns the last computed summary without taking any lock, or nullptr if
+     * there is none yet. If fRequireCurrent is set, also returns nullptr when
+     * the wallet has changed since the summary was computed.
+     */
+    std::shared_ptr<const WalletSummary> GetSummary(bool fRequireCurrent = false) const;
+    /**
+     * Returns the wallet transactions that a query has to look at. With
+     * fUnspentOnly, transactions whose outputs and notes have all been spent
+     * are left out; callers may only set it when they ignore spent outputs
+     * and look at the current chain state rather than an earlier height.
+     */
+    std::vector<const std::pair<const uint256, CWalletTx>*> GetWalletTxsForQuery(bool fUnspentOnly) const;
     bool UpdateNullifierNoteMap();
     void UpdateNullifierNoteMapWithTx(const CWalletTx& wtx);
     void UpdateSaplingNullifierNoteMapWithTx(CWalletTx& wtx);
@@ -2059,6 +2136,7 @@ public:
         const CBlockIndex *pindex,
         const CBlock *pblock,
         std::optional<MerkleFrontiers> added);
+    void NotificationsProcessed();
     void RunSaplingMigration(int blockHeight);
     void AddPendingSaplingMigrationTx(const CTransaction& tx);
     /** Saves witness caches and best block locator to disk. */